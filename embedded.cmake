@@ -1,13 +1,27 @@
+# add_resource( input [RGB|PLANES|KEEP_GIF] )
+#
+# Embeds a GIF as ${input_identifier}_start/_end. By default util/gif2panel
+# compiles it into a panel asset with indexed, gamma corrected frames (RGB).
+# PLANES stores ready-to-scan bit-planes, the fastest to play but by far the
+# largest. KEEP_GIF embeds the original file to save flash, it is decoded at
+# runtime. The flash and CPU cost of every asset is reported during the build.
 function( add_resource input )
+    set( format rgb )
+    if ( "PLANES" IN_LIST ARGN )
+        set( format planes )
+    elseif ( "KEEP_GIF" IN_LIST ARGN )
+        set( format gif )
+    endif ()
+
     string( MAKE_C_IDENTIFIER ${input} input_identifier )
     set( output "${input_identifier}.S" )
 
     target_sources( ${PROJECT_NAME} PRIVATE ${output} )
     add_custom_command(
             OUTPUT ${output}
-            COMMAND util/build/bin2asm ${input_identifier} > ${PROJECT_BINARY_DIR}/${output} < ${PROJECT_SOURCE_DIR}/${input}
+            COMMAND util/build/gif2panel ${input_identifier} ${format} > ${PROJECT_BINARY_DIR}/${output} < ${PROJECT_SOURCE_DIR}/${input}
             DEPENDS ${input}
-            COMMENT "util/build/bin2asm ${input_identifier}"
+            COMMENT "util/build/gif2panel ${input_identifier} ${format}"
             WORKING_DIRECTORY ${PROJECT_SOURCE_DIR}
     )
-endfunction()
\ No newline at end of file
+endfunction()
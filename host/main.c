@@ -0,0 +1,208 @@
+// Plays a built-in sequence through the real framebuffer and animation code
+// on the virtual HUB75 panel of panel_model.c, and writes the last full BCM
+// cycle out as the image the panel would show. The checks and benchmarks
+// are in tests/, run them with ctest.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "asset_store.h"
+#include "compositor.h"
+#include "framebuffer.h"
+#include "frame_stream.h"
+#include "gif_decoder.h"
+#include "hub75_stream.h"
+#include "animations/animations.h"
+#include "panel_model.h"
+#include "platform/platform.h"
+#include "stream_client.h"
+
+#define GIF_FRAME_CACHE_SIZE (32 * 1024)
+
+static uint8_t frame_cache_storage[GIF_FRAME_CACHE_SIZE] __attribute__((aligned(8)));
+static framebuffer_t fb;
+static compositor_t compositor;
+static frame_stream_t stream;
+
+// Feed a recorded stream, the bytes written to the stream register, through
+// the frame stream and show the result on the virtual panel
+static int replay_stream(const char *filename, const char *ppm) {
+    static uint8_t data[4 * 1024 * 1024];
+    FILE *f = fopen(filename, "rb");
+    if (f == NULL) {
+        perror(filename);
+        return 1;
+    }
+    size_t size = fread(data, 1, sizeof(data), f);
+    fclose(f);
+
+    platform_host_set_gpio_hook(panel_gpio_hook);
+    if (framebuffer_init(panel_config, &fb) != FRAMEBUFFER_OK) {
+        fprintf(stderr, "Framebuffer issue\n");
+        return 1;
+    }
+    frame_stream_init(&stream);
+    uint64_t clocks = stream_send(&stream, &fb, data, size);
+
+    // Let the last commit reach the screen and keep a complete BCM cycle
+    panel_refresh(&fb, 3);
+
+    printf("%zu bytes, %u frames, status 0x%02x, %u pixels drawn, %.1f ms at 1 MHz\n",
+           size, stream.frames, frame_stream_status(&stream), fb.pixels_drawn, clocks / 1e3);
+    if (ppm != NULL) {
+        write_ppm(&fb, ppm, 1);
+    }
+    return 0;
+}
+
+#define STORE_FLASH_SIZE (1024 * 1024)
+#define STORE_CHUNK 256
+
+static asset_store_t store;
+
+static void print_store(void) {
+    for (int i = 0; i < asset_store_count(&store); i++) {
+        const uint8_t *data;
+        size_t size;
+        asset_store_get(&store, i, &data, &size);
+        printf("asset %d %-8.8s %7zu bytes, sequence %d\n", i, asset_store_name(&store, i), size,
+               gif_animation_get_builtin_count() + i);
+    }
+    printf("%zu KB free\n", asset_store_free(&store) / 1024);
+}
+
+// Upload a file the way the I2C commands do, in chunks, and report the time
+// the flash takes on the virtual clock. Returns the index of the new asset.
+static int store_upload(const char *filename) {
+    static uint8_t data[STORE_FLASH_SIZE];
+    FILE *f = fopen(filename, "rb");
+    if (f == NULL) {
+        perror(filename);
+        return -1;
+    }
+    size_t size = fread(data, 1, sizeof(data), f);
+    fclose(f);
+
+    char name[ASSET_STORE_NAME_SIZE + 1] = { 0 };
+    const char *base = strrchr(filename, '/');
+    strncpy(name, base != NULL ? base + 1 : filename, ASSET_STORE_NAME_SIZE);
+
+    uint64_t start_us = platform_time_us();
+    clock_t start = clock();
+    int result = asset_store_begin(&store, name, size, asset_store_crc32(0, data, size));
+    uint64_t erase_us = platform_time_us() - start_us;
+    for (size_t offset = 0; result == ASSET_STORE_OK && offset < size; offset += STORE_CHUNK) {
+        size_t length = size - offset < STORE_CHUNK ? size - offset : STORE_CHUNK;
+        result = asset_store_write(&store, data + offset, length);
+    }
+    if (result == ASSET_STORE_OK) {
+        result = asset_store_finish(&store);
+    }
+    double host_s = (double) (clock() - start) / CLOCKS_PER_SEC;
+    uint64_t program_us = platform_time_us() - start_us - erase_us;
+    if (result != ASSET_STORE_OK) {
+        fprintf(stderr, "upload failed, %d\n", result);
+        return -1;
+    }
+
+    // Every data chunk is a transfer of register, command and data
+    size_t chunks = (size + STORE_CHUNK - 1) / STORE_CHUNK;
+    uint64_t clocks = chunks * (1 + 9 * 2 + 1) + size * 9;
+    printf("%zu bytes, erase %.1f ms (%.0f KB/s), program %.1f ms (%.0f KB/s), i2c %.1f ms at 1 MHz\n",
+           size, erase_us / 1e3, size / 1.024 / erase_us * 1e3, program_us / 1e3,
+           size / 1.024 / program_us * 1e3, clocks / 1e3);
+    printf("upload %.0f KB/s flash only, %.0f KB/s with i2c, %.0f MB/s on the host\n",
+           size / 1.024 / (erase_us + program_us) * 1e3, size / 1.024 / (erase_us + program_us + clocks) * 1e3,
+           size / 1e6 / host_s);
+    return asset_store_count(&store) - 1;
+}
+
+// Play a sequence on the virtual panel for duration_us
+// With layered set the gif is drawn into an opaque layer of the compositor
+static int play_sequence(int sequence, uint64_t duration_us, const char *ppm, int layered) {
+    platform_host_set_gpio_hook(panel_gpio_hook);
+    if (framebuffer_init(panel_config, &fb) != FRAMEBUFFER_OK) {
+        fprintf(stderr, "Framebuffer issue\n");
+        return 1;
+    }
+
+    gif_animation_init(&fb);
+    gif_animation_set_store(&store);
+    gif_animation_enable_cache(frame_cache_storage, sizeof(frame_cache_storage));
+    if (layered && (compositor_init(&compositor, fb.width, fb.height) != COMPOSITOR_OK ||
+            compositor_layer_init(&compositor, 0, fb.width, fb.height, COMPOSITOR_BLEND_OPAQUE) != COMPOSITOR_OK ||
+            gif_animation_set_layer(&compositor, 0) != GIF_OK)) {
+        fprintf(stderr, "Compositor issue\n");
+        return 1;
+    }
+    gif_animation_play(sequence, 3);
+
+    uint64_t start_us = platform_time_us();
+    clock_t start = clock();
+    while (platform_time_us() - start_us < duration_us) {
+        framebuffer_sync(&fb);
+
+        // Keep the last complete BCM cycle for the image
+        panel_keep_cycle(&fb);
+    }
+    double cpu_s = (double) (clock() - start) / CLOCKS_PER_SEC;
+    double virtual_s = (platform_time_us() - start_us) / 1e6;
+
+    printf("sequence %d, %.1f s virtual in %.3f s cpu\n", sequence, virtual_s, cpu_s);
+    // The virtual clock only advances while rows are lit
+    hub75_timing_t timing = { platform_cycles_per_us(), 0, 0, 0 };
+    printf("refresh %.1f Hz (model %.1f Hz), decode %.1f fps, %llu gpio writes\n",
+           fb.refresh_count / virtual_s,
+           hub75_refresh_model(&fb.config, fb.slices, fb.slice_count, &timing),
+           gif_animation_get_frames_decoded() / virtual_s,
+           (unsigned long long) platform_host_gpio_writes());
+    printf("%.1f pixels drawn per frame\n",
+           (double) fb.pixels_drawn / gif_animation_get_frames_decoded());
+
+    uint32_t hits, misses;
+    size_t bytes_used;
+    gif_animation_get_cache_stats(&hits, &misses, &bytes_used);
+    printf("frame cache %u hits, %u misses, %zu bytes\n", hits, misses, bytes_used);
+
+    if (ppm != NULL) {
+        write_ppm(&fb, ppm, 1);
+    }
+    return 0;
+}
+
+static void usage(const char *program) {
+    fprintf(stderr, "usage: %s [SEQUENCE] [SECONDS] [FRAME.ppm]\n", program);
+    fprintf(stderr, "       %s layers SEQUENCE [SECONDS [FRAME.ppm]]\n", program);
+    fprintf(stderr, "       %s stream RECORDING [FRAME.ppm]\n", program);
+    fprintf(stderr, "       %s store FLASH.bin [ASSET [FRAME.ppm]]\n", program);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc >= 3 && argc <= 5 && strcmp(argv[1], "layers") == 0) {
+        return play_sequence(atoi(argv[2]), (argc > 3 ? atoi(argv[3]) : 10) * 1000000ULL, argc > 4 ? argv[4] : NULL, 1);
+    }
+    if (argc >= 3 && argc <= 5 && strcmp(argv[1], "store") == 0) {
+        if (!platform_host_flash_open(argv[2], STORE_FLASH_SIZE) || asset_store_init(&store) != ASSET_STORE_OK) {
+            fprintf(stderr, "Can't open the store in %s\n", argv[2]);
+            return 1;
+        }
+        int index = argc > 3 ? store_upload(argv[3]) : 0;
+        print_store();
+        if (index < 0 || asset_store_count(&store) == 0) {
+            return index < 0;
+        }
+        return play_sequence(gif_animation_get_builtin_count() + index, 3000000, argc > 4 ? argv[4] : NULL, 0);
+    }
+    if (argc >= 3 && argc <= 4 && strcmp(argv[1], "stream") == 0) {
+        return replay_stream(argv[2], argc > 3 ? argv[3] : NULL);
+    }
+    if (argc > 4 || (argc > 1 && (argv[1][0] < '0' || argv[1][0] > '9'))) {
+        usage(argv[0]);
+        return 1;
+    }
+    int sequence = argc > 1 ? atoi(argv[1]) : DEFAULT_GIF_SEQUENCE;
+    uint64_t duration_us = (argc > 2 ? atoi(argv[2]) : 10) * 1000000ULL;
+    return play_sequence(sequence, duration_us, argc > 3 ? argv[3] : NULL, 0);
+}
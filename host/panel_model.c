@@ -0,0 +1,107 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "panel_model.h"
+
+const framebuffer_config_t panel_config = {
+    R0, G0, B0,
+    R1, G1, B1,
+    CLK, LAT, OE,
+    A, B, C,
+    DISPLAY_W, DISPLAY_H, DISPLAY_BPP,
+    .oe_inverted = false, // LOW = off
+    .chain = DISPLAY_CHAIN,
+    .scan = DISPLAY_SCAN,
+    .orientation = DISPLAY_ORIENTATION,
+    .led_ua = DISPLAY_LED_UA,
+    .current_limit_ma = DISPLAY_CURRENT_LIMIT_MA,
+    .dither = DISPLAY_DITHER
+};
+
+uint64_t lit_us[DISPLAY_H][CHAIN_W][3];
+uint64_t cycle_us[DISPLAY_H][CHAIN_W][3];
+
+static uint8_t shift_register[CHAIN_W][6];
+static uint8_t latched[DISPLAY_SCAN][CHAIN_W][6];
+static int latched_row = -1;
+static uint32_t last_gpio;
+static uint64_t last_time_us;
+
+static int pin(uint32_t gpio, int pin) {
+    return (gpio >> pin) & 0x1;
+}
+
+void panel_gpio_hook(uint32_t gpio, uint64_t time_us) {
+    // Integrate the lit time of the row that was on since the last change
+    if (pin(last_gpio, OE) && latched_row >= 0) {
+        uint64_t elapsed = time_us - last_time_us;
+        for (int x = 0; x < CHAIN_W; x++) {
+            for (int c = 0; c < 3; c++) {
+                lit_us[latched_row][x][c] += latched[latched_row][x][c] * elapsed;
+                lit_us[latched_row + DISPLAY_SCAN][x][c] += latched[latched_row][x][c + 3] * elapsed;
+            }
+        }
+    }
+
+    if (pin(gpio, CLK) && !pin(last_gpio, CLK)) {
+        memmove(shift_register[0], shift_register[1], sizeof(shift_register) - sizeof(shift_register[0]));
+        uint8_t *column = shift_register[CHAIN_W - 1];
+        column[0] = pin(gpio, R0);
+        column[1] = pin(gpio, G0);
+        column[2] = pin(gpio, B0);
+        column[3] = pin(gpio, R1);
+        column[4] = pin(gpio, G1);
+        column[5] = pin(gpio, B1);
+    }
+
+    if (pin(gpio, LAT) && !pin(last_gpio, LAT)) {
+        latched_row = pin(gpio, A) | pin(gpio, B) << 1 | pin(gpio, C) << 2;
+        memcpy(latched[latched_row], shift_register, sizeof(shift_register));
+    }
+
+    last_gpio = gpio;
+    last_time_us = time_us;
+}
+
+void panel_keep_cycle(const framebuffer_t *framebuffer) {
+    if (framebuffer->pwm == framebuffer->slice_count) {
+        memcpy(cycle_us, lit_us, sizeof(lit_us));
+        memset(lit_us, 0, sizeof(lit_us));
+    }
+}
+
+void panel_refresh(framebuffer_t *framebuffer, uint32_t refreshes) {
+    uint32_t refresh_count = framebuffer->refresh_count;
+    while (framebuffer->refresh_count - refresh_count < refreshes) {
+        framebuffer_sync(framebuffer);
+        panel_keep_cycle(framebuffer);
+    }
+}
+
+void write_ppm(const framebuffer_t *framebuffer, const char *filename, uint32_t cycles) {
+    FILE *f = fopen(filename, "wb");
+    if (f == NULL) {
+        perror(filename);
+        return;
+    }
+
+    // The planes below the lowest one shown are dropped
+    int lowest = FRAMEBUFFER_PLANES;
+    for (int i = 0; i < framebuffer->slice_count; i++) {
+        if (framebuffer->slices[i].plane < lowest) {
+            lowest = framebuffer->slices[i].plane;
+        }
+    }
+
+    // A full BCM cycle lights a channel value v for 2 * (v >> lowest) us
+    fprintf(f, "P6\n%d %d\n255\n", CHAIN_W, DISPLAY_H);
+    for (int y = 0; y < DISPLAY_H; y++) {
+        for (int x = 0; x < CHAIN_W; x++) {
+            for (int c = 0; c < 3; c++) {
+                uint64_t value = cycle_us[y][x][c] / (2 * cycles) << lowest;
+                fputc(value > 255 ? 255 : (int) value, f);
+            }
+        }
+    }
+    fclose(f);
+}
@@ -0,0 +1,38 @@
+// Virtual HUB75 panel for the host build. The model follows CLK, LAT and OE
+// on the recorded GPIO stream and integrates how long every LED is lit, so
+// the last full BCM cycle can be written out as the image the panel would
+// show. Shared by ledpanel_host and the tests.
+//
+
+#ifndef LEDPANEL_PANEL_MODEL_H
+#define LEDPANEL_PANEL_MODEL_H
+
+#include <stdint.h>
+#include "framebuffer.h"
+#include "panel.h"
+
+// The whole chain as seen from the front
+#define CHAIN_W (DISPLAY_W * DISPLAY_CHAIN)
+
+// The panel the firmware is built for, with the pins from panel.h
+extern const framebuffer_config_t panel_config;
+
+// Lit time of every LED since it was last cleared, and of the last full
+// cycle kept by panel_keep_cycle()
+extern uint64_t lit_us[DISPLAY_H][CHAIN_W][3];
+extern uint64_t cycle_us[DISPLAY_H][CHAIN_W][3];
+
+// GPIO hook for platform_host_set_gpio_hook()
+void panel_gpio_hook(uint32_t gpio, uint64_t time_us);
+
+// After framebuffer_sync(), keep lit_us as the last complete BCM cycle when
+// one just ended
+void panel_keep_cycle(const framebuffer_t *framebuffer);
+
+// Scan-out until the frame committed last has been shown refreshes times
+void panel_refresh(framebuffer_t *framebuffer, uint32_t refreshes);
+
+// cycle_us as an 8-bit PPM, cycles is the number of BCM cycles it holds
+void write_ppm(const framebuffer_t *framebuffer, const char *filename, uint32_t cycles);
+
+#endif //LEDPANEL_PANEL_MODEL_H
@@ -0,0 +1,69 @@
+#include "stream_client.h"
+
+clock_t stream_process_clock;
+
+// Parse what is in the ring, scan-out runs whenever the stream has to wait
+// for a buffer
+static void stream_process(frame_stream_t *stream, framebuffer_t *framebuffer, size_t free_bytes) {
+    while (frame_stream_free(stream) < free_bytes) {
+        clock_t start = clock();
+        size_t processed = frame_stream_process(stream, framebuffer, SIZE_MAX);
+        stream_process_clock += clock() - start;
+        if (processed == 0) {
+            framebuffer_sync(framebuffer);
+        }
+    }
+}
+
+size_t stream_put_u16(uint8_t *dst, int value) {
+    dst[0] = value & 0xff;
+    dst[1] = value >> 8 & 0xff;
+    return 2;
+}
+
+size_t stream_put_rect(uint8_t *dst, uint8_t command, int x, int y, int w, int h) {
+    size_t size = 0;
+    dst[size++] = command;
+    size += stream_put_u16(dst + size, x);
+    size += stream_put_u16(dst + size, y);
+    size += stream_put_u16(dst + size, w);
+    size += stream_put_u16(dst + size, h);
+    return size;
+}
+
+uint32_t stream_pattern(int x, int y, int frame) {
+    return (uint32_t) (x * 8 + frame) % 256 << 16 | (y * 16 + frame) % 256 << 8 | (x * y + frame) % 256;
+}
+
+size_t stream_put_pixels(uint8_t *dst, uint8_t command, int x0, int y0, int w, int h, int frame) {
+    size_t size = 0;
+    for (int y = y0; y < y0 + h; y++) {
+        for (int x = x0; x < x0 + w; x++) {
+            uint32_t color = stream_pattern(x, y, frame);
+            if (command == FRAME_STREAM_RECT_RGB565) {
+                size += stream_put_u16(dst + size, (color >> 19 & 0x1f) << 11 | (color >> 10 & 0x3f) << 5 |
+                                                   (color >> 3 & 0x1f));
+            } else {
+                dst[size++] = color >> 16 & 0xff;
+                dst[size++] = color >> 8 & 0xff;
+                dst[size++] = color & 0xff;
+            }
+        }
+    }
+    return size;
+}
+
+uint64_t stream_send(frame_stream_t *stream, framebuffer_t *framebuffer, const uint8_t *data, size_t size) {
+    uint64_t clocks = 0;
+    for (size_t offset = 0; offset < size; offset += STREAM_TRANSFER) {
+        size_t length = size - offset < STREAM_TRANSFER ? size - offset : STREAM_TRANSFER;
+        stream_process(stream, framebuffer, length);
+        for (size_t i = 0; i < length; i++) {
+            frame_stream_push(stream, data[offset + i]);
+        }
+        // START, address, register, data with an ACK per byte, STOP
+        clocks += 1 + 9 * (2 + length) + 1;
+    }
+    stream_process(stream, framebuffer, FRAME_STREAM_RING_SIZE);
+    return clocks;
+}
@@ -0,0 +1,34 @@
+// Controller side of the I2C frame stream. Transfers carry at most
+// STREAM_TRANSFER bytes after the register, every one costs a START, the
+// address, the register and a STOP on the wire.
+//
+
+#ifndef LEDPANEL_STREAM_CLIENT_H
+#define LEDPANEL_STREAM_CLIENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include "framebuffer.h"
+#include "frame_stream.h"
+
+#define STREAM_TRANSFER 256
+
+// Host time spent in frame_stream_process()
+extern clock_t stream_process_clock;
+
+size_t stream_put_u16(uint8_t *dst, int value);
+size_t stream_put_rect(uint8_t *dst, uint8_t command, int x, int y, int w, int h);
+
+// Test pattern color of a pixel in frame
+uint32_t stream_pattern(int x, int y, int frame);
+
+// Pixels of the test pattern inside a rect, in the stream pixel format
+size_t stream_put_pixels(uint8_t *dst, uint8_t command, int x0, int y0, int w, int h, int frame);
+
+// Push data the way the I2C interrupt would, with the main loop parsing in
+// between transfers. Returns the I2C clock cycles the transfers take.
+// The controller polls the status register until a transfer fits.
+uint64_t stream_send(frame_stream_t *stream, framebuffer_t *framebuffer, const uint8_t *data, size_t size);
+
+#endif //LEDPANEL_STREAM_CLIENT_H
@@ -0,0 +1,133 @@
+// Fuzz target for the gif decoder. Every input is loaded the way a gif
+// from the asset store is: initialised, validated and indexed. Only when
+// validation passes are its frames decoded as trusted, without checks, so
+// anything validation lets through that the unchecked decoder can't handle
+// shows up as a crash under the sanitizers. Inputs that fail validation
+// are decoded with the checks instead.
+//
+// Built with clang the target links against libFuzzer, see CMakeLists.txt.
+// Otherwise main() replays the files on the command line and a fixed set of
+// mutations of each through the same code, which is what CTest runs.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gif_decoder.h"
+
+// Larger screens can't be shown, don't spend the fuzzing time on them
+#define FUZZ_MAX_SCREEN (256 * 256)
+#define FUZZ_MAX_FRAMES 1024
+
+static gif_lzw_context_t lzw;
+static gif_frame_index_t frame_index[FUZZ_MAX_FRAMES];
+static int inputs_opened;
+static int inputs_trusted;
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+// Every frame in order, then every indexed frame on its own
+static void decode_frames(gif_t *gif, uint8_t *pixels, uint16_t frames) {
+    frame_t frame = { .frame = pixels };
+    gif->frame_ptr = gif->first_frame;
+    int decoded = 0;
+    while (decoded < FUZZ_MAX_FRAMES && gif_decoder_read_next_frame(gif, &frame) == GIF_OK) {
+        decoded++;
+    }
+    for (int n = 0; n < frames; n++) {
+        gif_decoder_read_frame(gif, &frame_index[n], &frame);
+    }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    // A copy of exactly the input size, reading past it is caught
+    uint8_t *source = malloc(size > 0 ? size : 1);
+    if (source == NULL) {
+        return 0;
+    }
+    memcpy(source, data, size);
+
+    gif_t gif = { .lzw = &lzw };
+    if (gif_decoder_init(source, size, &gif) != GIF_OK) {
+        free(source);
+        return 0;
+    }
+    size_t screen = (size_t) gif.width * gif.height;
+    uint8_t *pixels = screen > 0 && screen <= FUZZ_MAX_SCREEN ? malloc(screen) : NULL;
+    if (pixels == NULL) {
+        free(source);
+        return 0;
+    }
+
+    inputs_opened++;
+    uint16_t frames = 0;
+    if (gif_decoder_index(&gif, frame_index, FUZZ_MAX_FRAMES, &frames) != GIF_OK) {
+        frames = 0;
+    }
+    // Trusted from here on only when it passes
+    inputs_trusted += gif_decoder_validate(&gif, pixels, screen) == GIF_OK;
+    decode_frames(&gif, pixels, frames);
+
+    free(pixels);
+    free(source);
+    return 0;
+}
+
+#ifndef LEDPANEL_LIBFUZZER
+
+#define FUZZ_MUTATIONS 256
+
+static uint32_t fuzz_random(uint32_t *seed) {
+    *seed = *seed * 1664525u + 1013904223u;
+    return *seed >> 8;
+}
+
+// Flipped bits, overwritten bytes and a cut off end, the way a corrupted
+// upload or a broken flash write would look
+static size_t mutate(const uint8_t *data, size_t size, uint8_t *mutated, uint32_t *seed) {
+    memcpy(mutated, data, size);
+    int changes = 1 + fuzz_random(seed) % 8;
+    for (int i = 0; i < changes && size > 0; i++) {
+        size_t offset = fuzz_random(seed) % size;
+        switch (fuzz_random(seed) % 3) {
+            case 0:
+                mutated[offset] ^= 1 << fuzz_random(seed) % 8;
+                break;
+            case 1:
+                mutated[offset] = fuzz_random(seed);
+                break;
+            default:
+                mutated[offset] = fuzz_random(seed) % 2 ? 0x00 : 0xff;
+                break;
+        }
+    }
+    return fuzz_random(seed) % 4 == 0 && size > 0 ? fuzz_random(seed) % size : size;
+}
+
+int main(int argc, char *argv[]) {
+    static uint8_t data[1024 * 1024];
+    static uint8_t mutated[1024 * 1024];
+    int runs = 0;
+    for (int i = 1; i < argc; i++) {
+        FILE *f = fopen(argv[i], "rb");
+        if (f == NULL) {
+            perror(argv[i]);
+            return 1;
+        }
+        size_t size = fread(data, 1, sizeof(data), f);
+        fclose(f);
+
+        LLVMFuzzerTestOneInput(data, size);
+        runs++;
+        uint32_t seed = i;
+        for (int m = 0; m < FUZZ_MUTATIONS; m++) {
+            size_t mutated_size = mutate(data, size, mutated, &seed);
+            LLVMFuzzerTestOneInput(mutated, mutated_size);
+            runs++;
+        }
+    }
+    printf("%d inputs, %d opened, %d trusted\n", runs, inputs_opened, inputs_trusted);
+    return 0;
+}
+
+#endif
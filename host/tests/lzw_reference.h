@@ -0,0 +1,15 @@
+// See lzw_reference.c
+//
+
+#ifndef LEDPANEL_LZW_REFERENCE_H
+#define LEDPANEL_LZW_REFERENCE_H
+
+#include <stdint.h>
+
+#define LZW_REFERENCE_OK 0
+#define LZW_REFERENCE_ERROR 1
+
+// Decode the image data starting with the LZW minimum code size at data
+int lzw_reference_decode(uint8_t *data, uint8_t *buffer);
+
+#endif //LEDPANEL_LZW_REFERENCE_H
@@ -0,0 +1,49 @@
+// Checks for the host tests. Every test is an executable that prints what it
+// measured and exits with 1 when any CHECK() failed, CTest runs them all.
+//
+
+#ifndef LEDPANEL_TEST_H
+#define LEDPANEL_TEST_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#define COUNT_OF(array) ((int) (sizeof(array) / sizeof((array)[0])))
+
+static int test_failures;
+
+#define CHECK(condition, ...) do { \
+        if (!(condition)) { \
+            test_failures++; \
+            printf("FAIL %s:%d: %s: ", __FILE__, __LINE__, #condition); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+        } \
+    } while (0)
+
+// Exit status of the test
+static inline int test_result(void) {
+    printf("%s, %d failed checks\n", test_failures == 0 ? "PASS" : "FAIL", test_failures);
+    return test_failures != 0;
+}
+
+// Reads a whole file into data, returns its size or 0 when it can't be read
+static inline size_t test_read_file(const char *filename, uint8_t *data, size_t size) {
+    FILE *f = fopen(filename, "rb");
+    if (f == NULL) {
+        perror(filename);
+        test_failures++;
+        return 0;
+    }
+    size = fread(data, 1, size, f);
+    fclose(f);
+    return size;
+}
+
+static inline const char *test_basename(const char *filename) {
+    const char *base = strrchr(filename, '/');
+    return base != NULL ? base + 1 : filename;
+}
+
+#endif //LEDPANEL_TEST_H
@@ -0,0 +1,163 @@
+// gif2panel round trip. Every gif is compiled by the gif2panel built next
+// to this test, in both panel asset formats, and the assembler it emits is
+// read back into bytes. Every frame of the asset has to match the gif
+// decoded and composed the way it is played at runtime: RGB frames color
+// for color, bit-plane frames byte for byte against the same canvas drawn
+// into the framebuffer, both with the delay the gif gives the frame.
+//
+// Gifs the decoder can't play are embedded as they are, those must not
+// pass for an asset.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "animations/palette.h"
+#include "animations/panel_asset.h"
+#include "framebuffer.h"
+#include "gif_canvas.h"
+#include "gif_decoder.h"
+#include "panel_model.h"
+#include "test.h"
+
+#define ASSET_CAPACITY (8 * 1024 * 1024)
+
+static gif_lzw_context_t lzw;
+
+// The bytes of the .byte lines gif2panel writes for a gif
+static size_t compile(const char *gif2panel, const char *filename, const char *format, uint8_t *asset) {
+    char command[1024];
+    snprintf(command, sizeof(command), "\"%s\" test %s < \"%s\" 2>/dev/null", gif2panel, format, filename);
+    FILE *pipe = popen(command, "r");
+    if (pipe == NULL) {
+        return 0;
+    }
+
+    size_t size = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), pipe) != NULL) {
+        if (strncmp(line, ".byte ", 6) != 0) {
+            continue;
+        }
+        for (char *value = line + 6; value != NULL && size < ASSET_CAPACITY; value = strchr(value, ',')) {
+            if (*value == ',') {
+                value++;
+            }
+            asset[size++] = (uint8_t) strtoul(value, NULL, 16);
+        }
+    }
+    return pclose(pipe) == 0 ? size : 0;
+}
+
+static void check_assets(const char *gif2panel, int count, char *filenames[]) {
+    static uint8_t data[1024 * 1024];
+    static uint8_t asset_data[2][ASSET_CAPACITY];
+    static uint8_t frame_pixels[65536];
+    static uint8_t canvas_pixels[65536];
+    static uint8_t canvas_previous[65536];
+    static uint32_t colors[PALETTE_SIZE];
+    static const char *formats[] = { "rgb", "planes" };
+
+    framebuffer_config_t config = panel_config;
+    config.dither = 0;
+    framebuffer_t expected_fb, asset_fb;
+    if (framebuffer_init(config, &expected_fb) != FRAMEBUFFER_OK ||
+            framebuffer_init(config, &asset_fb) != FRAMEBUFFER_OK) {
+        CHECK(0, "framebuffer can't be set up");
+        return;
+    }
+    int width = expected_fb.width;
+    int height = expected_fb.height;
+    uint32_t *expected = malloc(width * height * sizeof(uint32_t));
+    uint32_t *rendered = malloc(width * height * sizeof(uint32_t));
+
+    printf("gif            frames  rgb bytes  rgb off  planes bytes  planes off\n");
+    for (int i = 0; i < count; i++) {
+        size_t size = test_read_file(filenames[i], data, sizeof(data));
+        const char *name = test_basename(filenames[i]);
+
+        panel_asset_t assets[2];
+        size_t asset_sizes[2];
+        int loaded[2];
+        for (int f = 0; f < 2; f++) {
+            asset_sizes[f] = compile(gif2panel, filenames[i], formats[f], asset_data[f]);
+            CHECK(asset_sizes[f] > 0, "gif2panel can't compile %s as %s", name, formats[f]);
+            loaded[f] = panel_asset_init(&assets[f], asset_data[f], asset_sizes[f]) == PANEL_ASSET_OK;
+        }
+
+        gif_t gif = { .lzw = &lzw };
+        frame_t frame = { .frame = frame_pixels };
+        gif_canvas_t canvas;
+        if (gif_decoder_init(data, size, &gif) != GIF_OK) {
+            CHECK(0, "%s isn't a gif", name);
+            continue;
+        }
+        palette_convert(gif.global_ct, gif.ct_size, colors);
+        gif_canvas_init(&canvas, &gif, canvas_pixels, canvas_previous);
+
+        int frames = 0;
+        int off[2] = { 0, 0 };
+        gif_error_t res;
+        while ((res = gif_decoder_read_next_frame(&gif, &frame)) == GIF_OK) {
+            gif_canvas_draw(&canvas, &frame);
+            uint16_t delay = frame.delay != 0 ? frame.delay : GIF_DEFAULT_DELAY;
+            for (int y = 0; y < height; y++) {
+                for (int x = 0; x < width; x++) {
+                    uint32_t color = 0;
+                    if (x < canvas.width && y < canvas.height) {
+                        color = colors[canvas.pixels[y * canvas.width + x]] & 0xffffff;
+                    }
+                    expected[y * width + x] = color;
+                }
+            }
+
+            uint16_t asset_delay = 0;
+            if (loaded[0]) {
+                off[0] += panel_asset_render_next(&assets[0], rendered, width, height, &asset_delay) !=
+                          PANEL_ASSET_OK || asset_delay != delay ||
+                          memcmp(rendered, expected, width * height * sizeof(uint32_t)) != 0;
+            }
+            if (loaded[1]) {
+                framebuffer_begin(&expected_fb);
+                for (int y = 0; y < height; y++) {
+                    for (int x = 0; x < width; x++) {
+                        framebuffer_drawpixel(&expected_fb, x, y, expected[y * width + x]);
+                    }
+                }
+                framebuffer_begin(&asset_fb);
+                off[1] += panel_asset_draw_next(&assets[1], &asset_fb, &asset_delay) != PANEL_ASSET_OK ||
+                          asset_delay != delay ||
+                          memcmp(asset_fb.buffer, expected_fb.buffer, expected_fb.buffer_size) != 0;
+            }
+            frames++;
+        }
+
+        if (res != GIF_EOF) {
+            // Embedded as the gif itself
+            printf("%-14.14s doesn't decode, %zu bytes embedded as is\n", name, asset_sizes[0]);
+            CHECK(!loaded[0] && !loaded[1], "%s doesn't decode but compiled to an asset", name);
+            CHECK(asset_sizes[0] == size && memcmp(asset_data[0], data, size) == 0,
+                  "%s isn't embedded as is", name);
+            continue;
+        }
+        for (int f = 0; f < 2; f++) {
+            CHECK(loaded[f], "%s compiled to %s isn't an asset", name, formats[f]);
+            CHECK(!loaded[f] || assets[f].header->frame_count == frames, "%s as %s has %u frames, the gif %d",
+                  name, formats[f], loaded[f] ? assets[f].header->frame_count : 0, frames);
+            CHECK(off[f] == 0, "%s as %s: %d frames differ", name, formats[f], off[f]);
+        }
+        printf("%-14.14s %6d  %9zu  %7d  %12zu  %10d\n", name, frames, asset_sizes[0], off[0], asset_sizes[1],
+               off[1]);
+    }
+    free(expected);
+    free(rendered);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s GIF2PANEL GIF...\n", argv[0]);
+        return 1;
+    }
+    check_assets(argv[1], argc - 2, argv + 2);
+    return test_result();
+}
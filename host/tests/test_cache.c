@@ -0,0 +1,156 @@
+// The frame cache at budgets from less than one frame to more than a whole
+// gif. Every frame the cache hands back, looping in order and after seeking,
+// has to be the one a fresh decode gives, with the same placement, delay,
+// disposal and transparency. The cache never uses more than its budget,
+// stops recording for good once it runs out and the decoder has to carry
+// on at the frame after the last cached one.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "animations/frame_cache.h"
+#include "gif_decoder.h"
+#include "test.h"
+
+#define INDEX_FRAMES 1024
+#define CACHE_STORAGE (512 * 1024)
+
+static gif_lzw_context_t lzw;
+static gif_frame_index_t frame_index[INDEX_FRAMES];
+static uint8_t storage[CACHE_STORAGE];
+
+static int same_frame(const frame_t *a, const frame_t *b) {
+    return a->offset_x == b->offset_x && a->offset_y == b->offset_y &&
+           a->width == b->width && a->height == b->height && a->delay == b->delay &&
+           a->disposal == b->disposal && a->transparancy_enabled == b->transparancy_enabled &&
+           (!a->transparancy_enabled || a->transparancy_index == b->transparancy_index) &&
+           memcmp(a->frame, b->frame, a->width * a->height) == 0;
+}
+
+// Every frame decoded fresh, in order
+static int decode_all(gif_t *gif, uint16_t frames, frame_t *decoded, uint8_t *pixels, size_t screen) {
+    for (int n = 0; n < frames; n++) {
+        decoded[n].frame = pixels + n * screen;
+        if (gif_decoder_read_frame(gif, &frame_index[n], &decoded[n]) != GIF_OK) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void check_cache(int count, char *filenames[]) {
+    static uint8_t data[1024 * 1024];
+    static uint8_t pixels[64 * 1024];
+    static const size_t budgets[] = { 16, 1024, 8 * 1024, 32 * 1024, CACHE_STORAGE };
+
+    printf("gif            frames   budget  cached  bytes used  loop errors  seek errors  cache us  decode us\n");
+    for (int i = 0; i < count; i++) {
+        size_t size = test_read_file(filenames[i], data, sizeof(data));
+        const char *name = test_basename(filenames[i]);
+
+        gif_t gif = { .lzw = &lzw };
+        uint16_t frames;
+        if (gif_decoder_init(data, size, &gif) != GIF_OK ||
+                gif_decoder_index(&gif, frame_index, INDEX_FRAMES, &frames) != GIF_OK) {
+            // Interlaced, see test_index
+            printf("%-14.14s can't be indexed\n", name);
+            continue;
+        }
+
+        size_t screen = gif.width * gif.height;
+        frame_t *decoded = malloc(frames * sizeof(frame_t));
+        uint8_t *decoded_pixels = malloc(frames * screen);
+        if (decoded == NULL || decoded_pixels == NULL || !decode_all(&gif, frames, decoded, decoded_pixels, screen)) {
+            CHECK(0, "%s can't be decoded", name);
+            free(decoded);
+            free(decoded_pixels);
+            continue;
+        }
+
+        for (int b = 0; b < COUNT_OF(budgets); b++) {
+            frame_cache_t cache;
+            frame_cache_init(&cache, storage, budgets[b]);
+
+            // Three loops, recorded during the first, the way gif_animation
+            // plays gifs that aren't indexed: from the cache when it has the
+            // frame, from the decoder at the pointer the cache left otherwise
+            int loop_errors = 0;
+            int stored = 0;
+            int full = 0;
+            frame_t frame = { .frame = pixels };
+            for (int loop = 0; loop < 3; loop++) {
+                gif.frame_ptr = gif.first_frame;
+                for (int n = 0; n < frames; n++) {
+                    if (frame_cache_next(&cache, &frame, &gif.frame_ptr) != FRAME_CACHE_OK) {
+                        loop_errors += gif_decoder_read_next_frame(&gif, &frame) != GIF_OK;
+                        int res = frame_cache_store(&cache, &frame, gif.frame_ptr);
+                        // Nothing is stored once the budget ran out
+                        loop_errors += full && res == FRAME_CACHE_OK;
+                        full |= res == FRAME_CACHE_FULL;
+                        stored += res == FRAME_CACHE_OK;
+                    }
+                    loop_errors += !same_frame(&frame, &decoded[n]);
+                    loop_errors += cache.used > cache.size;
+                }
+                frame_cache_rewind(&cache);
+            }
+            loop_errors += cache.frames != stored || (stored < frames && !full);
+
+            // Any cached frame, going back and forth
+            int seek_errors = 0;
+            for (int step = 0; step < 2 * frames; step++) {
+                uint16_t position = (step * 7919) % (frames + 1);
+                int res = frame_cache_seek(&cache, position);
+                if (position > cache.frames) {
+                    seek_errors += res != FRAME_CACHE_MISS;
+                } else if (position == cache.frames) {
+                    seek_errors += res != FRAME_CACHE_OK ||
+                                   frame_cache_next(&cache, &frame, NULL) != FRAME_CACHE_MISS;
+                } else {
+                    seek_errors += res != FRAME_CACHE_OK ||
+                                   frame_cache_next(&cache, &frame, NULL) != FRAME_CACHE_OK ||
+                                   !same_frame(&frame, &decoded[position]);
+                }
+            }
+
+            // Replaying what is cached against decoding the same frames
+            double frame_us[2] = { 0, 0 };
+            if (cache.frames > 0) {
+                int passes = 0;
+                clock_t start = clock();
+                do {
+                    frame_cache_rewind(&cache);
+                    for (int n = 0; n < cache.frames; n++) {
+                        frame_cache_next(&cache, &frame, NULL);
+                    }
+                    passes++;
+                } while (clock() - start < CLOCKS_PER_SEC / 50);
+                frame_us[0] = (double) (clock() - start) * 1e6 / CLOCKS_PER_SEC / passes / cache.frames;
+
+                passes = 0;
+                start = clock();
+                do {
+                    for (int n = 0; n < cache.frames; n++) {
+                        gif_decoder_read_frame(&gif, &frame_index[n], &frame);
+                    }
+                    passes++;
+                } while (clock() - start < CLOCKS_PER_SEC / 50);
+                frame_us[1] = (double) (clock() - start) * 1e6 / CLOCKS_PER_SEC / passes / cache.frames;
+            }
+
+            printf("%-14.14s %6u  %7zu  %6u  %10zu  %11d  %11d  %8.2f  %9.2f\n", name, frames, budgets[b],
+                   cache.frames, cache.used, loop_errors, seek_errors, frame_us[0], frame_us[1]);
+            CHECK(loop_errors == 0, "%s with a budget of %zu bytes", name, budgets[b]);
+            CHECK(seek_errors == 0, "%s with a budget of %zu bytes", name, budgets[b]);
+        }
+        free(decoded);
+        free(decoded_pixels);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    check_cache(argc - 1, argv + 1);
+    return test_result();
+}
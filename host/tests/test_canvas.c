@@ -0,0 +1,180 @@
+// Gifs larger than the display, decoded row by row onto the canvas and
+// shown through a view. Reports the memory that takes against decoding
+// whole frames, and per view the cost of a frame from the gif into the back
+// buffer and of redrawing the display after a pan. Every frame the streamed
+// canvas is compared with one composed from whole frames, and the back
+// buffer with the view drawn in full from that canvas.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "framebuffer.h"
+#include "gif_canvas.h"
+#include "gif_decoder.h"
+#include "animations/canvas_view.h"
+#include "animations/palette.h"
+#include "panel_model.h"
+#include "test.h"
+
+#define INDEX_FRAMES 1024
+
+static gif_lzw_context_t lzw;
+static framebuffer_t fb;
+static framebuffer_t fb_spans;
+static uint32_t render_colors[PALETTE_SIZE];
+
+static void render_span(void *context, int x, int y, const uint8_t *pixels, int count) {
+    framebuffer_drawspan((framebuffer_t *) context, x, y, pixels, count, render_colors);
+}
+
+static gif_canvas_t stream_canvas;
+static framebuffer_t *stream_framebuffer; // Changed pixels go here while the view is direct
+static canvas_view_t stream_view;
+
+static void stream_begin(void *context, const frame_t *frame) {
+    (void) context;
+    gif_canvas_begin(&stream_canvas, frame, stream_framebuffer != NULL ? render_span : NULL, stream_framebuffer);
+}
+
+static void stream_row(void *context, int y, const uint8_t *pixels) {
+    gif_canvas_draw_row(&stream_canvas, (const frame_t *) context, y, pixels);
+}
+
+// Same steps as draw_next_frame() in gif_animation.c, framebuffer is NULL to only compose
+static void stream_frame(const gif_t *gif, const gif_frame_index_t *entry, frame_t *frame,
+                         framebuffer_t *framebuffer) {
+    int full = stream_canvas.redraw;
+    int direct = canvas_view_is_direct(&stream_view);
+    stream_framebuffer = framebuffer != NULL && direct && !full ? framebuffer : NULL;
+    gif_rows_t rows = { stream_begin, stream_row, frame };
+    gif_decoder_read_frame_rows(gif, entry, frame, &rows);
+    gif_canvas_end(&stream_canvas, frame);
+    if (framebuffer == NULL) {
+        return;
+    }
+    if (full) {
+        canvas_view_draw_all(&stream_view, framebuffer, stream_canvas.pixels, render_colors);
+    } else if (!direct) {
+        const gif_rect_t *dirty = &stream_canvas.dirty;
+        canvas_view_draw(&stream_view, framebuffer, stream_canvas.pixels, render_colors,
+                         dirty->x, dirty->y, dirty->width, dirty->height);
+    }
+}
+
+static void print_canvas_benchmark(int count, char *filenames[]) {
+    static uint8_t data[1024 * 1024];
+    static uint8_t pixels[64 * 1024];
+    static uint8_t canvas_pixels[2][64 * 1024];
+    static uint8_t canvas_previous[2][64 * 1024];
+    static gif_frame_index_t index[INDEX_FRAMES];
+    static const struct {
+        const char *name;
+        int scale, shrink, filter;
+    } views[] = {
+            { "1:1", 1, 1, CANVAS_VIEW_NEAREST },
+            { "2:1", 2, 1, CANVAS_VIEW_NEAREST },
+            { "1:2", 1, 2, CANVAS_VIEW_NEAREST },
+            { "1:4 nearest", 1, 4, CANVAS_VIEW_NEAREST },
+            { "1:4 box", 1, 4, CANVAS_VIEW_BOX },
+    };
+
+    if (framebuffer_init(panel_config, &fb) != FRAMEBUFFER_OK ||
+            framebuffer_init(panel_config, &fb_spans) != FRAMEBUFFER_OK ||
+            canvas_view_init(&stream_view, fb.width, fb.height) != CANVAS_VIEW_OK) {
+        CHECK(0, "framebuffer can't be set up");
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        size_t size = test_read_file(filenames[i], data, sizeof(data));
+        const char *name = test_basename(filenames[i]);
+
+        // Streamed frames only ever need a row of the logical screen
+        gif_t gif = { .lzw = &lzw };
+        uint16_t frames;
+        if (gif_decoder_init(data, size, &gif) != GIF_OK || gif.width * gif.height > sizeof(pixels) ||
+                gif_decoder_index(&gif, index, INDEX_FRAMES, &frames) != GIF_OK ||
+                gif_decoder_validate(&gif, pixels, gif.width) != GIF_OK) {
+            printf("%s can't be indexed\n", name);
+            continue;
+        }
+        palette_convert(gif.global_ct, gif.ct_size, render_colors);
+        canvas_view_set_canvas(&stream_view, gif.width, gif.height);
+        frame_t frame = { .frame = pixels };
+
+        size_t canvas_bytes = 2 * gif.width * gif.height;
+        size_t view_bytes = (stream_view.width + stream_view.height) * sizeof(int16_t) + stream_view.width;
+        size_t streamed_bytes = canvas_bytes + gif.width + sizeof(gif_lzw_context_t) + view_bytes;
+        printf("%s, %dx%d canvas on a %dx%d display, %u frames\n", name, gif.width, gif.height,
+               fb.width, fb.height, frames);
+        printf("  streamed     %6zu bytes: canvas and previous %zu, row %u, LZW context %zu, view %zu\n",
+               streamed_bytes, canvas_bytes, gif.width, sizeof(gif_lzw_context_t), view_bytes);
+        printf("  whole frames %6zu bytes: frame %u on top\n",
+               streamed_bytes - gif.width + gif.width * gif.height, gif.width * gif.height);
+
+        // Decoding and composing without drawing anything
+        int passes = 0;
+        clock_t start = clock();
+        do {
+            gif_canvas_init(&stream_canvas, &gif, canvas_pixels[1], canvas_previous[1]);
+            for (int n = 0; n < frames; n++) {
+                stream_frame(&gif, &index[n], &frame, NULL);
+            }
+            passes++;
+        } while (clock() - start < CLOCKS_PER_SEC / 10);
+        printf("  compose %.2f us per frame\n", (double) (clock() - start) * 1e6 / CLOCKS_PER_SEC / passes / frames);
+
+        printf("  view         us per frame  pixels drawn  pan us  same\n");
+        for (int v = 0; v < COUNT_OF(views); v++) {
+            canvas_view_set(&stream_view, views[v].scale, views[v].shrink, views[v].filter);
+            canvas_view_pan(&stream_view, 0, 0);
+
+            gif_canvas_t reference;
+            gif_canvas_init(&reference, &gif, canvas_pixels[0], canvas_previous[0]);
+            gif_canvas_init(&stream_canvas, &gif, canvas_pixels[1], canvas_previous[1]);
+            framebuffer_clear(&fb_spans);
+            uint32_t drawn = fb_spans.pixels_drawn;
+            int same = 1;
+            for (int n = 0; n < frames; n++) {
+                stream_frame(&gif, &index[n], &frame, &fb_spans);
+                gif_decoder_read_frame(&gif, &index[n], &frame);
+                gif_canvas_draw(&reference, &frame);
+                canvas_view_draw_all(&stream_view, &fb, reference.pixels, render_colors);
+                same &= memcmp(reference.pixels, stream_canvas.pixels, gif.width * gif.height) == 0 &&
+                        memcmp(fb.buffer, fb_spans.buffer, fb.buffer_size) == 0;
+            }
+            drawn = fb_spans.pixels_drawn - drawn;
+
+            passes = 0;
+            start = clock();
+            do {
+                gif_canvas_init(&stream_canvas, &gif, canvas_pixels[1], canvas_previous[1]);
+                for (int n = 0; n < frames; n++) {
+                    stream_frame(&gif, &index[n], &frame, &fb_spans);
+                }
+                passes++;
+            } while (clock() - start < CLOCKS_PER_SEC / 10);
+            double frame_us = (double) (clock() - start) * 1e6 / CLOCKS_PER_SEC / passes / frames;
+
+            // Panning redraws the whole display from the canvas, nothing is decoded
+            passes = 0;
+            start = clock();
+            do {
+                canvas_view_pan(&stream_view, passes % gif.width - fb.width / 2, passes % gif.height - fb.height / 2);
+                canvas_view_draw_all(&stream_view, &fb_spans, stream_canvas.pixels, render_colors);
+                passes++;
+            } while (clock() - start < CLOCKS_PER_SEC / 10);
+            double pan_us = (double) (clock() - start) * 1e6 / CLOCKS_PER_SEC / passes;
+
+            printf("  %-11s  %12.2f  %12.1f  %6.2f  %4s\n", views[v].name, frame_us, (double) drawn / frames,
+                   pan_us, same ? "yes" : "NO");
+            CHECK(same, "%s through a %s view", name, views[v].name);
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    print_canvas_benchmark(argc - 1, argv + 1);
+    return test_result();
+}
@@ -0,0 +1,216 @@
+// Temporal dithering on the virtual panel. A ramp through the palette is
+// shown for DITHER_CYCLES cycles, averaged every LED has to come out at the
+// 10-bit color the palette asked for, where the planes alone stop at 8 bits.
+// Then the cost of working out the phases at commit for two panel sizes.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "framebuffer.h"
+#include "animations/palette.h"
+#include "panel_model.h"
+#include "platform/platform.h"
+#include "test.h"
+
+#define DITHER_CYCLES (4 * FRAMEBUFFER_DITHER_PHASES)
+
+static framebuffer_t fb;
+
+// Lit time of every LED over DITHER_CYCLES whole cycles
+static void show_dither_frame(const uint8_t *pixels, const uint32_t *colors, uint64_t (*lit)[CHAIN_W][3]) {
+    framebuffer_begin(&fb);
+    for (int y = 0; y < fb.height; y++) {
+        framebuffer_drawspan(&fb, 0, y, pixels + y * fb.width, fb.width, colors);
+    }
+    framebuffer_commit(&fb);
+
+    memset(lit, 0, sizeof(lit_us));
+    uint32_t start = fb.refresh_count;
+    while (fb.refresh_count - start < 2 + DITHER_CYCLES) {
+        framebuffer_sync(&fb);
+        if (fb.pwm == fb.slice_count) {
+            for (int y = 0; fb.refresh_count - start >= 2 && y < DISPLAY_H; y++) {
+                for (int x = 0; x < CHAIN_W; x++) {
+                    for (int c = 0; c < 3; c++) {
+                        lit[y][x][c] += lit_us[y][x][c];
+                    }
+                }
+            }
+            memset(lit_us, 0, sizeof(lit_us));
+        }
+    }
+}
+
+// Averaged output as a PPM with 10-bit channels
+static void write_dither_ppm(const char *filename, uint64_t (*lit)[CHAIN_W][3]) {
+    FILE *f = fopen(filename, "wb");
+    if (f == NULL) {
+        perror(filename);
+        return;
+    }
+    fprintf(f, "P6\n%d %d\n1023\n", CHAIN_W, DISPLAY_H);
+    for (int y = 0; y < DISPLAY_H; y++) {
+        for (int x = 0; x < CHAIN_W; x++) {
+            for (int c = 0; c < 3; c++) {
+                uint32_t value = lit[y][x][c] * 2 / DITHER_CYCLES;
+                fputc(value >> 8, f);
+                fputc(value & 0xff, f);
+            }
+        }
+    }
+    fclose(f);
+}
+
+static void print_dither_cost(void) {
+    static const struct {
+        int w, h, scan, chain;
+    } geometries[] = { { 32, 16, 8, 1 }, { 64, 64, 32, 2 } };
+    static uint8_t pixels[128 * 64 + 1]; // Every other frame starts a pixel later
+    uint32_t colors[PALETTE_SIZE];
+    for (int i = 0; i < PALETTE_SIZE; i++) {
+        colors[i] = i * 0x010101 | FRAMEBUFFER_COLOR_FRACTION(i & 3, i >> 2 & 3, i >> 4 & 3);
+    }
+    for (int i = 0; i < COUNT_OF(pixels); i++) {
+        pixels[i] = i * 7;
+    }
+
+    printf("\npanel     chain  dither  buffers KB  host commit us  ns per pixel  host scan us\n");
+    platform_host_set_gpio_hook(NULL);
+    for (int g = 0; g < COUNT_OF(geometries); g++) {
+        for (int dither = 0; dither < 2; dither++) {
+            framebuffer_config_t config = panel_config;
+            config.w = geometries[g].w;
+            config.h = geometries[g].h;
+            config.scan = geometries[g].scan;
+            config.chain = geometries[g].chain;
+            config.pin_d = 17;
+            config.pin_e = 23;
+            config.dither = dither;
+
+            framebuffer_t framebuffer;
+            if (framebuffer_init(config, &framebuffer) != FRAMEBUFFER_OK) {
+                continue;
+            }
+
+            // Every commit redraws the whole display, scan-out runs a cycle
+            // whenever it holds on to all buffers
+            clock_t commit_clock = 0;
+            int frames = 0;
+            clock_t start = clock();
+            do {
+                while (framebuffer_begin(&framebuffer) != FRAMEBUFFER_OK) {
+                    for (int i = 0; i < framebuffer.slice_count; i++) {
+                        framebuffer_sync(&framebuffer);
+                    }
+                }
+                for (int y = 0; y < framebuffer.height; y++) {
+                    framebuffer_drawspan(&framebuffer, 0, y, pixels + y * framebuffer.width + frames % 2,
+                                         framebuffer.width, colors);
+                }
+                clock_t commit_start = clock();
+                framebuffer_commit(&framebuffer);
+                commit_clock += clock() - commit_start;
+                frames++;
+            } while (clock() - start < CLOCKS_PER_SEC / 10);
+            double commit_us = (double) commit_clock * 1e6 / CLOCKS_PER_SEC / frames;
+
+            start = clock();
+            int cycles = 0;
+            do {
+                for (int i = 0; i < framebuffer.slice_count; i++) {
+                    framebuffer_sync(&framebuffer);
+                }
+                cycles++;
+            } while (clock() - start < CLOCKS_PER_SEC / 20);
+            double scan_us = (double) (clock() - start) * 1e6 / CLOCKS_PER_SEC / cycles;
+
+            printf("%2dx%-2d     %5d  %6s  %10.1f  %14.2f  %12.2f  %12.1f\n", config.w, config.h, config.chain,
+                   dither ? "yes" : "no", FRAMEBUFFER_BUFFERS * framebuffer.buffer_size / 1024.0, commit_us,
+                   commit_us * 1e3 / (framebuffer.width * framebuffer.height), scan_us);
+        }
+    }
+}
+
+// Every cycle lights a value v for 2 * v us, the average in quarters has to
+// match the color and its fraction exactly. Full channels can't go up.
+static void print_dither_check(const char *ppm) {
+    // Red ramps up, green down and blue hops around the palette
+    uint8_t color_table[PALETTE_SIZE * 3];
+    for (int i = 0; i < PALETTE_SIZE; i++) {
+        color_table[i * 3] = i;
+        color_table[i * 3 + 1] = 255 - i;
+        color_table[i * 3 + 2] = i * 7;
+    }
+    uint32_t colors[PALETTE_SIZE];
+    palette_convert(color_table, PALETTE_SIZE, colors);
+    static uint8_t pixels[DISPLAY_PIXELS];
+    for (int i = 0; i < DISPLAY_PIXELS; i++) {
+        pixels[i] = i;
+    }
+
+    static uint64_t lit[2][DISPLAY_H][CHAIN_W][3];
+    platform_host_set_gpio_hook(panel_gpio_hook);
+    for (int dither = 0; dither < 2; dither++) {
+        framebuffer_config_t config = panel_config;
+        config.dither = dither;
+        if (framebuffer_init(config, &fb) != FRAMEBUFFER_OK) {
+            CHECK(0, "framebuffer can't be set up");
+            return;
+        }
+        if (fb.lowest_plane != 0) {
+            printf("dithering shows the bits below plane 0, %d planes are too few to check\n",
+                   FRAMEBUFFER_PLANES - fb.lowest_plane);
+            return;
+        }
+        show_dither_frame(pixels, colors, lit[dither]);
+    }
+
+    uint32_t errors[2] = { 0, 0 };
+    uint32_t worst[2] = { 0, 0 };
+    for (int y = 0; y < DISPLAY_H; y++) {
+        for (int x = 0; x < CHAIN_W; x++) {
+            uint32_t color = colors[pixels[y * CHAIN_W + x]];
+            for (int c = 0; c < 3; c++) {
+                uint32_t value = color >> (16 - c * 8) & 0xff;
+                uint32_t expected = value == 0xff ? 1020 : value * 4 + (color >> (28 - c * 2) & 0x3);
+                for (int dither = 0; dither < 2; dither++) {
+                    uint64_t shown = lit[dither][y][x][c] * 2;
+                    uint64_t wanted = (uint64_t) expected * DITHER_CYCLES;
+                    uint32_t error = (shown > wanted ? shown - wanted : wanted - shown) / DITHER_CYCLES;
+                    errors[dither] += shown != wanted;
+                    worst[dither] = error > worst[dither] ? error : worst[dither];
+                }
+            }
+        }
+    }
+
+    // Distinct levels the darkest quarter of the ramp comes out at
+    int levels[2] = { 0, 0 };
+    for (int dither = 0; dither < 2; dither++) {
+        uint64_t last = UINT64_MAX;
+        for (int i = 0; i < 64; i++) {
+            uint64_t shown = lit[dither][i / CHAIN_W][i % CHAIN_W][0];
+            levels[dither] += shown != last;
+            last = shown;
+        }
+    }
+
+    printf("%dx%d, %d phases, averaged over %d cycles\n", fb.width, fb.height, FRAMEBUFFER_DITHER_PHASES,
+           DITHER_CYCLES);
+    printf("           channels off  worst error  levels for red 0-63  ok\n");
+    printf("planes     %12u  %11.2f  %19d\n", errors[0], worst[0] / 4.0, levels[0]);
+    printf("dithered   %12u  %11.2f  %19d  %2s\n", errors[1], worst[1] / 4.0, levels[1],
+           errors[1] == 0 ? "ok" : "NO");
+    if (ppm != NULL) {
+        write_dither_ppm(ppm, lit[1]);
+    }
+    CHECK(errors[1] == 0, "%u channels off by up to %.2f", errors[1], worst[1] / 4.0);
+    CHECK(levels[1] > levels[0], "%d levels dithered, %d without", levels[1], levels[0]);
+}
+
+int main(int argc, char *argv[]) {
+    print_dither_check(argc > 1 ? argv[1] : NULL);
+    print_dither_cost();
+    return test_result();
+}
@@ -0,0 +1,149 @@
+// The page flip between two threads, the way the drawing core and the
+// refresh core use it. One thread draws numbered frames of a single color
+// and commits them as fast as framebuffer_begin() hands out buffers, the
+// other runs framebuffer_sync(). At the start of every BCM cycle the frame
+// on screen must be whole, one color in every column of every plane, and
+// no older than the one shown before it. The threads run until a fixed
+// number of frames has been shown however long that takes, the rates are
+// only printed.
+//
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <time.h>
+#include "framebuffer.h"
+#include "panel_model.h"
+#include "test.h"
+
+#define FLIP_FRAMES 200
+// Only there so a flip that never shows anything fails instead of hanging
+#define FLIP_TIMEOUT_SECONDS 60
+
+static framebuffer_t fb;
+static volatile int stop;
+
+// Frame number drawn into every buffer, written before the commit
+// publishes the buffer and read after scan-out took it
+static uint32_t buffer_frame[FRAMEBUFFER_BUFFERS];
+
+static uint32_t frames_committed;
+static uint32_t begin_busy;
+static volatile uint32_t frames_shown;
+static uint32_t frames_torn;
+static uint32_t frames_behind;
+
+static int index_of(const uint32_t *buffer) {
+    for (int i = 0; i < FRAMEBUFFER_BUFFERS; i++) {
+        if (fb.buffers[i] == buffer) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Gray level of frame n, within the planes the display shows
+static uint32_t frame_level(uint32_t frame) {
+    return frame % (1u << (FRAMEBUFFER_PLANES - fb.lowest_plane)) << fb.lowest_plane;
+}
+
+static void *draw_thread(void *arg) {
+    (void) arg;
+    uint32_t row[256];
+    for (uint32_t frame = 1; !stop; frame++) {
+        while (framebuffer_begin(&fb) == FRAMEBUFFER_BUSY) {
+            begin_busy++;
+            if (stop) {
+                return NULL;
+            }
+            sched_yield();
+        }
+        uint32_t level = frame_level(frame);
+        for (int x = 0; x < fb.width; x++) {
+            row[x] = level << 16 | level << 8 | level;
+        }
+        for (int y = 0; y < fb.height; y++) {
+            framebuffer_drawrow(&fb, 0, y, row, fb.width);
+        }
+        buffer_frame[index_of(fb.buffer)] = frame;
+        if (framebuffer_commit(&fb) == FRAMEBUFFER_OK) {
+            frames_committed++;
+        }
+    }
+    return NULL;
+}
+
+// Every column of a plane is the same, all data pins or none
+static int frame_whole(const uint32_t *buffer, uint32_t level) {
+    const uint8_t *ptr = (const uint8_t *) buffer;
+    for (int plane = fb.lowest_plane; plane < FRAMEBUFFER_PLANES; plane++) {
+        uint32_t first = fb.column_bytes == 1 ? ptr[0] : *(const uint32_t *) ptr;
+        if ((first != 0) != (level >> plane & 0x1)) {
+            return 0;
+        }
+        for (size_t i = 0; i < fb.plane_size; i += fb.column_bytes) {
+            uint32_t column = fb.column_bytes == 1 ? ptr[i] : *(const uint32_t *) (ptr + i);
+            if (column != first) {
+                return 0;
+            }
+        }
+        ptr += fb.plane_size;
+    }
+    return 1;
+}
+
+static void *scan_thread(void *arg) {
+    (void) arg;
+    uint32_t *shown = NULL;
+    uint32_t last_frame = 0;
+    while (!stop) {
+        framebuffer_sync(&fb);
+        if (fb.pwm != 1 || fb.front == shown) {
+            continue;
+        }
+        shown = fb.front;
+        uint32_t frame = buffer_frame[index_of(shown)];
+        frames_shown++;
+        frames_torn += !frame_whole(shown, frame_level(frame));
+        frames_behind += frame < last_frame;
+        last_frame = frame;
+    }
+    return NULL;
+}
+
+int main(void) {
+    framebuffer_config_t config = panel_config;
+    config.dither = 0;
+    config.current_limit_ma = 0;
+    if (framebuffer_init(config, &fb) != FRAMEBUFFER_OK) {
+        CHECK(0, "framebuffer can't be set up");
+        return test_result();
+    }
+
+    pthread_t drawer, scanner;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_create(&scanner, NULL, scan_thread, NULL);
+    pthread_create(&drawer, NULL, draw_thread, NULL);
+    struct timespec wait = { 0, 1000000 };
+    for (int waited = 0; frames_shown < FLIP_FRAMES && waited < FLIP_TIMEOUT_SECONDS * 1000; waited++) {
+        nanosleep(&wait, NULL);
+    }
+    stop = 1;
+    pthread_join(drawer, NULL);
+    pthread_join(scanner, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (double) (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    printf("refreshes per second   %10.0f\n", fb.refresh_count / seconds);
+    printf("frames drawn per second%10.0f\n", frames_committed / seconds);
+    printf("frames shown           %10u\n", frames_shown);
+    printf("frames overtaken       %10u\n", frames_committed - frames_shown);
+    printf("begin busy             %10u\n", begin_busy);
+    printf("frames torn            %10u\n", frames_torn);
+    printf("frames out of order    %10u\n", frames_behind);
+    CHECK(frames_shown >= FLIP_FRAMES, "%u frames shown in %d s", frames_shown, FLIP_TIMEOUT_SECONDS);
+    CHECK(frames_torn == 0, "%u frames torn", frames_torn);
+    CHECK(frames_behind == 0, "%u frames out of order", frames_behind);
+    return test_result();
+}
@@ -0,0 +1,257 @@
+// Chain geometry, orientation and row addressing, from the pins. For every
+// orientation single pixels are drawn at the corners and inside the display
+// and a full BCM cycle is captured off CLK and LAT: the one LED that lights
+// up has to be where the rotation puts the pixel on the chain. Every row
+// address of the scan has to be latched, through A to E as far as the scan
+// needs them and with the address lines it doesn't need left low.
+//
+
+#include <stdio.h>
+#include "framebuffer.h"
+#include "hub75_stream.h"
+#include "panel_model.h"
+#include "platform/platform.h"
+#include "test.h"
+
+#define MAX_ROWS (2 * FRAMEBUFFER_MAX_ROWS)
+#define MAX_COLUMNS 256
+#define PIN_D 17
+#define PIN_E 23
+
+static framebuffer_t fb;
+
+// Data pins clocked into the row being shifted, and the LEDs every latch lit
+static uint32_t shifted[MAX_COLUMNS];
+static int shifted_count;
+static uint8_t lit[MAX_ROWS][MAX_COLUMNS];
+static uint32_t addresses_latched;
+static uint32_t address_pins_seen;
+static uint32_t last_gpio;
+
+// Address lines A to E in order, independent of hub75_address_pins()
+static int latched_address(uint32_t gpio) {
+    const int pins[] = { fb.config.pin_a, fb.config.pin_b, fb.config.pin_c, fb.config.pin_d, fb.config.pin_e };
+    int address = 0;
+    for (int i = 0; i < COUNT_OF(pins); i++) {
+        address |= (gpio >> pins[i] & 0x1) << i;
+    }
+    return address;
+}
+
+static void geometry_hook(uint32_t gpio, uint64_t time_us) {
+    (void) time_us;
+    const framebuffer_config_t *config = &fb.config;
+    uint32_t rising = gpio & ~last_gpio;
+    last_gpio = gpio;
+    if (rising >> config->pin_clk & 0x1 && shifted_count < MAX_COLUMNS) {
+        shifted[shifted_count++] = gpio;
+    }
+    if (rising >> config->pin_lat & 0x1) {
+        int rows = hub75_scan_rows(config);
+        int address = latched_address(gpio);
+        address_pins_seen |= address;
+        if (address < rows) {
+            addresses_latched |= 1u << address;
+            for (int column = 0; column < shifted_count; column++) {
+                uint32_t bits = shifted[column];
+                lit[address][column] |= (bits >> config->pin_r0 & 0x1) << 2 | (bits >> config->pin_g0 & 0x1) << 1 |
+                                        (bits >> config->pin_b0 & 0x1);
+                lit[address + rows][column] |= (bits >> config->pin_r1 & 0x1) << 2 |
+                                               (bits >> config->pin_g1 & 0x1) << 1 | (bits >> config->pin_b1 & 0x1);
+            }
+        }
+        shifted_count = 0;
+    }
+}
+
+// Shows a frame with one white pixel, or none, for a whole BCM cycle
+static void capture_pixel(int x, int y) {
+    framebuffer_begin(&fb);
+    framebuffer_clear(&fb);
+    if (x >= 0) {
+        framebuffer_drawpixel(&fb, x, y, 0xffffff);
+    }
+    framebuffer_commit(&fb);
+    while (fb.pwm != fb.slice_count) {
+        framebuffer_sync(&fb);
+    }
+
+    memset(lit, 0, sizeof(lit));
+    shifted_count = 0;
+    addresses_latched = 0;
+    address_pins_seen = 0;
+    last_gpio = 0;
+    platform_host_set_gpio_hook(geometry_hook);
+    for (int s = 0; s <= fb.slice_count; s++) {
+        framebuffer_sync(&fb);
+    }
+    platform_host_set_gpio_hook(NULL);
+}
+
+// Where the top left corner of the display sits on the chain and which way
+// its x and y axes run there, in chain columns and panel rows
+typedef struct {
+    int right, bottom;   // Corner is the last column, the last row
+    int x_column, x_row; // One step along x
+    int y_column, y_row; // One step along y
+} orientation_t;
+
+static const orientation_t orientations[] = {
+        [FRAMEBUFFER_ROTATE_0] = { 0, 0, 1, 0, 0, 1 },
+        [FRAMEBUFFER_ROTATE_90] = { 0, 1, 0, -1, 1, 0 },
+        [FRAMEBUFFER_ROTATE_180] = { 1, 1, -1, 0, 0, -1 },
+        [FRAMEBUFFER_ROTATE_270] = { 1, 0, 0, 1, -1, 0 },
+};
+
+static void expected_led(const framebuffer_config_t *config, int x, int y, int *column, int *row) {
+    const orientation_t *o = &orientations[config->orientation];
+    *column = (o->right ? hub75_chain_columns(config) - 1 : 0) + x * o->x_column + y * o->y_column;
+    *row = (o->bottom ? config->h - 1 : 0) + x * o->x_row + y * o->y_row;
+}
+
+// hub75_map_pixel() for every pixel of the display, which has to cover
+// every LED of the chain once
+static int check_map(const framebuffer_config_t *config, int width, int height) {
+    static uint8_t covered[MAX_ROWS][MAX_COLUMNS];
+    memset(covered, 0, sizeof(covered));
+    int errors = 0;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int column, row, expected_column, expected_row;
+            hub75_map_pixel(config, x, y, &column, &row);
+            expected_led(config, x, y, &expected_column, &expected_row);
+            if (column != expected_column || row != expected_row) {
+                errors++;
+                continue;
+            }
+            errors += covered[row][column]++ != 0;
+        }
+    }
+    return errors;
+}
+
+// The LEDs lit in the last capture, other than the one at column, row
+static int stray_leds(int column, int row) {
+    int rows = 2 * hub75_scan_rows(&fb.config);
+    int columns = hub75_chain_columns(&fb.config);
+    int stray = 0;
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < columns; c++) {
+            stray += (r != row || c != column) && lit[r][c] != 0;
+        }
+    }
+    return stray;
+}
+
+static void check_geometry(void) {
+    static const struct {
+        const char *name;
+        int w, h, scan, chain, address_lines;
+    } geometries[] = {
+            { "32x16 1/8 x2", 32, 16, 8, 2, 3 },
+            { "64x32 1/16", 64, 32, 16, 1, 4 },
+            { "64x64 1/32", 64, 64, 32, 1, 5 },
+            { "64x64 1/32 x2", 64, 64, 32, 2, 5 },
+    };
+    static const char *orientation_names[] = { "0", "90", "180", "270" };
+
+    printf("geometry       rotate  display  address pins  map errors  scan errors\n");
+    for (int g = 0; g < COUNT_OF(geometries); g++) {
+        for (int orientation = FRAMEBUFFER_ROTATE_0; orientation <= FRAMEBUFFER_ROTATE_270; orientation++) {
+            framebuffer_config_t config = panel_config;
+            config.w = geometries[g].w;
+            config.h = geometries[g].h;
+            config.scan = geometries[g].scan;
+            config.chain = geometries[g].chain;
+            config.orientation = orientation;
+            config.pin_d = PIN_D;
+            config.pin_e = PIN_E;
+            config.current_limit_ma = 0;
+            config.dither = 0;
+            const char *name = geometries[g].name;
+            const char *rotation = orientation_names[orientation];
+            if (framebuffer_init(config, &fb) != FRAMEBUFFER_OK) {
+                CHECK(0, "%s rotated %s can't be set up", name, rotation);
+                continue;
+            }
+
+            int address_pins[5];
+            const int all_address_pins[] = { config.pin_a, config.pin_b, config.pin_c, PIN_D, PIN_E };
+            int address_count = hub75_address_pins(&config, address_pins);
+            CHECK(address_count == geometries[g].address_lines, "%s drives %d address lines", name,
+                  address_count);
+            for (int i = 0; i < address_count && i < COUNT_OF(all_address_pins); i++) {
+                CHECK(address_pins[i] == all_address_pins[i], "%s address line %d on pin %d", name, i,
+                      address_pins[i]);
+            }
+
+            int width, height;
+            hub75_display_size(&config, &width, &height);
+            int columns = hub75_chain_columns(&config);
+            int rotated = orientation == FRAMEBUFFER_ROTATE_90 || orientation == FRAMEBUFFER_ROTATE_270;
+            CHECK(fb.width == width && fb.height == height && width == (rotated ? config.h : columns) &&
+                  height == (rotated ? columns : config.h), "%s rotated %s is %dx%d", name, rotation, width,
+                  height);
+            int map_errors = check_map(&config, width, height);
+            CHECK(map_errors == 0, "%s rotated %s maps %d pixels wrong", name, rotation, map_errors);
+
+            // Nothing drawn, every address is still latched
+            int scan_errors = 0;
+            uint32_t all_addresses = (uint32_t) ((1ull << hub75_scan_rows(&config)) - 1);
+            capture_pixel(-1, -1);
+            scan_errors += stray_leds(-1, -1);
+            scan_errors += addresses_latched != all_addresses;
+            scan_errors += (address_pins_seen & ~all_addresses) != 0;
+
+            const int probes[][2] = {
+                    { 0, 0 }, { width - 1, 0 }, { 0, height - 1 }, { width - 1, height - 1 },
+                    { 1, 2 }, { width / 2 + 3, height / 2 - 1 },
+            };
+            for (int p = 0; p < COUNT_OF(probes); p++) {
+                int x = probes[p][0];
+                int y = probes[p][1];
+                int column, row;
+                expected_led(&config, x, y, &column, &row);
+                capture_pixel(x, y);
+                int errors = (lit[row][column] != 0x7) + stray_leds(column, row);
+                CHECK(errors == 0, "%s rotated %s: pixel %d,%d should light column %d row %d", name, rotation, x,
+                      y, column, row);
+                scan_errors += errors;
+            }
+            CHECK(scan_errors == 0, "%s rotated %s: %d scan errors", name, rotation, scan_errors);
+            printf("%-14s %6s  %3dx%-3d  %12d  %10d  %11d\n", name, rotation, width, height, address_count,
+                   map_errors, scan_errors);
+        }
+    }
+}
+
+// Layouts the scan engine can't drive
+static void check_unsupported(void) {
+    static const struct {
+        int w, h, scan;
+    } layouts[] = {
+            { 32, 16, 4 },  // 1/4 scan lights more than two rows per address
+            { 32, 16, 16 }, // More addresses than row pairs
+            { 32, 24, 12 }, // Not a power of two
+            { 64, 128, 64 },
+            { 0, 16, 8 },
+    };
+    for (int i = 0; i < COUNT_OF(layouts); i++) {
+        framebuffer_config_t config = panel_config;
+        config.w = layouts[i].w;
+        config.h = layouts[i].h;
+        config.scan = layouts[i].scan;
+        CHECK(hub75_check_geometry(&config) < 0, "%dx%d at 1/%d scan is accepted", config.w, config.h,
+              config.scan);
+    }
+    framebuffer_config_t config = panel_config;
+    config.scan = 0;
+    CHECK(hub75_check_geometry(&config) == 0 && hub75_scan_rows(&config) == config.h / 2,
+          "scan 0 isn't half the rows");
+}
+
+int main(void) {
+    check_geometry();
+    check_unsupported();
+    return test_result();
+}
@@ -0,0 +1,229 @@
+// The frame_queue_t handoff between the cores, under threads. A producer
+// fills buffers with a sequence number and passes them over committed, a
+// consumer checks every word of them and hands them back over released.
+// No buffer may be lost, repeated, seen out of order or seen before the
+// producer finished writing it. Both run a fixed number of buffers however
+// long that takes, the rates are only printed. The same handoff through a queue behind
+// a mutex, and the refresh loop sharing one thread with drawing the way
+// it did before it moved to core 1, give the numbers to compare against.
+//
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <time.h>
+#include "frame_queue.h"
+#include "framebuffer.h"
+#include "panel_model.h"
+#include "test.h"
+
+#define HANDOFF_BUFFERS 3
+#define HANDOFF_WORDS 512
+#define HANDOFF_COUNT 20000
+// Only there so a handoff that gets stuck fails instead of hanging
+#define HANDOFF_TIMEOUT_SECONDS 60
+// Refresh comparison
+#define REFRESH_SECONDS 0.5
+
+typedef struct {
+    frame_queue_t committed;
+    frame_queue_t released;
+    pthread_mutex_t mutex;
+    int locked;
+    volatile int stop;
+    uint32_t produced;
+    volatile uint32_t handoffs;
+    uint32_t errors;      // Consumer side
+    uint32_t push_errors; // Producer side
+} handoff_t;
+
+static uint32_t buffers[HANDOFF_BUFFERS][HANDOFF_WORDS];
+
+static double seconds_since(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static int push(handoff_t *handoff, frame_queue_t *queue, uint32_t *frame) {
+    if (!handoff->locked) {
+        return frame_queue_push(queue, frame);
+    }
+    pthread_mutex_lock(&handoff->mutex);
+    int pushed = frame_queue_push(queue, frame);
+    pthread_mutex_unlock(&handoff->mutex);
+    return pushed;
+}
+
+static int pop(handoff_t *handoff, frame_queue_t *queue, uint32_t **frame) {
+    if (!handoff->locked) {
+        return frame_queue_pop(queue, frame);
+    }
+    pthread_mutex_lock(&handoff->mutex);
+    int popped = frame_queue_pop(queue, frame);
+    pthread_mutex_unlock(&handoff->mutex);
+    return popped;
+}
+
+static void *produce(void *arg) {
+    handoff_t *handoff = arg;
+    for (uint32_t sequence = 1; sequence <= HANDOFF_COUNT && !handoff->stop; sequence++) {
+        uint32_t *buffer;
+        while (!pop(handoff, &handoff->released, &buffer)) {
+            if (handoff->stop) {
+                return NULL;
+            }
+            sched_yield();
+        }
+        for (int i = 0; i < HANDOFF_WORDS; i++) {
+            buffer[i] = sequence;
+        }
+        if (!push(handoff, &handoff->committed, buffer)) {
+            handoff->push_errors++;
+        }
+        handoff->produced++;
+    }
+    return NULL;
+}
+
+static void *consume(void *arg) {
+    handoff_t *handoff = arg;
+    uint32_t expected = 1;
+    while (handoff->handoffs < HANDOFF_COUNT && !handoff->stop) {
+        uint32_t *buffer;
+        if (!pop(handoff, &handoff->committed, &buffer)) {
+            sched_yield();
+            continue;
+        }
+        for (int i = 0; i < HANDOFF_WORDS; i++) {
+            handoff->errors += buffer[i] != expected;
+        }
+        expected++;
+        handoff->handoffs++;
+        if (!push(handoff, &handoff->released, buffer)) {
+            handoff->errors++;
+        }
+    }
+    return NULL;
+}
+
+// Nanoseconds per buffer handed over and back
+static double run_handoff(int locked, uint32_t *errors) {
+    static handoff_t handoff;
+    frame_queue_init(&handoff.committed);
+    frame_queue_init(&handoff.released);
+    pthread_mutex_init(&handoff.mutex, NULL);
+    handoff.locked = locked;
+    handoff.stop = 0;
+    handoff.produced = 0;
+    handoff.handoffs = 0;
+    handoff.errors = 0;
+    handoff.push_errors = 0;
+    for (int i = 0; i < HANDOFF_BUFFERS; i++) {
+        frame_queue_push(&handoff.released, buffers[i]);
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_t producer, consumer;
+    pthread_create(&consumer, NULL, consume, &handoff);
+    pthread_create(&producer, NULL, produce, &handoff);
+    while (handoff.handoffs < HANDOFF_COUNT && seconds_since(&start) < HANDOFF_TIMEOUT_SECONDS) {
+        struct timespec wait = { 0, 1000000 };
+        nanosleep(&wait, NULL);
+    }
+    handoff.stop = 1;
+    pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+    double seconds = seconds_since(&start);
+    pthread_mutex_destroy(&handoff.mutex);
+
+    *errors = handoff.errors + handoff.push_errors;
+    // Every buffer was checked against the sequence number it had to carry
+    CHECK(handoff.produced == HANDOFF_COUNT && handoff.handoffs == HANDOFF_COUNT,
+          "%s queue handed over %u of %u buffers", locked ? "locked" : "lock-free", handoff.handoffs,
+          handoff.produced);
+    return handoff.handoffs > 0 ? seconds * 1e9 / handoff.handoffs : 0;
+}
+
+static framebuffer_t fb;
+static volatile int refresh_stop;
+static uint32_t frames_drawn;
+
+static void draw_frame(uint32_t frame) {
+    framebuffer_begin(&fb);
+    for (int y = 0; y < fb.height; y++) {
+        for (int x = 0; x < fb.width; x++) {
+            framebuffer_drawpixel(&fb, x, y, (x + y + frame) * 0x030507);
+        }
+    }
+    if (framebuffer_commit(&fb) == FRAMEBUFFER_OK) {
+        frames_drawn++;
+    }
+}
+
+static void *refresh_thread(void *arg) {
+    (void) arg;
+    while (!refresh_stop) {
+        framebuffer_sync(&fb);
+    }
+    return NULL;
+}
+
+// Frames drawn and BCM cycles shown per second with drawing between the
+// cycles of the refresh loop, or with the refresh loop on a thread of its own
+static void run_refresh(int threaded, double *frames, double *refreshes) {
+    framebuffer_config_t config = panel_config;
+    config.dither = 0;
+    if (framebuffer_init(config, &fb) != FRAMEBUFFER_OK) {
+        CHECK(0, "framebuffer can't be set up");
+        return;
+    }
+    frames_drawn = 0;
+    refresh_stop = 0;
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_t refresher;
+    if (threaded) {
+        pthread_create(&refresher, NULL, refresh_thread, NULL);
+    }
+    for (uint32_t frame = 0; seconds_since(&start) < REFRESH_SECONDS; frame++) {
+        if (threaded) {
+            while (framebuffer_begin(&fb) == FRAMEBUFFER_BUSY) {
+                sched_yield();
+            }
+        } else {
+            do {
+                framebuffer_sync(&fb);
+            } while (fb.pwm != fb.slice_count);
+        }
+        draw_frame(frame);
+    }
+    refresh_stop = 1;
+    if (threaded) {
+        pthread_join(refresher, NULL);
+    }
+    double seconds = seconds_since(&start);
+    *frames = frames_drawn / seconds;
+    *refreshes = fb.refresh_count / seconds;
+}
+
+int main(void) {
+    uint32_t errors;
+    printf("queue      ns per handoff  errors\n");
+    double lock_free_ns = run_handoff(0, &errors);
+    printf("lock-free  %14.0f  %6u\n", lock_free_ns, errors);
+    CHECK(errors == 0, "%u errors handing over through the lock-free queue", errors);
+    double locked_ns = run_handoff(1, &errors);
+    printf("mutex      %14.0f  %6u\n", locked_ns, errors);
+    CHECK(errors == 0, "%u errors handing over through the locked queue", errors);
+
+    double frames, refreshes;
+    printf("\nrefresh               frames/s  refreshes/s\n");
+    run_refresh(0, &frames, &refreshes);
+    printf("between frames        %8.0f  %11.0f\n", frames, refreshes);
+    run_refresh(1, &frames, &refreshes);
+    printf("thread of its own     %8.0f  %11.0f\n", frames, refreshes);
+    return test_result();
+}
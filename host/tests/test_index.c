@@ -0,0 +1,119 @@
+// Per frame cost of finding frames while parsing in order against fetching
+// them through the frame index, and what seeking to the last frame takes.
+// Frames fetched through the index have to be the ones read in order.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "gif_decoder.h"
+#include "test.h"
+
+#define INDEX_FRAMES 1024
+
+static gif_lzw_context_t lzw;
+
+static void print_index_benchmark(int count, char *filenames[]) {
+    static uint8_t data[1024 * 1024];
+    static uint8_t pixels[64 * 1024];
+    static uint8_t indexed_pixels[64 * 1024];
+    static gif_frame_index_t index[INDEX_FRAMES];
+
+    printf("gif            frames  keys  parse us  index us  seq us  indexed us  seek decodes\n");
+    for (int i = 0; i < count; i++) {
+        size_t size = test_read_file(filenames[i], data, sizeof(data));
+        const char *name = test_basename(filenames[i]);
+
+        gif_t gif = { .lzw = &lzw };
+        uint16_t frames;
+        if (gif_decoder_init(data, size, &gif) != GIF_OK) {
+            CHECK(0, "%s isn't a gif", name);
+            continue;
+        }
+        if (gif_decoder_index(&gif, index, INDEX_FRAMES, &frames) != GIF_OK) {
+            // Only for frames the decoder can't read either: interlaced ones
+            // and those with a local color table
+            frame_t frame = { .frame = pixels };
+            int read = 0;
+            gif_error_t res;
+            while ((res = gif_decoder_read_next_frame(&gif, &frame)) == GIF_OK) {
+                read++;
+            }
+            printf("%-14.14s can't be indexed, fails after %d frames in order\n", name, read);
+            CHECK(res != GIF_EOF, "%s can be read in order", name);
+            continue;
+        }
+        int keys = 0;
+        for (int n = 0; n < frames; n++) {
+            keys += index[n].key == n;
+        }
+        CHECK(frames > 0 && index[0].key == 0, "%s: %u frames, first key %u", name, frames, index[0].key);
+
+        // Every frame read through the index is the one read in order
+        frame_t frame = { .frame = pixels };
+        frame_t indexed = { .frame = indexed_pixels };
+        int read = 0;
+        int same = 1;
+        gif.frame_ptr = gif.first_frame;
+        while (gif_decoder_read_next_frame(&gif, &frame) == GIF_OK && read < frames) {
+            same &= gif_decoder_read_frame(&gif, &index[read], &indexed) == GIF_OK &&
+                    indexed.width == frame.width && indexed.height == frame.height &&
+                    indexed.offset_x == frame.offset_x && indexed.offset_y == frame.offset_y &&
+                    indexed.delay == frame.delay && indexed.disposal == frame.disposal &&
+                    memcmp(indexed.frame, frame.frame, frame.width * frame.height) == 0;
+            read++;
+        }
+        CHECK(read == frames, "%s: %d frames in order, %u indexed", name, read, frames);
+        CHECK(same, "%s: frames read through the index differ", name);
+
+        // Building the index walks the blocks exactly like reading in order
+        // does, without the decoding, so per frame it is the parse overhead
+        int passes = 0;
+        clock_t start = clock();
+        do {
+            gif_decoder_index(&gif, index, INDEX_FRAMES, &frames);
+            passes++;
+        } while (clock() - start < CLOCKS_PER_SEC / 20);
+        double parse_us = (double) (clock() - start) * 1e6 / CLOCKS_PER_SEC / passes / frames;
+
+        passes = 0;
+        start = clock();
+        do {
+            gif.frame_ptr = gif.first_frame;
+            while (gif_decoder_read_next_frame(&gif, &frame) == GIF_OK);
+            passes++;
+        } while (clock() - start < CLOCKS_PER_SEC / 20);
+        double sequential_us = (double) (clock() - start) * 1e6 / CLOCKS_PER_SEC / passes / frames;
+
+        passes = 0;
+        start = clock();
+        do {
+            for (int n = 0; n < frames; n++) {
+                gif_decoder_read_frame(&gif, &index[n], &frame);
+            }
+            passes++;
+        } while (clock() - start < CLOCKS_PER_SEC / 20);
+        double indexed_us = (double) (clock() - start) * 1e6 / CLOCKS_PER_SEC / passes / frames;
+
+        // The index lookup itself is an array access
+        passes = 0;
+        start = clock();
+        do {
+            volatile uint32_t sum = 0;
+            for (int n = 0; n < frames; n++) {
+                sum += index[n].descriptor;
+            }
+            passes++;
+        } while (clock() - start < CLOCKS_PER_SEC / 100);
+        double lookup_us = (double) (clock() - start) * 1e6 / CLOCKS_PER_SEC / passes / frames;
+
+        printf("%-14.14s %6u  %4d  %8.3f  %8.3f  %6.1f  %10.1f  %5u -> %u\n", name,
+               frames, keys, parse_us, lookup_us, sequential_us, indexed_us,
+               frames, frames - index[frames - 1].key);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    print_index_benchmark(argc - 1, argv + 1);
+    return test_result();
+}
@@ -0,0 +1,303 @@
+// Layers composed by compositor.c. Random stacks of layers in every blend
+// mode are drawn, changed and moved, after every composite the display has
+// to hold what blending every pixel a channel at a time gives. Then the
+// cost of composing the whole display from 1 to 4 layers, in SWAR and a
+// channel at a time, and of a frame where little or nothing changed.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "compositor.h"
+#include "framebuffer.h"
+#include "panel_model.h"
+#include "platform/platform.h"
+#include "test.h"
+
+#define LAYERS_ROUNDS 200
+
+static compositor_t compositor;
+
+static uint32_t random_u32(uint32_t *seed) {
+    *seed = *seed * 1664525u + 1013904223u;
+    return *seed >> 16 | (*seed * 1664525u + 1013904223u) >> 16 << 16;
+}
+
+static int channel_lerp(int dst, int src, int alpha) {
+    return dst + ((src - dst) * alpha >> 8);
+}
+
+// One pixel of a layer onto dst, a channel at a time
+static uint32_t reference_blend(const compositor_layer_t *layer, uint32_t dst, uint32_t src) {
+    int opacity = layer->opacity + (layer->opacity >> 7);
+    int alpha = opacity;
+    switch (layer->blend) {
+        case COMPOSITOR_BLEND_KEY:
+            if ((src & 0xffffff) == (layer->key & 0xffffff)) {
+                return dst;
+            }
+            // Fall through
+        case COMPOSITOR_BLEND_OPAQUE:
+            if (opacity == 256) {
+                return src;
+            }
+            break;
+        case COMPOSITOR_BLEND_ALPHA:
+            alpha = (int) ((src >> 24) + (src >> 31)) * opacity >> 8;
+            if (alpha == 0) {
+                return dst;
+            }
+            if (alpha == 256) {
+                return src & 0xffffff;
+            }
+            break;
+        default:
+            break;
+    }
+
+    uint32_t color = 0;
+    for (int shift = 0; shift < 24; shift += 8) {
+        int d = dst >> shift & 0xff;
+        int s = src >> shift & 0xff;
+        int c;
+        if (layer->blend == COMPOSITOR_BLEND_ADD) {
+            c = d + (s * opacity >> 8);
+            c = c > 255 ? 255 : c;
+        } else {
+            c = channel_lerp(d, s, alpha);
+        }
+        color |= (uint32_t) c << shift;
+    }
+    return color;
+}
+
+static uint32_t reference_pixel(const compositor_t *layers, int x, int y) {
+    uint32_t color = 0;
+    for (int i = 0; i < COMPOSITOR_LAYERS; i++) {
+        const compositor_layer_t *layer = &layers->layers[i];
+        if (layer->pixels == NULL || !layer->visible || layer->opacity == 0 || x < layer->x || y < layer->y ||
+                x >= layer->x + layer->width || y >= layer->y + layer->height) {
+            continue;
+        }
+        color = reference_blend(layer, color, layer->pixels[(y - layer->y) * layer->width + x - layer->x]);
+    }
+    return color;
+}
+
+static void random_pixels(compositor_layer_t *layer, uint32_t *seed, int x0, int y0, int x1, int y1) {
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+            uint32_t color = random_u32(seed);
+            // Plenty of fully transparent, fully opaque and key pixels
+            switch (color >> 29) {
+                case 0: color &= 0xffffff; break;
+                case 1: color |= 0xff000000; break;
+                case 2: color = layer->key | (color & 0xff000000); break;
+                default: break;
+            }
+            layer->pixels[y * layer->width + x] = color;
+        }
+    }
+}
+
+static void check_layers(void) {
+    platform_host_set_gpio_hook(NULL);
+    framebuffer_config_t config = panel_config;
+    config.dither = 1; // Keeps the colors drawn in colors
+    framebuffer_t framebuffer;
+    if (framebuffer_init(config, &framebuffer) != FRAMEBUFFER_OK ||
+            compositor_init(&compositor, framebuffer.width, framebuffer.height) != COMPOSITOR_OK) {
+        CHECK(0, "framebuffer can't be set up");
+        return;
+    }
+    int width = framebuffer.width;
+    int height = framebuffer.height;
+
+    uint32_t seed = 1;
+    int errors = 0;
+    int composites = 0;
+    int unchanged = 0;
+    for (int round = 0; round < LAYERS_ROUNDS; round++) {
+        compositor_lock(&compositor);
+        if (round % 20 == 0) {
+            // A new stack of layers from a quarter to twice the display
+            for (int i = 0; i < COMPOSITOR_LAYERS; i++) {
+                int w = width / 4 + random_u32(&seed) % (width * 7 / 4);
+                int h = height / 4 + random_u32(&seed) % (height * 7 / 4);
+                compositor_layer_init(&compositor, i, w, h, random_u32(&seed) % 4);
+                compositor_layer_t *layer = compositor_get_layer(&compositor, i);
+                compositor_layer_set_blend(&compositor, i, layer->blend, random_u32(&seed) & 0xffffff);
+                random_pixels(layer, &seed, 0, 0, w, h);
+                compositor_layer_move(&compositor, i, (int) (random_u32(&seed) % width) - w / 2,
+                                      (int) (random_u32(&seed) % height) - h / 2);
+            }
+        }
+
+        // Change one thing about a random layer
+        int i = random_u32(&seed) % COMPOSITOR_LAYERS;
+        compositor_layer_t *layer = compositor_get_layer(&compositor, i);
+        uint32_t r = random_u32(&seed);
+        switch (round % 6) {
+            case 0: {
+                int x = r % layer->width;
+                int y = (r >> 8) % layer->height;
+                int x1 = x + 1 + (int) (r >> 16 & 7) < layer->width ? x + 1 + (int) (r >> 16 & 7) : layer->width;
+                int y1 = y + 1 + (int) (r >> 20 & 7) < layer->height ? y + 1 + (int) (r >> 20 & 7) : layer->height;
+                random_pixels(layer, &seed, x, y, x1, y1);
+                compositor_layer_damage(&compositor, i, x, y, x1 - x, y1 - y);
+                break;
+            }
+            case 1:
+                compositor_layer_move(&compositor, i, layer->x + (int) (r % 7) - 3, layer->y + (int) (r >> 8 & 7) - 3);
+                break;
+            case 2: {
+                // Mostly full or no opacity, those take shortcuts
+                static const int opacities[] = { 0, 255, 255, 1, 128, 254 };
+                compositor_layer_set_opacity(&compositor, i, r % 2 ? opacities[r % 6] : (int) (r >> 8 & 0xff));
+                break;
+            }
+            case 3:
+                compositor_layer_set_blend(&compositor, i, r % 4, layer->key);
+                break;
+            case 4:
+                compositor_layer_show(&compositor, i, !layer->visible);
+                break;
+            default:
+                // Nothing changed
+                break;
+        }
+
+        while (framebuffer_begin(&framebuffer) != FRAMEBUFFER_OK) {
+            for (int s = 0; s < framebuffer.slice_count; s++) {
+                framebuffer_sync(&framebuffer);
+            }
+        }
+        int res = compositor_draw(&compositor, &framebuffer);
+        composites += res == COMPOSITOR_OK;
+        unchanged += res == COMPOSITOR_UNCHANGED;
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                errors += framebuffer.colors[y * width + x] != reference_pixel(&compositor, x, y);
+            }
+        }
+        framebuffer_commit(&framebuffer);
+        compositor_unlock(&compositor);
+    }
+
+    printf("%d rounds, %d composites, %d unchanged, %d pixels off  %s\n", LAYERS_ROUNDS, composites, unchanged,
+           errors, errors == 0 ? "ok" : "NO");
+    CHECK(errors == 0, "%d pixels off", errors);
+    CHECK(composites > 0 && unchanged > 0, "%d composites, %d unchanged", composites, unchanged);
+}
+
+// The same composite as compositor_draw(), a channel at a time
+static void reference_draw(const compositor_t *layers, framebuffer_t *framebuffer, uint32_t *line) {
+    for (int y = 0; y < framebuffer->height; y++) {
+        for (int x = 0; x < framebuffer->width; x++) {
+            line[x] = reference_pixel(layers, x, y);
+        }
+        framebuffer_drawrow(framebuffer, 0, y, line, framebuffer->width);
+    }
+}
+
+static void print_layers_cost(void) {
+    static const struct {
+        int w, h, scan, chain;
+    } geometries[] = { { 32, 16, 8, 1 }, { 64, 64, 32, 2 } };
+    // Bottom first, every layer covers the whole display
+    static const struct {
+        const char *name;
+        int blend;
+        int opacity;
+    } stack[COMPOSITOR_LAYERS] = {
+            { "opaque", COMPOSITOR_BLEND_OPAQUE, 255 },
+            { "alpha", COMPOSITOR_BLEND_ALPHA, 255 },
+            { "add", COMPOSITOR_BLEND_ADD, 128 },
+            { "key", COMPOSITOR_BLEND_KEY, 192 },
+    };
+
+    printf("\npanel   layers  top     host swar us  per channel us  8x8 change us  unchanged us  layer rows\n");
+    platform_host_set_gpio_hook(NULL);
+    for (int g = 0; g < COUNT_OF(geometries); g++) {
+        framebuffer_config_t config = panel_config;
+        config.w = geometries[g].w;
+        config.h = geometries[g].h;
+        config.scan = geometries[g].scan;
+        config.chain = geometries[g].chain;
+        config.pin_d = 17;
+        config.pin_e = 23;
+        framebuffer_t framebuffer;
+        if (framebuffer_init(config, &framebuffer) != FRAMEBUFFER_OK) {
+            continue;
+        }
+        framebuffer_begin(&framebuffer);
+        int width = framebuffer.width;
+        int height = framebuffer.height;
+        uint32_t *line = malloc(width * sizeof(uint32_t));
+
+        for (int count = 1; count <= COMPOSITOR_LAYERS; count++) {
+            compositor_t layers;
+            compositor_init(&layers, width, height);
+            uint32_t seed = 1;
+            for (int i = 0; i < count; i++) {
+                compositor_layer_init(&layers, i, width, height, stack[i].blend);
+                compositor_layer_set_opacity(&layers, i, stack[i].opacity);
+                compositor_layer_t *layer = compositor_get_layer(&layers, i);
+                random_pixels(layer, &seed, 0, 0, width, height);
+            }
+
+            // The whole display changes every frame
+            int frames = 0;
+            clock_t start = clock();
+            do {
+                compositor_layer_damage(&layers, count - 1, 0, 0, width, height);
+                compositor_draw(&layers, &framebuffer);
+                frames++;
+            } while (clock() - start < CLOCKS_PER_SEC / 10);
+            double swar_us = (double) (clock() - start) * 1e6 / CLOCKS_PER_SEC / frames;
+            uint32_t rows = layers.layers_blended / frames;
+            // Only the opaque bottom layer covers, every layer takes part
+            CHECK(rows == (uint32_t) (count * height), "%d layers blended %u rows", count, rows);
+
+            frames = 0;
+            start = clock();
+            do {
+                reference_draw(&layers, &framebuffer, line);
+                frames++;
+            } while (clock() - start < CLOCKS_PER_SEC / 10);
+            double reference_us = (double) (clock() - start) * 1e6 / CLOCKS_PER_SEC / frames;
+
+            // An 8x8 block of the top layer changes
+            frames = 0;
+            start = clock();
+            do {
+                compositor_layer_damage(&layers, count - 1, frames * 8 % width, frames * 8 / width * 8 % height, 8, 8);
+                compositor_draw(&layers, &framebuffer);
+                frames++;
+            } while (clock() - start < CLOCKS_PER_SEC / 10);
+            double block_us = (double) (clock() - start) * 1e6 / CLOCKS_PER_SEC / frames;
+
+            frames = 0;
+            start = clock();
+            do {
+                compositor_draw(&layers, &framebuffer);
+                frames++;
+            } while (clock() - start < CLOCKS_PER_SEC / 20);
+            double unchanged_us = (double) (clock() - start) * 1e6 / CLOCKS_PER_SEC / frames;
+
+            printf("%3dx%-3d  %6d  %-6s  %12.2f  %14.2f  %13.2f  %12.3f  %10u\n", width, height, count,
+                   stack[count - 1].name, swar_us, reference_us, block_us, unchanged_us, rows);
+            for (int i = 0; i < count; i++) {
+                free(layers.layers[i].pixels);
+            }
+            free(layers.line);
+        }
+        free(line);
+    }
+}
+
+int main(void) {
+    check_layers();
+    print_layers_cost();
+    return test_result();
+}
@@ -0,0 +1,205 @@
+// The LZW decoder against the one it replaced, see lzw_reference.c. The
+// image data of every frame is found by walking the blocks of the gif, so
+// interlaced frames the decoder can't show are compared as well. Every
+// frame has to decode to the same bytes with and without the checks as
+// with the old decoder, then the time each of them takes per frame.
+// Last the stack each decoder needs: every one runs on a thread of its own
+// with a painted stack, the deepest byte that changed is how much it used.
+//
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "gif_lzw_decompress.h"
+#include "lzw_reference.h"
+#include "test.h"
+
+#define LZW_FRAMES 1024
+#define LZW_PIXELS (256 * 1024)
+#define LZW_STACK_SIZE (128 * 1024)
+#define LZW_STACK_PAINT 0xa5
+// Deepest the current decoders may go. The old one had its table on the
+// stack, any table would be 16 KB. Sanitizers make the frames a few KB.
+#define LZW_STACK_LIMIT 4096
+
+typedef struct {
+    uint8_t *data; // LZW minimum code size
+    const uint8_t *end;
+    size_t size;   // Pixels
+} lzw_frame_t;
+
+typedef struct {
+    int decoder;
+    lzw_frame_t *frames;
+    int count;
+    uint8_t *top; // Frame of decode(), where the stack of the decoders starts
+} lzw_run_t;
+
+static gif_lzw_context_t lzw;
+static uint8_t data[1024 * 1024];
+static lzw_frame_t frames[LZW_FRAMES];
+static uint8_t stack[LZW_STACK_SIZE] __attribute__((aligned(64)));
+// The old decoder writes whole strings, give it room past the frame
+static uint8_t reference[LZW_PIXELS + 4096];
+static uint8_t checked[LZW_PIXELS];
+static uint8_t trusted[LZW_PIXELS];
+
+// Sub-blocks up to and including the terminator, NULL past end
+static uint8_t *skip_sub_blocks(uint8_t *ptr, const uint8_t *end) {
+    while (ptr < end && *ptr != 0) {
+        ptr += *ptr + 1;
+    }
+    return ptr < end ? ptr + 1 : NULL;
+}
+
+static int find_frames(uint8_t *gif, size_t size, lzw_frame_t *frames) {
+    const uint8_t *end = gif + size;
+    if (size < 13 || memcmp(gif, "GIF", 3) != 0) {
+        return 0;
+    }
+    uint8_t *ptr = gif + 13;
+    if (gif[10] & 0x80) {
+        ptr += 3 << ((gif[10] & 0x7) + 1);
+    }
+
+    int count = 0;
+    while (ptr != NULL && ptr < end && count < LZW_FRAMES) {
+        if (*ptr == 0x21 && ptr + 2 < end) {
+            ptr = skip_sub_blocks(ptr + 2, end);
+        } else if (*ptr == 0x2c && ptr + 11 < end) {
+            uint16_t width = ptr[5] | ptr[6] << 8;
+            uint16_t height = ptr[7] | ptr[8] << 8;
+            uint8_t flags = ptr[9];
+            ptr += 10;
+            if (flags & 0x80) {
+                ptr += 3 << ((flags & 0x7) + 1);
+            }
+            if (ptr >= end) {
+                break;
+            }
+            uint8_t *data = ptr;
+            ptr = skip_sub_blocks(ptr + 1, end);
+            if (ptr != NULL) {
+                frames[count++] = (lzw_frame_t) { data, ptr, (size_t) width * height };
+            }
+        } else {
+            break;
+        }
+    }
+    return count;
+}
+
+// Every frame with one decoder, 0 is the old one, then checked and trusted
+static void *decode(void *context) {
+    lzw_run_t *run = context;
+    run->top = __builtin_frame_address(0);
+    for (int n = 0; n < run->count; n++) {
+        lzw_frame_t *frame = &run->frames[n];
+        if (run->decoder == 0) {
+            lzw_reference_decode(frame->data, reference);
+        } else if (run->decoder == 1) {
+            gif_decoder_read_image_data(&lzw, frame->data, frame->end, checked, frame->size);
+        } else {
+            gif_decoder_read_image_data_trusted(&lzw, frame->data, trusted);
+        }
+    }
+    return NULL;
+}
+
+// Bytes of stack decode() used below its own frame, on a thread of its own
+static size_t stack_used(lzw_run_t *run) {
+    memset(stack, LZW_STACK_PAINT, sizeof(stack));
+    pthread_attr_t attr;
+    pthread_t thread;
+    pthread_attr_init(&attr);
+    pthread_attr_setstack(&attr, stack, sizeof(stack));
+    int started = pthread_create(&thread, &attr, decode, run) == 0;
+    pthread_attr_destroy(&attr);
+    if (!started) {
+        return sizeof(stack);
+    }
+    pthread_join(thread, NULL);
+
+    size_t untouched = 0;
+    while (untouched < sizeof(stack) && stack[untouched] == LZW_STACK_PAINT) {
+        untouched++;
+    }
+    return run->top - (stack + untouched);
+}
+
+static void check_lzw(int count, char *filenames[]) {
+    printf("gif            frames  old us  checked us  trusted us  speedup  result\n");
+    for (int i = 0; i < count; i++) {
+        size_t size = test_read_file(filenames[i], data, sizeof(data));
+        const char *name = test_basename(filenames[i]);
+        int frame_count = find_frames(data, size, frames);
+        CHECK(frame_count > 0, "%s has no frames", name);
+
+        int different = 0;
+        for (int n = 0; n < frame_count; n++) {
+            lzw_frame_t *frame = &frames[n];
+            if (frame->size > LZW_PIXELS) {
+                CHECK(0, "%s frame %d is too large", name, n);
+                frame_count = n;
+                break;
+            }
+            memset(reference, 0, frame->size);
+            memset(checked, 0, frame->size);
+            memset(trusted, 0, frame->size);
+            int reference_ok = lzw_reference_decode(frame->data, reference) == LZW_REFERENCE_OK;
+            int checked_ok = gif_decoder_read_image_data(&lzw, frame->data, frame->end, checked, frame->size) ==
+                             GIF_LZW_OK;
+            gif_decoder_read_image_data_trusted(&lzw, frame->data, trusted);
+            different += !reference_ok || !checked_ok ||
+                         memcmp(reference, checked, frame->size) != 0 ||
+                         memcmp(reference, trusted, frame->size) != 0;
+        }
+        CHECK(different == 0, "%s: %d frames decode differently", name, different);
+
+        double frame_us[3];
+        for (int decoder = 0; decoder < 3; decoder++) {
+            int passes = 0;
+            clock_t start = clock();
+            do {
+                decode(&(lzw_run_t) { decoder, frames, frame_count, NULL });
+                passes++;
+            } while (clock() - start < CLOCKS_PER_SEC / 20);
+            frame_us[decoder] = (double) (clock() - start) * 1e6 / CLOCKS_PER_SEC / passes / frame_count;
+        }
+
+        printf("%-14.14s %6d  %6.1f  %10.1f  %10.1f  %6.2fx  %s\n", name, frame_count, frame_us[0], frame_us[1],
+               frame_us[2], frame_us[0] / frame_us[2], different == 0 ? "same" : "DIFFERENT");
+    }
+}
+
+static void check_stack(int count, char *filenames[]) {
+    CHECK(sizeof(gif_lzw_context_t) == GIF_LZW_TABLE_SIZE * sizeof(uint32_t),
+          "the LZW context is %zu bytes", sizeof(gif_lzw_context_t));
+
+    size_t deepest[3] = { 0 };
+    for (int i = 0; i < count; i++) {
+        size_t size = test_read_file(filenames[i], data, sizeof(data));
+        int frame_count = find_frames(data, size, frames);
+        for (int n = 0; n < frame_count; n++) {
+            if (frames[n].size > LZW_PIXELS) {
+                frame_count = n;
+            }
+        }
+        for (int decoder = 0; decoder < 3; decoder++) {
+            size_t used = stack_used(&(lzw_run_t) { decoder, frames, frame_count, NULL });
+            deepest[decoder] = used > deepest[decoder] ? used : deepest[decoder];
+        }
+    }
+
+    printf("stack in bytes: old %zu, checked %zu, trusted %zu, context %zu\n", deepest[0], deepest[1], deepest[2],
+           sizeof(gif_lzw_context_t));
+    CHECK(deepest[1] <= LZW_STACK_LIMIT && deepest[2] <= LZW_STACK_LIMIT,
+          "the decoder uses %zu bytes of stack", deepest[1] > deepest[2] ? deepest[1] : deepest[2]);
+}
+
+int main(int argc, char *argv[]) {
+    check_lzw(argc - 1, argv + 1);
+    check_stack(argc - 1, argv + 1);
+    return test_result();
+}
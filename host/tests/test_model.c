@@ -0,0 +1,183 @@
+// Refresh rates the scan engine reaches against what hub75_refresh_model()
+// predicts, for common panels and chains, and the memory and scan cost of
+// the storage formats.
+//
+
+#include <stdio.h>
+#include <time.h>
+#include "framebuffer.h"
+#include "hub75_stream.h"
+#include "panel_model.h"
+#include "platform/platform.h"
+#include "test.h"
+
+// Predicted refresh rates on the pico for a range of depth and slice settings
+// Deeper planes and shorter slices can only cost refresh rate, and the PIO
+// always outruns bit-banging
+static void print_refresh_model(void) {
+    static const int depths[] = { 8, 7, 6, 5, 4 };
+    static const int slice_lengths[] = { 256, 64, 32, 16, 8 };
+    hub75_timing_t pio = hub75_pio_timing(125);
+    hub75_timing_t bitbang = hub75_bitbang_timing(125);
+
+    printf("depth  slice  slices    pio Hz  bit-bang Hz\n");
+    double deeper_hz = 0;
+    for (int d = 0; d < COUNT_OF(depths); d++) {
+        double longer_hz = 1e9;
+        for (int s = 0; s < COUNT_OF(slice_lengths); s++) {
+            framebuffer_config_t config = panel_config;
+            config.depth = depths[d];
+            config.slice_us = slice_lengths[s];
+            framebuffer_slice_t slices[FRAMEBUFFER_MAX_SLICES];
+            int count = hub75_build_schedule(&config, slices);
+            CHECK(count > 0, "depth %d, slice %d us", depths[d], slice_lengths[s]);
+            if (count <= 0) {
+                continue;
+            }
+            double pio_hz = hub75_refresh_model(&config, slices, count, &pio);
+            double bitbang_hz = hub75_refresh_model(&config, slices, count, &bitbang);
+            printf("%5d  %5d  %6d  %8.1f  %11.1f\n", depths[d], slice_lengths[s], count, pio_hz, bitbang_hz);
+            CHECK(pio_hz >= bitbang_hz && bitbang_hz > 0, "depth %d, slice %d us", depths[d], slice_lengths[s]);
+            CHECK(pio_hz <= longer_hz && pio_hz > deeper_hz, "depth %d, slice %d us", depths[d], slice_lengths[s]);
+            longer_hz = pio_hz;
+        }
+        deeper_hz = longer_hz;
+    }
+}
+
+// Refresh rate against pixel count for common panels and chains. The host
+// column runs the bit-banged scan on the virtual clock, which only counts
+// the time rows are lit, and has to come out at the host model.
+static void print_geometry_benchmark(void) {
+    static const struct {
+        int w, h, scan, chain;
+    } geometries[] = {
+            { 32, 16, 8, 1 }, { 32, 16, 8, 4 },
+            { 64, 32, 16, 1 }, { 64, 32, 16, 2 },
+            { 64, 64, 32, 1 }, { 64, 64, 32, 2 }, { 64, 64, 32, 4 },
+    };
+    hub75_timing_t pio = hub75_pio_timing(125);
+    hub75_timing_t bitbang = hub75_bitbang_timing(125);
+    hub75_timing_t host = { platform_cycles_per_us(), 0, 0, 0 };
+
+    printf("\npanel     scan  chain  pixels  buffers KB    pio Hz  bit-bang Hz   host Hz\n");
+    platform_host_set_gpio_hook(NULL);
+    for (int i = 0; i < COUNT_OF(geometries); i++) {
+        framebuffer_config_t config = panel_config;
+        config.w = geometries[i].w;
+        config.h = geometries[i].h;
+        config.scan = geometries[i].scan;
+        config.chain = geometries[i].chain;
+        config.pin_d = 17;
+        config.pin_e = 23;
+
+        framebuffer_t framebuffer;
+        if (framebuffer_init(config, &framebuffer) != FRAMEBUFFER_OK) {
+            printf("%2dx%-2d  1/%-2d  %5d  unsupported\n", config.w, config.h, config.scan, config.chain);
+            CHECK(0, "%dx%d 1/%d scan can't be set up", config.w, config.h, config.scan);
+            continue;
+        }
+        // Time whole cycles, from the start of one to the start of another
+        uint32_t start_count = framebuffer.refresh_count;
+        while (framebuffer.refresh_count == start_count) {
+            framebuffer_sync(&framebuffer);
+        }
+        uint64_t start_us = platform_time_us();
+        start_count = framebuffer.refresh_count;
+        while (framebuffer.refresh_count - start_count < 20) {
+            framebuffer_sync(&framebuffer);
+        }
+        double host_hz = (framebuffer.refresh_count - start_count) * 1e6 / (platform_time_us() - start_us);
+
+        double model_hz = hub75_refresh_model(&config, framebuffer.slices, framebuffer.slice_count, &host);
+        int pixels = framebuffer.width * framebuffer.height;
+        printf("%2dx%-2d     1/%-2d  %5d  %6d  %10zu  %8.1f  %11.1f  %8.1f  (model %.1f)\n",
+               config.w, config.h, config.scan, config.chain, pixels,
+               FRAMEBUFFER_BUFFERS * framebuffer.buffer_size / 1024,
+               hub75_refresh_model(&config, framebuffer.slices, framebuffer.slice_count, &pio),
+               hub75_refresh_model(&config, framebuffer.slices, framebuffer.slice_count, &bitbang),
+               host_hz, model_hz);
+        CHECK(host_hz > model_hz * 0.99 && host_hz < model_hz * 1.01, "%dx%d chain %d at %.1f Hz",
+              config.w, config.h, config.chain, host_hz);
+        CHECK(framebuffer.width == config.w * config.chain && framebuffer.height == config.h,
+              "%dx%d chain %d", config.w, config.h, config.chain);
+    }
+}
+
+// Memory and scan cost of the storage formats. DMA is the data the PIO
+// path streams per BCM cycle, the host columns time the bit-banged
+// scan reading a full cycle and drawing every pixel once. Packing has to
+// take less memory than a word per pixel at every depth.
+static void print_format_comparison(void) {
+    static const struct {
+        int w, h, scan, chain;
+    } geometries[] = { { 32, 16, 8, 1 }, { 64, 64, 32, 2 } };
+    static const int formats[] = { FRAMEBUFFER_FORMAT_WORD, FRAMEBUFFER_FORMAT_PACKED };
+    static const int depths[] = { 8, 6, 5 };
+
+    printf("\npanel     chain  format  depth  buffer KB  buffers KB  DMA KB/cycle  host scan us  host draw us\n");
+    platform_host_set_gpio_hook(NULL);
+    for (int g = 0; g < COUNT_OF(geometries); g++) {
+        size_t word_size[COUNT_OF(depths)];
+        for (int f = 0; f < COUNT_OF(formats); f++) {
+            for (int d = 0; d < COUNT_OF(depths); d++) {
+                framebuffer_config_t config = panel_config;
+                config.w = geometries[g].w;
+                config.h = geometries[g].h;
+                config.scan = geometries[g].scan;
+                config.chain = geometries[g].chain;
+                config.pin_d = 17;
+                config.pin_e = 23;
+                config.format = formats[f];
+                config.depth = depths[d];
+
+                framebuffer_t framebuffer;
+                if (framebuffer_init(config, &framebuffer) != FRAMEBUFFER_OK) {
+                    CHECK(0, "%dx%d format %d depth %d can't be set up", config.w, config.h, formats[f], depths[d]);
+                    continue;
+                }
+                if (formats[f] == FRAMEBUFFER_FORMAT_WORD) {
+                    word_size[d] = framebuffer.buffer_size;
+                } else {
+                    CHECK(framebuffer.buffer_size < word_size[d], "%dx%d depth %d packed in %zu bytes",
+                          config.w, config.h, depths[d], framebuffer.buffer_size);
+                }
+
+                clock_t start = clock();
+                int cycles = 0;
+                do {
+                    for (int i = 0; i < framebuffer.slice_count; i++) {
+                        framebuffer_sync(&framebuffer);
+                    }
+                    cycles++;
+                } while (clock() - start < CLOCKS_PER_SEC / 20);
+                double scan_us = (double) (clock() - start) * 1e6 / CLOCKS_PER_SEC / cycles;
+
+                start = clock();
+                int frames = 0;
+                do {
+                    for (int y = 0; y < framebuffer.height; y++) {
+                        for (int x = 0; x < framebuffer.width; x++) {
+                            framebuffer_drawpixel(&framebuffer, x, y, x * 0x010203 + y * 0x030201 + frames);
+                        }
+                    }
+                    frames++;
+                } while (clock() - start < CLOCKS_PER_SEC / 20);
+                double draw_us = (double) (clock() - start) * 1e6 / CLOCKS_PER_SEC / frames;
+
+                printf("%2dx%-2d     %5d  %-6s  %5d  %9.1f  %10.1f  %12.1f  %12.1f  %12.1f\n",
+                       config.w, config.h, config.chain, formats[f] == FRAMEBUFFER_FORMAT_PACKED ? "packed" : "word",
+                       depths[d], framebuffer.buffer_size / 1024.0,
+                       FRAMEBUFFER_BUFFERS * framebuffer.buffer_size / 1024.0,
+                       framebuffer.slice_count * framebuffer.plane_size / 1024.0, scan_us, draw_us);
+            }
+        }
+    }
+}
+
+int main(void) {
+    print_refresh_model();
+    print_geometry_benchmark();
+    print_format_comparison();
+    return test_result();
+}
@@ -0,0 +1,119 @@
+// Color conversion once per palette against once per pixel. Every frame of
+// every gif is put through the pixel loop of gif_animation both ways: with
+// the gamma curve worked out for every channel of every pixel, the way it
+// was done before palette.c, and with one load from the converted palette.
+// Both are timed for the colors alone and with framebuffer_drawpixel().
+// With the default curve and white balance the palette has to give the
+// same colors as the per pixel curve.
+//
+
+#include <stdio.h>
+#include <time.h>
+#include "animations/palette.h"
+#include "framebuffer.h"
+#include "gif_decoder.h"
+#include "panel_model.h"
+#include "test.h"
+
+#define PALETTE_FRAMES 64
+#define PALETTE_BENCH_CLOCKS (CLOCKS_PER_SEC / 50)
+
+static gif_lzw_context_t lzw;
+static framebuffer_t fb;
+static uint8_t pixels[PALETTE_FRAMES][64 * 1024];
+static frame_t frames[PALETTE_FRAMES];
+static volatile uint32_t sink;
+
+static inline uint8_t gamma_correct(uint8_t value) {
+    return (value * value) / 256;
+}
+
+static uint32_t pixel_gamma(const uint8_t *color_table, uint8_t index) {
+    const uint8_t *rgb = color_table + index * 3;
+    return gamma_correct(rgb[0]) << 16 | gamma_correct(rgb[1]) << 8 | gamma_correct(rgb[2]);
+}
+
+// Microseconds per frame for the pixel loop, table or not, drawn or not
+static double time_frames(int count, const uint8_t *color_table, const uint32_t *colors, int draw) {
+    int passes = 0;
+    clock_t start = clock();
+    do {
+        uint32_t sum = 0;
+        for (int n = 0; n < count; n++) {
+            const frame_t *frame = &frames[n];
+            if (draw) {
+                framebuffer_begin(&fb);
+            }
+            for (int y = 0; y < frame->height; y++) {
+                const uint8_t *row = frame->frame + y * frame->width;
+                for (int x = 0; x < frame->width; x++) {
+                    uint32_t color = colors != NULL ? colors[row[x]] & 0xffffff : pixel_gamma(color_table, row[x]);
+                    if (draw) {
+                        framebuffer_drawpixel(&fb, x + frame->offset_x, y + frame->offset_y, color);
+                    } else {
+                        sum += color;
+                    }
+                }
+            }
+        }
+        sink = sum;
+        passes++;
+    } while (clock() - start < PALETTE_BENCH_CLOCKS);
+    return (double) (clock() - start) * 1e6 / CLOCKS_PER_SEC / passes / count;
+}
+
+static void check_palettes(int count, char *filenames[]) {
+    static uint8_t data[1024 * 1024];
+    static uint32_t colors[PALETTE_SIZE];
+
+    printf("gif             frames  color us  table us  drawn us  drawn table us  colors off\n");
+    for (int i = 0; i < count; i++) {
+        size_t size = test_read_file(filenames[i], data, sizeof(data));
+        const char *name = test_basename(filenames[i]);
+        gif_t gif = { .lzw = &lzw };
+        if (gif_decoder_init(data, size, &gif) != GIF_OK || (size_t) gif.width * gif.height > sizeof(pixels[0])) {
+            printf("%-14.14s can't be decoded\n", name);
+            continue;
+        }
+
+        int decoded = 0;
+        while (decoded < PALETTE_FRAMES) {
+            frames[decoded].frame = pixels[decoded];
+            if (gif_decoder_read_next_frame(&gif, &frames[decoded]) != GIF_OK) {
+                break;
+            }
+            decoded++;
+        }
+        if (decoded == 0) {
+            printf("%-14.14s doesn't decode\n", name);
+            continue;
+        }
+
+        palette_convert(gif.global_ct, gif.ct_size, colors);
+        int off = 0;
+        for (int c = 0; c < gif.ct_size; c++) {
+            off += (colors[c] & 0xffffff) != pixel_gamma(gif.global_ct, c);
+        }
+        CHECK(off == 0, "%s: %d palette colors differ from the per pixel curve", name, off);
+
+        double color_us = time_frames(decoded, gif.global_ct, NULL, 0);
+        double table_us = time_frames(decoded, gif.global_ct, colors, 0);
+        double drawn_us = time_frames(decoded, gif.global_ct, NULL, 1);
+        double drawn_table_us = time_frames(decoded, gif.global_ct, colors, 1);
+        printf("%-14.14s  %6d  %8.2f  %8.2f  %8.2f  %14.2f  %10d\n", name, decoded, color_us, table_us, drawn_us,
+               drawn_table_us, off);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    framebuffer_config_t config = panel_config;
+    config.dither = 0;
+    if (framebuffer_init(config, &fb) != FRAMEBUFFER_OK) {
+        CHECK(0, "framebuffer can't be set up");
+        return test_result();
+    }
+    palette_set_gamma(PALETTE_GAMMA_SQUARE);
+    palette_set_white_balance(255, 255, 255);
+    check_palettes(argc - 1, argv + 1);
+    return test_result();
+}
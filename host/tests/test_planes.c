@@ -0,0 +1,234 @@
+// The bit-plane encoding against extracting the bits of every pixel at
+// scan-out, the way framebuffer_sync() worked when the buffer held plain
+// 0x00RRGGBB pixels. Random frames are drawn pixel by pixel, as spans and
+// as rows. Every plane word of the buffer and every column shifted out in
+// a full BCM cycle has to hold the GPIO bits the per-pixel extraction
+// gives. Then the cost of a scan-out pass over one plane both ways.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "framebuffer.h"
+#include "hub75_stream.h"
+#include "panel_model.h"
+#include "platform/platform.h"
+#include "test.h"
+
+#define MAX_ROWS (2 * FRAMEBUFFER_MAX_ROWS)
+#define MAX_COLUMNS 256
+
+static framebuffer_t fb;
+
+// Colors by panel row, 0 to twice the row addresses, and chain column
+static uint32_t colors[MAX_ROWS][MAX_COLUMNS];
+
+// Data pins at every rising edge of CLK
+static uint32_t clocked[MAX_ROWS * MAX_COLUMNS];
+static int clocked_count;
+static uint32_t data_mask;
+static uint32_t last_clk;
+
+static void clock_hook(uint32_t gpio, uint64_t time_us) {
+    (void) time_us;
+    uint32_t clk = gpio >> fb.config.pin_clk & 0x1;
+    if (clk && !last_clk && clocked_count < MAX_ROWS * MAX_COLUMNS) {
+        clocked[clocked_count++] = gpio & data_mask;
+    }
+    last_clk = clk;
+}
+
+static uint32_t random_u32(uint32_t *seed) {
+    *seed = *seed * 1664525u + 1013904223u;
+    return *seed >> 16 | (*seed * 1664525u + 1013904223u) >> 16 << 16;
+}
+
+// GPIO state of the data pins for a column of a row pair in a plane
+static uint32_t extract_bits(const framebuffer_config_t *config, int plane, int row, int column, int rows) {
+    uint32_t top = colors[row][column];
+    uint32_t bottom = colors[row + rows][column];
+    return (top >> (16 + plane) & 0x1) << config->pin_r0 |
+           (top >> (8 + plane) & 0x1) << config->pin_g0 |
+           (top >> plane & 0x1) << config->pin_b0 |
+           (bottom >> (16 + plane) & 0x1) << config->pin_r1 |
+           (bottom >> (8 + plane) & 0x1) << config->pin_g1 |
+           (bottom >> plane & 0x1) << config->pin_b1;
+}
+
+// One plane the old way, from pixels kept by panel position
+static void scan_pixels(const framebuffer_config_t *config, int plane, int rows, int columns) {
+    for (int y = 0; y < rows; y++) {
+        for (int x = 0; x < columns; x++) {
+            platform_gpio_clr_mask(data_mask);
+            platform_gpio_set_mask(extract_bits(config, plane, y, x, rows));
+            platform_gpio_put(config->pin_clk, 1);
+            platform_gpio_put(config->pin_clk, 0);
+        }
+        platform_gpio_put(config->pin_lat, 1);
+        platform_gpio_put(config->pin_lat, 0);
+    }
+}
+
+static void draw_random_frame(int path, uint32_t *seed) {
+    uint32_t palette[256];
+    for (int i = 0; i < 256; i++) {
+        palette[i] = random_u32(seed) & 0xffffff;
+    }
+    framebuffer_begin(&fb);
+    for (int y = 0; y < fb.height; y++) {
+        uint32_t row[MAX_COLUMNS];
+        uint8_t indices[MAX_COLUMNS];
+        for (int x = 0; x < fb.width; x++) {
+            indices[x] = random_u32(seed);
+            row[x] = path == 1 ? palette[indices[x]] : random_u32(seed) & 0xffffff;
+            int column, panel_row;
+            hub75_map_pixel(&fb.config, x, y, &column, &panel_row);
+            colors[panel_row][column] = row[x];
+        }
+        if (path == 0) {
+            for (int x = 0; x < fb.width; x++) {
+                framebuffer_drawpixel(&fb, x, y, row[x]);
+            }
+        } else if (path == 1) {
+            framebuffer_drawspan(&fb, 0, y, indices, fb.width, palette);
+        } else {
+            framebuffer_drawrow(&fb, 0, y, row, fb.width);
+        }
+    }
+    framebuffer_commit(&fb);
+}
+
+// Every column of every plane in the committed buffer
+static int check_buffer(void) {
+    int errors = 0;
+    const uint8_t *buffer = (const uint8_t *) fb.latest;
+    for (int plane = fb.lowest_plane; plane < FRAMEBUFFER_PLANES; plane++) {
+        for (int row = 0; row < fb.rows; row++) {
+            for (int column = 0; column < fb.columns; column++) {
+                const uint8_t *ptr = buffer + (plane - fb.lowest_plane) * fb.plane_size +
+                                     (row * fb.columns + column) * fb.column_bytes;
+                uint32_t stored = fb.column_bytes == 1 ? *ptr : *(const uint32_t *) ptr;
+                errors += stored << fb.data_base != extract_bits(&fb.config, plane, row, column, fb.rows);
+            }
+        }
+    }
+    return errors;
+}
+
+// Every column shifted out in the first full BCM cycle of the frame
+static int check_scan(void) {
+    while (fb.pwm != fb.slice_count) {
+        framebuffer_sync(&fb);
+    }
+    platform_host_set_gpio_hook(clock_hook);
+    int errors = 0;
+    for (int s = 0; s < fb.slice_count; s++) {
+        clocked_count = 0;
+        framebuffer_sync(&fb);
+        errors += clocked_count != fb.rows * fb.columns;
+        for (int i = 0; i < clocked_count; i++) {
+            int row = i / fb.columns;
+            int column = i % fb.columns;
+            errors += clocked[i] != extract_bits(&fb.config, fb.slices[s].plane, row, column, fb.rows);
+        }
+    }
+    platform_host_set_gpio_hook(NULL);
+    return errors;
+}
+
+static void check_planes(void) {
+    static const struct {
+        const char *name;
+        int format, depth, chain, orientation;
+    } configs[] = {
+            { "packed", FRAMEBUFFER_FORMAT_PACKED, 8, 1, FRAMEBUFFER_ROTATE_0 },
+            { "word", FRAMEBUFFER_FORMAT_WORD, 8, 1, FRAMEBUFFER_ROTATE_0 },
+            { "packed 6 bit", FRAMEBUFFER_FORMAT_PACKED, 6, 1, FRAMEBUFFER_ROTATE_0 },
+            { "word 5 bit", FRAMEBUFFER_FORMAT_WORD, 5, 1, FRAMEBUFFER_ROTATE_0 },
+            { "packed chain 2", FRAMEBUFFER_FORMAT_PACKED, 8, 2, FRAMEBUFFER_ROTATE_0 },
+            { "word rotated 90", FRAMEBUFFER_FORMAT_WORD, 8, 2, FRAMEBUFFER_ROTATE_90 },
+            { "packed rotated 270", FRAMEBUFFER_FORMAT_PACKED, 7, 1, FRAMEBUFFER_ROTATE_270 },
+    };
+    static const char *paths[] = { "pixels", "spans", "rows" };
+
+    printf("config              path    planes  buffer columns off  shifted columns off\n");
+    uint32_t seed = 1;
+    for (int i = 0; i < COUNT_OF(configs); i++) {
+        framebuffer_config_t config = panel_config;
+        config.format = configs[i].format;
+        config.depth = configs[i].depth;
+        config.chain = configs[i].chain;
+        config.orientation = configs[i].orientation;
+        config.dither = 0;
+        platform_host_set_gpio_hook(NULL);
+        if (framebuffer_init(config, &fb) != FRAMEBUFFER_OK) {
+            CHECK(0, "%s can't be set up", configs[i].name);
+            continue;
+        }
+        data_mask = 1ul << config.pin_r0 | 1ul << config.pin_g0 | 1ul << config.pin_b0 |
+                    1ul << config.pin_r1 | 1ul << config.pin_g1 | 1ul << config.pin_b1;
+        for (int path = 0; path < COUNT_OF(paths); path++) {
+            draw_random_frame(path, &seed);
+            int buffer_errors = check_buffer();
+            int scan_errors = check_scan();
+            printf("%-18s  %-6s  %6d  %18d  %19d\n", configs[i].name, paths[path],
+                   FRAMEBUFFER_PLANES - fb.lowest_plane, buffer_errors, scan_errors);
+            CHECK(buffer_errors == 0, "%s drawn as %s", configs[i].name, paths[path]);
+            CHECK(scan_errors == 0, "%s drawn as %s", configs[i].name, paths[path]);
+        }
+    }
+}
+
+// Host time of shifting out one plane, as a column count of loads and
+// writes against extracting six bits of two pixels for every column
+static void print_scan_cost(void) {
+    static const struct {
+        int w, h, scan, chain;
+    } geometries[] = { { 32, 16, 8, 1 }, { 64, 64, 32, 2 } };
+
+    printf("\npanel    chain  format  planes us/pass  pixels us/pass  ns per column  speedup\n");
+    platform_host_set_gpio_hook(NULL);
+    for (int g = 0; g < COUNT_OF(geometries); g++) {
+        for (int format = FRAMEBUFFER_FORMAT_WORD; format <= FRAMEBUFFER_FORMAT_PACKED; format++) {
+            framebuffer_config_t config = panel_config;
+            config.w = geometries[g].w;
+            config.h = geometries[g].h;
+            config.scan = geometries[g].scan;
+            config.chain = geometries[g].chain;
+            config.pin_d = 17;
+            config.pin_e = 23;
+            config.format = format;
+            config.dither = 0;
+            if (framebuffer_init(config, &fb) != FRAMEBUFFER_OK) {
+                CHECK(0, "%dx%d can't be set up", config.w, config.h);
+                continue;
+            }
+
+            int passes = 0;
+            clock_t start = clock();
+            do {
+                framebuffer_sync(&fb);
+                passes++;
+            } while (clock() - start < CLOCKS_PER_SEC / 10);
+            double planes_us = (double) (clock() - start) * 1e6 / CLOCKS_PER_SEC / passes;
+
+            passes = 0;
+            start = clock();
+            do {
+                scan_pixels(&config, passes % FRAMEBUFFER_PLANES, fb.rows, fb.columns);
+                passes++;
+            } while (clock() - start < CLOCKS_PER_SEC / 10);
+            double pixels_us = (double) (clock() - start) * 1e6 / CLOCKS_PER_SEC / passes;
+
+            printf("%2dx%-2d    %5d  %-6s  %14.2f  %14.2f  %13.2f  %6.2fx\n", config.w, config.h, config.chain,
+                   format == FRAMEBUFFER_FORMAT_PACKED ? "packed" : "word", planes_us, pixels_us,
+                   planes_us * 1e3 / (fb.rows * fb.columns), pixels_us / planes_us);
+        }
+    }
+}
+
+int main(void) {
+    check_planes();
+    print_scan_cost();
+    return test_result();
+}
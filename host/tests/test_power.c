@@ -0,0 +1,191 @@
+// Estimated current of frames worked out by hand, then the same frames on
+// the virtual panel where brightness has to scale the time every LED is lit
+// by the same amount. Counting the LEDs lit only where frames changed has to
+// give the same estimate as counting every frame from scratch.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include "framebuffer.h"
+#include "panel_model.h"
+#include "platform/platform.h"
+#include "test.h"
+
+#define POWER_CYCLES 16
+
+static framebuffer_t fb;
+
+// Lit time of the top left red LED over POWER_CYCLES cycles
+static uint64_t show_frame(uint32_t color, int rows) {
+    framebuffer_begin(&fb);
+    framebuffer_clear(&fb);
+    for (int y = 0; y < rows; y++) {
+        for (int x = 0; x < fb.width; x++) {
+            framebuffer_drawpixel(&fb, x, y, color);
+        }
+    }
+    framebuffer_commit(&fb);
+
+    // Scan-out takes the frame and the brightness at the next cycle, the
+    // one after that is the first complete one
+    uint32_t start = fb.refresh_count;
+    uint64_t lit = 0;
+    while (fb.refresh_count - start < 2 + POWER_CYCLES) {
+        framebuffer_sync(&fb);
+        if (fb.pwm == fb.slice_count) {
+            lit += fb.refresh_count - start >= 2 ? lit_us[0][0][0] : 0;
+            memset(lit_us, 0, sizeof(lit_us));
+        }
+    }
+    return lit;
+}
+
+static void print_power_check(void) {
+    platform_host_set_gpio_hook(panel_gpio_hook);
+    if (framebuffer_init(panel_config, &fb) != FRAMEBUFFER_OK) {
+        CHECK(0, "framebuffer can't be set up");
+        return;
+    }
+
+    // Every LED lit all the time, the row addresses take turns
+    uint32_t all_ma = (uint64_t) DISPLAY_PIXELS * 3 * DISPLAY_LED_UA / DISPLAY_SCAN / 1000;
+    int lowest = fb.lowest_plane;
+    const struct {
+        const char *name;
+        uint32_t color;
+        int rows;
+        int brightness;
+        uint32_t limit_ma;
+        uint32_t expected_ma;
+    } frames[] = {
+            { "black", 0x000000, DISPLAY_H, 255, 0, 0 },
+            { "white", 0xffffff, DISPLAY_H, 255, 0, all_ma },
+            { "red", 0xff0000, DISPLAY_H, 255, 0, all_ma / 3 },
+            { "white top row", 0xffffff, 1, 255, 0, all_ma / DISPLAY_H },
+            { "grey 128", 0x808080, DISPLAY_H, 255, 0, (uint64_t) all_ma * (128 >> lowest) / ((256 >> lowest) - 1) },
+            { "white at 128", 0xffffff, DISPLAY_H, 128, 0, all_ma * 128 / 255 },
+            { "white at 0", 0xffffff, DISPLAY_H, 0, 0, 0 },
+            { "white, 1 A", 0xffffff, DISPLAY_H, 255, 1000, 1000 },
+            { "grey 128, 1 A", 0x808080, DISPLAY_H, 255, 1000, 1000 },
+    };
+
+    printf("%dx%d 1/%d scan, %d planes, %d uA per LED\n", fb.width, fb.height, DISPLAY_SCAN,
+           FRAMEBUFFER_PLANES - lowest, fb.config.led_ua);
+    printf("frame          brightness  limit mA  shown  estimate mA  expected mA  lit us  lit/full  ok\n");
+    uint64_t full_lit_us = 0;
+    for (int i = 0; i < COUNT_OF(frames); i++) {
+        framebuffer_set_brightness(&fb, frames[i].brightness);
+        framebuffer_set_current_limit(&fb, frames[i].limit_ma);
+        uint64_t lit = show_frame(frames[i].color, frames[i].rows);
+
+        // Limited frames have to end up just under the limit, brightness
+        // only comes in steps of 1/255
+        uint32_t expected = frames[i].expected_ma;
+        int limited = frames[i].limit_ma != 0;
+        int ok = limited ? fb.current_ma <= expected && fb.current_ma >= expected - expected / 50
+                         : fb.current_ma == expected;
+        if (i == 1) {
+            full_lit_us = lit;
+        }
+        double ratio = full_lit_us != 0 ? (double) lit / full_lit_us : 0;
+        if (frames[i].color == 0xffffff && frames[i].rows == DISPLAY_H) {
+            // Every slice of a row can lose up to a microsecond to the virtual clock
+            double wanted = (double) fb.scan_brightness / FRAMEBUFFER_BRIGHTNESS_MAX;
+            double margin = (double) fb.slice_count * POWER_CYCLES / full_lit_us;
+            ok &= ratio > wanted - margin && ratio < wanted + margin;
+        }
+        printf("%-14s %10d  %8u  %5d  %11u  %s%9u  %6llu  %8.3f  %2s\n", frames[i].name, frames[i].brightness,
+               frames[i].limit_ma, fb.scan_brightness, fb.current_ma, limited ? "<=" : "  ", expected,
+               (unsigned long long) lit, ratio, ok ? "ok" : "NO");
+        CHECK(ok, "%s at %u mA", frames[i].name, fb.current_ma);
+    }
+}
+
+#define COUNT_COMMITS 600
+#define COUNT_CHECK_EVERY 25
+
+static framebuffer_t reference;
+
+static uint32_t count_random(void) {
+    static uint32_t seed = 1;
+    seed = seed * 1664525u + 1013904223u;
+    return seed >> 8;
+}
+
+static void show(framebuffer_t *framebuffer) {
+    while (framebuffer_commit(framebuffer) == FRAMEBUFFER_BUSY) {
+        framebuffer_sync(framebuffer);
+    }
+}
+
+static void draw(framebuffer_t *framebuffer) {
+    while (framebuffer_begin(framebuffer) != FRAMEBUFFER_OK) {
+        framebuffer_sync(framebuffer);
+    }
+}
+
+// Commits only count the area drawn again. Small areas, rows, clears and
+// commits with nothing drawn, checked against counting the same frame from
+// scratch every few commits.
+static void check_counting(int dither) {
+    framebuffer_config_t config = panel_config;
+    config.dither = dither;
+    config.current_limit_ma = 0;
+    if (framebuffer_init(config, &fb) != FRAMEBUFFER_OK || framebuffer_init(config, &reference) != FRAMEBUFFER_OK) {
+        CHECK(0, "framebuffer can't be set up");
+        return;
+    }
+    static uint32_t colors[DISPLAY_H * CHAIN_W];
+    memset(colors, 0, sizeof(colors));
+    int width = fb.width;
+    int height = fb.height;
+
+    int checks = 0;
+    int wrong = 0;
+    for (int commit = 1; commit <= COUNT_COMMITS; commit++) {
+        draw(&fb);
+        uint32_t kind = count_random() % 16;
+        if (kind == 0) {
+            framebuffer_clear(&fb);
+            memset(colors, 0, sizeof(colors));
+        } else if (kind == 1) {
+            int y = count_random() % height;
+            for (int x = 0; x < width; x++) {
+                colors[y * width + x] = count_random() & 0x3fffffff;
+                framebuffer_drawpixel(&fb, x, y, colors[y * width + x]);
+            }
+        } else if (kind != 2) {
+            int x0 = count_random() % width;
+            int y0 = count_random() % height;
+            for (int i = count_random() % 12; i >= 0; i--) {
+                int x = (x0 + count_random() % 8) % width;
+                int y = (y0 + count_random() % 8) % height;
+                colors[y * width + x] = count_random() & 0x3fffffff;
+                framebuffer_drawpixel(&fb, x, y, colors[y * width + x]);
+            }
+        }
+        show(&fb);
+
+        if (commit % COUNT_CHECK_EVERY == 0) {
+            draw(&reference);
+            framebuffer_clear(&reference);
+            for (int y = 0; y < height; y++) {
+                framebuffer_drawrow(&reference, 0, y, colors + y * width, width);
+            }
+            show(&reference);
+            checks++;
+            wrong += memcmp(fb.plane_bits, reference.plane_bits, sizeof(fb.plane_bits)) != 0;
+        }
+    }
+    printf("dither %d: %d commits counted incrementally, %d of %d counts wrong\n", dither, COUNT_COMMITS, wrong,
+           checks);
+    CHECK(wrong == 0, "%d incremental counts with dither %d differ from a full count", wrong, dither);
+}
+
+int main(void) {
+    print_power_check();
+    platform_host_set_gpio_hook(NULL);
+    check_counting(0);
+    check_counting(1);
+    return test_result();
+}
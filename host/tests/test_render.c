@@ -0,0 +1,130 @@
+// End to end cost of a frame from the gif into the back buffer: decoding,
+// composing it on the canvas and drawing the dirty rectangle pixel by pixel
+// like before, against drawing the changed runs of every row as spans while
+// composing. Both paths draw into a framebuffer of their own, every frame
+// is compared to make sure they end up with the same bits.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "framebuffer.h"
+#include "gif_canvas.h"
+#include "gif_decoder.h"
+#include "animations/palette.h"
+#include "panel_model.h"
+#include "test.h"
+
+#define INDEX_FRAMES 1024
+
+static gif_lzw_context_t lzw;
+static framebuffer_t fb;
+static framebuffer_t fb_spans;
+static uint32_t render_colors[PALETTE_SIZE];
+
+static void render_span(void *context, int x, int y, const uint8_t *pixels, int count) {
+    framebuffer_drawspan((framebuffer_t *) context, x, y, pixels, count, render_colors);
+}
+
+static void render_dirty(framebuffer_t *framebuffer, const gif_canvas_t *canvas) {
+    const gif_rect_t *dirty = &canvas->dirty;
+    for (int y = dirty->y; y < dirty->y + dirty->height; y++) {
+        const uint8_t *pixel = canvas->pixels + y * canvas->width + dirty->x;
+        for (int x = dirty->x; x < dirty->x + dirty->width; x++) {
+            framebuffer_drawpixel(framebuffer, x, y, render_colors[*pixel++]);
+        }
+    }
+}
+
+static void print_render_benchmark(int count, char *filenames[]) {
+    static uint8_t data[1024 * 1024];
+    static uint8_t pixels[64 * 1024];
+    static uint8_t canvas_pixels[2][64 * 1024];
+    static uint8_t canvas_previous[2][64 * 1024];
+    static gif_frame_index_t index[INDEX_FRAMES];
+
+    if (framebuffer_init(panel_config, &fb) != FRAMEBUFFER_OK ||
+            framebuffer_init(panel_config, &fb_spans) != FRAMEBUFFER_OK) {
+        CHECK(0, "framebuffer can't be set up");
+        return;
+    }
+    framebuffer_t *framebuffers[2] = { &fb, &fb_spans };
+
+    printf("%dx%d display, us per frame\n", fb.width, fb.height);
+    printf("gif            frames  decode  per pixel  spans  speedup  pixels drawn  spans drawn  same\n");
+    for (int i = 0; i < count; i++) {
+        size_t size = test_read_file(filenames[i], data, sizeof(data));
+        const char *name = test_basename(filenames[i]);
+
+        gif_t gif = { .lzw = &lzw };
+        uint16_t frames;
+        if (gif_decoder_init(data, size, &gif) != GIF_OK || gif.width * gif.height > sizeof(pixels) ||
+                gif_decoder_index(&gif, index, INDEX_FRAMES, &frames) != GIF_OK ||
+                gif_decoder_validate(&gif, pixels, sizeof(pixels)) != GIF_OK) {
+            printf("%-14.14s can't be indexed\n", name);
+            continue;
+        }
+        palette_convert(gif.global_ct, gif.ct_size, render_colors);
+        frame_t frame = { .frame = pixels };
+
+        // Both paths frame by frame, the back buffers have to stay the same
+        gif_canvas_t canvas[2];
+        uint32_t drawn[2];
+        int same = 1;
+        for (int path = 0; path < 2; path++) {
+            gif_canvas_init(&canvas[path], &gif, canvas_pixels[path], canvas_previous[path]);
+            framebuffer_clear(framebuffers[path]);
+            drawn[path] = framebuffers[path]->pixels_drawn;
+        }
+        for (int n = 0; n < frames; n++) {
+            gif_decoder_read_frame(&gif, &index[n], &frame);
+            gif_canvas_draw(&canvas[0], &frame);
+            render_dirty(&fb, &canvas[0]);
+            gif_canvas_draw_spans(&canvas[1], &frame, render_span, &fb_spans);
+            same &= memcmp(fb.buffer, fb_spans.buffer, fb.buffer_size) == 0;
+        }
+        for (int path = 0; path < 2; path++) {
+            drawn[path] = framebuffers[path]->pixels_drawn - drawn[path];
+        }
+
+        int passes = 0;
+        clock_t start = clock();
+        do {
+            for (int n = 0; n < frames; n++) {
+                gif_decoder_read_frame(&gif, &index[n], &frame);
+            }
+            passes++;
+        } while (clock() - start < CLOCKS_PER_SEC / 10);
+        double decode_us = (double) (clock() - start) * 1e6 / CLOCKS_PER_SEC / passes / frames;
+
+        double frame_us[2];
+        for (int path = 0; path < 2; path++) {
+            passes = 0;
+            start = clock();
+            do {
+                gif_canvas_init(&canvas[path], &gif, canvas_pixels[path], canvas_previous[path]);
+                for (int n = 0; n < frames; n++) {
+                    gif_decoder_read_frame(&gif, &index[n], &frame);
+                    if (path == 0) {
+                        gif_canvas_draw(&canvas[0], &frame);
+                        render_dirty(&fb, &canvas[0]);
+                    } else {
+                        gif_canvas_draw_spans(&canvas[1], &frame, render_span, &fb_spans);
+                    }
+                }
+                passes++;
+            } while (clock() - start < CLOCKS_PER_SEC / 10);
+            frame_us[path] = (double) (clock() - start) * 1e6 / CLOCKS_PER_SEC / passes / frames;
+        }
+
+        printf("%-14.14s %6u  %6.2f  %9.2f  %5.2f  %6.2fx  %12.1f  %11.1f  %4s\n", name, frames, decode_us,
+               frame_us[0], frame_us[1], frame_us[0] / frame_us[1],
+               (double) drawn[0] / frames, (double) drawn[1] / frames, same ? "yes" : "NO");
+        CHECK(same, "%s: spans and pixels end up different", name);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    print_render_benchmark(argc - 1, argv + 1);
+    return test_result();
+}
@@ -0,0 +1,147 @@
+// The row stream the PIO scan-out runs on against the pins the bit-banged
+// framebuffer_sync() drives for the same configuration. Every row latched
+// in a full BCM cycle has to be the one the stream addresses at that
+// point, lit for as long as the stream keeps it lit and dark for the rest
+// of its display time before the next latch.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "framebuffer.h"
+#include "hub75_stream.h"
+#include "panel_model.h"
+#include "platform/platform.h"
+#include "test.h"
+
+#define MAX_LATCHES (FRAMEBUFFER_MAX_SLICES * FRAMEBUFFER_MAX_ROWS + 1)
+
+static framebuffer_t fb;
+
+typedef struct {
+    uint32_t address;
+    uint64_t time_us;
+    uint64_t lit_us;
+} row_latch_t;
+
+static row_latch_t latches[MAX_LATCHES];
+static int latch_count;
+static uint32_t address_mask;
+static int address_base;
+static uint32_t last_gpio;
+static uint64_t oe_start_us;
+
+static int pin(uint32_t gpio, int pin) {
+    return (gpio >> pin) & 0x1;
+}
+
+static void row_hook(uint32_t gpio, uint64_t time_us) {
+    int oe = fb.config.pin_oe;
+    int lat = fb.config.pin_lat;
+    if (pin(gpio, oe) && !pin(last_gpio, oe)) {
+        oe_start_us = time_us;
+    }
+    if (!pin(gpio, oe) && pin(last_gpio, oe) && latch_count > 0) {
+        latches[latch_count - 1].lit_us += time_us - oe_start_us;
+    }
+    if (pin(gpio, lat) && !pin(last_gpio, lat) && latch_count < MAX_LATCHES) {
+        latches[latch_count++] = (row_latch_t) {
+                .address = (gpio & address_mask) >> address_base,
+                .time_us = time_us
+        };
+    }
+    last_gpio = gpio;
+}
+
+// Rows latched in a full BCM cycle at brightness, then those of the first
+// slice of the next cycle, whose first latch ends the last row of this one
+static void capture_cycle(int brightness) {
+    framebuffer_set_brightness(&fb, brightness);
+    framebuffer_begin(&fb);
+    framebuffer_commit(&fb);
+    while (fb.pwm != fb.slice_count) {
+        framebuffer_sync(&fb);
+    }
+
+    latch_count = 0;
+    platform_host_set_gpio_hook(row_hook);
+    for (int s = 0; s <= fb.slice_count; s++) {
+        framebuffer_sync(&fb);
+    }
+    platform_host_set_gpio_hook(NULL);
+}
+
+static void check_rows(void) {
+    static const struct {
+        const char *name;
+        int w, h, scan, depth, slice_us;
+    } configs[] = {
+            { "32x16 1/8", 32, 16, 8, 8, 0 },
+            { "32x16 1/8 6 bit", 32, 16, 8, 6, 8 },
+            { "32x32 1/16", 32, 32, 16, 8, 0 },
+            { "64x64 1/32", 64, 64, 32, 7, 0 },
+    };
+    static const int brightness_levels[] = { FRAMEBUFFER_BRIGHTNESS_MAX, 128, 17, 0 };
+    static uint32_t stream[FRAMEBUFFER_MAX_SLICES * FRAMEBUFFER_MAX_ROWS * 3];
+
+    printf("config            brightness  rows  address off  lit off  dark short\n");
+    for (int i = 0; i < COUNT_OF(configs); i++) {
+        framebuffer_config_t config = panel_config;
+        config.w = configs[i].w;
+        config.h = configs[i].h;
+        config.scan = configs[i].scan;
+        config.depth = configs[i].depth;
+        config.slice_us = configs[i].slice_us;
+        config.pin_d = 17;
+        config.pin_e = 23;
+        config.current_limit_ma = 0;
+        config.dither = 0;
+        if (framebuffer_init(config, &fb) != FRAMEBUFFER_OK) {
+            CHECK(0, "%s can't be set up", configs[i].name);
+            continue;
+        }
+
+        int pins[5];
+        int count = hub75_address_pins(&config, pins);
+        address_mask = hub75_pin_mask(pins, count);
+        address_base = hub75_pin_base(pins, count);
+        uint32_t cycles_per_us = platform_cycles_per_us();
+        int rows = (int) (hub75_row_stream_size(&config, fb.slice_count) / 3);
+
+        for (int b = 0; b < COUNT_OF(brightness_levels); b++) {
+            int brightness = brightness_levels[b];
+            hub75_build_row_stream(&config, fb.slices, fb.slice_count, cycles_per_us, brightness, stream);
+            capture_cycle(brightness);
+
+            int address_errors = 0;
+            int lit_errors = 0;
+            int dark_errors = 0;
+            CHECK(latch_count > rows, "%s latched %d rows, the stream has %d", configs[i].name,
+                  latch_count, rows);
+            for (int r = 0; r < rows && r + 1 < latch_count; r++) {
+                const uint32_t *entry = stream + 3 * r;
+                uint64_t lit_us = entry[0] / cycles_per_us;
+                uint64_t display_us = (entry[0] + entry[2]) / cycles_per_us;
+                address_errors += latches[r].address != entry[1];
+#if FRAMEBUFFER_OE_PULSE
+                lit_errors += llabs((long long) latches[r].lit_us - (long long) lit_us) > 1;
+#else
+                // Full brightness leaves OE on while the next row is shifted in
+                lit_errors += brightness == FRAMEBUFFER_BRIGHTNESS_MAX ? latches[r].lit_us + 1 < lit_us
+                                                                       : llabs((long long) latches[r].lit_us -
+                                                                               (long long) lit_us) > 1;
+#endif
+                dark_errors += latches[r + 1].time_us - latches[r].time_us + 1 < display_us;
+            }
+            printf("%-16s  %10d  %4d  %11d  %7d  %10d\n", configs[i].name, brightness, rows,
+                   address_errors, lit_errors, dark_errors);
+            CHECK(address_errors == 0, "%s at brightness %d", configs[i].name, brightness);
+            CHECK(lit_errors == 0, "%s at brightness %d", configs[i].name, brightness);
+            CHECK(dark_errors == 0, "%s at brightness %d", configs[i].name, brightness);
+        }
+    }
+}
+
+int main(void) {
+    check_rows();
+    return test_result();
+}
@@ -0,0 +1,157 @@
+// Frame deadlines of gif_animation on the virtual clock. Every built-in
+// sequence plays three loops, once on time and once with a timer that keeps
+// the frame alarm waiting up to most of a millisecond, the way other
+// interrupts would on the pico. Each frame has to be shown within a
+// millisecond of the sum of the delays of the frames before it, and every
+// loop has to take as long as the delays of the gif add up to. The drift a
+// schedule counting from when the alarm ran would have picked up is shown
+// alongside.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "animations/animations.h"
+#include "framebuffer.h"
+#include "gif_decoder.h"
+#include "panel_model.h"
+#include "platform/platform.h"
+#include "test.h"
+
+#define SCHEDULE_LOOPS 3
+#define SCHEDULE_FRAMES 1024
+#define SCHEDULE_STEP_US 10
+#define SCHEDULE_TOLERANCE_US 1000
+// Latency injected every few milliseconds
+#define LATENCY_INTERVAL_US 7000
+#define LATENCY_MAX_US 900
+// gif_animation_play() state that loops
+#define PLAY_LOOP 3
+
+// Built-in sequences in the order gif_animation numbers them
+static const char *builtin_names[] = {
+        "baloons.gif", "chevrons.gif", "fishandcat.gif", "lattice.gif", "pattern.gif", "seasons.gif",
+        "skull.gif", "snafu.gif", "pnp2000.gif", "numbers.gif", "piet.gif", "loopband.gif",
+};
+
+static framebuffer_t fb;
+static gif_lzw_context_t lzw;
+static platform_timer_t latency_timer;
+static uint32_t latency_max_us;
+static uint32_t latency_seed = 1;
+
+static bool inject_latency(platform_timer_t *timer) {
+    (void) timer;
+    latency_seed = latency_seed * 1103515245 + 12345;
+    if (latency_max_us > 0) {
+        platform_host_advance_us((latency_seed >> 16) % (latency_max_us + 1));
+    }
+    return true;
+}
+
+// Stands in for the scan-out core, the newest committed buffer goes on
+// screen and the one it replaces back to the drawing side
+static void scan_out(void) {
+    uint32_t *next;
+    while (frame_queue_pop(&fb.committed, &next)) {
+        if (fb.front != NULL) {
+            frame_queue_push(&fb.released, fb.front);
+        }
+        fb.front = next;
+    }
+}
+
+// Delays of every frame in microseconds, as gif_animation plays them
+static int frame_delays(const char *filename, uint32_t *delays) {
+    static uint8_t data[1024 * 1024];
+    static uint8_t pixels[256 * 1024];
+    size_t size = test_read_file(filename, data, sizeof(data));
+    gif_t gif = { .lzw = &lzw };
+    frame_t frame = { .frame = pixels };
+    if (gif_decoder_init(data, size, &gif) != GIF_OK || (size_t) gif.width * gif.height > sizeof(pixels)) {
+        return 0;
+    }
+    int frames = 0;
+    while (frames < SCHEDULE_FRAMES && gif_decoder_read_next_frame(&gif, &frame) == GIF_OK) {
+        delays[frames++] = (frame.delay != 0 ? frame.delay : GIF_DEFAULT_DELAY) * 10000UL;
+    }
+    return frames;
+}
+
+static void check_schedule(int sequence, const char *name, const uint32_t *delays, int frames) {
+    static uint64_t shown_us[SCHEDULE_LOOPS * SCHEDULE_FRAMES + 1];
+    int count = SCHEDULE_LOOPS * frames + 1;
+
+    uint32_t decoded = gif_animation_get_frames_decoded();
+    gif_animation_play(sequence, PLAY_LOOP);
+    for (int shown = 0; shown < count;) {
+        platform_host_advance_us(SCHEDULE_STEP_US);
+        scan_out();
+        if (gif_animation_get_frames_decoded() != decoded) {
+            CHECK(gif_animation_get_frames_decoded() == decoded + 1, "%s: %u frames in %d us", name,
+                  gif_animation_get_frames_decoded() - decoded, SCHEDULE_STEP_US);
+            decoded = gif_animation_get_frames_decoded();
+            shown_us[shown++] = platform_time_us();
+        }
+    }
+
+    // Against the delays added up from the first frame
+    uint64_t expected_us = shown_us[0];
+    int64_t worst_us = 0;
+    uint64_t late_us = 0;
+    for (int n = 0; n < count; n++) {
+        int64_t off_us = (int64_t) (shown_us[n] - expected_us);
+        worst_us = llabs(off_us) > worst_us ? llabs(off_us) : worst_us;
+        late_us += off_us > 0 ? off_us : 0;
+        expected_us += delays[n % frames];
+    }
+    CHECK(worst_us <= SCHEDULE_TOLERANCE_US, "%s: a frame is %lld us off its deadline", name,
+          (long long) worst_us);
+
+    uint64_t loop_us = 0;
+    for (int n = 0; n < frames; n++) {
+        loop_us += delays[n];
+    }
+    int64_t worst_loop_us = 0;
+    for (int loop = 0; loop < SCHEDULE_LOOPS; loop++) {
+        int64_t off_us = (int64_t) (shown_us[(loop + 1) * frames] - shown_us[loop * frames] - loop_us);
+        worst_loop_us = llabs(off_us) > worst_loop_us ? llabs(off_us) : worst_loop_us;
+    }
+    CHECK(worst_loop_us <= SCHEDULE_TOLERANCE_US, "%s: a loop is %lld us off %llu us", name,
+          (long long) worst_loop_us, (unsigned long long) loop_us);
+
+    printf("%-14.14s %6d  %7u  %10.1f  %10lld  %9lld  %13.1f\n", name, frames, latency_max_us, loop_us / 1000.0,
+           (long long) worst_us, (long long) worst_loop_us, late_us / 1000.0 / SCHEDULE_LOOPS);
+}
+
+int main(int argc, char *argv[]) {
+    static uint32_t delays[SCHEDULE_FRAMES];
+    framebuffer_config_t config = panel_config;
+    config.dither = 0;
+    if (framebuffer_init(config, &fb) != FRAMEBUFFER_OK) {
+        CHECK(0, "framebuffer can't be set up");
+        return test_result();
+    }
+    gif_animation_init(&fb);
+    platform_timer_start(&latency_timer, LATENCY_INTERVAL_US, inject_latency);
+
+    printf("gif            frames  latency     loop ms   frame off   loop off  drift ms/loop\n");
+    for (int i = 0; i < argc - 1; i++) {
+        const char *name = test_basename(argv[i + 1]);
+        int sequence = -1;
+        for (int s = 0; s < COUNT_OF(builtin_names); s++) {
+            if (strcmp(name, builtin_names[s]) == 0) {
+                sequence = s;
+            }
+        }
+        if (sequence < 0) {
+            continue;
+        }
+        int frames = frame_delays(argv[i + 1], delays);
+        CHECK(frames > 0, "%s doesn't decode", name);
+        for (int latency = 0; frames > 0 && latency < 2; latency++) {
+            latency_max_us = latency ? LATENCY_MAX_US : 0;
+            check_schedule(sequence, name, delays, frames);
+        }
+    }
+    return test_result();
+}
@@ -0,0 +1,241 @@
+// Uploads gifs into a fresh asset store the way the I2C commands do, in
+// chunks, and reports what the flash takes on the virtual clock. The assets
+// have to read back as uploaded, survive opening the store again, refuse a
+// bad CRC and play through gif_animation. No call may erase more than one
+// sector, whatever the size of the asset. A gif whose second frame breaks
+// off halfway has to leave the back buffer as the display shows it.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "asset_store.h"
+#include "framebuffer.h"
+#include "animations/animations.h"
+#include "panel_model.h"
+#include "platform/platform.h"
+#include "test.h"
+
+#define STORE_FLASH_SIZE (1024 * 1024)
+#define STORE_CHUNK 256
+#define STORE_FILE "test_store.bin"
+// Larger than the display so its frames are streamed a row at a time
+#define BROKEN_SIZE 64
+#define BROKEN_DELAY 10
+
+static asset_store_t store;
+static framebuffer_t fb;
+static uint8_t data[STORE_FLASH_SIZE];
+
+// Longest a single store call kept the flash, the main loop and with it
+// the I2C interrupt wait that long for a command to finish
+static uint64_t longest_us;
+
+static void took(uint64_t start_us) {
+    uint64_t us = platform_time_us() - start_us;
+    longest_us = us > longest_us ? us : longest_us;
+}
+
+static int upload(const char *name, const uint8_t *bytes, size_t size, uint32_t crc) {
+    uint64_t start_us = platform_time_us();
+    int result = asset_store_begin(&store, name, size, crc);
+    took(start_us);
+    for (size_t offset = 0; result == ASSET_STORE_OK && offset < size; offset += STORE_CHUNK) {
+        size_t length = size - offset < STORE_CHUNK ? size - offset : STORE_CHUNK;
+        start_us = platform_time_us();
+        result = asset_store_write(&store, bytes + offset, length);
+        took(start_us);
+    }
+    if (result != ASSET_STORE_OK) {
+        return result;
+    }
+    start_us = platform_time_us();
+    result = asset_store_finish(&store);
+    took(start_us);
+    return result;
+}
+
+static void check_upload(const char *filename) {
+    size_t size = test_read_file(filename, data, sizeof(data));
+    if (size == 0) {
+        return;
+    }
+    char name[ASSET_STORE_NAME_SIZE + 1] = { 0 };
+    size_t length = strlen(test_basename(filename));
+    memcpy(name, test_basename(filename), length < ASSET_STORE_NAME_SIZE ? length : ASSET_STORE_NAME_SIZE);
+
+    uint64_t start_us = platform_time_us();
+    int result = upload(name, data, size, asset_store_crc32(0, data, size));
+    uint64_t flash_us = platform_time_us() - start_us;
+    CHECK(result == ASSET_STORE_OK, "%s upload returned %d", name, result);
+    if (result != ASSET_STORE_OK) {
+        return;
+    }
+
+    // Every data chunk is a transfer of register, command and data
+    size_t chunks = (size + STORE_CHUNK - 1) / STORE_CHUNK;
+    uint64_t clocks = chunks * (1 + 9 * 2 + 1) + size * 9;
+    printf("%-8s %7zu bytes, flash %6.1f ms, %4.0f KB/s flash only, %4.0f KB/s with i2c at 1 MHz\n", name, size,
+           flash_us / 1e3, size / 1.024 / flash_us * 1e3, size / 1.024 / (flash_us + clocks) * 1e3);
+
+    int index = asset_store_count(&store) - 1;
+    const uint8_t *stored;
+    size_t stored_size;
+    CHECK(asset_store_get(&store, index, &stored, &stored_size) == ASSET_STORE_OK &&
+          stored_size == size && memcmp(stored, data, size) == 0, "%s reads back different", name);
+    CHECK(strncmp(asset_store_name(&store, index), name, ASSET_STORE_NAME_SIZE) == 0, "%s stored as %.8s",
+          name, asset_store_name(&store, index));
+}
+
+typedef struct {
+    uint8_t *out;
+    uint32_t bits;
+    int count;
+} bit_writer_t;
+
+static void put_code(bit_writer_t *writer, uint16_t code) {
+    writer->bits |= (uint32_t) code << writer->count;
+    for (writer->count += 3; writer->count >= 8; writer->count -= 8) {
+        *writer->out++ = writer->bits;
+        writer->bits >>= 8;
+    }
+}
+
+// Image data of 2 bit pixels with 3 bit codes, a clear code before every
+// pair of pixels keeps the table from growing. Pixels past good get a code
+// that isn't in the table.
+static uint8_t *put_image(uint8_t *ptr, uint8_t color, int good) {
+    static uint8_t codes[BROKEN_SIZE * BROKEN_SIZE * 2];
+    bit_writer_t writer = { codes, 0, 0 };
+    for (int pixel = 0; pixel < good; pixel += 2) {
+        put_code(&writer, 4);
+        put_code(&writer, color);
+        put_code(&writer, color);
+    }
+    if (good < BROKEN_SIZE * BROKEN_SIZE) {
+        put_code(&writer, 4);
+        put_code(&writer, 7);
+    }
+    put_code(&writer, 5);
+    put_code(&writer, 0);
+    put_code(&writer, 0);
+
+    static const uint8_t image[] = {
+            0x21, 0xf9, 0x04, 0x00, BROKEN_DELAY, 0x00, 0x00, 0x00,
+            0x2c, 0x00, 0x00, 0x00, 0x00, BROKEN_SIZE, 0x00, BROKEN_SIZE, 0x00, 0x00, 0x02
+    };
+    memcpy(ptr, image, sizeof(image));
+    ptr += sizeof(image);
+    for (const uint8_t *block = codes; block < writer.out; block += 255) {
+        size_t length = writer.out - block < 255 ? writer.out - block : 255;
+        *ptr++ = length;
+        memcpy(ptr, block, length);
+        ptr += length;
+    }
+    *ptr++ = 0;
+    return ptr;
+}
+
+// A frame all red, then one that turns green until the image data breaks
+// off halfway
+static size_t broken_gif(uint8_t *gif) {
+    static const uint8_t header[] = {
+            'G', 'I', 'F', '8', '9', 'a', BROKEN_SIZE, 0x00, BROKEN_SIZE, 0x00, 0x81, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0xff, 0x00, 0x00, 0x00, 0xff, 0x00, 0x00, 0x00, 0xff
+    };
+    memcpy(gif, header, sizeof(header));
+    uint8_t *ptr = put_image(gif + sizeof(header), 1, BROKEN_SIZE * BROKEN_SIZE);
+    ptr = put_image(ptr, 2, BROKEN_SIZE * BROKEN_SIZE / 2);
+    *ptr++ = 0x3b;
+    return ptr - gif;
+}
+
+static void check_broken_frame() {
+    size_t size = broken_gif(data);
+    int result = upload("broken", data, size, asset_store_crc32(0, data, size));
+    CHECK(result == ASSET_STORE_OK, "broken upload returned %d", result);
+    if (result != ASSET_STORE_OK) {
+        return;
+    }
+
+    // The back buffer is only held between updates after a frame failed
+    int failed = 0;
+    int differs = 0;
+    gif_animation_play(gif_animation_get_sequence_count() - 1, 3);
+    uint64_t start_us = platform_time_us();
+    while (platform_time_us() - start_us < 1000000) {
+        framebuffer_sync(&fb);
+        if (fb.buffer != NULL) {
+            failed++;
+            differs += memcmp(fb.buffer, fb.latest, fb.buffer_size) != 0;
+        }
+    }
+    gif_animation_stop();
+    CHECK(failed > 0, "the broken frame never failed");
+    CHECK(differs == 0, "the back buffer differs from the display %d times after a broken frame", differs);
+}
+
+int main(int argc, char *argv[]) {
+    remove(STORE_FILE);
+    if (!platform_host_flash_open(STORE_FILE, STORE_FLASH_SIZE) || asset_store_init(&store) != ASSET_STORE_OK) {
+        printf("Can't open the store in %s\n", STORE_FILE);
+        return 1;
+    }
+    CHECK(asset_store_count(&store) == 0, "%d assets in a new store", asset_store_count(&store));
+    size_t free_bytes = asset_store_free(&store);
+
+    for (int i = 1; i < argc; i++) {
+        check_upload(argv[i]);
+    }
+    int count = asset_store_count(&store);
+    CHECK(count == argc - 1, "%d of %d uploaded", count, argc - 1);
+    CHECK(asset_store_free(&store) < free_bytes, "%zu bytes free", asset_store_free(&store));
+    printf("%d assets, %zu KB free, longest call %.1f ms\n", count, asset_store_free(&store) / 1024,
+           longest_us / 1e3);
+    // One sector erase and a page program at most, however large the asset
+    CHECK(longest_us <= HOST_FLASH_ERASE_US + 2 * HOST_FLASH_PROGRAM_US, "a store call took %.1f ms",
+          longest_us / 1e3);
+
+    // A CRC that doesn't match leaves nothing behind
+    static const uint8_t junk[1000] = { 1, 2, 3 };
+    int result = upload("junk", junk, sizeof(junk), asset_store_crc32(0, junk, sizeof(junk)) ^ 1);
+    CHECK(result == ASSET_STORE_CRC, "bad CRC upload returned %d", result);
+    CHECK(asset_store_count(&store) == count, "%d assets after a bad upload", asset_store_count(&store));
+
+    // Opening the store again finds the same assets
+    asset_store_t reopened;
+    CHECK(asset_store_init(&reopened) == ASSET_STORE_OK && asset_store_count(&reopened) == count,
+          "%d assets after opening again", asset_store_count(&reopened));
+    if (count == 0) {
+        return test_result();
+    }
+
+    // The first upload plays like a built-in sequence
+    platform_host_set_gpio_hook(panel_gpio_hook);
+    if (framebuffer_init(panel_config, &fb) != FRAMEBUFFER_OK) {
+        CHECK(0, "framebuffer can't be set up");
+        return test_result();
+    }
+    gif_animation_init(&fb);
+    gif_animation_set_store(&store);
+    CHECK(gif_animation_get_sequence_count() == gif_animation_get_builtin_count() + count, "%d sequences",
+          gif_animation_get_sequence_count());
+    gif_animation_play(gif_animation_get_builtin_count(), 3);
+    uint64_t start_us = platform_time_us();
+    while (platform_time_us() - start_us < 1000000) {
+        framebuffer_sync(&fb);
+    }
+    printf("played %s, %u frames decoded in 1 s\n", asset_store_name(&store, 0), gif_animation_get_frames_decoded());
+    CHECK(gif_animation_get_frames_decoded() > 0, "nothing decoded");
+
+    // Deleting renumbers the assets after it
+    gif_animation_stop();
+    const char *second = count > 1 ? asset_store_name(&store, 1) : NULL;
+    CHECK(asset_store_delete(&store, 0) == ASSET_STORE_OK && asset_store_count(&store) == count - 1,
+          "%d assets after a delete", asset_store_count(&store));
+    CHECK(second == NULL || asset_store_name(&store, 0) == second, "%.8s first after a delete",
+          asset_store_name(&store, 0));
+
+    check_broken_frame();
+    return test_result();
+}
@@ -0,0 +1,361 @@
+// Frames per second over the I2C frame stream for full frames and deltas,
+// and a streamed frame against the same frame drawn directly. Then the
+// ways a stream goes wrong: the ring overflowing, an unknown command, a
+// reset in the middle of a command and commits while scan-out holds every
+// buffer. Nothing may be drawn from a broken stream, a reset has to bring
+// it back and a stream that waits for a buffer must not lose a byte. Fills
+// larger than the display are only drawn where they are on it.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "framebuffer.h"
+#include "frame_stream.h"
+#include "panel_model.h"
+#include "platform/platform.h"
+#include "stream_client.h"
+#include "test.h"
+
+#define STREAM_BUFFER_SIZE (64 * 1024)
+
+static frame_stream_t stream;
+
+// Frames per second over the I2C stream for full frames and deltas. The
+// host column is the parsing and drawing time of the consumer.
+static void print_stream_benchmark(void) {
+    static uint8_t data[STREAM_BUFFER_SIZE];
+    static const struct {
+        const char *name;
+        uint8_t command;
+        int rows; // 0 for the whole display
+        int square; // Side of a square delta, 0 for full width
+    } kinds[] = {
+            { "full rgb888", FRAME_STREAM_RECT_RGB888, 0, 0 },
+            { "full rgb565", FRAME_STREAM_RECT_RGB565, 0, 0 },
+            { "row rgb565", FRAME_STREAM_RECT_RGB565, 1, 0 },
+            { "8x8 rgb565", FRAME_STREAM_RECT_RGB565, 0, 8 },
+            { "fill", FRAME_STREAM_FILL, 0, 0 },
+    };
+
+    platform_host_set_gpio_hook(NULL);
+    framebuffer_t framebuffer;
+    if (framebuffer_init(panel_config, &framebuffer) != FRAMEBUFFER_OK) {
+        CHECK(0, "framebuffer can't be set up");
+        return;
+    }
+    int width = framebuffer.width;
+    int height = framebuffer.height;
+
+    printf("frame         bytes  fps 400k  fps 1M   host us\n");
+    for (int k = 0; k < COUNT_OF(kinds); k++) {
+        frame_stream_init(&stream);
+        uint64_t clocks = 0;
+        size_t bytes = 0;
+        int frames = 0;
+        stream_process_clock = 0;
+        clock_t start = clock();
+        do {
+            int w = kinds[k].square ? kinds[k].square : width;
+            int h = kinds[k].square ? kinds[k].square : kinds[k].rows ? kinds[k].rows : height;
+            int x = kinds[k].square ? frames * w % width : 0;
+            int y = kinds[k].square || kinds[k].rows ? frames * h % height : 0;
+            size_t size = stream_put_rect(data, kinds[k].command, x, y, w, h);
+            if (kinds[k].command == FRAME_STREAM_FILL) {
+                data[size++] = frames & 0xff;
+                data[size++] = 0x40;
+                data[size++] = 0x80;
+            } else {
+                size += stream_put_pixels(data + size, kinds[k].command, x, y, w, h, frames);
+            }
+            data[size++] = FRAME_STREAM_COMMIT;
+            clocks += stream_send(&stream, &framebuffer, data, size);
+            bytes = size;
+            frames++;
+        } while (clock() - start < CLOCKS_PER_SEC / 10);
+        double host_us = (double) stream_process_clock * 1e6 / CLOCKS_PER_SEC / frames;
+        printf("%-12s %6zu  %8.1f  %6.1f  %8.1f\n", kinds[k].name, bytes,
+               frames * 400e3 / clocks, frames * 1e6 / clocks, host_us);
+        CHECK(stream.frames == (uint32_t) frames && frame_stream_status(&stream) == 0, "%s: %u of %d frames, status 0x%02x",
+              kinds[k].name, stream.frames, frames, frame_stream_status(&stream));
+    }
+
+    // A full rgb888 frame has to come out exactly as drawn directly
+    frame_stream_init(&stream);
+    size_t size = stream_put_rect(data, FRAME_STREAM_RECT_RGB888, 0, 0, width, height);
+    size += stream_put_pixels(data + size, FRAME_STREAM_RECT_RGB888, 0, 0, width, height, 7);
+    data[size++] = FRAME_STREAM_COMMIT;
+    stream_send(&stream, &framebuffer, data, size);
+
+    framebuffer_t reference;
+    framebuffer_init(panel_config, &reference);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            framebuffer_drawpixel(&reference, x, y, stream_pattern(x, y, 7));
+        }
+    }
+    framebuffer_commit(&reference);
+    int same = memcmp(framebuffer.latest, reference.latest, framebuffer.buffer_size) == 0;
+    printf("streamed frame %s the directly drawn one, %u frames, status 0x%02x\n",
+           same ? "matches" : "DIFFERS from", stream.frames, frame_stream_status(&stream));
+    CHECK(same, "streamed rgb888 frame");
+    CHECK(stream.frames == 1 && frame_stream_status(&stream) == 0, "%u frames, status 0x%02x",
+          stream.frames, frame_stream_status(&stream));
+}
+
+static size_t push(const uint8_t *data, size_t size) {
+    size_t pushed = 0;
+    for (size_t i = 0; i < size; i++) {
+        pushed += frame_stream_push(&stream, data[i]);
+    }
+    return pushed;
+}
+
+// The whole display filled with color, and committed
+static size_t put_fill(uint8_t *dst, const framebuffer_t *framebuffer, uint32_t color) {
+    size_t size = stream_put_rect(dst, FRAME_STREAM_FILL, 0, 0, framebuffer->width, framebuffer->height);
+    dst[size++] = color >> 16 & 0xff;
+    dst[size++] = color >> 8 & 0xff;
+    dst[size++] = color & 0xff;
+    dst[size++] = FRAME_STREAM_COMMIT;
+    return size;
+}
+
+// The frame committed last is the display filled with color
+static int shows(const framebuffer_t *framebuffer, uint32_t color) {
+    static framebuffer_t reference;
+    if (reference.buffer == NULL && framebuffer_init(panel_config, &reference) != FRAMEBUFFER_OK) {
+        return 0;
+    }
+    framebuffer_begin(&reference);
+    for (int y = 0; y < reference.height; y++) {
+        for (int x = 0; x < reference.width; x++) {
+            framebuffer_drawpixel(&reference, x, y, color);
+        }
+    }
+    return framebuffer->latest != NULL &&
+           memcmp(framebuffer->latest, reference.buffer, reference.buffer_size) == 0;
+}
+
+static int setup(framebuffer_t *framebuffer) {
+    frame_stream_init(&stream);
+    if (framebuffer_init(panel_config, framebuffer) != FRAMEBUFFER_OK) {
+        CHECK(0, "framebuffer can't be set up");
+        return 0;
+    }
+    return 1;
+}
+
+// Parse everything in the ring, with scan-out releasing buffers meanwhile
+static void drain(framebuffer_t *framebuffer) {
+    while (frame_stream_free(&stream) < FRAME_STREAM_RING_SIZE) {
+        if (frame_stream_process(&stream, framebuffer, SIZE_MAX) == 0) {
+            framebuffer_sync(framebuffer);
+        }
+    }
+}
+
+static uint32_t fill_color(int frame) {
+    return (uint32_t) frame * 0x030507 & 0xffffff;
+}
+
+// More filled frames than the ring holds without parsing in between. The
+// frames that made it into the ring whole are still shown, nothing after
+// the first byte lost is taken until the controller resets the stream.
+static void check_overflow(void) {
+    static uint8_t data[2 * FRAME_STREAM_RING_SIZE];
+    framebuffer_t framebuffer;
+    if (!setup(&framebuffer)) {
+        return;
+    }
+
+    size_t sent = 0;
+    int frames = 0;
+    int whole = 0;
+    while (sent + 16 <= sizeof(data)) {
+        sent += put_fill(data + sent, &framebuffer, fill_color(frames++));
+        whole += sent <= FRAME_STREAM_RING_SIZE;
+    }
+    size_t pushed = push(data, sent);
+    CHECK(pushed == FRAME_STREAM_RING_SIZE, "%zu of %zu bytes pushed into the ring", pushed, sent);
+    CHECK(frame_stream_status(&stream) == FRAME_STREAM_OVERFLOW, "status 0x%02x after overflowing",
+          frame_stream_status(&stream));
+
+    drain(&framebuffer);
+    CHECK(stream.frames == (uint32_t) whole && shows(&framebuffer, fill_color(whole - 1)),
+          "%u frames shown, %d made it into the ring", stream.frames, whole);
+    CHECK(push(data, 1) == 0, "bytes are taken after an overflow");
+
+    frame_stream_request_reset(&stream);
+    CHECK(frame_stream_status(&stream) == 0, "status 0x%02x after a reset", frame_stream_status(&stream));
+    size_t size = put_fill(data, &framebuffer, 0x00ff00);
+    CHECK(push(data, size) == size, "bytes dropped after a reset");
+    drain(&framebuffer);
+    CHECK(stream.frames == (uint32_t) whole + 1 && shows(&framebuffer, 0x00ff00), "%u frames after the reset",
+          stream.frames);
+    printf("overflow: %zu of %zu bytes taken, %d of %d frames shown, status 0x%02x\n", pushed, sent, whole,
+           frames, frame_stream_status(&stream));
+}
+
+// An unknown command loses sync, nothing is drawn until a reset
+static void check_sync_loss(void) {
+    static uint8_t data[256];
+    framebuffer_t framebuffer;
+    if (!setup(&framebuffer)) {
+        return;
+    }
+
+    size_t size = 0;
+    data[size++] = 0x7f;
+    size += put_fill(data + size, &framebuffer, 0x0000ff);
+    size += put_fill(data + size, &framebuffer, 0x00ffff);
+    push(data, size);
+    frame_stream_process(&stream, &framebuffer, SIZE_MAX);
+    CHECK(frame_stream_status(&stream) == FRAME_STREAM_SYNC_LOST, "status 0x%02x after an unknown command",
+          frame_stream_status(&stream));
+    CHECK(stream.frames == 0 && shows(&framebuffer, 0), "%u frames drawn without sync", stream.frames);
+    CHECK(frame_stream_free(&stream) == FRAME_STREAM_RING_SIZE, "%zu bytes left in the ring",
+          FRAME_STREAM_RING_SIZE - frame_stream_free(&stream));
+
+    frame_stream_request_reset(&stream);
+    size = put_fill(data, &framebuffer, 0xffffff);
+    push(data, size);
+    frame_stream_process(&stream, &framebuffer, SIZE_MAX);
+    CHECK(frame_stream_status(&stream) == 0, "status 0x%02x after a reset", frame_stream_status(&stream));
+    CHECK(stream.frames == 1 && shows(&framebuffer, 0xffffff), "%u frames after the reset", stream.frames);
+    printf("sync loss: %u frames after the reset, status 0x%02x\n", stream.frames, frame_stream_status(&stream));
+}
+
+// A reset halfway through a rectangle, with part of it parsed and the rest
+// still in the ring, drops all of it
+static void check_reset(void) {
+    static uint8_t data[4096];
+    framebuffer_t framebuffer;
+    if (!setup(&framebuffer)) {
+        return;
+    }
+    int width = framebuffer.width;
+    int height = framebuffer.height;
+
+    size_t size = stream_put_rect(data, FRAME_STREAM_RECT_RGB888, 0, 0, width, height);
+    size += stream_put_pixels(data + size, FRAME_STREAM_RECT_RGB888, 0, 0, width, height, 5);
+    push(data, size / 2);
+    frame_stream_process(&stream, &framebuffer, size / 4);
+    CHECK(frame_stream_free(&stream) < FRAME_STREAM_RING_SIZE, "nothing left in the ring before the reset");
+
+    frame_stream_request_reset(&stream);
+    size = put_fill(data, &framebuffer, 0xffff00);
+    push(data, size);
+    frame_stream_process(&stream, &framebuffer, SIZE_MAX);
+    CHECK(frame_stream_status(&stream) == 0, "status 0x%02x after a reset", frame_stream_status(&stream));
+    CHECK(stream.frames == 1 && shows(&framebuffer, 0xffff00), "%u frames after the reset, or the frame "
+          "holds the rectangle", stream.frames);
+    printf("reset: %u frames, status 0x%02x\n", stream.frames, frame_stream_status(&stream));
+}
+
+// Commits while scan-out holds every buffer. The stream waits at the
+// command that needs a buffer and carries on from there once scan-out
+// releases one, a COMMIT without anything drawn shows the last frame again.
+static void check_commit_busy(void) {
+    static uint8_t data[256];
+    // One buffer is on screen, the others take a frame each
+    static const uint32_t colors[FRAMEBUFFER_BUFFERS - 1] = { 0x102030, 0x405060 };
+    framebuffer_t framebuffer;
+    if (!setup(&framebuffer)) {
+        return;
+    }
+
+    size_t size = 0;
+    for (int i = 0; i < COUNT_OF(colors); i++) {
+        size += put_fill(data + size, &framebuffer, colors[i]);
+    }
+    data[size++] = FRAME_STREAM_COMMIT;
+    size_t last = put_fill(data + size, &framebuffer, 0xa0b0c0);
+    size += last;
+    push(data, size);
+
+    frame_stream_process(&stream, &framebuffer, SIZE_MAX);
+    CHECK(framebuffer_begin(&framebuffer) == FRAMEBUFFER_BUSY, "scan-out doesn't hold every buffer");
+    CHECK(stream.frames == COUNT_OF(colors) && shows(&framebuffer, colors[COUNT_OF(colors) - 1]),
+          "%u frames committed before scan-out held every buffer", stream.frames);
+    size_t left = FRAME_STREAM_RING_SIZE - frame_stream_free(&stream);
+    CHECK(left == last + 1, "%zu bytes waiting, %zu expected", left, last + 1);
+
+    // Scan-out picks up the newest frame and releases the others
+    while (frame_stream_process(&stream, &framebuffer, 1) == 0) {
+        framebuffer_sync(&framebuffer);
+    }
+    CHECK(stream.frames == COUNT_OF(colors) + 1 && shows(&framebuffer, colors[COUNT_OF(colors) - 1]),
+          "the empty commit doesn't show the last frame");
+    frame_stream_process(&stream, &framebuffer, SIZE_MAX);
+    CHECK(stream.frames == COUNT_OF(colors) + 2 && shows(&framebuffer, 0xa0b0c0), "%u frames after waiting",
+          stream.frames);
+    CHECK(frame_stream_status(&stream) == 0 && frame_stream_free(&stream) == FRAME_STREAM_RING_SIZE,
+          "status 0x%02x, %zu bytes left", frame_stream_status(&stream),
+          FRAME_STREAM_RING_SIZE - frame_stream_free(&stream));
+    printf("commit while busy: %zu bytes waited, %u frames, status 0x%02x\n", left, stream.frames,
+           frame_stream_status(&stream));
+}
+
+// Fills reaching past the display, up to the largest one the header can
+// describe. Only the part on the display is drawn, so they return as fast
+// as a fill of the display itself.
+static void check_large_fill(void) {
+    static uint8_t data[256];
+    framebuffer_t framebuffer;
+    if (!setup(&framebuffer)) {
+        return;
+    }
+
+    size_t size = stream_put_rect(data, FRAME_STREAM_FILL, 0, 0, 0xffff, 0xffff);
+    data[size++] = 0x33;
+    data[size++] = 0x66;
+    data[size++] = 0x99;
+    data[size++] = FRAME_STREAM_COMMIT;
+    push(data, size);
+    clock_t start = clock();
+    drain(&framebuffer);
+    double fill_ms = (double) (clock() - start) * 1000 / CLOCKS_PER_SEC;
+    CHECK(stream.frames == 1 && shows(&framebuffer, 0x336699), "a 65535x65535 fill doesn't fill the display");
+
+    // Partly off the bottom right corner, and entirely off the display
+    int x0 = framebuffer.width - 5;
+    int y0 = framebuffer.height - 3;
+    size = stream_put_rect(data, FRAME_STREAM_FILL, x0, y0, 0xffff - x0, 0xffff - y0);
+    data[size++] = 0xff;
+    data[size++] = 0x00;
+    data[size++] = 0x00;
+    size += stream_put_rect(data + size, FRAME_STREAM_FILL, framebuffer.width, 0, 0xffff - framebuffer.width, 0xffff);
+    data[size++] = 0x00;
+    data[size++] = 0xff;
+    data[size++] = 0x00;
+    data[size++] = FRAME_STREAM_COMMIT;
+    push(data, size);
+    drain(&framebuffer);
+
+    static framebuffer_t reference;
+    if (reference.buffer == NULL && framebuffer_init(panel_config, &reference) != FRAMEBUFFER_OK) {
+        CHECK(0, "framebuffer can't be set up");
+        return;
+    }
+    framebuffer_begin(&reference);
+    for (int y = 0; y < reference.height; y++) {
+        for (int x = 0; x < reference.width; x++) {
+            framebuffer_drawpixel(&reference, x, y, x >= x0 && y >= y0 ? 0xff0000 : 0x336699);
+        }
+    }
+    int same = memcmp(framebuffer.latest, reference.buffer, reference.buffer_size) == 0;
+    CHECK(stream.frames == 2 && same, "fills past the corner draw outside their part of the display");
+    CHECK(frame_stream_status(&stream) == 0, "status 0x%02x after large fills", frame_stream_status(&stream));
+    printf("65535x65535 fill: %.3f ms, clipped fills %s\n", fill_ms, same ? "match" : "DIFFER");
+}
+
+int main(void) {
+    print_stream_benchmark();
+    check_overflow();
+    check_sync_loss();
+    check_reset();
+    check_commit_busy();
+    check_large_fill();
+    return test_result();
+}
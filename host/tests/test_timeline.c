@@ -0,0 +1,98 @@
+// Where the CPU time of one bit-banged BCM cycle goes. GPIO writes cost a
+// few cycles here so shifting takes about as long as on the RP2040, waiting
+// for the OE pulse counts as idle. Built with FRAMEBUFFER_OE_PULSE=0 the
+// same test shows the busy-wait latch for comparison.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include "framebuffer.h"
+#include "hub75_stream.h"
+#include "panel_model.h"
+#include "platform/platform.h"
+#include "test.h"
+
+#define TIMELINE_BAR 64
+
+static framebuffer_t fb;
+
+static void print_timeline(void) {
+    hub75_timing_t bitbang = hub75_bitbang_timing(125);
+    platform_host_set_gpio_hook(panel_gpio_hook);
+    platform_host_set_gpio_cycles(bitbang.column_cycles / 4);
+    if (framebuffer_init(panel_config, &fb) != FRAMEBUFFER_OK) {
+        CHECK(0, "framebuffer can't be set up");
+        return;
+    }
+    framebuffer_begin(&fb);
+    for (int y = 0; y < fb.height; y++) {
+        for (int x = 0; x < fb.width; x++) {
+            framebuffer_drawpixel(&fb, x, y, 0xffffff);
+        }
+    }
+    framebuffer_commit(&fb);
+
+    // Settle on the new frame, then run one cycle from its first slice
+    uint32_t start = fb.refresh_count;
+    while (fb.refresh_count - start < 2 || fb.pwm != fb.slice_count) {
+        framebuffer_sync(&fb);
+    }
+    memset(lit_us, 0, sizeof(lit_us));
+
+    printf("OE %s, %u cycles per GPIO write\n", FRAMEBUFFER_OE_PULSE ? "pulse" : "busy-wait", bitbang.column_cycles / 4);
+    printf("slice  plane  lit us  busy us  idle us  cpu (# busy, . idle)\n");
+    uint64_t scheduled_us = 0;
+    uint64_t cycle_start = platform_host_cycles();
+    uint64_t cycle_idle = platform_host_idle_cycles();
+    for (int s = 0; s < fb.slice_count; s++) {
+        uint64_t cycles = platform_host_cycles();
+        uint64_t idle = platform_host_idle_cycles();
+        framebuffer_sync(&fb);
+        cycles = platform_host_cycles() - cycles;
+        idle = platform_host_idle_cycles() - idle;
+
+        char bar[TIMELINE_BAR + 1];
+        int idle_chars = (int) (idle * TIMELINE_BAR / cycles);
+        memset(bar, '#', TIMELINE_BAR - idle_chars);
+        memset(bar + TIMELINE_BAR - idle_chars, '.', idle_chars);
+        bar[TIMELINE_BAR] = 0;
+        scheduled_us += (uint64_t) fb.slices[s].lit_us * DISPLAY_SCAN;
+        printf("%5d  %5d  %6d  %7.1f  %7.1f  %s\n", s, fb.slices[s].plane, fb.slices[s].lit_us,
+               (double) (cycles - idle) / 125, (double) idle / 125, bar);
+    }
+    uint64_t cycles = platform_host_cycles() - cycle_start;
+    uint64_t idle = platform_host_idle_cycles() - cycle_idle;
+
+    // The busy-wait model keeps the CPU in the latch for the whole cycle
+    hub75_timing_t busy_wait = { 125, 14, 24, 0 };
+    printf("cycle %.1f us, busy %.1f%%, idle %.1f%%, %.1f Hz\n", (double) cycles / 125,
+           100.0 * (cycles - idle) / cycles, 100.0 * idle / cycles, 125e6 / cycles);
+    double model_hz = hub75_refresh_model(&fb.config, fb.slices, fb.slice_count, &bitbang);
+    double busy_wait_hz = hub75_refresh_model(&fb.config, fb.slices, fb.slice_count, &busy_wait);
+    printf("model %.1f Hz, busy-wait model %.1f Hz with the CPU busy 100%%\n", model_hz, busy_wait_hz);
+    // Every row is latched once per slice, a row that stays on while the
+    // next one is shifted in is lit longer than scheduled
+    uint64_t lit = lit_us[0][0][0];
+    scheduled_us /= DISPLAY_SCAN;
+    printf("top left red lit %llu us per cycle, scheduled %llu us\n",
+           (unsigned long long) lit, (unsigned long long) scheduled_us);
+    platform_host_set_gpio_cycles(0);
+
+    double hz = 125e6 / cycles;
+#if FRAMEBUFFER_OE_PULSE
+    // The pulse lights a row for exactly its slice and frees the CPU
+    CHECK(lit == scheduled_us, "lit %llu us", (unsigned long long) lit);
+    CHECK(idle * 2 > cycles, "idle %.1f%%", 100.0 * idle / cycles);
+    // The model is a few percent pessimistic for short slices
+    CHECK(hz > model_hz * 0.97 && hz < model_hz * 1.05, "%.1f Hz", hz);
+#else
+    CHECK(lit >= scheduled_us, "lit %llu us", (unsigned long long) lit);
+    CHECK(idle == 0, "idle %.1f%%", 100.0 * idle / cycles);
+    CHECK(hz > busy_wait_hz * 0.97 && hz < busy_wait_hz * 1.03, "%.1f Hz", hz);
+#endif
+}
+
+int main(void) {
+    print_timeline();
+    return test_result();
+}
@@ -0,0 +1,85 @@
+// Cost of validating a gif once, and decoding its frames with and without
+// the checks in the LZW decoder. Every image has to pass validation and the
+// trusted decode has to give the same frames as the checked one.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "gif_decoder.h"
+#include "test.h"
+
+#define INDEX_FRAMES 1024
+
+static gif_lzw_context_t lzw;
+
+static void print_validate_benchmark(int count, char *filenames[]) {
+    static uint8_t data[1024 * 1024];
+    static uint8_t pixels[64 * 1024];
+    static uint8_t checked_pixels[64 * 1024];
+    static gif_frame_index_t index[INDEX_FRAMES];
+
+    printf("LZW context %zu bytes, shared by every decode\n", sizeof(gif_lzw_context_t));
+    printf("gif            frames  validate ms  checked us  trusted us\n");
+    for (int i = 0; i < count; i++) {
+        size_t size = test_read_file(filenames[i], data, sizeof(data));
+        const char *name = test_basename(filenames[i]);
+
+        gif_t gif = { .lzw = &lzw };
+        uint16_t frames;
+        if (gif_decoder_init(data, size, &gif) != GIF_OK ||
+                gif_decoder_index(&gif, index, INDEX_FRAMES, &frames) != GIF_OK) {
+            printf("%-14.14s can't be indexed\n", name);
+            continue;
+        }
+
+        int passes = 0;
+        gif_error_t res;
+        clock_t start = clock();
+        do {
+            res = gif_decoder_validate(&gif, pixels, sizeof(pixels));
+            passes++;
+        } while (res == GIF_OK && clock() - start < CLOCKS_PER_SEC / 20);
+        double validate_ms = (double) (clock() - start) * 1e3 / CLOCKS_PER_SEC / passes;
+        if (res != GIF_OK) {
+            printf("%-14.14s fails validation\n", name);
+            CHECK(0, "%s fails validation", name);
+            continue;
+        }
+        CHECK(gif.trusted, "%s isn't trusted after validation", name);
+
+        // Skipping the checks can't change a pixel
+        frame_t frame = { .frame = pixels };
+        frame_t checked = { .frame = checked_pixels };
+        int same = 1;
+        for (int n = 0; n < frames; n++) {
+            gif.trusted = 0;
+            gif_decoder_read_frame(&gif, &index[n], &checked);
+            gif.trusted = 1;
+            same &= gif_decoder_read_frame(&gif, &index[n], &frame) == GIF_OK &&
+                    memcmp(frame.frame, checked.frame, frame.width * frame.height) == 0;
+        }
+        CHECK(same, "%s decodes differently when trusted", name);
+
+        double frame_us[2];
+        for (int trusted = 0; trusted < 2; trusted++) {
+            gif.trusted = trusted;
+            passes = 0;
+            start = clock();
+            do {
+                for (int n = 0; n < frames; n++) {
+                    gif_decoder_read_frame(&gif, &index[n], &frame);
+                }
+                passes++;
+            } while (clock() - start < CLOCKS_PER_SEC / 10);
+            frame_us[trusted] = (double) (clock() - start) * 1e6 / CLOCKS_PER_SEC / passes / frames;
+        }
+
+        printf("%-14.14s %6u  %11.2f  %10.2f  %10.2f\n", name, frames, validate_ms, frame_us[0], frame_us[1]);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    print_validate_benchmark(argc - 1, argv + 1);
+    return test_result();
+}
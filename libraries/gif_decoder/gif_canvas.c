@@ -0,0 +1,147 @@
+#include <string.h>
+#include "gif_canvas.h"
+
+static void bounds_add(gif_bounds_t *bounds, int x, int y) {
+    if (x < bounds->x0) bounds->x0 = x;
+    if (y < bounds->y0) bounds->y0 = y;
+    if (x >= bounds->x1) bounds->x1 = x + 1;
+    if (y >= bounds->y1) bounds->y1 = y + 1;
+}
+
+// Clip a frame to the logical screen
+static gif_rect_t clip(const gif_canvas_t *canvas, int x, int y, int width, int height) {
+    gif_rect_t rect = { 0, 0, 0, 0 };
+    if (x >= canvas->width || y >= canvas->height) {
+        return rect;
+    }
+    rect.x = x;
+    rect.y = y;
+    rect.width = x + width > canvas->width ? canvas->width - x : width;
+    rect.height = y + height > canvas->height ? canvas->height - y : height;
+    return rect;
+}
+
+// Copy count pixels into row y of the canvas starting at x, src advances by
+// step per pixel so a step of 0 fills. Every run of pixels that changed
+// grows the bounds and goes to the span callback.
+static void copy_row(gif_canvas_t *canvas, int x, int y, const uint8_t *src, int step, int count) {
+    uint8_t *dst = canvas->pixels + y * canvas->width + x;
+    int i = 0;
+    while (i < count) {
+        if (dst[i] == *src) {
+            src += step;
+            i++;
+            continue;
+        }
+        int start = i;
+        do {
+            dst[i++] = *src;
+            src += step;
+        } while (i < count && dst[i] != *src);
+        bounds_add(&canvas->bounds, x + start, y);
+        bounds_add(&canvas->bounds, x + i - 1, y);
+        if (canvas->span != NULL) {
+            canvas->span(canvas->span_context, x + start, y, dst + start, i - start);
+        }
+    }
+}
+
+void gif_canvas_init(gif_canvas_t *canvas, const gif_t *gif, uint8_t *pixels, uint8_t *previous) {
+    canvas->width = gif->width;
+    canvas->height = gif->height;
+    canvas->pixels = pixels;
+    canvas->previous = previous;
+    canvas->background_index = gif->background_index;
+    canvas->disposal = GIF_DISPOSAL_UNSPECIFIED;
+
+    memset(pixels, canvas->background_index, canvas->width * canvas->height);
+    canvas->redraw = 1;
+}
+
+void gif_canvas_draw(gif_canvas_t *canvas, const frame_t *frame) {
+    gif_canvas_draw_spans(canvas, frame, NULL, NULL);
+}
+
+void gif_canvas_draw_spans(gif_canvas_t *canvas, const frame_t *frame, gif_canvas_span_t span, void *context) {
+    gif_canvas_begin(canvas, frame, span, context);
+    for (int y = 0; y < frame->height; y++) {
+        gif_canvas_draw_row(canvas, frame, y, frame->frame + y * frame->width);
+    }
+    gif_canvas_end(canvas, frame);
+}
+
+void gif_canvas_begin(gif_canvas_t *canvas, const frame_t *frame, gif_canvas_span_t span, void *context) {
+    canvas->bounds = (gif_bounds_t) { canvas->width, canvas->height, 0, 0 };
+
+    // Everything goes out in one go at the end
+    canvas->span = canvas->redraw ? NULL : span;
+    canvas->span_context = context;
+    canvas->end_span = span;
+
+    // Dispose of the previous frame
+    gif_rect_t *area = &canvas->disposal_rect;
+    if (canvas->disposal == GIF_DISPOSAL_BACKGROUND || canvas->disposal == GIF_DISPOSAL_PREVIOUS) {
+        for (int y = area->y; y < area->y + area->height; y++) {
+            if (canvas->disposal == GIF_DISPOSAL_PREVIOUS) {
+                copy_row(canvas, area->x, y, canvas->previous + y * canvas->width + area->x, 1, area->width);
+            } else {
+                copy_row(canvas, area->x, y, &canvas->background_index, 0, area->width);
+            }
+        }
+    }
+
+    gif_rect_t rect = clip(canvas, frame->offset_x, frame->offset_y, frame->width, frame->height);
+    if (frame->disposal == GIF_DISPOSAL_PREVIOUS) {
+        for (int y = rect.y; y < rect.y + rect.height; y++) {
+            memcpy(canvas->previous + y * canvas->width + rect.x,
+                   canvas->pixels + y * canvas->width + rect.x, rect.width);
+        }
+    }
+    canvas->disposal_rect = rect;
+}
+
+void gif_canvas_draw_row(gif_canvas_t *canvas, const frame_t *frame, int y, const uint8_t *pixels) {
+    // Since gif_canvas_begin() the area of the frame, clipped to the canvas
+    const gif_rect_t *rect = &canvas->disposal_rect;
+    if (y >= rect->height) {
+        return;
+    }
+
+    // Transparent pixels split a row into runs that are copied as a whole
+    if (!frame->transparancy_enabled) {
+        copy_row(canvas, rect->x, rect->y + y, pixels, 1, rect->width);
+        return;
+    }
+    int x = 0;
+    while (x < rect->width) {
+        if (pixels[x] == frame->transparancy_index) {
+            x++;
+            continue;
+        }
+        int start = x;
+        while (x < rect->width && pixels[x] != frame->transparancy_index) {
+            x++;
+        }
+        copy_row(canvas, rect->x + start, rect->y + y, pixels + start, 1, x - start);
+    }
+}
+
+void gif_canvas_end(gif_canvas_t *canvas, const frame_t *frame) {
+    canvas->disposal = frame->disposal;
+
+    // Whatever was shown before the first frame is unknown, redraw everything
+    if (canvas->redraw) {
+        canvas->redraw = 0;
+        canvas->dirty = (gif_rect_t) { 0, 0, canvas->width, canvas->height };
+        for (int y = 0; canvas->end_span != NULL && y < canvas->height; y++) {
+            canvas->end_span(canvas->span_context, 0, y, canvas->pixels + y * canvas->width, canvas->width);
+        }
+        return;
+    }
+    const gif_bounds_t *bounds = &canvas->bounds;
+    if (bounds->x1 <= bounds->x0) {
+        canvas->dirty = (gif_rect_t) { 0, 0, 0, 0 };
+        return;
+    }
+    canvas->dirty = (gif_rect_t) { bounds->x0, bounds->y0, bounds->x1 - bounds->x0, bounds->y1 - bounds->y0 };
+}
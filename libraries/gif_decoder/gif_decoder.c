@@ -4,7 +4,7 @@
 
 
 #include <string.h>
-#include <pico/printf.h>
+#include <stdio.h>
 #include <malloc.h>
 #include "gif_decoder.h"
 #include "gif_lzw_decompress.h"
@@ -44,11 +44,17 @@ typedef struct BYTE_ALIGNED {
 
 static gif_error_t gif_decoder_parse_extension_block(gif_t *gif);
 static gif_error_t find_next_image_block(gif_t *gif);
+static gif_error_t read_image(const gif_t *gif, uint8_t *ptr, frame_t *frame, uint8_t **next,
+                              const gif_rows_t *rows);
 
 gif_error_t gif_decoder_init(uint8_t *source, size_t size, gif_t *gif) {
     gif_header_t *header = (gif_header_t *) source;
     gif_log_scrn_descr_t *descriptor = (gif_log_scrn_descr_t *) (source + sizeof(gif_header_t));
 
+    if (size < sizeof(gif_header_t) + sizeof(gif_log_scrn_descr_t)) {
+        return GIF_ERROR;
+    }
+
     // Verify magic
     if (memcmp(&header->magic, "GIF", 3) != 0) {
         LOG_MSG("Invalid magic\n");
@@ -61,7 +67,7 @@ gif_error_t gif_decoder_init(uint8_t *source, size_t size, gif_t *gif) {
         return GIF_ERROR;
     }
 
-    if (descriptor->width != 32 && descriptor->height != 16) {
+    if (descriptor->width == 0 || descriptor->height == 0) {
         return GIF_ERROR;
     }
 
@@ -72,22 +78,29 @@ gif_error_t gif_decoder_init(uint8_t *source, size_t size, gif_t *gif) {
 
     gif->image_start = source;
     gif->image_size = size;
+    gif->width = descriptor->width;
+    gif->height = descriptor->height;
+    gif->background_index = descriptor->background_idx;
+    gif->disposal = GIF_DISPOSAL_UNSPECIFIED;
     gif->ct_size = 1 << (descriptor->packed.ct_size + 1);
     gif->global_ct = gif->image_start + sizeof(gif_header_t) + sizeof(gif_log_scrn_descr_t);
     gif->frame_ptr = gif->global_ct + (gif->ct_size * 3);
     gif->first_frame = gif->frame_ptr;
+    gif->trusted = 0;
+    if (gif->first_frame > source + size) {
+        return GIF_ERROR;
+    }
     return GIF_OK;
 }
 
-gif_error_t gif_decoder_read_next_frame(gif_t *gif, frame_t *frame) {
-    // Find next available frame
-    gif_error_t res = find_next_image_block(gif);
-    if (res != GIF_OK) {
-        return res;
-    }
-
-    uint8_t *ptr = gif->frame_ptr;
-    if (*ptr != BLOCK_IMAGE_DESCRIPTOR) {
+// Decode the image that starts with the descriptor at ptr, row by row when
+// rows isn't NULL. When next isn't NULL it is set to the first block after
+// the image data.
+static gif_error_t read_image(const gif_t *gif, uint8_t *ptr, frame_t *frame, uint8_t **next,
+                              const gif_rows_t *rows) {
+    uint8_t *end_ptr = gif->image_start + gif->image_size;
+    // Descriptor, LZW minimum code size and at least the block terminator
+    if (end_ptr - ptr < 12 || *ptr != BLOCK_IMAGE_DESCRIPTOR) {
         return GIF_ERROR;
     }
     ptr++;
@@ -114,33 +127,39 @@ gif_error_t gif_decoder_read_next_frame(gif_t *gif, frame_t *frame) {
         return GIF_ERROR;
     }
 
+    // Callers size their frame buffer after the logical screen
+    if (x_offset + width > gif->width || y_offset + height > gif->height) {
+        LOG_MSG("Frame outside of the logical screen\n");
+        return GIF_ERROR;
+    }
+
     frame->offset_x = x_offset;
     frame->offset_y = y_offset;
     frame->width = width;
     frame->height = height;
 
-    if (frame->frame == NULL) {
+    if (frame->frame == NULL || gif->lzw == NULL) {
         LOG_MSG("Not enough free memory for the frame\n");
         return GIF_ERROR;
     }
 
-    if (frame->color_table == NULL) {
-        LOG_MSG("Not enough free memory for the color_table\n");
-        return GIF_ERROR;
-    }
-
-    memcpy(frame->color_table, gif->global_ct, gif->ct_size * 3);
+    // Only the global color table is supported, it's the same for every frame
+    frame->color_table = gif->global_ct;
 
-    // We get a number of values from the GCE block, copy them over to the frame
-    frame->transparancy_enabled = gif->transparancy_enabled;
-    if (frame->transparancy_enabled) {
-        frame->transparancy_index = gif->transparancy_index;
-        LOG_MSG("Transparency enabled, index is %d\n", gif->transparancy_index);
+    // Every check in the LZW decoder costs time for every code, they are
+    // only needed until the gif has been validated as a whole
+    ptr++;
+    gif_error_t res;
+    if (rows != NULL) {
+        rows->begin(rows->context, frame);
+        res = gif->trusted ? gif_decoder_read_image_rows_trusted(gif->lzw, ptr, frame->frame, width,
+                                                                 rows->row, rows->context)
+                : gif_decoder_read_image_rows(gif->lzw, ptr, end_ptr, frame->frame, width, height,
+                                              rows->row, rows->context);
+    } else {
+        res = gif->trusted ? gif_decoder_read_image_data_trusted(gif->lzw, ptr, frame->frame)
+                : gif_decoder_read_image_data(gif->lzw, ptr, end_ptr, frame->frame, width * height);
     }
-
-    frame->delay = gif->delay;
-
-    res = gif_decoder_read_image_data(++ptr, frame->frame);
     if (res != GIF_OK) {
         LOG_MSG("Read image failed\n");
         return res;
@@ -148,10 +167,10 @@ gif_error_t gif_decoder_read_next_frame(gif_t *gif, frame_t *frame) {
 
     LOG_MSG("--- Frame %dx%d ---\n", frame->width, frame->height);
     uint8_t *frame_ptr = frame->frame;
-    for (int y=0; y<frame->height; y++) {
+    for (int y=0; rows == NULL && y<frame->height; y++) {
         for (int x=0; x<frame->width; x++) {
             uint8_t pattern_key = *frame_ptr;
-            if (pattern_key == gif->transparancy_index && gif->transparancy_enabled) {
+            if (pattern_key == frame->transparancy_index && frame->transparancy_enabled) {
                 LOG_MSG("  ");
             } else {
                 LOG_MSG("%02x", pattern_key);
@@ -162,19 +181,164 @@ gif_error_t gif_decoder_read_next_frame(gif_t *gif, frame_t *frame) {
     }
     LOG_MSG("--- End Frame ---\n");
 
+    if (next == NULL) {
+        return GIF_OK;
+    }
+
     // Jump over the blocks we just parsed
     ptr++; // Skip root key size
-    while (*ptr != 0) {  // TODO Danger bounds check
+    while (ptr < end_ptr && *ptr != 0) {
         uint8_t block_size = *ptr++;
         LOG_MSG("Processed data sub block of size %d\n", block_size);
         ptr += block_size;
     }
+    if (ptr >= end_ptr) {
+        return GIF_ERROR;
+    }
     ptr++;
-    gif->frame_ptr = ptr;
+    *next = ptr;
+
+    return GIF_OK;
+}
+
+static gif_error_t read_next_frame(gif_t *gif, frame_t *frame, const gif_rows_t *rows) {
+    // Find next available frame
+    gif_error_t res = find_next_image_block(gif);
+    if (res != GIF_OK) {
+        return res;
+    }
+
+    // We get a number of values from the GCE block, copy them over to the frame
+    frame->transparancy_enabled = gif->transparancy_enabled;
+    if (frame->transparancy_enabled) {
+        frame->transparancy_index = gif->transparancy_index;
+        LOG_MSG("Transparency enabled, index is %d\n", gif->transparancy_index);
+    }
+
+    frame->delay = gif->delay;
+    frame->disposal = gif->disposal;
+
+    return read_image(gif, gif->frame_ptr, frame, &gif->frame_ptr, rows);
+}
+
+gif_error_t gif_decoder_read_next_frame(gif_t *gif, frame_t *frame) {
+    return read_next_frame(gif, frame, NULL);
+}
+
+gif_error_t gif_decoder_read_next_frame_rows(gif_t *gif, frame_t *frame, const gif_rows_t *rows) {
+    return read_next_frame(gif, frame, rows);
+}
+
+static void validate_begin(void *context, const frame_t *frame) {
+    (void) context;
+    (void) frame;
+}
+
+static void validate_row(void *context, int y, const uint8_t *pixels) {
+    (void) context;
+    (void) y;
+    (void) pixels;
+}
+
+gif_error_t gif_decoder_validate(gif_t *gif, uint8_t *buffer, size_t size) {
+    if (size < gif->width) {
+        return GIF_ERROR;
+    }
 
+    // Row by row checks exactly what decoding the whole frame does
+    gif_t scan = *gif;
+    scan.trusted = 0;
+    scan.frame_ptr = scan.first_frame;
+    frame_t frame = { .frame = buffer };
+    gif_rows_t rows = { validate_begin, validate_row, NULL };
+
+    int frames = 0;
+    gif_error_t res;
+    while ((res = read_next_frame(&scan, &frame, &rows)) == GIF_OK) {
+        frames++;
+    }
+    if (res != GIF_EOF || frames == 0) {
+        return GIF_ERROR;
+    }
+    gif->trusted = 1;
+    return GIF_OK;
+}
+
+gif_error_t gif_decoder_index(const gif_t *gif, gif_frame_index_t *index, uint16_t max_frames, uint16_t *frame_count) {
+    // Extension blocks are parsed on a copy, so the values in a GCE carry
+    // over to the frames after it exactly like they do when reading in order
+    gif_t scan = *gif;
+    scan.frame_ptr = scan.first_frame;
+    uint8_t *end_ptr = scan.image_start + scan.image_size;
+
+    uint16_t count = 0;
+    gif_error_t res;
+    while ((res = find_next_image_block(&scan)) == GIF_OK) {
+        uint8_t *ptr = scan.frame_ptr;
+        // Descriptor, LZW minimum code size and at least the block terminator
+        if (count == max_frames || end_ptr - ptr < 12) {
+            return GIF_ERROR;
+        }
+        if (ptr[9] & 0xc0) {
+            LOG_MSG("Can't index interlaced frames or local color tables\n");
+            return GIF_ERROR;
+        }
+
+        gif_frame_index_t *entry = &index[count];
+        entry->descriptor = ptr - scan.image_start;
+        entry->delay = scan.delay;
+        entry->disposal = scan.disposal;
+        entry->transparancy_enabled = scan.transparancy_enabled;
+        entry->transparancy_index = scan.transparancy_index;
+        entry->reserved = 0;
+
+        // Drawn over the whole screen without holes, and not taken back
+        // afterwards, the frames that follow don't need anything before it
+        uint16_t x_offset = ptr[1] | ptr[2] << 8;
+        uint16_t y_offset = ptr[3] | ptr[4] << 8;
+        uint16_t width = ptr[5] | ptr[6] << 8;
+        uint16_t height = ptr[7] | ptr[8] << 8;
+        int key = x_offset == 0 && y_offset == 0 && width == gif->width && height == gif->height &&
+                !scan.transparancy_enabled && scan.disposal != GIF_DISPOSAL_PREVIOUS;
+        entry->key = key || count == 0 ? count : index[count - 1].key;
+
+        // Skip the data sub-blocks
+        ptr += 11;
+        while (ptr < end_ptr && *ptr != 0) {
+            ptr += *ptr + 1;
+        }
+        if (ptr >= end_ptr) {
+            return GIF_ERROR;
+        }
+        scan.frame_ptr = ptr + 1;
+        count++;
+    }
+
+    if (res != GIF_EOF || count == 0) {
+        return GIF_ERROR;
+    }
+    *frame_count = count;
     return GIF_OK;
 }
 
+static gif_error_t read_indexed_frame(const gif_t *gif, const gif_frame_index_t *entry, frame_t *frame,
+                                      const gif_rows_t *rows) {
+    frame->transparancy_enabled = entry->transparancy_enabled;
+    frame->transparancy_index = entry->transparancy_index;
+    frame->delay = entry->delay;
+    frame->disposal = entry->disposal;
+    return read_image(gif, gif->image_start + entry->descriptor, frame, NULL, rows);
+}
+
+gif_error_t gif_decoder_read_frame(const gif_t *gif, const gif_frame_index_t *entry, frame_t *frame) {
+    return read_indexed_frame(gif, entry, frame, NULL);
+}
+
+gif_error_t gif_decoder_read_frame_rows(const gif_t *gif, const gif_frame_index_t *entry, frame_t *frame,
+                                        const gif_rows_t *rows) {
+    return read_indexed_frame(gif, entry, frame, rows);
+}
+
 // Set the frame_ptr to the next available image
 // and process any extension blocks in the meantime
 static gif_error_t find_next_image_block(gif_t *gif) {
@@ -197,6 +361,10 @@ static gif_error_t find_next_image_block(gif_t *gif) {
 
         switch (*ptr) {
             case BLOCK_EXTENSION_INTRODUCER:
+                // Introducer, label and the size of the first sub-block, a GCE is 8 bytes
+                if (end_ptr - ptr < 3 || (*(ptr+1) == EXTBLOCK_GCE && end_ptr - ptr < 8)) {
+                    return GIF_ERROR;
+                }
                 LOG_MSG("Extension block, type 0x%02x, size %d\n", *(ptr+1), *(ptr+2));
                 if (*(ptr+1) == 0xFF) {
                     LOG_MSG("Expect subblocks\n");
@@ -258,6 +426,7 @@ static gif_error_t gif_decoder_parse_extension_block(gif_t *gif) {
     uint8_t transparent_idx = *ptr++;
     ptr++; // skip block terminator
 
+    gif->disposal = (fields >> 2) & 0x07;
     gif->transparancy_enabled = fields & 0x01;
     if (gif->transparancy_enabled) {
         LOG_MSG("Transparency enabled, index %d\n", transparent_idx);
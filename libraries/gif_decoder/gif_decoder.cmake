@@ -2,6 +2,7 @@ add_library(gif_decoder INTERFACE)
 
 target_sources(gif_decoder INTERFACE
         ${CMAKE_CURRENT_LIST_DIR}/gif_decoder.c
+        ${CMAKE_CURRENT_LIST_DIR}/gif_canvas.c
         ${CMAKE_CURRENT_LIST_DIR}/gif_lzw_decompress.c
 )
 
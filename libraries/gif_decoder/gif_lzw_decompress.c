@@ -14,30 +14,122 @@
 #define LOG_MSG(...)
 #endif
 
-typedef struct {
-    uint16_t length;
-    uint16_t prefix;
-    uint8_t  string_part;
-} entry_t;
-
+// The LZW code size never grows beyond 12 bits
+#define MAX_CODE_SIZE 12
+#define MAX_TABLE_SIZE (1 << MAX_CODE_SIZE)
+
+// A table entry is a single word: the length of its string, the code of
+// the string it extends and the pixel it adds. Strings never grow longer
+// than the table, so 12 bits hold the length as well.
+#define ENTRY(length, prefix, suffix) ((uint32_t) (length) << 20 | (uint32_t) (prefix) << 8 | (suffix))
+#define ENTRY_LENGTH(entry) ((entry) >> 20)
+#define ENTRY_PREFIX(entry) ((entry) >> 8 & 0xfff)
+#define ENTRY_SUFFIX(entry) ((uint8_t) (entry))
+
+// Only the bit reader lives on the stack, the table is in the context
 typedef struct {
     uint8_t code_size;
     uint8_t bits_remaining;
-    uint16_t current;
-    uint8_t *data_ptr;
+    uint32_t current;
+    const uint8_t *data_ptr;
+    const uint8_t *data_end; // Checked decoder only
     uint16_t table_size;
-    entry_t table[4096];
-    uint8_t *frame;
     uint8_t bytes_remaining_in_block;
+    uint8_t error;
 } reader_state_t;
 
-static void init_table(reader_state_t *reader_state, uint16_t key_size);
-static void add_table_entry(reader_state_t *reader_state, uint16_t length, uint16_t prefix, uint8_t suffix);
-static uint16_t read_bits(reader_state_t *reader_state);
+// Returned by read_bits() once the sub-blocks run out
+#define LZW_END_OF_DATA 0xFFFF
+
+static void init_table(uint32_t *table, reader_state_t *reader_state, uint16_t key_size);
+static inline uint16_t read_bits(reader_state_t *reader_state, int checked);
+
+// Write the string of entry backwards from its last pixel, returns the end of it
+static inline __attribute__((always_inline)) uint8_t *emit(const uint32_t *table, uint32_t entry, uint8_t *out) {
+    uint8_t *string_end = out + ENTRY_LENGTH(entry);
+    uint8_t *ptr = string_end;
+    do {
+        *--ptr = ENTRY_SUFFIX(entry);
+        entry = table[ENTRY_PREFIX(entry)];
+    } while (ptr > out);
+    return string_end;
+}
 
+// Row being written by the row by row decoder, full rows go to callback
+typedef struct {
+    uint8_t *ptr;
+    uint8_t *start;
+    uint8_t *end;
+    int y;
+    gif_row_t callback;
+    void *context;
+} rows_t;
+
+static void rows_flush(rows_t *rows) {
+    rows->callback(rows->context, rows->y++, rows->start);
+    rows->ptr = rows->start;
+}
 
-gif_lzw_error_t gif_decoder_read_image_data(uint8_t *data, uint8_t *buffer) {
-    uint8_t *ptr = data;
+static inline __attribute__((always_inline)) void rows_put(rows_t *rows, uint8_t pixel) {
+    *rows->ptr++ = pixel;
+    if (rows->ptr == rows->end) {
+        rows_flush(rows);
+    }
+}
+
+// Write a string that doesn't fit in what is left of the row. Every part
+// walks the string from its last pixel, skipping the ones that belong to
+// later rows. Returns the first pixel of the string.
+static __attribute__((noinline)) uint8_t rows_emit_split(const uint32_t *table, uint32_t entry, rows_t *rows) {
+    uint32_t remaining = ENTRY_LENGTH(entry);
+    uint8_t first = 0;
+    int first_part = 1;
+    while (remaining > 0) {
+        uint32_t room = rows->end - rows->ptr;
+        uint32_t count = remaining < room ? remaining : room;
+        uint32_t part = entry;
+        for (uint32_t skip = remaining - count; skip > 0; skip--) {
+            part = table[ENTRY_PREFIX(part)];
+        }
+        uint8_t *ptr = rows->ptr + count;
+        while (ptr > rows->ptr) {
+            *--ptr = ENTRY_SUFFIX(part);
+            part = table[ENTRY_PREFIX(part)];
+        }
+        if (first_part) {
+            first = *rows->ptr;
+            first_part = 0;
+        }
+        rows->ptr += count;
+        remaining -= count;
+        if (rows->ptr == rows->end) {
+            rows_flush(rows);
+        }
+    }
+    return first;
+}
+
+// Write the string of entry into the rows, returns its first pixel
+static inline __attribute__((always_inline)) uint8_t rows_emit(const uint32_t *table, uint32_t entry, rows_t *rows) {
+    if (ENTRY_LENGTH(entry) >= rows->end - rows->ptr) {
+        return rows_emit_split(table, entry, rows);
+    }
+    uint8_t *string = rows->ptr;
+    rows->ptr = emit(table, entry, rows->ptr);
+    return *string;
+}
+
+// Shared by the checked and the trusted decoder, writing into a buffer or
+// row by row. checked and whether rows is NULL are constants, so every
+// variant is compiled without the branches of the others. size is the
+// number of pixels the image holds, only used when checked.
+static inline __attribute__((always_inline))
+gif_lzw_error_t read_image_data(gif_lzw_context_t *context, const uint8_t *data, const uint8_t *end,
+                                uint8_t *buffer, size_t size, rows_t *rows, int checked) {
+    const uint8_t *ptr = data;
+    if (checked && end - ptr < 2) {
+        return GIF_LZW_ERROR;
+    }
     uint8_t root_size = *ptr;
 
     if (root_size < 2 || root_size > 8) {
@@ -52,6 +144,9 @@ gif_lzw_error_t gif_decoder_read_image_data(uint8_t *data, uint8_t *buffer) {
     uint16_t stop_code = clear_code + 1;
 
     uint8_t block_size = *ptr;
+    if (checked && block_size >= end - ptr) {
+        return GIF_LZW_ERROR;
+    }
 
     LOG_MSG("LZW variable code root size %d\n", root_size);
     LOG_MSG("Current block size %d\n", block_size);
@@ -64,26 +159,30 @@ gif_lzw_error_t gif_decoder_read_image_data(uint8_t *data, uint8_t *buffer) {
     reader_state_t reader_state = {
             .code_size = root_size + 1,
             .bits_remaining = 0,
+            .current = 0,
             .data_ptr = ptr + 1,
+            .data_end = end,
             .bytes_remaining_in_block = block_size,
+            .error = 0,
     };
-    init_table(&reader_state, root_size);
+    uint32_t *table = context->table;
+    init_table(table, &reader_state, root_size);
 
     LOG_MSG("Setup bit_size %d, clear_code %02x, stop_code %02x\n", reader_state.code_size, clear_code, stop_code);
-    LOG_MSG("Table initialized with %d entries, keysize increase at %d\n", reader_state.table_size, (1<<reader_state.code_size) -1);
 
-    uint16_t pattern_length = 0;
-    entry_t *code_table_entry;
     uint8_t *buffer_ptr = buffer;
-    uint16_t code, old_code;
+    uint8_t *buffer_end = rows ? NULL : buffer + size;
+    size_t left = size; // Pixels the image has room for, row by row only
+    uint16_t code, old_code = 0;
+    uint8_t old_first = 0; // First pixel of the string of old_code
     uint8_t first_code = 1; // special marker that we are expecting the first code
     while (1) {
-        code = read_bits(&reader_state);
+        code = read_bits(&reader_state, checked);
         LOG_MSG("Code %04x (%d)\n", code, code);
 
         if (code == clear_code) {
             LOG_MSG("  Cleaning table and resetting key size after clear code\n");
-            init_table(&reader_state, root_size);
+            init_table(table, &reader_state, root_size);
             reader_state.code_size = root_size + 1;
             first_code = 1;
             continue;
@@ -94,154 +193,167 @@ gif_lzw_error_t gif_decoder_read_image_data(uint8_t *data, uint8_t *buffer) {
             break;
         }
 
+        if (code > reader_state.table_size) {
+            // Running out of data ends the image like a stop code, a code
+            // that isn't in the table yet can only come from a broken stream
+            if (checked && code != LZW_END_OF_DATA) {
+                return GIF_LZW_ERROR;
+            }
+            LOG_MSG("  Code %d beyond the table, stream ended early\n", code);
+            break;
+        }
+
         if (first_code) {
-            LOG_MSG("  Output first code %02d\n", reader_state.table[code].string_part);
-            *buffer_ptr++ = reader_state.table[code].string_part;
+            if (checked && (code == reader_state.table_size || (rows ? left == 0 : buffer_ptr == buffer_end))) {
+                return GIF_LZW_ERROR;
+            }
+            LOG_MSG("  Output first code %02d\n", ENTRY_SUFFIX(table[code]));
+            if (rows) {
+                left--;
+                rows_put(rows, ENTRY_SUFFIX(table[code]));
+            } else {
+                *buffer_ptr++ = ENTRY_SUFFIX(table[code]);
+            }
             old_code = code;
+            old_first = ENTRY_SUFFIX(table[code]);
             first_code = 0;
             continue;
         }
 
+        // The string of a code that isn't in the table yet is the previous
+        // string followed by its own first pixel. Either way the first pixel
+        // of the string is known once it is written out.
+        uint32_t old_entry = table[old_code];
+        uint8_t first;
         if (code < reader_state.table_size) {
-            // Find the first pixel of the current sequence
-            entry_t *tmp_ptr = &reader_state.table[code];
-            while(1) {
-                if (tmp_ptr->prefix == 0xFFF) {
-                    break;
-                }
-                tmp_ptr = &reader_state.table[tmp_ptr->prefix];
+            uint32_t entry = table[code];
+            if (checked && ENTRY_LENGTH(entry) > (rows ? left : (size_t) (buffer_end - buffer_ptr))) {
+                LOG_MSG("  Image data larger than the frame\n");
+                return GIF_LZW_ERROR;
             }
-
-            // Entry is in the table, output the code
-            uint8_t str_len = 0;
-            code_table_entry = &reader_state.table[code];
-            LOG_MSG("  Output existing sequence for key %04x (%d)\n", code, code);
-            while(1) {
-                LOG_MSG("    Output string %02d at %08d (prefix %04x)\n",
-                        code_table_entry->string_part, (unsigned int)(buffer_ptr + code_table_entry->length - 1), code_table_entry->prefix);
-                *(buffer_ptr + code_table_entry->length - 1) = code_table_entry->string_part;
-                str_len++;
-
-                if (code_table_entry->prefix == 0xFFF) {
-                    break;
-                }
-                code_table_entry = &reader_state.table[code_table_entry->prefix];
+            if (rows) {
+                left -= ENTRY_LENGTH(entry);
+                first = rows_emit(table, entry, rows);
+            } else {
+                uint8_t *string = buffer_ptr;
+                buffer_ptr = emit(table, entry, buffer_ptr);
+                first = *string;
             }
-            buffer_ptr += str_len;
-
-            // A new entry is added to the table consisting of a pointer to the last sequence,
-            // followed by the first pixel in the current sequence.
-            add_table_entry(&reader_state, reader_state.table[old_code].length + 1, old_code, tmp_ptr->string_part);
-
-            old_code = code;
-            if (reader_state.table_size == 1<<reader_state.code_size) {
-                reader_state.code_size++;
+        } else {
+            if (checked && ENTRY_LENGTH(old_entry) + 1 > (rows ? left : (size_t) (buffer_end - buffer_ptr))) {
+                LOG_MSG("  Image data larger than the frame\n");
+                return GIF_LZW_ERROR;
             }
-            continue;
-        }
-
-        // Code isn't in the table
-        // A new entry is added to the table consisting of a pointer to the last sequence,
-        // followed by the first pixel in the last sequence.
-
-        // Find the first pixel of the previous sequence
-        entry_t *tmp_ptr = &reader_state.table[old_code];
-        while(1) {
-            if (tmp_ptr->prefix == 0xFFF) {
-                break;
+            first = old_first;
+            if (rows) {
+                left -= ENTRY_LENGTH(old_entry) + 1;
+                rows_emit(table, old_entry, rows);
+                rows_put(rows, first);
+            } else {
+                buffer_ptr = emit(table, old_entry, buffer_ptr);
+                *buffer_ptr++ = first;
             }
-            tmp_ptr = &reader_state.table[tmp_ptr->prefix];
         }
 
-        add_table_entry(&reader_state, reader_state.table[old_code].length + 1, old_code, tmp_ptr->string_part);
-        uint8_t str_len = 0;
-        code_table_entry = &reader_state.table[code];
-        LOG_MSG("  Output new sequence for key %04x (%d)\n", code, code);
-        while(1) {
-            LOG_MSG("    Output string %02d at %08d (prefix %04x)\n",
-                    code_table_entry->string_part, (unsigned int)(buffer_ptr + code_table_entry->length - 1), code_table_entry->prefix);
-            *(buffer_ptr + code_table_entry->length - 1) = code_table_entry->string_part;
-            str_len++;
-
-            if (code_table_entry->prefix == 0xFFF) {
-                break;
-            }
-            code_table_entry = &reader_state.table[code_table_entry->prefix];
+        // A new entry is added to the table consisting of the previous
+        // sequence followed by the first pixel of the current one
+        if (reader_state.table_size < MAX_TABLE_SIZE) {
+            table[reader_state.table_size++] = ENTRY(ENTRY_LENGTH(old_entry) + 1, old_code, first);
         }
-        buffer_ptr += str_len;
+
         old_code = code;
-        if (reader_state.table_size == 1<<reader_state.code_size) {
+        old_first = first;
+        if (reader_state.table_size == 1 << reader_state.code_size && reader_state.code_size < MAX_CODE_SIZE) {
             reader_state.code_size++;
         }
     }
 
+    if (checked && reader_state.error) {
+        return GIF_LZW_ERROR;
+    }
     return GIF_LZW_OK;
 }
 
-static void init_table(reader_state_t *reader_state, uint16_t key_size) {
-    // roots take up slots #0 through #(2**N-1), and the special codes are (2**N) and (2**N + 1)
-    reader_state->table_size = (1 << key_size) + 2;
-    for (int i=0; i < reader_state->table_size; i++) {
-        reader_state->table[i].length = 1;
-        reader_state->table[i].prefix = 0xFFF;
-        reader_state->table[i].string_part = i;
-    }
+gif_lzw_error_t gif_decoder_read_image_data(gif_lzw_context_t *context, const uint8_t *data, const uint8_t *end,
+                                            uint8_t *buffer, size_t size) {
+    return read_image_data(context, data, end, buffer, size, NULL, 1);
 }
 
-static void add_table_entry(reader_state_t *reader_state, uint16_t length, uint16_t prefix, uint8_t suffix) {
-    LOG_MSG("      Adding entry %d, length=%d, prefix=%04x, string_part=%02x\n",
-            reader_state->table_size, length, prefix, suffix);
-    reader_state->table[reader_state->table_size].length = length;
-    reader_state->table[reader_state->table_size].prefix = prefix;
-    reader_state->table[reader_state->table_size].string_part = suffix;
-    reader_state->table_size++;
+gif_lzw_error_t gif_decoder_read_image_data_trusted(gif_lzw_context_t *context, const uint8_t *data, uint8_t *buffer) {
+    return read_image_data(context, data, NULL, buffer, 0, NULL, 0);
 }
 
-static uint8_t get_next_byte(reader_state_t *reader_state) {
-    uint8_t *ptr = reader_state->data_ptr;
-    if (reader_state->bytes_remaining_in_block == 0) {
-        LOG_MSG("Skipping to next block with size %d", *ptr);
-        reader_state->bytes_remaining_in_block = *ptr;
-        ptr++;
-    }
-
-    uint8_t next = *ptr;
-    reader_state->bytes_remaining_in_block -= 1;
-    reader_state->data_ptr = ptr + 1;
+gif_lzw_error_t gif_decoder_read_image_rows(gif_lzw_context_t *context, const uint8_t *data, const uint8_t *end,
+                                            uint8_t *row, uint16_t width, uint16_t height,
+                                            gif_row_t callback, void *callback_context) {
+    rows_t rows = { row, row, row + width, 0, callback, callback_context };
+    return read_image_data(context, data, end, NULL, (size_t) width * height, &rows, 1);
+}
 
-    return next;
+gif_lzw_error_t gif_decoder_read_image_rows_trusted(gif_lzw_context_t *context, const uint8_t *data,
+                                                    uint8_t *row, uint16_t width,
+                                                    gif_row_t callback, void *callback_context) {
+    rows_t rows = { row, row, row + width, 0, callback, callback_context };
+    return read_image_data(context, data, NULL, NULL, 0, &rows, 0);
 }
 
-static uint16_t read_bits(reader_state_t *reader_state) {
-    uint8_t *ptr = reader_state->data_ptr;
-    uint8_t next_byte;
+static void init_table(uint32_t *table, reader_state_t *reader_state, uint16_t key_size) {
+    // roots take up slots #0 through #(2**N-1), and the special codes are (2**N) and (2**N + 1)
+    reader_state->table_size = (1 << key_size) + 2;
+    for (int i=0; i < reader_state->table_size; i++) {
+        table[i] = ENTRY(1, 0xFFF, (uint8_t) i);
+    }
+}
 
-    if (reader_state->bits_remaining == 0) {
-        reader_state->current = get_next_byte(reader_state) | get_next_byte(reader_state) << 8;
-        reader_state->bits_remaining += 16;
+// Move on to the next data sub-block, returns 0 at the block terminator
+// and when the checked decoder finds the block runs past the end of the data
+static __attribute__((noinline)) int next_block(reader_state_t *reader_state, int checked) {
+    if (checked && reader_state->data_ptr >= reader_state->data_end) {
+        reader_state->error = 1;
+        return 0;
+    }
+    uint8_t block_size = *reader_state->data_ptr;
+    if (block_size == 0) {
+        return 0;
+    }
+    if (checked && block_size >= reader_state->data_end - reader_state->data_ptr) {
+        reader_state->error = 1;
+        return 0;
     }
 
-    if (reader_state->bits_remaining <= 8) {
-        // Add 8 new bits of data to the reader
-        // by moving the data pointer forward by one position
-        // and filling up with a new byte
-        reader_state->current >>= 8;
-        reader_state->current |= get_next_byte(reader_state) << 8;
-        reader_state->bits_remaining += 8;
+    LOG_MSG("Skipping to next block with size %d\n", block_size);
+    reader_state->bytes_remaining_in_block = block_size;
+    reader_state->data_ptr++;
+    return 1;
+}
+
+// Top up the bit accumulator to at least 25 bits, enough for two 12 bit codes
+static void refill(reader_state_t *reader_state, int checked) {
+    uint32_t current = reader_state->current;
+    uint8_t bits = reader_state->bits_remaining;
+    while (bits <= 24) {
+        if (reader_state->bytes_remaining_in_block == 0 && !next_block(reader_state, checked)) {
+            break;
+        }
+        current |= (uint32_t) *reader_state->data_ptr++ << bits;
+        reader_state->bytes_remaining_in_block--;
+        bits += 8;
     }
+    reader_state->current = current;
+    reader_state->bits_remaining = bits;
+}
 
+static inline uint16_t read_bits(reader_state_t *reader_state, int checked) {
     if (reader_state->bits_remaining < reader_state->code_size) {
-        LOG_MSG("Not enough data remaining\n");
-        return 0;
+        refill(reader_state, checked);
+        if (reader_state->bits_remaining < reader_state->code_size) {
+            LOG_MSG("Not enough data remaining\n");
+            return LZW_END_OF_DATA;
+        }
     }
 
-    LOG_MSG("Current 0x%04x, keysize %d, bitremaining %d, bytes remaining %d\n",
-            reader_state->current, reader_state->code_size,
-            reader_state->bits_remaining, reader_state->bytes_remaining_in_block);
-    uint16_t value = reader_state->current;
-    value >>= (16 - reader_state->bits_remaining);
-    value &= (1 << reader_state->code_size) - 1;
-
+    uint16_t value = reader_state->current & ((1u << reader_state->code_size) - 1);
+    reader_state->current >>= reader_state->code_size;
     reader_state->bits_remaining -= reader_state->code_size;
 
     return value;
@@ -5,10 +5,34 @@
 #ifndef _GIF_LZW_DECOMPRESS_H
 #define _GIF_LZW_DECOMPRESS_H
 
+#include <stddef.h>
+#include <stdint.h>
+#include "gif_decoder.h"
+
 #define GIF_LZW_OK 0
 #define GIF_LZW_ERROR 1
 
 typedef unsigned char gif_lzw_error_t;
 
-gif_lzw_error_t gif_decoder_read_image_data(uint8_t *data, uint8_t *buffer);
+// Decode the image data starting with the LZW minimum code size at data.
+// Never reads at or past end and never writes more than size bytes, a code
+// stream that would is an error.
+gif_lzw_error_t gif_decoder_read_image_data(gif_lzw_context_t *context, const uint8_t *data, const uint8_t *end,
+                                            uint8_t *buffer, size_t size);
+
+// The same without any of those checks, only for image data that made it
+// through gif_decoder_read_image_data() before into a buffer of the same size
+gif_lzw_error_t gif_decoder_read_image_data_trusted(gif_lzw_context_t *context, const uint8_t *data, uint8_t *buffer);
+
+// Decode the image data a row at a time into row, which holds width bytes,
+// every full row goes to callback. Checked like gif_decoder_read_image_data()
+// with a buffer of width * height. Rows the data doesn't reach aren't passed on.
+gif_lzw_error_t gif_decoder_read_image_rows(gif_lzw_context_t *context, const uint8_t *data, const uint8_t *end,
+                                            uint8_t *row, uint16_t width, uint16_t height,
+                                            gif_row_t callback, void *callback_context);
+
+// The same without the checks, for image data that passed them before
+gif_lzw_error_t gif_decoder_read_image_rows_trusted(gif_lzw_context_t *context, const uint8_t *data,
+                                                    uint8_t *row, uint16_t width,
+                                                    gif_row_t callback, void *callback_context);
 #endif //_GIF_LZW_DECOMPRESS_H
@@ -0,0 +1,59 @@
+#ifndef _GIF_CANVAS_H
+#define _GIF_CANVAS_H
+
+#include "gif_decoder.h"
+
+typedef struct {
+    uint16_t x, y;
+    uint16_t width, height;
+} gif_rect_t;
+
+// Receives the pixels that changed in a row of the canvas, pixels points
+// into the canvas
+typedef void (*gif_canvas_span_t)(void *context, int x, int y, const uint8_t *pixels, int count);
+
+typedef struct {
+    int x0, y0, x1, y1;
+} gif_bounds_t;
+
+// Logical screen of a gif as palette indices. Frames are drawn on top of it
+// as the disposal method of the previous frame dictates, dirty is the
+// bounding box of the pixels that changed during the last gif_canvas_draw().
+typedef struct {
+    uint16_t width, height;
+    uint8_t *pixels;
+    uint8_t *previous;
+    uint8_t background_index;
+    uint8_t disposal;
+    gif_rect_t disposal_rect;
+    gif_rect_t dirty;
+    uint8_t redraw; // The next draw marks the whole canvas dirty
+
+    // Frame being drawn
+    gif_bounds_t bounds;
+    gif_canvas_span_t span;
+    gif_canvas_span_t end_span;
+    void *span_context;
+} gif_canvas_t;
+
+// pixels and previous both hold gif->width * gif->height bytes, previous
+// backs up the area under frames that are disposed by restoring it.
+// The canvas starts filled with the background color, the first frame
+// drawn after init marks the whole canvas dirty, as does any draw after
+// redraw is set.
+void gif_canvas_init(gif_canvas_t *canvas, const gif_t *gif, uint8_t *pixels, uint8_t *previous);
+void gif_canvas_draw(gif_canvas_t *canvas, const frame_t *frame);
+
+// Like gif_canvas_draw(), and hands every run of pixels that changed to span
+// while the row is being drawn. Transparent pixels end a run. When the whole
+// canvas is dirty every row is handed over in full once the frame is drawn.
+void gif_canvas_draw_spans(gif_canvas_t *canvas, const frame_t *frame, gif_canvas_span_t span, void *context);
+
+// The same in steps for frames decoded row by row, see gif_rows_t. Begin
+// disposes of the previous frame, rows are numbered from the top of the
+// frame and end works out the dirty rectangle.
+void gif_canvas_begin(gif_canvas_t *canvas, const frame_t *frame, gif_canvas_span_t span, void *context);
+void gif_canvas_draw_row(gif_canvas_t *canvas, const frame_t *frame, int y, const uint8_t *pixels);
+void gif_canvas_end(gif_canvas_t *canvas, const frame_t *frame);
+
+#endif //_GIF_CANVAS_H
@@ -5,6 +5,9 @@
 #ifndef _GIF_DECODER_H
 #define _GIF_DECODER_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 #define GIF_OK    0
 #define GIF_ERROR 1
 #define GIF_EOF 2
@@ -15,11 +18,30 @@
 
 #define EXTBLOCK_GCE 0xF9
 
+// Delay in 1/100 s for frames that don't specify one
+#define GIF_DEFAULT_DELAY 4
+
+// Disposal methods from the graphic control extension
+#define GIF_DISPOSAL_UNSPECIFIED 0
+#define GIF_DISPOSAL_NONE 1
+#define GIF_DISPOSAL_BACKGROUND 2
+#define GIF_DISPOSAL_PREVIOUS 3
+
 typedef unsigned char gif_error_t;
 
+// Code table of the LZW decoder, 16 KB. Every decoder that runs at the same
+// time needs one of its own, it is only used while a frame is decoded.
+#define GIF_LZW_TABLE_SIZE 4096
+
+typedef struct {
+    uint32_t table[GIF_LZW_TABLE_SIZE];
+} gif_lzw_context_t;
+
 typedef struct {
     uint8_t *image_start;
     size_t image_size;
+    uint16_t width, height;
+    uint8_t background_index;
     uint16_t ct_size;
     uint8_t *global_ct;
     uint8_t *first_frame;
@@ -27,19 +49,68 @@ typedef struct {
     uint8_t transparancy_enabled;
     uint8_t transparancy_index;
     uint16_t delay;
+    uint8_t disposal;
+    uint8_t trusted; // Set by gif_decoder_validate()
+    gif_lzw_context_t *lzw; // Set by the caller before decoding, like frame_t.frame
 } gif_t;
 
 typedef struct {
     uint16_t offset_x, offset_y;
     uint16_t width, height;
     uint8_t *frame;
-    uint8_t *color_table;
+    uint8_t *color_table; // Points into the gif
     uint8_t transparancy_enabled;
     uint8_t transparancy_index;
     uint16_t delay;
+    uint8_t disposal;
 } frame_t;
 
+// Frames can be decoded a row at a time instead of as a whole, frame_t.frame
+// then only holds the row that is being decoded. begin runs once the fields
+// of the frame are set, before the first row. Rows come in order, the ones
+// the image data doesn't reach are left out.
+typedef void (*gif_row_t)(void *context, int y, const uint8_t *pixels);
+
+typedef struct {
+    void (*begin)(void *context, const frame_t *frame);
+    gif_row_t row;
+    void *context;
+} gif_rows_t;
+
+// Where a frame is in the gif and how it is shown, see gif_decoder_index().
+// The LZW data follows the image descriptor, local color tables aren't supported.
+typedef struct {
+    uint32_t descriptor; // Offset of the image descriptor from the start of the gif
+    uint16_t delay;
+    uint16_t key; // Closest frame at or before this one that doesn't depend on earlier frames
+    uint8_t disposal;
+    uint8_t transparancy_enabled;
+    uint8_t transparancy_index;
+    uint8_t reserved;
+} gif_frame_index_t;
+
 gif_error_t gif_decoder_init(uint8_t *source, size_t size, gif_t *gif);
 gif_error_t gif_decoder_read_next_frame(gif_t *gif, frame_t *frame);
 
+// Row by row, frame->frame holds at least one row of the logical screen
+gif_error_t gif_decoder_read_next_frame_rows(gif_t *gif, frame_t *frame, const gif_rows_t *rows);
+
+// Decode every frame once with all checks, buffer holds at least one row
+// of the logical screen. A gif that passes is trusted: its frames are
+// decoded without checks from then on, as long as frame->frame is as large
+// as the logical screen, or a row of it when decoding row by row. Gifs that
+// aren't validated are decoded with the checks for every frame.
+gif_error_t gif_decoder_validate(gif_t *gif, uint8_t *buffer, size_t size);
+
+// Walk the whole gif once, without decoding, and record every frame in index.
+// Fails when the gif holds more than max_frames frames or ends early.
+gif_error_t gif_decoder_index(const gif_t *gif, gif_frame_index_t *index, uint16_t max_frames, uint16_t *frame_count);
+
+// Decode any frame of an indexed gif. Frames that cover the whole logical
+// screen without transparency are key frames, the canvas for frame n can
+// be rebuilt by drawing the frames from index[n].key up to n.
+gif_error_t gif_decoder_read_frame(const gif_t *gif, const gif_frame_index_t *entry, frame_t *frame);
+gif_error_t gif_decoder_read_frame_rows(const gif_t *gif, const gif_frame_index_t *entry, frame_t *frame,
+                                        const gif_rows_t *rows);
+
 #endif //_GIF_DECODER_H
@@ -6,19 +6,74 @@
 #define LEDPANEL_ANIMATIONS_H
 
 #include "framebuffer.h"
+#include "asset_store.h"
+#include "canvas_view.h"
+#include "compositor.h"
 
 #define DEFAULT_GIF_SEQUENCE 0
 
 void plasma_init(framebuffer_t *framebuffer);
 void plasma_update(framebuffer_t *framebuffer);
+// The next plasma frame into width by height colors, such as a compositor layer
+void plasma_draw(uint32_t *pixels, int width, int height);
 
+// Frames are drawn from a one-shot platform alarm armed for the
+// presentation time of the next frame, see gif_animation.c. The alarm only
+// tries to take the lock and comes back later when it is held. Everything
+// that changes what is played waits for the lock, call those from the main
+// loop and never from an interrupt. The getters and gif_animation_seek()
+// only read or store a single value and are safe from interrupts.
 void gif_animation_init(framebuffer_t *framebuffer);
-void gif_animation_update(framebuffer_t *framebuffer);
 void gif_animation_play(int sequence_id, int state);
 void gif_animation_pause();
 void gif_animation_resume();
 void gif_animation_stop();
+// Stop without clearing and leave the framebuffer to another producer,
+// nothing is drawn until a sequence is played again
+void gif_animation_release();
 uint8_t gif_animation_get_state();
 uint8_t gif_animation_get_sequence();
+uint32_t gif_animation_get_frames_decoded();
+
+// Order the frames of a sequence are played in. Panel assets and gifs of
+// up to 1024 frames can be played in any order, longer gifs
+// only play forward.
+#define GIF_PLAYBACK_FORWARD 0
+#define GIF_PLAYBACK_REVERSE 1
+#define GIF_PLAYBACK_PINGPONG 2
+
+void gif_animation_set_playback(int mode);
+int gif_animation_get_playback();
+// Show frame_number next, playing continues from there
+void gif_animation_seek(int frame_number);
+// Frame on screen, -1 when unknown
+int gif_animation_get_frame();
+// 0 when the sequence can't be played out of order
+int gif_animation_get_frame_count();
+
+// Sequences past the built-in ones are the assets in store, in the order
+// asset_store_get() numbers them. Call again after every change to the
+// store, the gifs in it are validated here and not while they play.
+void gif_animation_set_store(const asset_store_t *store);
+int gif_animation_get_builtin_count();
+int gif_animation_get_sequence_count();
+
+// Gifs can be larger than the display, up to 128x64, and are shown through
+// a view that scales and pans them, see canvas_view.h. Panel assets are
+// always shown as they are.
+int gif_animation_set_view(int scale, int shrink, int filter);
+void gif_animation_pan(int x, int y);
+const canvas_view_t *gif_animation_get_view();
+
+// Draw gifs into a layer of the compositor, which is composed with the
+// others at every frame, instead of straight into the framebuffer. The layer
+// has to be as large as the display, it is cleared when playing stops.
+// Panel assets compiled to bit-planes don't play meanwhile. NULL goes back
+// to drawing into the framebuffer.
+int gif_animation_set_layer(compositor_t *compositor, int layer);
+
+// Opt-in cache of decoded frames, storage must be pointer aligned
+void gif_animation_enable_cache(uint8_t *storage, size_t size);
+void gif_animation_get_cache_stats(uint32_t *hits, uint32_t *misses, size_t *bytes_used);
 
 #endif //LEDPANEL_ANIMATIONS_H
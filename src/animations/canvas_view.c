@@ -0,0 +1,191 @@
+#include <malloc.h>
+#include "canvas_view.h"
+
+// Canvas position behind display position i along an axis where the view
+// starts at origin, -1 when that is off the canvas
+static int16_t sample(const canvas_view_t *view, int origin, int i, int size) {
+    int position;
+    if (view->scale > 1) {
+        position = origin + i / view->scale;
+    } else if (view->filter == CANVAS_VIEW_BOX) {
+        position = origin + i * view->shrink;
+    } else {
+        position = origin + i * view->shrink + view->shrink / 2;
+    }
+    return position >= 0 && position < size ? position : -1;
+}
+
+static void update_tables(canvas_view_t *view) {
+    for (int i = 0; i < view->width; i++) {
+        view->columns[i] = sample(view, view->x, i, view->canvas_width);
+    }
+    for (int i = 0; i < view->height; i++) {
+        view->rows[i] = sample(view, view->y, i, view->canvas_height);
+    }
+}
+
+int canvas_view_init(canvas_view_t *view, int width, int height) {
+    view->width = width;
+    view->height = height;
+    view->columns = malloc((width + height) * sizeof(int16_t) + width);
+    if (view->columns == NULL) {
+        return CANVAS_VIEW_ERROR;
+    }
+    view->rows = view->columns + width;
+    view->line = (uint8_t *) (view->rows + height);
+
+    view->canvas_width = 0;
+    view->canvas_height = 0;
+    view->x = 0;
+    view->y = 0;
+    view->scale = 1;
+    view->shrink = 1;
+    view->filter = CANVAS_VIEW_NEAREST;
+    update_tables(view);
+    return CANVAS_VIEW_OK;
+}
+
+int canvas_view_set(canvas_view_t *view, int scale, int shrink, int filter) {
+    if (scale < 1 || scale > CANVAS_VIEW_MAX_SCALE || shrink < 1 || shrink > CANVAS_VIEW_MAX_SCALE ||
+            (scale > 1 && shrink > 1) || filter > CANVAS_VIEW_BOX) {
+        return CANVAS_VIEW_ERROR;
+    }
+    view->scale = scale;
+    view->shrink = shrink;
+    view->filter = filter;
+    update_tables(view);
+    return CANVAS_VIEW_OK;
+}
+
+void canvas_view_pan(canvas_view_t *view, int x, int y) {
+    view->x = x;
+    view->y = y;
+    update_tables(view);
+}
+
+void canvas_view_set_canvas(canvas_view_t *view, int width, int height) {
+    view->canvas_width = width;
+    view->canvas_height = height;
+    update_tables(view);
+}
+
+int canvas_view_is_direct(const canvas_view_t *view) {
+    return view->scale == 1 && view->shrink == 1;
+}
+
+// Display positions that show any of start to start + length along an axis,
+// they are a single range because the table is ascending where it isn't -1
+static void covered(const int16_t *table, int size, int cover, int start, int length, int *first, int *end) {
+    *first = size;
+    *end = 0;
+    for (int i = 0; i < size; i++) {
+        if (table[i] >= 0 && table[i] < start + length && table[i] + cover > start) {
+            if (*first == size) {
+                *first = i;
+            }
+            *end = i + 1;
+        }
+    }
+}
+
+// Average color of the block of canvas pixels shown at column, row
+static uint32_t box_color(const canvas_view_t *view, const uint8_t *pixels, const uint32_t *colors,
+                          int column, int row) {
+    int column_end = column + view->shrink < view->canvas_width ? column + view->shrink : view->canvas_width;
+    int row_end = row + view->shrink < view->canvas_height ? row + view->shrink : view->canvas_height;
+    uint32_t r = 0, g = 0, b = 0;
+    for (int y = row; y < row_end; y++) {
+        const uint8_t *pixel = pixels + y * view->canvas_width;
+        for (int x = column; x < column_end; x++) {
+            uint32_t color = colors[pixel[x]];
+            r += color >> 16 & 0xff;
+            g += color >> 8 & 0xff;
+            b += color & 0xff;
+        }
+    }
+    uint32_t count = (column_end - column) * (row_end - row);
+    return (r / count) << 16 | (g / count) << 8 | b / count;
+}
+
+void canvas_view_draw(const canvas_view_t *view, framebuffer_t *framebuffer, const uint8_t *pixels,
+                      const uint32_t *colors, int x, int y, int width, int height) {
+    int box = view->filter == CANVAS_VIEW_BOX && view->shrink > 1;
+    int cover = box ? view->shrink : 1;
+    int x0, x1, y0, y1;
+    covered(view->columns, view->width, cover, x, width, &x0, &x1);
+    covered(view->rows, view->height, cover, y, height, &y0, &y1);
+
+    for (int display_y = y0; display_y < y1; display_y++) {
+        int row = view->rows[display_y];
+        if (row < 0) {
+            continue;
+        }
+        if (box) {
+            for (int display_x = x0; display_x < x1; display_x++) {
+                uint32_t color = box_color(view, pixels, colors, view->columns[display_x], row);
+                framebuffer_drawpixel(framebuffer, display_x, display_y, color);
+            }
+            continue;
+        }
+
+        // Nearest pixels are still palette indices, they go out as one span
+        const uint8_t *canvas_row = pixels + row * view->canvas_width;
+        for (int display_x = x0; display_x < x1; display_x++) {
+            view->line[display_x - x0] = canvas_row[view->columns[display_x]];
+        }
+        framebuffer_drawspan(framebuffer, x0, display_y, view->line, x1 - x0, colors);
+    }
+}
+
+void canvas_view_draw_all(const canvas_view_t *view, framebuffer_t *framebuffer, const uint8_t *pixels,
+                          const uint32_t *colors) {
+    for (int y = 0; y < view->height; y++) {
+        for (int x = 0; x < view->width; x++) {
+            if (view->rows[y] < 0 || view->columns[x] < 0) {
+                framebuffer_drawpixel(framebuffer, x, y, 0);
+            }
+        }
+    }
+    canvas_view_draw(view, framebuffer, pixels, colors, 0, 0, view->canvas_width, view->canvas_height);
+}
+
+void canvas_view_render(const canvas_view_t *view, uint32_t *layer, const uint8_t *pixels, const uint32_t *colors,
+                        int x, int y, int width, int height, framebuffer_rect_t *area) {
+    int box = view->filter == CANVAS_VIEW_BOX && view->shrink > 1;
+    int cover = box ? view->shrink : 1;
+    int x0, x1, y0, y1;
+    covered(view->columns, view->width, cover, x, width, &x0, &x1);
+    covered(view->rows, view->height, cover, y, height, &y0, &y1);
+    *area = (framebuffer_rect_t) { x0, y0, x1, y1 };
+
+    for (int display_y = y0; display_y < y1; display_y++) {
+        int row = view->rows[display_y];
+        if (row < 0) {
+            continue;
+        }
+        uint32_t *line = layer + display_y * view->width;
+        if (box) {
+            for (int display_x = x0; display_x < x1; display_x++) {
+                line[display_x] = box_color(view, pixels, colors, view->columns[display_x], row);
+            }
+            continue;
+        }
+        const uint8_t *canvas_row = pixels + row * view->canvas_width;
+        for (int display_x = x0; display_x < x1; display_x++) {
+            line[display_x] = colors[canvas_row[view->columns[display_x]]];
+        }
+    }
+}
+
+void canvas_view_render_all(const canvas_view_t *view, uint32_t *layer, const uint8_t *pixels,
+                            const uint32_t *colors) {
+    for (int y = 0; y < view->height; y++) {
+        for (int x = 0; x < view->width; x++) {
+            if (view->rows[y] < 0 || view->columns[x] < 0) {
+                layer[y * view->width + x] = 0;
+            }
+        }
+    }
+    framebuffer_rect_t area;
+    canvas_view_render(view, layer, pixels, colors, 0, 0, view->canvas_width, view->canvas_height, &area);
+}
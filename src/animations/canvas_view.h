@@ -0,0 +1,62 @@
+// The part of a canvas of palette indices that is on the display. Canvases
+// can be of any size, a view shows them 1:1, enlarged by an integer factor
+// or reduced by one, and pans across canvases larger than what it shows.
+// Reduced views either take the pixel in the middle of every block
+// (nearest) or average the colors of the whole block (box).
+//
+// The canvas column and row behind every display column and row are worked
+// out when the view or the canvas changes, drawing only looks them up.
+//
+
+#ifndef LEDPANEL_CANVAS_VIEW_H
+#define LEDPANEL_CANVAS_VIEW_H
+
+#include <stdint.h>
+#include "framebuffer.h"
+
+#define CANVAS_VIEW_NEAREST 0
+#define CANVAS_VIEW_BOX 1
+
+// Largest factor to enlarge or reduce by
+#define CANVAS_VIEW_MAX_SCALE 8
+
+#define CANVAS_VIEW_OK 0
+#define CANVAS_VIEW_ERROR 1
+
+typedef struct {
+    int width, height; // Display
+    int canvas_width, canvas_height;
+    int x, y;          // Canvas pixel at the top left of the display, may be negative
+    int scale;         // Display pixels per canvas pixel
+    int shrink;        // Canvas pixels per display pixel, scale or shrink is 1
+    int filter;        // CANVAS_VIEW_*, only used when shrinking
+    int16_t *columns;  // Canvas column sampled by every display column, the first of the block for box, -1 off the canvas
+    int16_t *rows;     // The same for every display row
+    uint8_t *line;     // Palette indices of one display row
+} canvas_view_t;
+
+// A 1:1 view of an empty canvas, tables are allocated for a display of width by height
+int canvas_view_init(canvas_view_t *view, int width, int height);
+int canvas_view_set(canvas_view_t *view, int scale, int shrink, int filter);
+void canvas_view_pan(canvas_view_t *view, int x, int y);
+void canvas_view_set_canvas(canvas_view_t *view, int width, int height);
+
+// Canvas pixels map onto display pixels one to one, offset by x and y
+int canvas_view_is_direct(const canvas_view_t *view);
+
+// Draw the display pixels that show any part of the canvas area x, y, width by height
+void canvas_view_draw(const canvas_view_t *view, framebuffer_t *framebuffer, const uint8_t *pixels,
+                      const uint32_t *colors, int x, int y, int width, int height);
+
+// Draw every display pixel, black where the view is off the canvas
+void canvas_view_draw_all(const canvas_view_t *view, framebuffer_t *framebuffer, const uint8_t *pixels,
+                          const uint32_t *colors);
+
+// The same into a buffer of width by height colors, such as a compositor
+// layer. The display area drawn goes in area, empty when there is none.
+void canvas_view_render(const canvas_view_t *view, uint32_t *layer, const uint8_t *pixels, const uint32_t *colors,
+                        int x, int y, int width, int height, framebuffer_rect_t *area);
+void canvas_view_render_all(const canvas_view_t *view, uint32_t *layer, const uint8_t *pixels,
+                            const uint32_t *colors);
+
+#endif //LEDPANEL_CANVAS_VIEW_H
@@ -0,0 +1,144 @@
+#include <string.h>
+#include "frame_cache.h"
+
+typedef struct {
+    uint8_t *next_frame_ptr;
+    uint16_t offset_x, offset_y;
+    uint16_t width, height;
+    uint16_t delay;
+    uint16_t data_size;
+    uint8_t transparancy_enabled;
+    uint8_t transparancy_index;
+    uint8_t disposal;
+} frame_cache_record_t;
+
+#define RECORD_ALIGN(x) (((x) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
+void frame_cache_init(frame_cache_t *cache, uint8_t *storage, size_t size) {
+    cache->storage = storage;
+    cache->size = size;
+    frame_cache_reset(cache);
+}
+
+void frame_cache_reset(frame_cache_t *cache) {
+    cache->used = 0;
+    cache->read_offset = 0;
+    cache->frames = 0;
+    cache->position = 0;
+    cache->recording = 1;
+    cache->hits = 0;
+    cache->misses = 0;
+}
+
+void frame_cache_rewind(frame_cache_t *cache) {
+    cache->read_offset = 0;
+    cache->position = 0;
+    cache->recording = 0;
+}
+
+int frame_cache_next(frame_cache_t *cache, frame_t *frame, uint8_t **next_frame_ptr) {
+    if (cache->position >= cache->frames) {
+        cache->misses++;
+        return FRAME_CACHE_MISS;
+    }
+
+    frame_cache_record_t *record = (frame_cache_record_t *) (cache->storage + cache->read_offset);
+    frame->offset_x = record->offset_x;
+    frame->offset_y = record->offset_y;
+    frame->width = record->width;
+    frame->height = record->height;
+    frame->delay = record->delay;
+    frame->transparancy_enabled = record->transparancy_enabled;
+    frame->transparancy_index = record->transparancy_index;
+    frame->disposal = record->disposal;
+    if (next_frame_ptr != NULL) {
+        *next_frame_ptr = record->next_frame_ptr;
+    }
+
+    // Runs are stored as (length, index) pairs
+    uint8_t *data = (uint8_t *) (record + 1);
+    uint8_t *data_end = data + record->data_size;
+    uint8_t *out = frame->frame;
+    while (data < data_end) {
+        memset(out, data[1], data[0]);
+        out += data[0];
+        data += 2;
+    }
+
+    cache->read_offset += RECORD_ALIGN(sizeof(frame_cache_record_t) + record->data_size);
+    cache->position++;
+    cache->hits++;
+    return FRAME_CACHE_OK;
+}
+
+int frame_cache_seek(frame_cache_t *cache, uint16_t position) {
+    if (position > cache->frames) {
+        cache->misses++;
+        return FRAME_CACHE_MISS;
+    }
+
+    if (position < cache->position) {
+        cache->read_offset = 0;
+        cache->position = 0;
+    }
+    while (cache->position < position) {
+        frame_cache_record_t *record = (frame_cache_record_t *) (cache->storage + cache->read_offset);
+        cache->read_offset += RECORD_ALIGN(sizeof(frame_cache_record_t) + record->data_size);
+        cache->position++;
+    }
+    return FRAME_CACHE_OK;
+}
+
+int frame_cache_store(frame_cache_t *cache, const frame_t *frame, uint8_t *next_frame_ptr) {
+    if (!cache->recording || cache->position != cache->frames) {
+        return FRAME_CACHE_FULL;
+    }
+
+    if (cache->used + sizeof(frame_cache_record_t) > cache->size) {
+        cache->recording = 0;
+        return FRAME_CACHE_FULL;
+    }
+
+    frame_cache_record_t *record = (frame_cache_record_t *) (cache->storage + cache->used);
+    uint8_t *data = (uint8_t *) (record + 1);
+    uint8_t *data_end = cache->storage + cache->size;
+
+    const uint8_t *in = frame->frame;
+    const uint8_t *in_end = in + frame->width * frame->height;
+    while (in < in_end) {
+        if (data + 2 > data_end) {
+            // Out of budget, everything after this frame keeps being decoded
+            cache->recording = 0;
+            return FRAME_CACHE_FULL;
+        }
+
+        uint8_t value = *in;
+        uint8_t length = 0;
+        while (in < in_end && *in == value && length < 255) {
+            in++;
+            length++;
+        }
+        *data++ = length;
+        *data++ = value;
+    }
+
+    record->next_frame_ptr = next_frame_ptr;
+    record->offset_x = frame->offset_x;
+    record->offset_y = frame->offset_y;
+    record->width = frame->width;
+    record->height = frame->height;
+    record->delay = frame->delay;
+    record->transparancy_enabled = frame->transparancy_enabled;
+    record->transparancy_index = frame->transparancy_index;
+    record->disposal = frame->disposal;
+    record->data_size = data - (uint8_t *) (record + 1);
+
+    cache->used += RECORD_ALIGN(sizeof(frame_cache_record_t) + record->data_size);
+    if (cache->used > cache->size) {
+        cache->used = cache->size;
+    }
+    cache->frames++;
+    cache->position++;
+    cache->read_offset = cache->used;
+    return FRAME_CACHE_OK;
+}
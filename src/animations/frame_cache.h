@@ -0,0 +1,50 @@
+#ifndef LEDPANEL_FRAME_CACHE_H
+#define LEDPANEL_FRAME_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "gif_decoder.h"
+
+#define FRAME_CACHE_OK 0
+#define FRAME_CACHE_MISS 1
+#define FRAME_CACHE_FULL 2
+
+// Keeps the decoded frames of the active sequence run-length encoded in a
+// fixed budget, so looping sequences don't have to be LZW decoded again.
+// Frames are recorded during the first pass in order. When the budget runs
+// out the rest of the sequence keeps being decoded, the cached frames are
+// still replayed at the start of every loop.
+typedef struct {
+    uint8_t *storage;
+    size_t size;
+    size_t used;
+    size_t read_offset;
+    uint16_t frames;
+    uint16_t position;
+    uint8_t recording;
+    uint32_t hits;
+    uint32_t misses;
+} frame_cache_t;
+
+void frame_cache_init(frame_cache_t *cache, uint8_t *storage, size_t size);
+
+// Forget all frames and start recording a new sequence
+void frame_cache_reset(frame_cache_t *cache);
+
+// Start replaying from the first frame, recording stops after the first loop
+void frame_cache_rewind(frame_cache_t *cache);
+
+// Fetch the next frame of the loop, next_frame_ptr is where the gif decoder
+// continues once the cached frames run out, it may be NULL
+int frame_cache_next(frame_cache_t *cache, frame_t *frame, uint8_t **next_frame_ptr);
+
+// Make frame number position the next one, for gifs that are played out of
+// order. Seeking to the first frame that isn't cached yet lets the next
+// frame_cache_store() record it. Walks the records from the start when
+// going backwards, that is one pointer per frame, nothing is decoded.
+int frame_cache_seek(frame_cache_t *cache, uint16_t position);
+
+// Record a freshly decoded frame, only frames that directly follow the cached ones are stored
+int frame_cache_store(frame_cache_t *cache, const frame_t *frame, uint8_t *next_frame_ptr);
+
+#endif //LEDPANEL_FRAME_CACHE_H
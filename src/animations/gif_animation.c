@@ -3,17 +3,45 @@
 //
 
 #include <malloc.h>
+#include <string.h>
 #include "stdio.h"
+#include "platform/platform.h"
 #include "gif_decoder.h"
+#include "gif_canvas.h"
 
 #include "framebuffer.h"
 #include "animations.h"
+#include "asset_store.h"
+#include "frame_cache.h"
+#include "panel_asset.h"
+#include "palette.h"
+#include "canvas_view.h"
+#include "compositor.h"
 
 typedef struct {
     uint8_t *start;
     uint8_t *end;
 } gif_image_t;
 
+// Frames are decoded whole when they are as large as the display, or
+// 32x32 on smaller displays
+#define GIF_CANVAS_MIN_SIZE 1024
+
+// Largest logical screen, larger frames are decoded row by row onto the
+// canvas and shown through the view
+#define GIF_CANVAS_PIXELS (128 * 64)
+
+// Retry interval while scan-out hasn't released a buffer yet
+#define GIF_RETRY_US 1000
+
+// Longest gif that can be played in any order, every frame takes 12 bytes
+// of index. Longer ones are parsed while they play, forward only.
+#define GIF_INDEX_FRAMES 1024
+
+// Falling further behind than this restarts the schedule from now
+// instead of rushing through the frames that were missed
+#define GIF_MAX_LATENESS_US 100000
+
 extern uint8_t baloons_gif_start[] asm( "images_baloons_gif_start" );
 extern uint8_t baloons_gif_end[]   asm( "images_baloons_gif_end" );
 extern uint8_t chevrons_gif_start[] asm( "images_chevrons_gif_start" );
@@ -58,6 +86,8 @@ static gif_image_t sequences[] = {
         { loopband_gif_start, loopband_gif_end },
 };
 
+#define BUILTIN_SEQUENCES ((int) (sizeof(sequences) / sizeof(sequences[0])))
+
 typedef enum {
     STOPPED,
     PAUSED,
@@ -66,53 +96,336 @@ typedef enum {
 } git_animation_state_t;
 
 static gif_t gif;
+static gif_lzw_context_t *lzw_context;
 static frame_t frame;
-static mutex_t gif_mutex;
+static platform_mutex_t gif_mutex;
 static git_animation_state_t state = STOPPED;
 static git_animation_state_t pause_state;
 static uint8_t current_sequence = DEFAULT_GIF_SEQUENCE;
-static unsigned long delay_ticks =0;
+static framebuffer_t *animation_framebuffer;
+static platform_alarm_t frame_alarm;
+static uint64_t frame_deadline_us;
+static uint64_t pause_remaining_us;
+static uint32_t frame_delay_us;
+static volatile uint32_t frames_decoded = 0;
+static frame_cache_t frame_cache;
+static uint8_t cache_enabled = 0;
+static panel_asset_t asset;
+static uint8_t asset_loaded = 0;
+static uint32_t colors[PALETTE_SIZE];
+static gif_canvas_t canvas;
+static uint8_t *canvas_pixels;
+static size_t canvas_size;
+static uint8_t *canvas_previous;
+static size_t frame_size;
+static uint8_t streamed;        // Frames don't fit frame.frame and skip the cache
+static canvas_view_t view;
+static uint8_t view_changed;    // The display doesn't show the view yet
+static const asset_store_t *sequence_store;
+static uint8_t trusted[BUILTIN_SEQUENCES + ASSET_STORE_SLOTS]; // By sequence id
+static gif_frame_index_t *frame_index;
+// Validation runs without gif_mutex, next to frames being decoded
+static gif_lzw_context_t *validate_context;
+static uint8_t *validate_row;
+static uint16_t frame_count;    // 0 for gifs that aren't indexed
+static int cursor;              // Frame on screen, -1 before the first one
+static int step;                // 1 or -1, ping-pong turns it around
+static volatile int seek_frame = -1;
+static uint8_t playback = GIF_PLAYBACK_FORWARD;
+static compositor_t *layer_compositor; // Frames go into a layer of it instead of the framebuffer
+static int layer_index;
 
-inline uint8_t gamma_correct(uint8_t value) {
-    return (value*value)/256;
+// First frame of a pass comes after the cursor
+static void start_pass() {
+    step = playback == GIF_PLAYBACK_REVERSE ? -1 : 1;
+    cursor = playback == GIF_PLAYBACK_REVERSE ? frame_count : -1;
+}
+
+// Move the cursor to the frame to show next, GIF_EOF at the end of a pass.
+// A ping-pong pass runs to the last frame and back to the first.
+static gif_error_t advance() {
+    int next = cursor + step;
+    if (playback == GIF_PLAYBACK_PINGPONG && next == frame_count && frame_count > 1) {
+        step = -1;
+        next = cursor - 1;
+    }
+    if (next < 0 || next >= frame_count) {
+        return GIF_EOF;
+    }
+    cursor = next;
+    return GIF_OK;
+}
+
+// The next ping-pong pass doesn't show the first frame twice
+static void rewind_sequence() {
+    int first = playback == GIF_PLAYBACK_PINGPONG && cursor == 0;
+    start_pass();
+    if (first && frame_count > 1) {
+        cursor = 0;
+    }
+    if (asset_loaded) {
+        panel_asset_rewind(&asset);
+    } else if (frame_count == 0) {
+        gif.frame_ptr = gif.first_frame;
+        if (cache_enabled) {
+            frame_cache_rewind(&frame_cache);
+        }
+    }
+}
+
+// Uploaded sequences are played from flash where they are stored
+static gif_error_t sequence_data(int sequence_id, const uint8_t **start, size_t *size) {
+    if (sequence_id < BUILTIN_SEQUENCES) {
+        *start = sequences[sequence_id].start;
+        *size = sequences[sequence_id].end - *start;
+        return GIF_OK;
+    }
+    if (sequence_store == NULL ||
+            asset_store_get(sequence_store, sequence_id - BUILTIN_SEQUENCES, start, size) != ASSET_STORE_OK) {
+        return GIF_ERROR;
+    }
+    return GIF_OK;
+}
+
+// Gifs are checked completely once, their frames are decoded without checks
+// from then on. Panel assets are checked by panel_asset_init(). Checking
+// takes a while, it is done without gif_mutex so frames keep coming and
+// the result is published under it. Only ever called from one thread.
+static void validate_sequences(int first) {
+    uint8_t checked[BUILTIN_SEQUENCES + ASSET_STORE_SLOTS] = { 0 };
+    int count = BUILTIN_SEQUENCES + (sequence_store != NULL ? asset_store_count(sequence_store) : 0);
+    for (int sequence_id = first; sequence_id < count; sequence_id++) {
+        const uint8_t *start;
+        size_t size;
+        gif_t check = { .lzw = validate_context };
+        checked[sequence_id] = sequence_data(sequence_id, &start, &size) == GIF_OK &&
+                gif_decoder_init((uint8_t *) start, size, &check) == GIF_OK &&
+                gif_decoder_validate(&check, validate_row, frame_size) == GIF_OK;
+    }
+
+    platform_mutex_enter(&gif_mutex);
+    memcpy(trusted + first, checked + first, sizeof(trusted) - first);
+    platform_mutex_exit(&gif_mutex);
+}
+
+// Sequences are either compiled panel assets or plain gifs, see add_resource()
+static gif_error_t load_sequence(int sequence_id) {
+    const uint8_t *start;
+    size_t size;
+    if (sequence_data(sequence_id, &start, &size) != GIF_OK) {
+        return GIF_ERROR;
+    }
+
+    seek_frame = -1;
+    // Bit-plane assets only go straight into the back buffer, not into a layer
+    asset_loaded = panel_asset_init(&asset, start, size) == PANEL_ASSET_OK;
+    if (asset_loaded && layer_compositor != NULL && asset.header->format != PANEL_ASSET_RGB) {
+        asset_loaded = 0;
+        return GIF_ERROR;
+    }
+    if (asset_loaded) {
+        frame_count = asset.header->frame_count;
+        start_pass();
+        return GIF_OK;
+    }
+
+    // The decoder only reads from the gif
+    if (gif_decoder_init((uint8_t *) start, size, &gif) != GIF_OK || gif.width * gif.height > canvas_size ||
+            gif.width > frame_size) {
+        return GIF_ERROR;
+    }
+    streamed = gif.width * gif.height > frame_size;
+    gif.trusted = trusted[sequence_id];
+    gif.lzw = lzw_context;
+    if (gif_decoder_index(&gif, frame_index, GIF_INDEX_FRAMES, &frame_count) != GIF_OK) {
+        frame_count = 0;
+    }
+    start_pass();
+    palette_convert(gif.global_ct, gif.ct_size, colors);
+    gif_canvas_init(&canvas, &gif, canvas_pixels, canvas_previous);
+    canvas_view_set_canvas(&view, gif.width, gif.height);
+    return GIF_OK;
+}
+
+static uint64_t gif_animation_update(platform_alarm_t *alarm);
+
+// Must not be called with gif_mutex held, an alarm that is already due runs right away
+static void schedule(uint64_t time_us) {
+    platform_alarm_at(&frame_alarm, time_us, gif_animation_update);
 }
 
 void gif_animation_init(framebuffer_t *framebuffer) {
-    frame.color_table = malloc(1024); // Enough to hold a 256 color palette
-    frame.frame = malloc(1024); // Enough to hold 32*16;
+    // Frames never exceed the logical screen, see gif_decoder_read_next_frame()
+    frame_size = framebuffer->width * framebuffer->height;
+    if (frame_size < GIF_CANVAS_MIN_SIZE) {
+        frame_size = GIF_CANVAS_MIN_SIZE;
+    }
+    canvas_size = frame_size > GIF_CANVAS_PIXELS ? frame_size : GIF_CANVAS_PIXELS;
+    frame.frame = malloc(frame_size);
+    canvas_pixels = malloc(canvas_size);
+    canvas_previous = malloc(canvas_size);
+    frame_index = malloc(GIF_INDEX_FRAMES * sizeof(gif_frame_index_t));
+    // Kept off the stack, frames are decoded from the alarm interrupt
+    lzw_context = malloc(sizeof(gif_lzw_context_t));
+    validate_context = malloc(sizeof(gif_lzw_context_t));
+    validate_row = malloc(frame_size);
+    animation_framebuffer = framebuffer;
+    canvas_view_init(&view, framebuffer->width, framebuffer->height);
 
-    mutex_init(&gif_mutex);
-    gif_decoder_init(sequences[DEFAULT_GIF_SEQUENCE].start, sequences[DEFAULT_GIF_SEQUENCE].end - sequences[DEFAULT_GIF_SEQUENCE].start, &gif);
-    state = PLAYING_LOOP;
+    platform_mutex_init(&gif_mutex);
+    validate_sequences(0);
+    state = load_sequence(DEFAULT_GIF_SEQUENCE) == GIF_OK ? PLAYING_LOOP : STOPPED;
+    frame_deadline_us = platform_time_us();
+    schedule(frame_deadline_us);
 }
 
 void gif_animation_play(int sequence_id, int new_state) {
-    mutex_enter_blocking(&gif_mutex);
+    platform_mutex_enter(&gif_mutex);
     current_sequence = sequence_id;
-    gif_decoder_init(sequences[current_sequence].start, sequences[current_sequence].end - sequences[current_sequence].start, &gif);
-    state = new_state;
-    mutex_exit(&gif_mutex);
+    if (cache_enabled) {
+        frame_cache_reset(&frame_cache);
+    }
+    state = load_sequence(current_sequence) == GIF_OK ? new_state : STOPPED;
+    frame_deadline_us = platform_time_us();
+    platform_mutex_exit(&gif_mutex);
+    schedule(frame_deadline_us);
+}
+
+void gif_animation_set_playback(int mode) {
+    platform_mutex_enter(&gif_mutex);
+    playback = mode;
+    // Carries on from the frame on screen, in the new direction
+    step = mode == GIF_PLAYBACK_REVERSE ? -1 : 1;
+    platform_mutex_exit(&gif_mutex);
+}
+
+int gif_animation_get_playback() {
+    return playback;
+}
+
+void gif_animation_seek(int frame_number) {
+    // Taken by the next update, rebuilding the canvas may take a while
+    seek_frame = frame_number;
+}
+
+int gif_animation_get_frame() {
+    return cursor;
+}
+
+int gif_animation_get_frame_count() {
+    return frame_count;
+}
+
+void gif_animation_set_store(const asset_store_t *store) {
+    // Nothing in the store is trusted until it has been checked again
+    platform_mutex_enter(&gif_mutex);
+    sequence_store = store;
+    memset(trusted + BUILTIN_SEQUENCES, 0, sizeof(trusted) - BUILTIN_SEQUENCES);
+    platform_mutex_exit(&gif_mutex);
+    validate_sequences(BUILTIN_SEQUENCES);
+}
+
+int gif_animation_get_builtin_count() {
+    return BUILTIN_SEQUENCES;
+}
+
+int gif_animation_get_sequence_count() {
+    return BUILTIN_SEQUENCES + (sequence_store != NULL ? asset_store_count(sequence_store) : 0);
+}
+
+void gif_animation_enable_cache(uint8_t *storage, size_t size) {
+    platform_mutex_enter(&gif_mutex);
+    frame_cache_init(&frame_cache, storage, size);
+    cache_enabled = 1;
+    platform_mutex_exit(&gif_mutex);
+}
+
+void gif_animation_get_cache_stats(uint32_t *hits, uint32_t *misses, size_t *bytes_used) {
+    *hits = frame_cache.hits;
+    *misses = frame_cache.misses;
+    *bytes_used = frame_cache.used;
 }
 
 void gif_animation_pause() {
-    mutex_enter_blocking(&gif_mutex);
+    platform_mutex_enter(&gif_mutex);
+    if (state == PAUSED) {
+        platform_mutex_exit(&gif_mutex);
+        return;
+    }
     pause_state = state;
     state = PAUSED;
-    mutex_exit(&gif_mutex);
+
+    // The frame on screen keeps the rest of its delay for when playing resumes
+    uint64_t now = platform_time_us();
+    pause_remaining_us = frame_deadline_us > now ? frame_deadline_us - now : 0;
+    platform_mutex_exit(&gif_mutex);
+    platform_alarm_cancel(&frame_alarm);
 }
 
 void gif_animation_resume() {
-    if (state != PAUSED)
+    platform_mutex_enter(&gif_mutex);
+    if (state != PAUSED) {
+        platform_mutex_exit(&gif_mutex);
         return;
-    mutex_enter_blocking(&gif_mutex);
+    }
     state = pause_state;
-    mutex_exit(&gif_mutex);
+    frame_deadline_us = platform_time_us() + pause_remaining_us;
+    platform_mutex_exit(&gif_mutex);
+    schedule(frame_deadline_us);
 }
 
 void gif_animation_stop() {
-    mutex_enter_blocking(&gif_mutex);
+    platform_mutex_enter(&gif_mutex);
     state = STOPPED;
-    mutex_exit(&gif_mutex);
+    platform_mutex_exit(&gif_mutex);
+    schedule(platform_time_us());
+}
+
+void gif_animation_release() {
+    platform_mutex_enter(&gif_mutex);
+    state = STOPPED;
+    // Cancelled with the mutex held, an update that runs in the meantime
+    // can only have rescheduled itself
+    platform_alarm_cancel(&frame_alarm);
+    platform_mutex_exit(&gif_mutex);
+}
+
+int gif_animation_set_layer(compositor_t *compositor, int layer) {
+    const compositor_layer_t *l = compositor != NULL ? compositor_get_layer(compositor, layer) : NULL;
+    if (compositor != NULL && (l == NULL || l->pixels == NULL || l->width != view.width || l->height != view.height)) {
+        return GIF_ERROR;
+    }
+    platform_mutex_enter(&gif_mutex);
+    layer_compositor = compositor;
+    layer_index = layer;
+    if (compositor != NULL && asset_loaded && asset.header->format != PANEL_ASSET_RGB) {
+        state = STOPPED;
+    }
+    view_changed = 1;
+    platform_mutex_exit(&gif_mutex);
+    schedule(platform_time_us());
+    return GIF_OK;
+}
+
+int gif_animation_set_view(int scale, int shrink, int filter) {
+    platform_mutex_enter(&gif_mutex);
+    int res = canvas_view_set(&view, scale, shrink, filter);
+    view_changed = 1;
+    platform_mutex_exit(&gif_mutex);
+    schedule(platform_time_us());
+    return res == CANVAS_VIEW_OK ? GIF_OK : GIF_ERROR;
+}
+
+void gif_animation_pan(int x, int y) {
+    platform_mutex_enter(&gif_mutex);
+    canvas_view_pan(&view, x, y);
+    view_changed = 1;
+    platform_mutex_exit(&gif_mutex);
+    schedule(platform_time_us());
+}
+
+const canvas_view_t *gif_animation_get_view() {
+    return &view;
 }
 
 uint8_t gif_animation_get_sequence() {
@@ -123,72 +436,289 @@ uint8_t gif_animation_get_state() {
     return state;
 }
 
-void gif_animation_update(framebuffer_t *framebuffer) {
-    mutex_enter_blocking(&gif_mutex);
-    if (state == PAUSED) {
-        mutex_exit(&gif_mutex);
+uint32_t gif_animation_get_frames_decoded() {
+    return frames_decoded;
+}
+
+// Gifs that aren't indexed, next frame from the cache when possible,
+// from the gif decoder otherwise
+static gif_error_t read_next_frame() {
+    if (cache_enabled && frame_cache_next(&frame_cache, &frame, &gif.frame_ptr) == FRAME_CACHE_OK) {
+        return GIF_OK;
+    }
+
+    gif_error_t res = gif_decoder_read_next_frame(&gif, &frame);
+    if (res == GIF_OK && cache_enabled) {
+        frame_cache_store(&frame_cache, &frame, gif.frame_ptr);
+    }
+    return res;
+}
+
+// Indexed gifs, any frame from the cache when it is there, straight from the index otherwise
+static gif_error_t read_frame(int frame_number) {
+    if (cache_enabled && frame_cache_seek(&frame_cache, frame_number) == FRAME_CACHE_OK &&
+            frame_cache_next(&frame_cache, &frame, NULL) == FRAME_CACHE_OK) {
+        return GIF_OK;
+    }
+
+    gif_error_t res = gif_decoder_read_frame(&gif, &frame_index[frame_number], &frame);
+    if (res == GIF_OK && cache_enabled) {
+        frame_cache_store(&frame_cache, &frame, NULL);
+    }
+    return res;
+}
+
+// Frames are drawn into the back buffer, or into the layer which is then
+// composed with the others. The compositor stays locked from output_begin()
+// until output_end().
+static int output_begin(framebuffer_t *framebuffer) {
+    if (layer_compositor != NULL && compositor_try_lock(layer_compositor) != COMPOSITOR_OK) {
+        return FRAMEBUFFER_BUSY;
+    }
+    int res = framebuffer_begin(framebuffer);
+    if (res != FRAMEBUFFER_OK && layer_compositor != NULL) {
+        compositor_unlock(layer_compositor);
+    }
+    return res;
+}
+
+// Show what was drawn, unless commit is 0
+static void output_end(framebuffer_t *framebuffer, int commit) {
+    if (commit) {
+        if (layer_compositor != NULL) {
+            compositor_draw(layer_compositor, framebuffer);
+        }
+        framebuffer_commit(framebuffer);
+    }
+    if (layer_compositor != NULL) {
+        compositor_unlock(layer_compositor);
+    }
+}
+
+static uint32_t *layer_pixels() {
+    return compositor_get_layer(layer_compositor, layer_index)->pixels;
+}
+
+// The whole display through the view
+static void output_view_all(framebuffer_t *framebuffer) {
+    if (layer_compositor == NULL) {
+        canvas_view_draw_all(&view, framebuffer, canvas_pixels, colors);
         return;
     }
+    canvas_view_render_all(&view, layer_pixels(), canvas_pixels, colors);
+    compositor_layer_damage(layer_compositor, layer_index, 0, 0, view.width, view.height);
+}
 
-    if (state == STOPPED) {
-        framebuffer_clear(framebuffer);
-        mutex_exit(&gif_mutex);
+// The part of the display that shows the canvas area x, y, width by height
+static void output_view(framebuffer_t *framebuffer, int x, int y, int width, int height) {
+    if (layer_compositor == NULL) {
+        canvas_view_draw(&view, framebuffer, canvas_pixels, colors, x, y, width, height);
         return;
     }
+    framebuffer_rect_t area;
+    canvas_view_render(&view, layer_pixels(), canvas_pixels, colors, x, y, width, height, &area);
+    compositor_layer_damage(layer_compositor, layer_index, area.x0, area.y0, area.x1 - area.x0, area.y1 - area.y0);
+}
 
-    // Crude but effective
-    if (delay_ticks > 0) {
-        delay_ticks--;
-        mutex_exit(&gif_mutex);
+static void output_clear(framebuffer_t *framebuffer) {
+    if (layer_compositor == NULL) {
+        framebuffer_clear(framebuffer);
         return;
     }
+    memset(layer_pixels(), 0, view.width * view.height * sizeof(uint32_t));
+    compositor_layer_damage(layer_compositor, layer_index, 0, 0, view.width, view.height);
+}
 
-    gif_error_t res = gif_decoder_read_next_frame(&gif, &frame);
-    if (res == GIF_EOF) {
-        if (state == PLAYING_LOOP) {
-            gif.frame_ptr = gif.first_frame;
-            res = gif_decoder_read_next_frame(&gif, &frame);
+// Changed pixels go straight from the canvas into the back buffer, which
+// already holds the previous frame. Only used while the view is direct.
+static void draw_span(void *context, int x, int y, const uint8_t *pixels, int count) {
+    framebuffer_drawspan((framebuffer_t *) context, x - view.x, y - view.y, pixels, count, colors);
+}
+
+static void begin_rows(void *context, const frame_t *rows_frame) {
+    (void) context;
+    gif_canvas_begin(&canvas, rows_frame, NULL, NULL);
+}
+
+static void draw_row(void *context, int y, const uint8_t *pixels) {
+    (void) context;
+    gif_canvas_draw_row(&canvas, &frame, y, pixels);
+}
+
+// Draw frame_number on the canvas, or the next frame of a gif that isn't
+// indexed when it is -1. Changed pixels also go to framebuffer unless it is
+// NULL, once the frame decoded. Streamed frames are decoded row by row
+// straight onto the canvas and never drawn here, their image data can still
+// turn out to be broken after the first rows.
+static gif_error_t draw_frame(int frame_number, framebuffer_t *framebuffer) {
+    gif_error_t res;
+    if (streamed) {
+        gif_rows_t rows = { begin_rows, draw_row, NULL };
+        res = frame_number < 0 ? gif_decoder_read_next_frame_rows(&gif, &frame, &rows)
+                               : gif_decoder_read_frame_rows(&gif, &frame_index[frame_number], &frame, &rows);
+        if (res == GIF_OK) {
+            gif_canvas_end(&canvas, &frame);
+        } else {
+            // Part of the frame made it onto the canvas
+            canvas.redraw = 1;
         }
-        else {
-            state = STOPPED;
-            mutex_exit(&gif_mutex);
-            return;
+        return res;
+    }
+
+    res = frame_number < 0 ? read_next_frame() : read_frame(frame_number);
+    if (res == GIF_OK) {
+        gif_canvas_draw_spans(&canvas, &frame, framebuffer != NULL ? draw_span : NULL, framebuffer);
+    }
+    return res;
+}
+
+// The canvas holds frame previous, bring it to frame_number. Anything but
+// the next frame is composed again from the key frame it builds on.
+static gif_error_t compose_frame(framebuffer_t *framebuffer, int previous, int frame_number) {
+    if (frame_number != previous + 1) {
+        gif_canvas_init(&canvas, &gif, canvas_pixels, canvas_previous);
+        for (int i = frame_index[frame_number].key; i < frame_number; i++) {
+            gif_error_t res = draw_frame(i, NULL);
+            if (res != GIF_OK) {
+                return res;
+            }
+        }
+    }
+    return draw_frame(frame_number, framebuffer);
+}
+
+static uint32_t delay_us(uint16_t delay) {
+    return (delay != 0 ? delay : GIF_DEFAULT_DELAY) * 10000UL;
+}
+
+static gif_error_t draw_next_frame(framebuffer_t *framebuffer) {
+    int previous = cursor;
+    if (frame_count > 0) {
+        int target = seek_frame;
+        seek_frame = -1;
+        if (target >= 0 && target < frame_count) {
+            cursor = target;
+        } else if (advance() != GIF_OK) {
+            return GIF_EOF;
+        }
+    }
+
+    if (asset_loaded) {
+        panel_asset_seek(&asset, cursor);
+        // Compiled assets are composited and gamma corrected already
+        uint16_t delay;
+        int res;
+        if (layer_compositor != NULL) {
+            res = panel_asset_render_next(&asset, layer_pixels(), view.width, view.height, &delay);
+            compositor_layer_damage(layer_compositor, layer_index, 0, 0, view.width, view.height);
+        } else {
+            res = panel_asset_draw_next(&asset, framebuffer, &delay);
+        }
+        if (res == PANEL_ASSET_OK) {
+            frame_delay_us = delay_us(delay);
         }
+        return res == PANEL_ASSET_OK ? GIF_OK : res == PANEL_ASSET_EOF ? GIF_EOF : GIF_ERROR;
     }
 
+    // The display is drawn in full when it doesn't show the previous frame
+    // through the current view. Otherwise a direct view takes the changed
+    // pixels as they are drawn, a scaled one, a layer or a streamed frame
+    // redraws what they cover. Nothing reaches the back buffer before the
+    // frame decoded, a frame that fails leaves it as it was.
+    int full = view_changed || canvas.redraw || (frame_count > 0 && cursor != previous + 1);
+    framebuffer_t *spans = full || streamed || !canvas_view_is_direct(&view) || layer_compositor != NULL ?
+                           NULL : framebuffer;
+    gif_error_t res = frame_count > 0 ? compose_frame(spans, previous, cursor) : draw_frame(-1, spans);
     if (res != GIF_OK) {
-        printf("Error in decoder %d\n", res);
-        mutex_exit(&gif_mutex);
-        return;
+        return res;
+    }
+    if (full) {
+        output_view_all(framebuffer);
+        view_changed = 0;
+    } else if (spans == NULL) {
+        output_view(framebuffer, canvas.dirty.x, canvas.dirty.y, canvas.dirty.width, canvas.dirty.height);
     }
+    frame_delay_us = delay_us(frame.delay);
+    return GIF_OK;
+}
+
+// Runs from the frame alarm when the next frame is due and returns when it
+// wants to run again. Deadlines advance by the frame delays and not by when
+// the alarm got to run, so being late for one frame doesn't stretch the loop.
+static uint64_t gif_animation_update(platform_alarm_t *alarm) {
+    (void) alarm;
+    framebuffer_t *framebuffer = animation_framebuffer;
+    uint64_t now = platform_time_us();
 
-    if (frame.delay != 0) {
-        // Calculate the number of updates we need to skip before the next frame should be shown
-        // frame.delay is in 1/100 of a second, so every tick in delay is 10 ms.
-        // We are called at 24hz (see ANIMATION_FREQUENCY in main.c)
-        // That means a single frame is visible for 41.667 ms
-        // A frame delay below 5 is negligible
-        if (frame.delay > 5) {
-            delay_ticks = (10000UL * frame.delay) / 41667;
+    // Runs from an interrupt and must not wait for the lock. Busy changing
+    // sequence or state, come back in a bit.
+    if (!platform_mutex_try_enter(&gif_mutex)) {
+        return now + GIF_RETRY_US;
+    }
+
+    // A new view is shown right away and not with the next frame
+    if (view_changed && state != STOPPED && !asset_loaded && (state == PAUSED || now < frame_deadline_us)) {
+        if (output_begin(framebuffer) != FRAMEBUFFER_OK) {
+            platform_mutex_exit(&gif_mutex);
+            return now + GIF_RETRY_US;
         }
-    } else {
-        delay_ticks = 0;
+        output_view_all(framebuffer);
+        output_end(framebuffer, 1);
+        view_changed = 0;
+        platform_mutex_exit(&gif_mutex);
+        return state == PAUSED ? 0 : frame_deadline_us;
     }
 
-    uint8_t *frame_ptr = frame.frame;
-    for (int y=0; y<frame.height; y++) {
-        for (int x=0; x<frame.width; x++) {
-            uint8_t pixel = *frame_ptr++;
-            if (frame.transparancy_enabled && pixel == frame.transparancy_index) {
-                    continue;
-            }
+    if (state == PAUSED) {
+        platform_mutex_exit(&gif_mutex);
+        return 0;
+    }
+
+    if (state == STOPPED) {
+        uint64_t next_us = now + GIF_RETRY_US;
+        if (output_begin(framebuffer) == FRAMEBUFFER_OK) {
+            output_clear(framebuffer);
+            output_end(framebuffer, 1);
+            next_us = 0;
+        }
+        platform_mutex_exit(&gif_mutex);
+        return next_us;
+    }
 
-            uint8_t *color_idx = frame.color_table + pixel * 3;
-            uint32_t color = gamma_correct(*color_idx) << 16 | gamma_correct(*(color_idx+1)) << 8 | gamma_correct(*(color_idx+2));
+    // Scan-out hasn't picked up the previous frame yet
+    if (output_begin(framebuffer) != FRAMEBUFFER_OK) {
+        platform_mutex_exit(&gif_mutex);
+        return now + GIF_RETRY_US;
+    }
 
-            framebuffer_drawpixel(framebuffer, x+frame.offset_x, y+frame.offset_y, color);
+    gif_error_t res = draw_next_frame(framebuffer);
+    if (res == GIF_EOF) {
+        if (state == PLAYING_LOOP) {
+            rewind_sequence();
+            res = draw_next_frame(framebuffer);
         }
+        else {
+            state = STOPPED;
+            output_end(framebuffer, 0);
+            platform_mutex_exit(&gif_mutex);
+            return now;
+        }
+    }
+
+    // A frame that failed hasn't drawn anything, the back buffer still holds
+    // the frame on screen for whoever commits next
+    if (res != GIF_OK) {
+        printf("Error in decoder %d\n", res);
+        frame_delay_us = delay_us(GIF_DEFAULT_DELAY);
+    } else {
+        frames_decoded++;
     }
+    output_end(framebuffer, res == GIF_OK);
 
-    mutex_exit(&gif_mutex);
-}
\ No newline at end of file
+    frame_deadline_us += frame_delay_us;
+    if (frame_deadline_us + GIF_MAX_LATENESS_US < now) {
+        frame_deadline_us = now;
+    }
+    platform_mutex_exit(&gif_mutex);
+    return frame_deadline_us;
+}
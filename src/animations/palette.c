@@ -0,0 +1,98 @@
+#include "framebuffer.h"
+#include "palette.h"
+
+// Four times the 8-bit curve plus what it rounded off, 0 to 3
+static uint16_t gamma_table[256];
+static uint8_t white_balance[3] = {
+        PALETTE_WHITE_BALANCE_R, PALETTE_WHITE_BALANCE_G, PALETTE_WHITE_BALANCE_B
+};
+
+// Gamma and white balance combined, one table per channel, and the two
+// bits below every value for framebuffers that dither
+static uint8_t channel_tables[3][256];
+static uint8_t channel_fractions[3][256];
+static uint8_t initialized = 0;
+
+static void update_channel_tables() {
+    for (int c = 0; c < 3; c++) {
+        for (int v = 0; v < 256; v++) {
+            channel_tables[c][v] = ((gamma_table[v] >> 2) * white_balance[c] + 127) / 255;
+            int fraction = (gamma_table[v] * white_balance[c] + 127) / 255 - channel_tables[c][v] * 4;
+            channel_fractions[c][v] = fraction < 0 ? 0 : fraction > 3 ? 3 : fraction;
+        }
+    }
+    initialized = 1;
+}
+
+// A curve value between 0 and 1 as the 8-bit value, rounded, and the fraction below it
+static uint16_t gamma_value(float value) {
+    int rounded = (int) (value * 255.0f + 0.5f);
+    int fraction = (int) (value * 1020.0f + 0.5f) - rounded * 4;
+    return rounded * 4 + (fraction < 0 ? 0 : fraction > 3 ? 3 : fraction);
+}
+
+void palette_set_gamma(int curve) {
+    for (int v = 0; v < 256; v++) {
+        switch (curve) {
+            case PALETTE_GAMMA_CIE1931: {
+                // Perceived lightness L* in 0..100 to relative luminance
+                float lightness = v * 100.0f / 255.0f;
+                float luminance;
+                if (lightness <= 8.0f) {
+                    luminance = lightness / 903.3f;
+                } else {
+                    float f = (lightness + 16.0f) / 116.0f;
+                    luminance = f * f * f;
+                }
+                gamma_table[v] = gamma_value(luminance);
+                break;
+            }
+            case PALETTE_GAMMA_LINEAR:
+                gamma_table[v] = v * 4;
+                break;
+            case PALETTE_GAMMA_SQUARE:
+            default:
+                gamma_table[v] = (v * v) / 64;
+                break;
+        }
+    }
+    update_channel_tables();
+}
+
+void palette_set_gamma_table(const uint8_t table[256]) {
+    for (int v = 0; v < 256; v++) {
+        gamma_table[v] = table[v] * 4;
+    }
+    update_channel_tables();
+}
+
+void palette_set_white_balance(uint8_t r, uint8_t g, uint8_t b) {
+    white_balance[0] = r;
+    white_balance[1] = g;
+    white_balance[2] = b;
+    if (!initialized) {
+        palette_set_gamma(PALETTE_GAMMA);
+    } else {
+        update_channel_tables();
+    }
+}
+
+void palette_convert(const uint8_t *color_table, int size, uint32_t colors[PALETTE_SIZE]) {
+    if (!initialized) {
+        palette_set_gamma(PALETTE_GAMMA);
+    }
+
+    for (int i = 0; i < PALETTE_SIZE; i++) {
+        if (i >= size) {
+            colors[i] = 0;
+            continue;
+        }
+
+        const uint8_t *rgb = color_table + i * 3;
+        colors[i] = (uint32_t) channel_tables[0][rgb[0]] << 16 |
+                    (uint32_t) channel_tables[1][rgb[1]] << 8 |
+                    channel_tables[2][rgb[2]] |
+                    FRAMEBUFFER_COLOR_FRACTION(channel_fractions[0][rgb[0]], channel_fractions[1][rgb[1]],
+                                               channel_fractions[2][rgb[2]]);
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef LEDPANEL_PALETTE_H
+#define LEDPANEL_PALETTE_H
+
+#include <stdint.h>
+
+// Gamma curves for palette_set_gamma()
+#define PALETTE_GAMMA_SQUARE 0   // value^2 / 256, the original curve
+#define PALETTE_GAMMA_CIE1931 1  // CIE 1931 lightness to luminance
+#define PALETTE_GAMMA_LINEAR 2
+
+// Defaults for the firmware and for assets compiled by util/gif2panel
+#ifndef PALETTE_GAMMA
+#define PALETTE_GAMMA PALETTE_GAMMA_SQUARE
+#endif
+
+// White balance as a per channel scale, 255 is full intensity
+#ifndef PALETTE_WHITE_BALANCE_R
+#define PALETTE_WHITE_BALANCE_R 255
+#endif
+#ifndef PALETTE_WHITE_BALANCE_G
+#define PALETTE_WHITE_BALANCE_G 255
+#endif
+#ifndef PALETTE_WHITE_BALANCE_B
+#define PALETTE_WHITE_BALANCE_B 255
+#endif
+
+#define PALETTE_SIZE 256
+
+// Color correction is done once per palette instead of once per pixel.
+// Every channel goes through the gamma curve and is then scaled by its white
+// balance factor, the result is the 0x00RRGGBB color framebuffer_drawpixel() takes.
+// The top byte carries the two bits below every channel, framebuffers that
+// dither show them, see FRAMEBUFFER_COLOR_FRACTION.
+// Changes apply to palettes converted afterwards, gif animations convert
+// theirs when a sequence starts playing.
+void palette_set_gamma(int curve);
+void palette_set_gamma_table(const uint8_t table[256]);
+void palette_set_white_balance(uint8_t r, uint8_t g, uint8_t b);
+
+// Convert size RGB triplets from a gif color table, the remaining entries are black
+void palette_convert(const uint8_t *color_table, int size, uint32_t colors[PALETTE_SIZE]);
+
+#endif //LEDPANEL_PALETTE_H
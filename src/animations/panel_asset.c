@@ -0,0 +1,150 @@
+#include <string.h>
+#include "panel_asset.h"
+
+int panel_asset_init(panel_asset_t *asset, const uint8_t *data, size_t size) {
+    const panel_asset_header_t *header = (const panel_asset_header_t *) data;
+    if (size < sizeof(panel_asset_header_t) || header->magic != PANEL_ASSET_MAGIC) {
+        return PANEL_ASSET_ERROR;
+    }
+
+    if (header->format != PANEL_ASSET_RGB && header->format != PANEL_ASSET_PLANES) {
+        return PANEL_ASSET_ERROR;
+    }
+
+    size_t tables_size = sizeof(panel_asset_header_t)
+            + header->frame_count * sizeof(panel_asset_frame_t)
+            + header->palette_size * sizeof(uint32_t);
+    if (header->frame_count == 0 || tables_size > size) {
+        return PANEL_ASSET_ERROR;
+    }
+
+    const panel_asset_frame_t *frames = (const panel_asset_frame_t *) (data + sizeof(panel_asset_header_t));
+    for (int i = 0; i < header->frame_count; i++) {
+        if (frames[i].offset < tables_size || frames[i].offset > size || frames[i].length > size - frames[i].offset) {
+            return PANEL_ASSET_ERROR;
+        }
+    }
+
+    asset->header = header;
+    asset->frames = frames;
+    asset->palette = (const uint32_t *) (frames + header->frame_count);
+    asset->data = data;
+    asset->position = 0;
+    return PANEL_ASSET_OK;
+}
+
+void panel_asset_rewind(panel_asset_t *asset) {
+    asset->position = 0;
+}
+
+void panel_asset_seek(panel_asset_t *asset, uint16_t position) {
+    asset->position = position;
+}
+
+// Runs that stay within the palette and the frame. Checked before drawing
+// so a broken frame draws nothing at all.
+static int check_runs(const panel_asset_t *asset, const uint8_t *runs, uint32_t length) {
+    int pixels = asset->header->width * asset->header->height;
+    int pixel = 0;
+
+    for (const uint8_t *run = runs; run + 1 < runs + length; run += 2) {
+        if (run[1] >= asset->header->palette_size || pixel + run[0] > pixels) {
+            return PANEL_ASSET_ERROR;
+        }
+        pixel += run[0];
+    }
+    return PANEL_ASSET_OK;
+}
+
+static int draw_rgb(panel_asset_t *asset, framebuffer_t *framebuffer, const uint8_t *runs, uint32_t length) {
+    int width = asset->header->width;
+    int pixel = 0;
+
+    if (check_runs(asset, runs, length) != PANEL_ASSET_OK) {
+        return PANEL_ASSET_ERROR;
+    }
+    for (const uint8_t *run = runs; run + 1 < runs + length; run += 2) {
+        uint32_t color = asset->palette[run[1]];
+        for (int i = 0; i < run[0]; i++, pixel++) {
+            framebuffer_drawpixel(framebuffer, pixel % width, pixel / width, color);
+        }
+    }
+    return PANEL_ASSET_OK;
+}
+
+static int draw_planes(panel_asset_t *asset, framebuffer_t *framebuffer, const uint8_t *planes, uint32_t length) {
+    const panel_asset_header_t *header = asset->header;
+    framebuffer_config_t *config = &framebuffer->config;
+    int base = framebuffer->data_base;
+
+    // The bit-planes are only valid for the panel and pins they were built
+    // for, and hold no fractions to dither
+    if (framebuffer->phases != 1 || header->width != framebuffer->width || header->height != framebuffer->height ||
+            header->planes != FRAMEBUFFER_PLANES - framebuffer->lowest_plane ||
+            header->column_bytes != framebuffer->column_bytes || length != framebuffer->buffer_size) {
+        return PANEL_ASSET_ERROR;
+    }
+    if (header->pins[0] != config->pin_r0 - base || header->pins[1] != config->pin_g0 - base ||
+            header->pins[2] != config->pin_b0 - base || header->pins[3] != config->pin_r1 - base ||
+            header->pins[4] != config->pin_g1 - base || header->pins[5] != config->pin_b1 - base) {
+        return PANEL_ASSET_ERROR;
+    }
+
+    // Written around the drawing functions, the whole display changed
+    memcpy(framebuffer->buffer, planes, length);
+    framebuffer->dirty = (framebuffer_rect_t) { 0, 0, framebuffer->width, framebuffer->height };
+    return PANEL_ASSET_OK;
+}
+
+static int render_rgb(panel_asset_t *asset, uint32_t *pixels, int width, int height, const uint8_t *runs,
+                      uint32_t length) {
+    int asset_width = asset->header->width;
+    int pixel = 0;
+
+    if (check_runs(asset, runs, length) != PANEL_ASSET_OK) {
+        return PANEL_ASSET_ERROR;
+    }
+    for (const uint8_t *run = runs; run + 1 < runs + length; run += 2) {
+        uint32_t color = asset->palette[run[1]];
+        for (int i = 0; i < run[0]; i++, pixel++) {
+            int x = pixel % asset_width;
+            int y = pixel / asset_width;
+            if (x < width && y < height) {
+                pixels[y * width + x] = color;
+            }
+        }
+    }
+    return PANEL_ASSET_OK;
+}
+
+int panel_asset_render_next(panel_asset_t *asset, uint32_t *pixels, int width, int height, uint16_t *delay) {
+    if (asset->position >= asset->header->frame_count) {
+        return PANEL_ASSET_EOF;
+    }
+    if (asset->header->format != PANEL_ASSET_RGB) {
+        return PANEL_ASSET_ERROR;
+    }
+
+    const panel_asset_frame_t *frame = &asset->frames[asset->position++];
+    *delay = frame->delay;
+    return render_rgb(asset, pixels, width, height, asset->data + frame->offset, frame->length);
+}
+
+int panel_asset_draw_next(panel_asset_t *asset, framebuffer_t *framebuffer, uint16_t *delay) {
+    if (asset->position >= asset->header->frame_count) {
+        return PANEL_ASSET_EOF;
+    }
+
+    if (framebuffer->buffer == NULL) {
+        return PANEL_ASSET_ERROR;
+    }
+
+    const panel_asset_frame_t *frame = &asset->frames[asset->position++];
+    const uint8_t *frame_data = asset->data + frame->offset;
+    *delay = frame->delay;
+
+    if (asset->header->format == PANEL_ASSET_PLANES) {
+        return draw_planes(asset, framebuffer, frame_data, frame->length);
+    }
+    return draw_rgb(asset, framebuffer, frame_data, frame->length);
+}
@@ -0,0 +1,68 @@
+#ifndef LEDPANEL_PANEL_ASSET_H
+#define LEDPANEL_PANEL_ASSET_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "framebuffer.h"
+
+// Animations pre-decoded at build time by util/gif2panel. An asset starts
+// with a header, followed by a frame table, an optional palette and the
+// frame data. All fields are little endian and 32-bit aligned, so the asset
+// can be used directly from flash.
+//
+// PANEL_ASSET_RGB frames are (run length, palette index) byte pairs that
+// cover the whole canvas, the palette holds gamma corrected 0x00RRGGBB colors.
+// PANEL_ASSET_PLANES frames are framebuffer contents for the pin layout,
+// depth and format in the header and are copied into the back buffer as is.
+#define PANEL_ASSET_MAGIC 0x414c4e50 // "PNLA"
+
+#define PANEL_ASSET_RGB 1
+#define PANEL_ASSET_PLANES 2
+
+#define PANEL_ASSET_OK 0
+#define PANEL_ASSET_ERROR 1
+#define PANEL_ASSET_EOF 2
+
+typedef struct {
+    uint32_t magic;
+    uint16_t format;
+    uint16_t frame_count;
+    uint16_t width, height;
+    uint16_t planes; // Bit-planes stored per frame, the most significant ones
+    uint16_t palette_size;
+    uint8_t pins[6]; // R0, G0, B0, R1, G1, B1 relative to the lowest of them
+    uint8_t column_bytes; // 1 for FRAMEBUFFER_FORMAT_PACKED, 4 for FRAMEBUFFER_FORMAT_WORD
+    uint8_t reserved;
+} panel_asset_header_t;
+
+typedef struct {
+    uint32_t offset; // From the start of the asset
+    uint32_t length;
+    uint16_t delay; // 1/100 s like in a gif, never 0
+    uint16_t reserved;
+} panel_asset_frame_t;
+
+typedef struct {
+    const panel_asset_header_t *header;
+    const panel_asset_frame_t *frames;
+    const uint32_t *palette;
+    const uint8_t *data;
+    uint16_t position;
+} panel_asset_t;
+
+// Returns PANEL_ASSET_ERROR when data doesn't hold a complete asset
+int panel_asset_init(panel_asset_t *asset, const uint8_t *data, size_t size);
+void panel_asset_rewind(panel_asset_t *asset);
+
+// Every frame is complete, any of them can be drawn next
+void panel_asset_seek(panel_asset_t *asset, uint16_t position);
+
+// Draw the next frame into the back buffer, delay is how long it
+// stays on screen in 1/100 s
+int panel_asset_draw_next(panel_asset_t *asset, framebuffer_t *framebuffer, uint16_t *delay);
+
+// The same into width by height colors, such as a compositor layer, for
+// PANEL_ASSET_RGB assets only
+int panel_asset_render_next(panel_asset_t *asset, uint32_t *pixels, int width, int height, uint16_t *delay);
+
+#endif //LEDPANEL_PANEL_ASSET_H
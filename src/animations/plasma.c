@@ -11,6 +11,7 @@ static uint8_t colour_map[256][3];
 static uint8_t ptn_table[4];
 
 void plasma_init(framebuffer_t *framebuffer) {
+    (void) framebuffer;
     for (int i = 0; i< 256; i++) {
         cos_table[i]= (60 * (cos(i*M_PI/32))) + 4;
     }
@@ -37,10 +38,10 @@ void plasma_init(framebuffer_t *framebuffer) {
 void plasma_update(framebuffer_t *framebuffer) {
     uint8_t t1 = ptn_table[0];
     uint8_t t2 = ptn_table[1];
-    for (int y = 0; y < framebuffer->config.h; y++) {
+    for (int y = 0; y < framebuffer->height; y++) {
         uint8_t t3 = ptn_table[2];
         uint8_t t4 = ptn_table[3];
-        for (int x = 0; x < framebuffer->config.w; x++) {
+        for (int x = 0; x < framebuffer->width; x++) {
             uint32_t colour = cos_table[t1] + cos_table[t2] + cos_table[t3] + cos_table[t4];
             uint32_t c = colour_map[colour][0]<<16|colour_map[colour][1]<<8|colour_map[colour][2];
             framebuffer_drawpixel(framebuffer, x, y, c);
@@ -55,4 +56,26 @@ void plasma_update(framebuffer_t *framebuffer) {
     ptn_table[1] += 2;
     ptn_table[2] += 3;
     ptn_table[3] += 4;
-}
\ No newline at end of file
+}
+
+void plasma_draw(uint32_t *pixels, int width, int height) {
+    uint8_t t1 = ptn_table[0];
+    uint8_t t2 = ptn_table[1];
+    for (int y = 0; y < height; y++) {
+        uint8_t t3 = ptn_table[2];
+        uint8_t t4 = ptn_table[3];
+        for (int x = 0; x < width; x++) {
+            uint32_t colour = cos_table[t1] + cos_table[t2] + cos_table[t3] + cos_table[t4];
+            *pixels++ = colour_map[colour][0]<<16|colour_map[colour][1]<<8|colour_map[colour][2];
+            t3 += 5;
+            t4 += 2;
+        }
+        t1 += 3;
+        t2 += 1;
+    }
+
+    ptn_table[0] += 1;
+    ptn_table[1] += 2;
+    ptn_table[2] += 3;
+    ptn_table[3] += 4;
+}
@@ -0,0 +1,268 @@
+#include <string.h>
+#include "asset_store.h"
+
+#define SECTOR_ALIGN(n) (((n) + PLATFORM_FLASH_SECTOR_SIZE - 1) & ~(PLATFORM_FLASH_SECTOR_SIZE - 1))
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t data_start;
+    uint32_t data_end;
+    uint32_t reserved[4];
+} asset_store_header_t;
+
+#define ASSET_STORE_VERSION 1
+
+static const asset_store_slot_t *slot_at(const asset_store_t *store, int slot) {
+    return (const asset_store_slot_t *) platform_flash_data(store->directory + (slot + 1) * sizeof(asset_store_slot_t));
+}
+
+// Program len bytes at offset in the directory, everything else in the page
+// is written as 0xff which leaves it as it is
+static int directory_program(asset_store_t *store, uint32_t offset, const void *data, size_t len) {
+    uint8_t page[PLATFORM_FLASH_PAGE_SIZE];
+    uint32_t page_offset = offset & ~(PLATFORM_FLASH_PAGE_SIZE - 1);
+    memset(page, 0xff, sizeof(page));
+    memcpy(page + (offset - page_offset), data, len);
+    return platform_flash_program(store->directory + page_offset, page, sizeof(page)) ? ASSET_STORE_OK
+                                                                                     : ASSET_STORE_ERROR;
+}
+
+static int slot_program(asset_store_t *store, int slot, size_t field, const void *data, size_t len) {
+    return directory_program(store, (slot + 1) * sizeof(asset_store_slot_t) + field, data, len);
+}
+
+static int slot_valid(const asset_store_t *store, int slot) {
+    const asset_store_slot_t *entry = slot_at(store, slot);
+    if (entry->committed != 0 || entry->deleted == 0) {
+        return 0;
+    }
+    // Data has to lie within the region the firmware leaves free today
+    if (entry->offset < store->data_start || entry->offset + entry->size > store->data_end) {
+        return 0;
+    }
+    return asset_store_crc32(0, platform_flash_data(entry->offset), entry->size) == entry->crc;
+}
+
+int asset_store_format(asset_store_t *store) {
+    if (!platform_flash_erase(store->directory, PLATFORM_FLASH_SECTOR_SIZE)) {
+        return ASSET_STORE_ERROR;
+    }
+    asset_store_header_t header = {
+            .magic = ASSET_STORE_MAGIC,
+            .version = ASSET_STORE_VERSION,
+            .data_start = store->data_start,
+            .data_end = store->data_end,
+    };
+    if (directory_program(store, 0, &header, sizeof(header)) != ASSET_STORE_OK) {
+        return ASSET_STORE_ERROR;
+    }
+
+    store->next_data = store->data_start;
+    store->slots_used = 0;
+    memset(store->valid, 0, sizeof(store->valid));
+    store->upload_slot = -1;
+    return ASSET_STORE_OK;
+}
+
+int asset_store_init(asset_store_t *store) {
+    uint32_t start, end;
+    platform_flash_region(&start, &end);
+    if (end < start + 2 * PLATFORM_FLASH_SECTOR_SIZE) {
+        return ASSET_STORE_ERROR;
+    }
+    store->directory = end - PLATFORM_FLASH_SECTOR_SIZE;
+    store->data_start = start;
+    store->data_end = store->directory;
+    store->upload_slot = -1;
+
+    // A store is kept as long as it sits in the same place, the data
+    // area may shrink when the firmware grows
+    const asset_store_header_t *header = (const asset_store_header_t *) platform_flash_data(store->directory);
+    if (header->magic != ASSET_STORE_MAGIC || header->version != ASSET_STORE_VERSION ||
+            header->data_end != store->data_end) {
+        return asset_store_format(store);
+    }
+
+    store->next_data = store->data_start;
+    store->slots_used = 0;
+    for (int slot = 0; slot < ASSET_STORE_SLOTS; slot++) {
+        const asset_store_slot_t *entry = slot_at(store, slot);
+        if (entry->magic != ASSET_STORE_SLOT_MAGIC) {
+            break;
+        }
+        store->slots_used++;
+        store->valid[slot] = slot_valid(store, slot);
+        uint32_t end_offset = SECTOR_ALIGN(entry->offset + entry->size);
+        if (end_offset > store->next_data && end_offset <= store->data_end) {
+            store->next_data = end_offset;
+        }
+    }
+    for (int slot = store->slots_used; slot < ASSET_STORE_SLOTS; slot++) {
+        store->valid[slot] = 0;
+    }
+    return ASSET_STORE_OK;
+}
+
+int asset_store_begin(asset_store_t *store, const char *name, uint32_t size, uint32_t crc) {
+    // An upload that never finished keeps its slot and space until the next format
+    store->upload_slot = -1;
+
+    if (size == 0) {
+        return ASSET_STORE_ERROR;
+    }
+    if (store->slots_used == ASSET_STORE_SLOTS || size > store->data_end - store->next_data) {
+        return ASSET_STORE_FULL;
+    }
+    asset_store_slot_t entry;
+    memset(&entry, 0xff, sizeof(entry));
+    entry.magic = ASSET_STORE_SLOT_MAGIC;
+    entry.offset = store->next_data;
+    entry.size = size;
+    entry.crc = crc;
+    // Padded with zeros, a name that uses all of the field isn't terminated
+    memset(entry.name, 0, sizeof(entry.name));
+    memcpy(entry.name, name, strnlen(name, sizeof(entry.name)));
+
+    int slot = store->slots_used;
+    if (slot_program(store, slot, 0, &entry, sizeof(entry)) != ASSET_STORE_OK) {
+        return ASSET_STORE_ERROR;
+    }
+    store->slots_used++;
+    store->next_data += SECTOR_ALIGN(size);
+
+    store->upload_slot = slot;
+    store->upload_erased = entry.offset;
+    store->upload_written = 0;
+    store->page_length = 0;
+    return ASSET_STORE_OK;
+}
+
+static int flush_page(asset_store_t *store) {
+    const asset_store_slot_t *entry = slot_at(store, store->upload_slot);
+    memset(store->page + store->page_length, 0xff, sizeof(store->page) - store->page_length);
+    uint32_t offset = entry->offset + store->upload_written - store->page_length;
+    store->page_length = 0;
+    // A sector at a time as the upload reaches it, erasing stops everything
+    // else for as long as it takes
+    while (offset >= store->upload_erased) {
+        if (!platform_flash_erase(store->upload_erased, PLATFORM_FLASH_SECTOR_SIZE)) {
+            return ASSET_STORE_ERROR;
+        }
+        store->upload_erased += PLATFORM_FLASH_SECTOR_SIZE;
+    }
+    return platform_flash_program(offset, store->page, sizeof(store->page)) ? ASSET_STORE_OK : ASSET_STORE_ERROR;
+}
+
+int asset_store_write(asset_store_t *store, const uint8_t *data, size_t size) {
+    if (store->upload_slot < 0 || size > slot_at(store, store->upload_slot)->size - store->upload_written) {
+        return ASSET_STORE_ERROR;
+    }
+
+    while (size > 0) {
+        size_t length = sizeof(store->page) - store->page_length;
+        if (length > size) {
+            length = size;
+        }
+        memcpy(store->page + store->page_length, data, length);
+        store->page_length += length;
+        store->upload_written += length;
+        data += length;
+        size -= length;
+
+        if (store->page_length == sizeof(store->page) && flush_page(store) != ASSET_STORE_OK) {
+            return ASSET_STORE_ERROR;
+        }
+    }
+    return ASSET_STORE_OK;
+}
+
+int asset_store_finish(asset_store_t *store) {
+    int slot = store->upload_slot;
+    if (slot < 0 || store->upload_written != slot_at(store, slot)->size) {
+        return ASSET_STORE_ERROR;
+    }
+    if (store->page_length > 0 && flush_page(store) != ASSET_STORE_OK) {
+        return ASSET_STORE_ERROR;
+    }
+    store->upload_slot = -1;
+
+    const asset_store_slot_t *entry = slot_at(store, slot);
+    if (asset_store_crc32(0, platform_flash_data(entry->offset), entry->size) != entry->crc) {
+        return ASSET_STORE_CRC;
+    }
+
+    uint32_t committed = 0;
+    if (slot_program(store, slot, offsetof(asset_store_slot_t, committed), &committed, sizeof(committed)) !=
+            ASSET_STORE_OK) {
+        return ASSET_STORE_ERROR;
+    }
+    store->valid[slot] = 1;
+    return ASSET_STORE_OK;
+}
+
+static int find_slot(const asset_store_t *store, int index) {
+    for (int slot = 0; slot < store->slots_used; slot++) {
+        if (store->valid[slot] && index-- == 0) {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+int asset_store_count(const asset_store_t *store) {
+    int count = 0;
+    for (int slot = 0; slot < store->slots_used; slot++) {
+        count += store->valid[slot];
+    }
+    return count;
+}
+
+int asset_store_get(const asset_store_t *store, int index, const uint8_t **data, size_t *size) {
+    int slot = find_slot(store, index);
+    if (slot < 0) {
+        return ASSET_STORE_ERROR;
+    }
+    const asset_store_slot_t *entry = slot_at(store, slot);
+    *data = platform_flash_data(entry->offset);
+    *size = entry->size;
+    return ASSET_STORE_OK;
+}
+
+const char *asset_store_name(const asset_store_t *store, int index) {
+    int slot = find_slot(store, index);
+    return slot < 0 ? NULL : slot_at(store, slot)->name;
+}
+
+int asset_store_delete(asset_store_t *store, int index) {
+    int slot = find_slot(store, index);
+    if (slot < 0) {
+        return ASSET_STORE_ERROR;
+    }
+    uint32_t deleted = 0;
+    if (slot_program(store, slot, offsetof(asset_store_slot_t, deleted), &deleted, sizeof(deleted)) !=
+            ASSET_STORE_OK) {
+        return ASSET_STORE_ERROR;
+    }
+    store->valid[slot] = 0;
+    return ASSET_STORE_OK;
+}
+
+size_t asset_store_free(const asset_store_t *store) {
+    return store->slots_used == ASSET_STORE_SLOTS ? 0 : store->data_end - store->next_data;
+}
+
+uint32_t asset_store_crc32(uint32_t crc, const uint8_t *data, size_t size) {
+    // Four bits at a time, a 64 byte table instead of 1 KB
+    static const uint32_t table[16] = {
+            0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+            0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+    };
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc ^= data[i];
+        crc = crc >> 4 ^ table[crc & 0xf];
+        crc = crc >> 4 ^ table[crc & 0xf];
+    }
+    return ~crc;
+}
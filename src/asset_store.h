@@ -0,0 +1,87 @@
+// Animations uploaded at runtime, kept in the flash after the firmware
+// image and played from there without copying them into RAM. Assets are
+// anything gif_animation can play: a gif or a panel asset.
+//
+// The directory is the last sector of the flash region. It starts with a
+// header followed by fixed size slots that are only ever appended to, state
+// changes program more bits to zero. The data of every asset starts on a
+// sector of its own past the data of the previous one. Deleting an asset
+// only marks its slot, the space comes back when the store is formatted.
+// Every asset carries a CRC-32 that is checked when the upload finishes and
+// again at init, so assets that a larger firmware image overwrote are
+// dropped instead of played.
+//
+// Flash goes through the platform layer, the host build backs it with a file.
+//
+
+#ifndef LEDPANEL_ASSET_STORE_H
+#define LEDPANEL_ASSET_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "platform/platform.h"
+
+#define ASSET_STORE_MAGIC 0x52545341 // "ASTR"
+#define ASSET_STORE_SLOT_MAGIC 0x544f4c53 // "SLOT"
+#define ASSET_STORE_NAME_SIZE 8
+
+#define ASSET_STORE_OK 0
+#define ASSET_STORE_ERROR 1
+#define ASSET_STORE_FULL 2
+#define ASSET_STORE_CRC 3
+
+typedef struct {
+    uint32_t magic;
+    uint32_t offset; // From the start of flash
+    uint32_t size;
+    uint32_t crc;
+    uint32_t committed; // 0 once the data is complete and checked
+    uint32_t deleted;   // 0 once deleted
+    char name[ASSET_STORE_NAME_SIZE]; // Not terminated when all 8 are used
+} asset_store_slot_t;
+
+// The header takes the place of the first slot
+#define ASSET_STORE_SLOTS ((int) (PLATFORM_FLASH_SECTOR_SIZE / sizeof(asset_store_slot_t)) - 1)
+
+typedef struct {
+    uint32_t directory;
+    uint32_t data_start, data_end;
+    uint32_t next_data;
+    int slots_used;
+    uint8_t valid[ASSET_STORE_SLOTS];
+
+    // Upload in progress, -1 when there is none
+    int upload_slot;
+    uint32_t upload_erased; // Erased up to here
+    uint32_t upload_written;
+    uint8_t page[PLATFORM_FLASH_PAGE_SIZE];
+    size_t page_length;
+} asset_store_t;
+
+// Formats the region when it doesn't hold a store yet
+int asset_store_init(asset_store_t *store);
+int asset_store_format(asset_store_t *store);
+
+// Upload in chunks of any size. asset_store_begin() only reserves the space
+// for size bytes, asset_store_write() erases every sector when it first
+// writes to it, so no call erases more than one. asset_store_finish() checks
+// the CRC-32 of what was written against crc and only then makes the asset
+// visible.
+int asset_store_begin(asset_store_t *store, const char *name, uint32_t size, uint32_t crc);
+int asset_store_write(asset_store_t *store, const uint8_t *data, size_t size);
+int asset_store_finish(asset_store_t *store);
+
+// Assets are numbered 0 to asset_store_count() - 1 in upload order,
+// deleting one renumbers the ones after it
+int asset_store_count(const asset_store_t *store);
+int asset_store_get(const asset_store_t *store, int index, const uint8_t **data, size_t *size);
+const char *asset_store_name(const asset_store_t *store, int index);
+int asset_store_delete(asset_store_t *store, int index);
+
+// Bytes left for new assets
+size_t asset_store_free(const asset_store_t *store);
+
+// CRC-32 as used by zlib, pass 0 to start
+uint32_t asset_store_crc32(uint32_t crc, const uint8_t *data, size_t size);
+
+#endif //LEDPANEL_ASSET_STORE_H
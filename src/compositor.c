@@ -0,0 +1,291 @@
+#include <malloc.h>
+#include <string.h>
+#include "compositor.h"
+
+#define RB_MASK 0x00ff00fful
+#define G_MASK 0x0000ff00ul
+
+static const framebuffer_rect_t empty_rect = { 0, 0, 0, 0 };
+
+// dst + (src - dst) * alpha / 256, alpha 0 to 256. A lane that goes
+// negative borrows from the lane above it, that never reaches past the
+// bits the shift and the mask drop.
+static inline uint32_t blend_lerp(uint32_t dst, uint32_t src, uint32_t alpha) {
+    uint32_t rb = dst & RB_MASK;
+    uint32_t g = dst & G_MASK;
+    rb = (rb + (((src & RB_MASK) - rb) * alpha >> 8)) & RB_MASK;
+    g = (g + (((src & G_MASK) - g) * alpha >> 8)) & G_MASK;
+    return rb | g;
+}
+
+// Every channel times factor / 256, factor 0 to 256
+static inline uint32_t blend_scale(uint32_t color, uint32_t factor) {
+    return ((color & RB_MASK) * factor >> 8 & RB_MASK) | ((color & G_MASK) * factor >> 8 & G_MASK);
+}
+
+// Lanes that carry into their headroom are set to 0xff
+static inline uint32_t blend_add(uint32_t dst, uint32_t src) {
+    uint32_t rb = (dst & RB_MASK) + (src & RB_MASK);
+    uint32_t g = (dst & G_MASK) + (src & G_MASK);
+    rb |= 0x01000100ul - (rb >> 8 & 0x00010001ul);
+    g |= 0x00010000ul - (g >> 8 & 0x00000100ul);
+    return (rb & RB_MASK) | (g & G_MASK);
+}
+
+static void blend_span(const compositor_layer_t *layer, uint32_t *dst, const uint32_t *src, int count) {
+    // 255 becomes 256 so full opacity leaves the pixels as they are
+    uint32_t opacity = layer->opacity + (layer->opacity >> 7);
+    uint32_t key = layer->key & 0xffffff;
+
+    switch (layer->blend) {
+        case COMPOSITOR_BLEND_OPAQUE:
+            if (opacity == 256) {
+                memcpy(dst, src, count * sizeof(uint32_t));
+                break;
+            }
+            for (int i = 0; i < count; i++) {
+                dst[i] = blend_lerp(dst[i], src[i], opacity);
+            }
+            break;
+        case COMPOSITOR_BLEND_KEY:
+            for (int i = 0; i < count; i++) {
+                if ((src[i] & 0xffffff) != key) {
+                    dst[i] = opacity == 256 ? src[i] : blend_lerp(dst[i], src[i], opacity);
+                }
+            }
+            break;
+        case COMPOSITOR_BLEND_ALPHA:
+            for (int i = 0; i < count; i++) {
+                uint32_t alpha = src[i] >> 24;
+                alpha = (alpha + (alpha >> 7)) * opacity >> 8;
+                if (alpha == 256) {
+                    dst[i] = src[i] & 0xffffff;
+                } else if (alpha != 0) {
+                    dst[i] = blend_lerp(dst[i], src[i], alpha);
+                }
+            }
+            break;
+        case COMPOSITOR_BLEND_ADD:
+            if (opacity == 256) {
+                for (int i = 0; i < count; i++) {
+                    dst[i] = blend_add(dst[i], src[i]);
+                }
+                break;
+            }
+            for (int i = 0; i < count; i++) {
+                dst[i] = blend_add(dst[i], blend_scale(src[i], opacity));
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static int layer_active(const compositor_layer_t *layer) {
+    return layer->pixels != NULL && layer->visible && layer->opacity != 0;
+}
+
+// The layer hides everything below it from x0 to x1 of display row y
+static int layer_covers(const compositor_layer_t *layer, int y, int x0, int x1) {
+    return layer->blend == COMPOSITOR_BLEND_OPAQUE && layer->opacity == COMPOSITOR_OPACITY_MAX &&
+           y >= layer->y && y < layer->y + layer->height && x0 >= layer->x && x1 <= layer->x + layer->width;
+}
+
+static void damage(compositor_t *compositor, int x0, int y0, int x1, int y1) {
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 > compositor->width) x1 = compositor->width;
+    if (y1 > compositor->height) y1 = compositor->height;
+    if (x1 <= x0 || y1 <= y0) {
+        return;
+    }
+
+    framebuffer_rect_t *dirty = &compositor->dirty;
+    if (dirty->x1 <= dirty->x0) {
+        *dirty = (framebuffer_rect_t) { x0, y0, x1, y1 };
+    } else {
+        if (x0 < dirty->x0) dirty->x0 = x0;
+        if (y0 < dirty->y0) dirty->y0 = y0;
+        if (x1 > dirty->x1) dirty->x1 = x1;
+        if (y1 > dirty->y1) dirty->y1 = y1;
+    }
+}
+
+// Everything the layer covers, whether it shows or not
+static void damage_layer(compositor_t *compositor, const compositor_layer_t *layer) {
+    if (layer->pixels != NULL) {
+        damage(compositor, layer->x, layer->y, layer->x + layer->width, layer->y + layer->height);
+    }
+}
+
+int compositor_init(compositor_t *compositor, int width, int height) {
+    memset(compositor->layers, 0, sizeof(compositor->layers));
+    compositor->width = width;
+    compositor->height = height;
+    compositor->line = malloc(width * sizeof(uint32_t));
+    if (compositor->line == NULL) {
+        return COMPOSITOR_ERROR;
+    }
+    compositor->dirty = empty_rect;
+    compositor->layers_blended = 0;
+    platform_mutex_init(&compositor->mutex);
+    return COMPOSITOR_OK;
+}
+
+int compositor_layer_init(compositor_t *compositor, int layer, int width, int height, int blend) {
+    if (layer < 0 || layer >= COMPOSITOR_LAYERS || width <= 0 || height <= 0 || blend > COMPOSITOR_BLEND_ADD) {
+        return COMPOSITOR_ERROR;
+    }
+    compositor_layer_t *l = &compositor->layers[layer];
+    damage_layer(compositor, l);
+    if (l->pixels == NULL || l->width * l->height != width * height) {
+        free(l->pixels);
+        l->pixels = malloc(width * height * sizeof(uint32_t));
+        if (l->pixels == NULL) {
+            return COMPOSITOR_ERROR;
+        }
+    }
+    memset(l->pixels, 0, width * height * sizeof(uint32_t));
+    l->width = width;
+    l->height = height;
+    l->x = 0;
+    l->y = 0;
+    l->blend = blend;
+    l->key = 0;
+    l->opacity = COMPOSITOR_OPACITY_MAX;
+    l->visible = 1;
+    damage_layer(compositor, l);
+    return COMPOSITOR_OK;
+}
+
+compositor_layer_t *compositor_get_layer(compositor_t *compositor, int layer) {
+    return layer >= 0 && layer < COMPOSITOR_LAYERS ? &compositor->layers[layer] : NULL;
+}
+
+void compositor_lock(compositor_t *compositor) {
+    platform_mutex_enter(&compositor->mutex);
+}
+
+int compositor_try_lock(compositor_t *compositor) {
+    return platform_mutex_try_enter(&compositor->mutex) ? COMPOSITOR_OK : COMPOSITOR_BUSY;
+}
+
+void compositor_unlock(compositor_t *compositor) {
+    platform_mutex_exit(&compositor->mutex);
+}
+
+void compositor_layer_damage(compositor_t *compositor, int layer, int x, int y, int width, int height) {
+    compositor_layer_t *l = &compositor->layers[layer];
+    if (!l->visible) {
+        // Showing it again redraws all of it
+        return;
+    }
+    if (x < 0) {
+        width += x;
+        x = 0;
+    }
+    if (y < 0) {
+        height += y;
+        y = 0;
+    }
+    if (width > l->width - x) width = l->width - x;
+    if (height > l->height - y) height = l->height - y;
+    if (width > 0 && height > 0) {
+        damage(compositor, l->x + x, l->y + y, l->x + x + width, l->y + y + height);
+    }
+}
+
+void compositor_layer_move(compositor_t *compositor, int layer, int x, int y) {
+    compositor_layer_t *l = &compositor->layers[layer];
+    if (l->x == x && l->y == y) {
+        return;
+    }
+    if (l->visible) {
+        damage_layer(compositor, l);
+    }
+    l->x = x;
+    l->y = y;
+    if (l->visible) {
+        damage_layer(compositor, l);
+    }
+}
+
+void compositor_layer_set_blend(compositor_t *compositor, int layer, int blend, uint32_t key) {
+    compositor_layer_t *l = &compositor->layers[layer];
+    if (blend < 0 || blend > COMPOSITOR_BLEND_ADD || (l->blend == blend && l->key == key)) {
+        return;
+    }
+    l->blend = blend;
+    l->key = key;
+    if (l->visible) {
+        damage_layer(compositor, l);
+    }
+}
+
+void compositor_layer_set_opacity(compositor_t *compositor, int layer, int opacity) {
+    compositor_layer_t *l = &compositor->layers[layer];
+    opacity = opacity < 0 ? 0 : opacity > COMPOSITOR_OPACITY_MAX ? COMPOSITOR_OPACITY_MAX : opacity;
+    if (l->opacity == opacity) {
+        return;
+    }
+    l->opacity = opacity;
+    if (l->visible) {
+        damage_layer(compositor, l);
+    }
+}
+
+void compositor_layer_show(compositor_t *compositor, int layer, int visible) {
+    compositor_layer_t *l = &compositor->layers[layer];
+    if (l->visible == (visible != 0)) {
+        return;
+    }
+    l->visible = visible != 0;
+    damage_layer(compositor, l);
+}
+
+// Display row y from x0 to x1 into line, starting from the topmost layer
+// that hides everything below it
+static void compose_row(compositor_t *compositor, int y, int x0, int x1) {
+    uint32_t *line = compositor->line;
+    int bottom = COMPOSITOR_LAYERS;
+    for (int i = COMPOSITOR_LAYERS - 1; i >= 0; i--) {
+        const compositor_layer_t *layer = &compositor->layers[i];
+        if (layer_active(layer) && layer_covers(layer, y, x0, x1)) {
+            bottom = i;
+            break;
+        }
+    }
+    if (bottom == COMPOSITOR_LAYERS) {
+        memset(line + x0, 0, (x1 - x0) * sizeof(uint32_t));
+        bottom = 0;
+    }
+
+    for (int i = bottom; i < COMPOSITOR_LAYERS; i++) {
+        const compositor_layer_t *layer = &compositor->layers[i];
+        if (!layer_active(layer) || y < layer->y || y >= layer->y + layer->height) {
+            continue;
+        }
+        int start = x0 > layer->x ? x0 : layer->x;
+        int end = x1 < layer->x + layer->width ? x1 : layer->x + layer->width;
+        if (start >= end) {
+            continue;
+        }
+        const uint32_t *src = layer->pixels + (y - layer->y) * layer->width + (start - layer->x);
+        blend_span(layer, line + start, src, end - start);
+        compositor->layers_blended++;
+    }
+}
+
+int compositor_draw(compositor_t *compositor, framebuffer_t *framebuffer) {
+    framebuffer_rect_t dirty = compositor->dirty;
+    if (dirty.x1 <= dirty.x0 || dirty.y1 <= dirty.y0) {
+        return COMPOSITOR_UNCHANGED;
+    }
+    compositor->dirty = empty_rect;
+
+    for (int y = dirty.y0; y < dirty.y1; y++) {
+        compose_row(compositor, y, dirty.x0, dirty.x1);
+        framebuffer_drawrow(framebuffer, dirty.x0, y, compositor->line + dirty.x0, dirty.x1 - dirty.x0);
+    }
+    return COMPOSITOR_OK;
+}
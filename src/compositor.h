@@ -0,0 +1,93 @@
+// Stacks a few layers into the framebuffer, so a gif, a procedural
+// animation and an overlay can be on the display at the same time. Every
+// layer has its own buffer of 0x00RRGGBB pixels, a blend mode, a position
+// on the display and an opacity. Layers are stacked bottom first, whatever
+// no layer covers is black.
+//
+// Layers mark what they change with compositor_layer_damage(), moving them
+// or changing how they blend does that for them. compositor_draw() only
+// composes the display area damaged since it last ran, layers that don't
+// reach into that area are skipped and so is everything below a layer that
+// covers it opaquely. Nothing is drawn at all while no layer changed.
+//
+// Blending handles two channels per 32-bit operation, red and blue sit in
+// one word with a byte of headroom each and green goes on its own. The
+// Cortex-M0+ has no SIMD instructions, this halves the multiplies and adds
+// of doing every channel by itself. Opaque pixels that are copied as they
+// are keep the fraction bits of FRAMEBUFFER_COLOR_FRACTION, blended ones
+// lose them.
+//
+// The compositor isn't locked by itself. Whatever changes layers or draws
+// holds it with compositor_lock(), or compositor_try_lock() from an
+// interrupt, which must not wait for the code it interrupted.
+//
+
+#ifndef LEDPANEL_COMPOSITOR_H
+#define LEDPANEL_COMPOSITOR_H
+
+#include <stdint.h>
+#include "framebuffer.h"
+#include "platform/platform.h"
+
+#define COMPOSITOR_LAYERS 4
+
+// Pixels replace what is below
+#define COMPOSITOR_BLEND_OPAQUE 0
+// As opaque, except pixels of the key color which are left out
+#define COMPOSITOR_BLEND_KEY 1
+// The top byte of every pixel is its alpha, 255 replaces what is below
+#define COMPOSITOR_BLEND_ALPHA 2
+// Pixels are added to what is below, channels saturate at 255
+#define COMPOSITOR_BLEND_ADD 3
+
+#define COMPOSITOR_OPACITY_MAX 255
+
+#define COMPOSITOR_OK 0
+#define COMPOSITOR_ERROR 1
+#define COMPOSITOR_BUSY 2
+#define COMPOSITOR_UNCHANGED 3
+
+typedef struct {
+    uint32_t *pixels;  // width by height, NULL while the layer is unused
+    int width, height;
+    int x, y;          // Display position of the top left pixel, may be off the display
+    int blend;         // COMPOSITOR_BLEND_*
+    uint32_t key;      // Color left out by COMPOSITOR_BLEND_KEY
+    uint8_t opacity;   // Scales the whole layer, COMPOSITOR_OPACITY_MAX is as the pixels say
+    uint8_t visible;
+} compositor_layer_t;
+
+typedef struct {
+    compositor_layer_t layers[COMPOSITOR_LAYERS]; // Bottom first
+    int width, height;                            // Display
+    uint32_t *line;                               // One display row being composed
+    framebuffer_rect_t dirty;                     // Display area to compose again
+    uint32_t layers_blended;                      // Layer rows blended, for profiling
+    platform_mutex_t mutex;
+} compositor_t;
+
+// An empty compositor for a display of width by height
+int compositor_init(compositor_t *compositor, int width, int height);
+
+// Allocate the buffer of a layer, cleared to 0. It starts out visible and
+// opaque at the top left of the display.
+int compositor_layer_init(compositor_t *compositor, int layer, int width, int height, int blend);
+compositor_layer_t *compositor_get_layer(compositor_t *compositor, int layer);
+
+void compositor_lock(compositor_t *compositor);
+int compositor_try_lock(compositor_t *compositor);
+void compositor_unlock(compositor_t *compositor);
+
+// Mark the layer area x, y, width by height as changed
+void compositor_layer_damage(compositor_t *compositor, int layer, int x, int y, int width, int height);
+void compositor_layer_move(compositor_t *compositor, int layer, int x, int y);
+void compositor_layer_set_blend(compositor_t *compositor, int layer, int blend, uint32_t key);
+void compositor_layer_set_opacity(compositor_t *compositor, int layer, int opacity);
+void compositor_layer_show(compositor_t *compositor, int layer, int visible);
+
+// Compose the damaged area into the back buffer of framebuffer, between
+// framebuffer_begin() and framebuffer_commit(). Returns
+// COMPOSITOR_UNCHANGED when nothing was damaged.
+int compositor_draw(compositor_t *compositor, framebuffer_t *framebuffer);
+
+#endif //LEDPANEL_COMPOSITOR_H
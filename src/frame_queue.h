@@ -0,0 +1,51 @@
+// Single producer, single consumer queue used to hand frame buffers between
+// the drawing side and scan-out. Each index is only written by one side and
+// published with release/acquire ordering, so no lock is needed and it works
+// between the two cores as well as between a core and an interrupt.
+// Plain C without SDK dependencies so it also builds on a workstation.
+//
+
+#ifndef LEDPANEL_FRAME_QUEUE_H
+#define LEDPANEL_FRAME_QUEUE_H
+
+#include <stdint.h>
+
+// Must be a power of two
+#define FRAME_QUEUE_SIZE 4
+
+typedef struct {
+    uint32_t *slots[FRAME_QUEUE_SIZE];
+    uint32_t head; // written by the producer only
+    uint32_t tail; // written by the consumer only
+} frame_queue_t;
+
+static inline void frame_queue_init(frame_queue_t *queue) {
+    queue->head = 0;
+    queue->tail = 0;
+}
+
+static inline int frame_queue_push(frame_queue_t *queue, uint32_t *frame) {
+    uint32_t head = queue->head;
+    uint32_t tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+    if (head - tail == FRAME_QUEUE_SIZE) {
+        return 0;
+    }
+
+    queue->slots[head & (FRAME_QUEUE_SIZE - 1)] = frame;
+    __atomic_store_n(&queue->head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+static inline int frame_queue_pop(frame_queue_t *queue, uint32_t **frame) {
+    uint32_t tail = queue->tail;
+    uint32_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+        return 0;
+    }
+
+    *frame = queue->slots[tail & (FRAME_QUEUE_SIZE - 1)];
+    __atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+#endif //LEDPANEL_FRAME_QUEUE_H
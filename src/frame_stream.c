@@ -0,0 +1,186 @@
+#include <string.h>
+#include "frame_stream.h"
+
+#define RING_MASK (FRAME_STREAM_RING_SIZE - 1)
+// Fills are drawn as spans of this many pixels of a one color palette
+#define FILL_SPAN 64
+
+static const uint8_t fill_pixels[FILL_SPAN];
+
+void frame_stream_init(frame_stream_t *stream) {
+    memset(stream, 0, sizeof(*stream));
+}
+
+int frame_stream_push(frame_stream_t *stream, uint8_t byte) {
+    uint32_t head = stream->head;
+    uint32_t tail = __atomic_load_n(&stream->tail, __ATOMIC_ACQUIRE);
+
+    // Once a byte is lost the rest can't be parsed either
+    if (stream->overflow || head - tail == FRAME_STREAM_RING_SIZE) {
+        stream->overflow = 1;
+        return 0;
+    }
+
+    stream->ring[head & RING_MASK] = byte;
+    __atomic_store_n(&stream->head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+size_t frame_stream_free(const frame_stream_t *stream) {
+    uint32_t tail = __atomic_load_n(&stream->tail, __ATOMIC_ACQUIRE);
+    return FRAME_STREAM_RING_SIZE - (stream->head - tail);
+}
+
+uint8_t frame_stream_status(const frame_stream_t *stream) {
+    return (stream->overflow ? FRAME_STREAM_OVERFLOW : 0) | (stream->sync_lost ? FRAME_STREAM_SYNC_LOST : 0);
+}
+
+void frame_stream_request_reset(frame_stream_t *stream) {
+    stream->reset_head = stream->head;
+    stream->overflow = 0;
+    __atomic_store_n(&stream->resets, stream->resets + 1, __ATOMIC_RELEASE);
+}
+
+static void parser_reset(frame_stream_t *stream) {
+    stream->command = 0;
+    stream->header_length = 0;
+    stream->pixel_length = 0;
+    stream->sync_lost = 0;
+}
+
+static uint16_t read_u16(const uint8_t *src) {
+    return src[0] | src[1] << 8;
+}
+
+static int pixel_size(uint8_t command) {
+    return command == FRAME_STREAM_RECT_RGB565 ? 2 : 3;
+}
+
+static uint32_t pixel_color(const frame_stream_t *stream) {
+    const uint8_t *pixel = stream->pixel;
+    if (stream->command != FRAME_STREAM_RECT_RGB565) {
+        return (uint32_t) pixel[0] << 16 | pixel[1] << 8 | pixel[2];
+    }
+
+    // Widen by repeating the top bits, so full intensity stays 0xff
+    uint16_t value = read_u16(pixel);
+    uint8_t r = value >> 11 & 0x1f;
+    uint8_t g = value >> 5 & 0x3f;
+    uint8_t b = value & 0x1f;
+    return (uint32_t) (r << 3 | r >> 2) << 16 | (g << 2 | g >> 4) << 8 | (b << 3 | b >> 2);
+}
+
+// Clipped to the display first, a fill may ask for up to 65535x65535 pixels
+static void fill(framebuffer_t *framebuffer, const frame_stream_t *stream, uint32_t color) {
+    int x1 = stream->x1 < framebuffer->width ? stream->x1 : framebuffer->width;
+    int y1 = stream->y1 < framebuffer->height ? stream->y1 : framebuffer->height;
+    for (int y = stream->y0; y < y1; y++) {
+        for (int x = stream->x0; x < x1; x += FILL_SPAN) {
+            int count = x1 - x < FILL_SPAN ? x1 - x : FILL_SPAN;
+            framebuffer_drawspan(framebuffer, x, y, fill_pixels, count, &color);
+        }
+    }
+}
+
+// Returns 0 when byte can't be taken yet, the stream then stays as it was
+static int parse(frame_stream_t *stream, framebuffer_t *framebuffer, uint8_t byte) {
+    if (stream->sync_lost) {
+        return 1;
+    }
+
+    if (stream->command == 0) {
+        switch (byte) {
+            case FRAME_STREAM_RECT_RGB888:
+            case FRAME_STREAM_RECT_RGB565:
+            case FRAME_STREAM_FILL:
+                stream->command = byte;
+                stream->header_length = 0;
+                return 1;
+            case FRAME_STREAM_COMMIT:
+                if (framebuffer->buffer == NULL && framebuffer_begin(framebuffer) != FRAMEBUFFER_OK) {
+                    return 0;
+                }
+                if (framebuffer_commit(framebuffer) != FRAMEBUFFER_OK) {
+                    return 0;
+                }
+                stream->frames++;
+                return 1;
+            default:
+                stream->sync_lost = 1;
+                return 1;
+        }
+    }
+
+    if (stream->header_length < (int) sizeof(stream->header)) {
+        stream->header[stream->header_length++] = byte;
+        if (stream->header_length == (int) sizeof(stream->header)) {
+            stream->x0 = read_u16(stream->header);
+            stream->y0 = read_u16(stream->header + 2);
+            stream->x1 = stream->x0 + read_u16(stream->header + 4);
+            stream->y1 = stream->y0 + read_u16(stream->header + 6);
+            stream->x = stream->x0;
+            stream->y = stream->y0;
+            stream->pixel_length = 0;
+            if (stream->command != FRAME_STREAM_FILL && (stream->x1 == stream->x0 || stream->y1 == stream->y0)) {
+                stream->command = 0;
+            }
+        }
+        return 1;
+    }
+
+    // Pixels go straight into the back buffer, wait until there is one
+    if (framebuffer->buffer == NULL && framebuffer_begin(framebuffer) != FRAMEBUFFER_OK) {
+        return 0;
+    }
+
+    stream->pixel[stream->pixel_length++] = byte;
+    if (stream->pixel_length < pixel_size(stream->command)) {
+        return 1;
+    }
+    stream->pixel_length = 0;
+
+    uint32_t color = pixel_color(stream);
+    if (stream->command == FRAME_STREAM_FILL) {
+        fill(framebuffer, stream, color);
+        stream->command = 0;
+        return 1;
+    }
+
+    // Pixels outside the display are dropped by framebuffer_drawpixel()
+    framebuffer_drawpixel(framebuffer, stream->x, stream->y, color);
+    if (++stream->x == stream->x1) {
+        stream->x = stream->x0;
+        if (++stream->y == stream->y1) {
+            stream->command = 0;
+        }
+    }
+    return 1;
+}
+
+size_t frame_stream_process(frame_stream_t *stream, framebuffer_t *framebuffer, size_t max_bytes) {
+    size_t processed = 0;
+    while (processed < max_bytes) {
+        // Checked for every byte, the ones after a reset must see a fresh parser.
+        // A reset is published before the bytes that follow it, so reading
+        // head first guarantees it is seen before any of them are parsed.
+        uint32_t head = __atomic_load_n(&stream->head, __ATOMIC_ACQUIRE);
+        uint32_t resets = __atomic_load_n(&stream->resets, __ATOMIC_ACQUIRE);
+        if (resets != stream->resets_handled) {
+            stream->resets_handled = resets;
+            __atomic_store_n(&stream->tail, stream->reset_head, __ATOMIC_RELEASE);
+            parser_reset(stream);
+        }
+
+        uint32_t tail = stream->tail;
+        if (head == tail) {
+            break;
+        }
+
+        if (!parse(stream, framebuffer, stream->ring[tail & RING_MASK])) {
+            break;
+        }
+        __atomic_store_n(&stream->tail, tail + 1, __ATOMIC_RELEASE);
+        processed++;
+    }
+    return processed;
+}
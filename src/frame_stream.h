@@ -0,0 +1,79 @@
+// Raw frames pushed by a controller, drawn straight into the back buffer.
+// The transport (the I2C slave interrupt in main.c) pushes the bytes it
+// receives into a ring buffer, frame_stream_process() parses them from the
+// main loop. The ring is a single producer, single consumer queue like
+// frame_queue.h, so the interrupt never waits for drawing.
+// Plain C without SDK dependencies so it also builds on a workstation.
+//
+// The stream is a sequence of commands, all numbers little endian:
+//
+//   FRAME_STREAM_RECT_RGB888  x:u16 y:u16 w:u16 h:u16, w*h pixels r g b
+//   FRAME_STREAM_RECT_RGB565  x:u16 y:u16 w:u16 h:u16, w*h pixels rgb565:u16
+//   FRAME_STREAM_FILL         x:u16 y:u16 w:u16 h:u16 r g b
+//   FRAME_STREAM_COMMIT       show everything drawn since the last commit
+//
+// Rectangles are in display coordinates and rows go top to bottom, a full
+// frame is a single rectangle covering the display. Pixels outside the
+// display are skipped. Colors are drawn as is, gamma correction is up to
+// the controller. Commands may be split over as many transfers as needed.
+//
+// When the ring overflows or an unknown command shows up the stream stops
+// drawing and drops everything until the controller resets it, see
+// frame_stream_request_reset().
+//
+
+#ifndef LEDPANEL_FRAME_STREAM_H
+#define LEDPANEL_FRAME_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "framebuffer.h"
+
+// Must be a power of two
+#define FRAME_STREAM_RING_SIZE 4096
+
+#define FRAME_STREAM_RECT_RGB888 0x01
+#define FRAME_STREAM_RECT_RGB565 0x02
+#define FRAME_STREAM_FILL 0x03
+#define FRAME_STREAM_COMMIT 0x04
+
+// Status flags
+#define FRAME_STREAM_OVERFLOW 0x01
+#define FRAME_STREAM_SYNC_LOST 0x02
+
+typedef struct {
+    uint8_t ring[FRAME_STREAM_RING_SIZE];
+    uint32_t head; // written by the producer only
+    uint32_t tail; // written by the consumer only
+    uint32_t reset_head; // head when the producer last asked for a reset
+    uint32_t resets;     // written by the producer only
+    uint8_t overflow;    // written by the producer only
+
+    // Parser state, consumer only
+    uint8_t command;
+    uint8_t header[8];
+    int header_length;
+    uint8_t pixel[3];
+    int pixel_length;
+    int x0, y0, x1, y1;
+    int x, y;
+    uint32_t resets_handled;
+    uint8_t sync_lost;
+    uint32_t frames; // Commits done
+} frame_stream_t;
+
+void frame_stream_init(frame_stream_t *stream);
+
+// Producer side, returns 0 and drops the byte when the ring is full
+int frame_stream_push(frame_stream_t *stream, uint8_t byte);
+size_t frame_stream_free(const frame_stream_t *stream);
+uint8_t frame_stream_status(const frame_stream_t *stream);
+
+// Producer side, drop everything pushed so far and start parsing from the next byte
+void frame_stream_request_reset(frame_stream_t *stream);
+
+// Consumer side, parses at most max_bytes and returns how many it took.
+// Stops early while the framebuffer has no back buffer to draw on.
+size_t frame_stream_process(frame_stream_t *stream, framebuffer_t *framebuffer, size_t max_bytes);
+
+#endif //LEDPANEL_FRAME_STREAM_H
@@ -5,66 +5,506 @@
 
 #include <malloc.h>
 #include <framebuffer.h>
-#include <hardware/gpio.h>
 #include <string.h>
+#include "hub75_stream.h"
+#include "platform/platform.h"
 
-static void latch(framebuffer_t *framebuffer, int line, int delay);
+#if FRAMEBUFFER_SCAN_PIO
+#include <hardware/dma.h>
+#include <hardware/irq.h>
+#include <hardware/pio.h>
+#include "hub75.pio.h"
+
+static int scan_init(framebuffer_t *framebuffer);
+static void scan_dma_irq_handler(void);
+
+// The scan interrupt keeps running while flash is written, see
+// platform_flash_keep_irq(). It and what it calls live in RAM, the
+// frame_queue and DMA helpers are inline.
+#define SCAN_RAM_FUNC(f) __not_in_flash_func(f)
+
+// The DMA interrupt needs to find the framebuffer, there is only one panel
+static framebuffer_t *scan_framebuffer;
+#else
+static void latch(framebuffer_t *framebuffer, int line, int delay, int brightness);
+
+#define SCAN_RAM_FUNC(f) f
+
+#if FRAMEBUFFER_OE_PULSE
+// Lit part of the row on the panel, there is only one panel
+static platform_pulse_t oe_pulse;
+#endif
+#endif
+
+static const framebuffer_rect_t empty_rect = { 0, 0, 0, 0 };
+
+static int init_geometry(framebuffer_t *framebuffer);
+static void dither(framebuffer_t *framebuffer);
 
 int framebuffer_init(framebuffer_config_t config, framebuffer_t *framebuffer) {
-    uint pins_mask = 1 << config.pin_r0 |
-            1 << config.pin_g0 |
-            1 << config.pin_b0 |
-            1 << config.pin_r1 |
-            1 << config.pin_g1 |
-            1 << config.pin_b1 |
-            1 << config.pin_clk |
-            1 << config.pin_lat |
-            1 << config.pin_oe |
-            1 << config.pin_a |
-            1 << config.pin_b |
-            1 << config.pin_c;
-
-    gpio_init_mask(pins_mask);
-    gpio_set_dir_out_masked(pins_mask);
-    gpio_clr_mask(pins_mask);
-
-    gpio_set_pulls(framebuffer->config.pin_r0, 0, 1);
-    gpio_set_pulls(framebuffer->config.pin_g0, 0, 1);
-    gpio_set_pulls(framebuffer->config.pin_b0, 0, 1);
-    gpio_set_pulls(framebuffer->config.pin_r1, 0, 1);
-    gpio_set_pulls(framebuffer->config.pin_g1, 0, 1);
-    gpio_set_pulls(framebuffer->config.pin_b1, 0, 1);
-    gpio_set_pulls(framebuffer->config.pin_clk, 0, 1);
-    gpio_set_pulls(framebuffer->config.pin_lat, 0, 1);
-    gpio_set_pulls(framebuffer->config.pin_oe, 0, 1);
-
-    size_t buffer_size = config.w * config.h * (config.bpp / 8);
-    void *fb = malloc(buffer_size);
+    if (hub75_check_geometry(&config) != 0 || hub75_check_format(&config) != 0) {
+        return FRAMEBUFFER_ERROR;
+    }
+
+    int address_pins[5];
+    int address_count = hub75_address_pins(&config, address_pins);
+    uint32_t pins_mask = 1ul << config.pin_r0 |
+            1ul << config.pin_g0 |
+            1ul << config.pin_b0 |
+            1ul << config.pin_r1 |
+            1ul << config.pin_g1 |
+            1ul << config.pin_b1 |
+            1ul << config.pin_clk |
+            1ul << config.pin_lat |
+            1ul << config.pin_oe |
+            hub75_pin_mask(address_pins, address_count);
+
+    platform_gpio_init_outputs(pins_mask);
+
+    platform_gpio_pull_down(config.pin_r0);
+    platform_gpio_pull_down(config.pin_g0);
+    platform_gpio_pull_down(config.pin_b0);
+    platform_gpio_pull_down(config.pin_r1);
+    platform_gpio_pull_down(config.pin_g1);
+    platform_gpio_pull_down(config.pin_b1);
+    platform_gpio_pull_down(config.pin_clk);
+    platform_gpio_pull_down(config.pin_lat);
+    platform_gpio_pull_down(config.pin_oe);
+
+    int slice_count = hub75_build_schedule(&config, framebuffer->slices);
+    if (slice_count < 0) {
+        return FRAMEBUFFER_ERROR;
+    }
+    framebuffer->slice_count = slice_count;
+
+    int phases = config.dither ? FRAMEBUFFER_DITHER_PHASES : 1;
+    size_t phase_size = hub75_buffer_size(&config);
+    size_t buffer_size = phases * phase_size;
+    uint32_t *fb = malloc(FRAMEBUFFER_BUFFERS * buffer_size);
     if (fb == NULL) {
         return FRAMEBUFFER_ERROR;
     }
-    bzero(fb, buffer_size);
+    bzero(fb, FRAMEBUFFER_BUFFERS * buffer_size);
+
+    int data_pins[6];
+    int data_count = hub75_data_pins(&config, data_pins);
 
     framebuffer->buffer_size = buffer_size;
-    framebuffer->buffer = fb;
+    framebuffer->phase_size = phase_size;
+    framebuffer->phases = phases;
+    framebuffer->plane_size = hub75_plane_size(&config);
+    framebuffer->column_bytes = hub75_column_bytes(&config);
+    framebuffer->lowest_plane = hub75_lowest_plane(&config);
+    for (int i = 0; i < FRAMEBUFFER_BUFFERS; i++) {
+        framebuffer->buffers[i] = fb + i * (buffer_size / sizeof(uint32_t));
+    }
+    frame_queue_init(&framebuffer->committed);
+    frame_queue_init(&framebuffer->released);
+    framebuffer->front = framebuffer->buffers[0];
+    framebuffer->latest = framebuffer->buffers[0];
+    framebuffer->buffer = framebuffer->buffers[1];
+    for (int i = 2; i < FRAMEBUFFER_BUFFERS; i++) {
+        frame_queue_push(&framebuffer->released, framebuffer->buffers[i]);
+    }
+    framebuffer->refresh_count = 0;
+    framebuffer->dirty = empty_rect;
+    for (int i = 0; i < FRAMEBUFFER_DIRTY_HISTORY; i++) {
+        framebuffer->dirty_history[i] = empty_rect;
+    }
+    framebuffer->commits = 0;
+    for (int i = 0; i < FRAMEBUFFER_BUFFERS; i++) {
+        framebuffer->buffer_commit[i] = 0;
+    }
+    framebuffer->pixels_drawn = 0;
     framebuffer->config = config;
+    framebuffer->data_base = hub75_pin_base(data_pins, data_count);
     framebuffer->pwm = 0;
+    if (config.led_ua == 0) {
+        framebuffer->config.led_ua = FRAMEBUFFER_LED_UA;
+    }
+    framebuffer->brightness = FRAMEBUFFER_BRIGHTNESS_MAX;
+    framebuffer->scan_brightness = FRAMEBUFFER_BRIGHTNESS_MAX;
+    framebuffer->current_limit_ma = config.current_limit_ma;
+    framebuffer->current_ma = 0;
+    for (int i = 0; i < FRAMEBUFFER_PLANES; i++) {
+        framebuffer->plane_bits[i] = 0;
+        framebuffer->lit_bits[i] = 0;
+    }
+    if (init_geometry(framebuffer) != FRAMEBUFFER_OK) {
+        return FRAMEBUFFER_ERROR;
+    }
+    framebuffer->colors = NULL;
+    if (config.dither) {
+        framebuffer->colors = calloc(framebuffer->width * framebuffer->height, sizeof(uint32_t));
+        if (framebuffer->colors == NULL) {
+            return FRAMEBUFFER_ERROR;
+        }
+    }
+
+#if FRAMEBUFFER_SCAN_PIO
+    if (scan_init(framebuffer) != FRAMEBUFFER_OK) {
+        return FRAMEBUFFER_ERROR;
+    }
+#else
+    framebuffer->cycles_per_us = platform_cycles_per_us();
+    framebuffer->cycle_brightness = FRAMEBUFFER_BRIGHTNESS_MAX;
+    framebuffer->phase = 0;
+#if FRAMEBUFFER_OE_PULSE
+    for (int i = 0; i < framebuffer->slice_count; i++) {
+        if (framebuffer->slices[i].lit_us * framebuffer->cycles_per_us > PLATFORM_PULSE_MAX) {
+            return FRAMEBUFFER_ERROR;
+        }
+    }
+    platform_pulse_init(&oe_pulse, config.pin_oe);
+#endif
+#endif
+    return FRAMEBUFFER_OK;
+}
+
+// Plane offset of a panel row, rows in the lower half share words with the upper half
+static uint32_t row_offset(framebuffer_t *framebuffer, int row) {
+    uint32_t offset = (row % framebuffer->rows) * framebuffer->columns * framebuffer->column_bytes;
+    return row >= framebuffer->rows ? offset | FRAMEBUFFER_MAP_LOWER : offset;
+}
+
+// Work out the geometry once so drawing is two table lookups and
+// scan-out never has to deal with chains, scan ratios or rotation
+static int init_geometry(framebuffer_t *framebuffer) {
+    framebuffer_config_t *config = &framebuffer->config;
+    hub75_display_size(config, &framebuffer->width, &framebuffer->height);
+    framebuffer->rows = hub75_scan_rows(config);
+    framebuffer->columns = hub75_chain_columns(config);
+
+    framebuffer->map_x = malloc((framebuffer->width + framebuffer->height) * sizeof(uint32_t));
+    if (framebuffer->map_x == NULL) {
+        return FRAMEBUFFER_ERROR;
+    }
+    framebuffer->map_y = framebuffer->map_x + framebuffer->width;
+
+    // Rotation puts one display axis on the chain and the other on the panel rows
+    int rotated = config->orientation == FRAMEBUFFER_ROTATE_90 || config->orientation == FRAMEBUFFER_ROTATE_270;
+    int column, row;
+    for (int x = 0; x < framebuffer->width; x++) {
+        hub75_map_pixel(config, x, 0, &column, &row);
+        framebuffer->map_x[x] = rotated ? row_offset(framebuffer, row) : (uint32_t) (column * framebuffer->column_bytes);
+    }
+    for (int y = 0; y < framebuffer->height; y++) {
+        hub75_map_pixel(config, 0, y, &column, &row);
+        framebuffer->map_y[y] = rotated ? (uint32_t) (column * framebuffer->column_bytes) : row_offset(framebuffer, row);
+    }
+
+    // Data pin of every channel relative to data_base, per half of the panel
+    const int pins[2][3] = {
+            { config->pin_r0, config->pin_g0, config->pin_b0 },
+            { config->pin_r1, config->pin_g1, config->pin_b1 }
+    };
+    for (int half = 0; half < 2; half++) {
+        for (int c = 0; c < 3; c++) {
+            framebuffer->channel_shift[half][c] = pins[half][c] - framebuffer->data_base;
+            for (int value = 0; value < 16; value++) {
+                uint32_t spread = 0;
+                for (int bit = 0; bit < 4; bit++) {
+                    spread |= (uint32_t) (value >> bit & 0x1) << (bit * 8);
+                }
+                framebuffer->plane_spread[half][c][value] = spread << framebuffer->channel_shift[half][c];
+            }
+        }
+    }
+
+#if !FRAMEBUFFER_SCAN_PIO
+    // GPIO state of the address lines for every row
+    int address_pins[5];
+    int address_count = hub75_address_pins(config, address_pins);
+    framebuffer->address_mask = hub75_pin_mask(address_pins, address_count);
+    for (int line = 0; line < framebuffer->rows; line++) {
+        framebuffer->row_select[line] = 0;
+        for (int i = 0; i < address_count; i++) {
+            framebuffer->row_select[line] |= (uint32_t) (line >> i & 0x1) << address_pins[i];
+        }
+    }
+#endif
     return FRAMEBUFFER_OK;
 }
 
 int framebuffer_clear(framebuffer_t *framebuffer) {
+    if (framebuffer->buffer == NULL) {
+        return FRAMEBUFFER_ERROR;
+    }
     bzero(framebuffer->buffer, framebuffer->buffer_size);
+    if (framebuffer->colors != NULL) {
+        bzero(framebuffer->colors, framebuffer->width * framebuffer->height * sizeof(uint32_t));
+    }
+    framebuffer->dirty = (framebuffer_rect_t) { 0, 0, framebuffer->width, framebuffer->height };
+
+    return FRAMEBUFFER_OK;
+}
+
+static void rect_union(framebuffer_rect_t *rect, const framebuffer_rect_t *other) {
+    if (other->x1 <= other->x0 || other->y1 <= other->y0) {
+        return;
+    }
+    if (rect->x1 <= rect->x0 || rect->y1 <= rect->y0) {
+        *rect = *other;
+        return;
+    }
+    if (other->x0 < rect->x0) rect->x0 = other->x0;
+    if (other->y0 < rect->y0) rect->y0 = other->y0;
+    if (other->x1 > rect->x1) rect->x1 = other->x1;
+    if (other->y1 > rect->y1) rect->y1 = other->y1;
+}
+
+static int buffer_index(framebuffer_t *framebuffer, uint32_t *buffer) {
+    return (buffer - framebuffer->buffers[0]) / (framebuffer->buffer_size / sizeof(uint32_t));
+}
+
+// Columns and rows of the panel chain rect covers, opposite corners of the
+// rect. The top and bottom half of the panel share words, so rows are folded
+// onto the first half.
+static void chain_rect(framebuffer_t *framebuffer, const framebuffer_rect_t *rect, int *column0, int *column1,
+                       int *row0, int *row1) {
+    hub75_map_pixel(&framebuffer->config, rect->x0, rect->y0, column0, row0);
+    hub75_map_pixel(&framebuffer->config, rect->x1 - 1, rect->y1 - 1, column1, row1);
+    if (*column1 < *column0) {
+        int column = *column0;
+        *column0 = *column1;
+        *column1 = column;
+    }
+    if (*row1 < *row0) {
+        int row = *row0;
+        *row0 = *row1;
+        *row1 = row;
+    }
+    (*column1)++;
+    (*row1)++;
+
+    int rows = framebuffer->rows;
+    if (*row0 >= rows) {
+        *row0 -= rows;
+        *row1 -= rows;
+    } else if (*row1 > rows) {
+        *row0 = 0;
+        *row1 = rows;
+    }
+}
+
+// Copy the columns of rect in every bit-plane of every dither phase
+static void copy_rect(framebuffer_t *framebuffer, uint32_t *dst, const uint32_t *src, const framebuffer_rect_t *rect) {
+    uint8_t *dst_bytes = (uint8_t *) dst;
+    const uint8_t *src_bytes = (const uint8_t *) src;
+    int column0, column1, row0, row1;
+    chain_rect(framebuffer, rect, &column0, &column1, &row0, &row1);
+
+    int w = framebuffer->columns;
+    int column_bytes = framebuffer->column_bytes;
+    int planes = (FRAMEBUFFER_PLANES - framebuffer->lowest_plane) * framebuffer->phases;
+    size_t length = (column1 - column0) * column_bytes;
+    for (int plane = 0; plane < planes; plane++) {
+        for (int row = row0; row < row1; row++) {
+            size_t offset = plane * framebuffer->plane_size + (row * w + column0) * column_bytes;
+            memcpy(dst_bytes + offset, src_bytes + offset, length);
+        }
+    }
+}
+
+int framebuffer_begin(framebuffer_t *framebuffer) {
+    if (framebuffer->buffer != NULL) {
+        return FRAMEBUFFER_OK;
+    }
+
+    if (!frame_queue_pop(&framebuffer->released, &framebuffer->buffer)) {
+        return FRAMEBUFFER_BUSY;
+    }
+
+    // A released buffer holds an older frame, producers expect to draw on
+    // top of the latest one. Only the areas drawn since have to be copied.
+    int index = buffer_index(framebuffer, framebuffer->buffer);
+    uint32_t behind = framebuffer->commits - framebuffer->buffer_commit[index];
+    if (behind > FRAMEBUFFER_DIRTY_HISTORY) {
+        memcpy(framebuffer->buffer, framebuffer->latest, framebuffer->buffer_size);
+    } else {
+        framebuffer_rect_t stale = empty_rect;
+        for (uint32_t commit = framebuffer->commits - behind + 1; commit != framebuffer->commits + 1; commit++) {
+            rect_union(&stale, &framebuffer->dirty_history[commit % FRAMEBUFFER_DIRTY_HISTORY]);
+        }
+        if (stale.x1 > stale.x0) {
+            copy_rect(framebuffer, framebuffer->buffer, framebuffer->latest, &stale);
+        }
+    }
+    framebuffer->buffer_commit[index] = framebuffer->commits;
+    framebuffer->dirty = empty_rect;
+
+    return FRAMEBUFFER_OK;
+}
+
+static inline uint32_t popcount(uint32_t v) {
+    v = v - (v >> 1 & 0x55555555);
+    v = (v & 0x33333333) + (v >> 2 & 0x33333333);
+    v = (v + (v >> 4)) & 0x0f0f0f0f;
+    return v * 0x01010101 >> 24;
+}
+
+static uint32_t count_bits(const uint8_t *bytes, size_t length) {
+    uint32_t bits = 0;
+    for (; length >= sizeof(uint32_t); length -= sizeof(uint32_t), bytes += sizeof(uint32_t)) {
+        uint32_t word;
+        memcpy(&word, bytes, sizeof(word));
+        bits += popcount(word);
+    }
+    for (; length > 0; length--) {
+        bits += popcount(*bytes++);
+    }
+    return bits;
+}
+
+// Adds the bits set in the columns of rect, or takes them away, in every
+// plane over all phases
+static void count_rect_bits(framebuffer_t *framebuffer, const uint32_t *buffer, const framebuffer_rect_t *rect,
+                            int subtract) {
+    const uint8_t *bytes = (const uint8_t *) buffer;
+    int column0, column1, row0, row1;
+    chain_rect(framebuffer, rect, &column0, &column1, &row0, &row1);
+
+    int w = framebuffer->columns;
+    int column_bytes = framebuffer->column_bytes;
+    size_t length = (column1 - column0) * column_bytes;
+    for (int phase = 0; phase < framebuffer->phases; phase++) {
+        for (int plane = framebuffer->lowest_plane; plane < FRAMEBUFFER_PLANES; plane++) {
+            uint32_t bits = 0;
+            for (int row = row0; row < row1; row++) {
+                bits += count_bits(bytes + (row * w + column0) * column_bytes, length);
+            }
+            framebuffer->lit_bits[plane] += subtract ? -bits : bits;
+            bytes += framebuffer->plane_size;
+        }
+    }
+}
+
+// Columns only ever hold data pin bits, every bit set is a lit LED. Outside
+// the area drawn the buffer holds the latest frame, see framebuffer_begin(),
+// so only that area is counted again in both. Large areas are cheaper to
+// count once over the whole buffer.
+static void count_plane_bits(framebuffer_t *framebuffer) {
+    const framebuffer_rect_t *dirty = &framebuffer->dirty;
+    if (dirty->x1 <= dirty->x0 || dirty->y1 <= dirty->y0) {
+        return;
+    }
+
+    int column0, column1, row0, row1;
+    chain_rect(framebuffer, dirty, &column0, &column1, &row0, &row1);
+    if (2 * (column1 - column0) * (row1 - row0) < framebuffer->columns * framebuffer->rows) {
+        count_rect_bits(framebuffer, framebuffer->latest, dirty, 1);
+        count_rect_bits(framebuffer, framebuffer->buffer, dirty, 0);
+    } else {
+        framebuffer_rect_t all = { 0, 0, framebuffer->width, framebuffer->height };
+        for (int plane = 0; plane < FRAMEBUFFER_PLANES; plane++) {
+            framebuffer->lit_bits[plane] = 0;
+        }
+        count_rect_bits(framebuffer, framebuffer->buffer, &all, 0);
+    }
+    for (int plane = 0; plane < FRAMEBUFFER_PLANES; plane++) {
+        framebuffer->plane_bits[plane] = framebuffer->lit_bits[plane] / framebuffer->phases;
+    }
+}
+
+// Brightness to show the latest frame at, as bright as asked for unless
+// that takes more current than the limit
+static void limit_power(framebuffer_t *framebuffer) {
+    const framebuffer_config_t *config = &framebuffer->config;
+    // Read once, they may be set from an interrupt
+    int brightness = framebuffer->brightness;
+    uint32_t limit_ma = framebuffer->current_limit_ma;
+    uint32_t current_ma = hub75_estimate_current(config, framebuffer->plane_bits, brightness, config->led_ua);
+    if (limit_ma != 0 && current_ma > limit_ma) {
+        brightness = brightness * limit_ma / current_ma;
+        current_ma = hub75_estimate_current(config, framebuffer->plane_bits, brightness, config->led_ua);
+    }
+    framebuffer->current_ma = current_ma;
+    framebuffer->scan_brightness = brightness;
+}
+
+void framebuffer_set_brightness(framebuffer_t *framebuffer, int brightness) {
+    if (brightness < 0) brightness = 0;
+    if (brightness > FRAMEBUFFER_BRIGHTNESS_MAX) brightness = FRAMEBUFFER_BRIGHTNESS_MAX;
+    framebuffer->brightness = brightness;
+}
+
+void framebuffer_set_current_limit(framebuffer_t *framebuffer, uint32_t limit_ma) {
+    framebuffer->current_limit_ma = limit_ma;
+}
+
+int framebuffer_commit(framebuffer_t *framebuffer) {
+    if (framebuffer->buffer == NULL) {
+        return FRAMEBUFFER_ERROR;
+    }
+    if (framebuffer->colors != NULL) {
+        dither(framebuffer);
+    }
+
+    if (!frame_queue_push(&framebuffer->committed, framebuffer->buffer)) {
+        return FRAMEBUFFER_BUSY;
+    }
+
+    // Scan-out may show the first BCM cycle of the frame at the brightness
+    // of the one before. Only this side takes released buffers, latest
+    // still holds the frame before.
+    count_plane_bits(framebuffer);
+    limit_power(framebuffer);
+    framebuffer->commits++;
+    framebuffer->dirty_history[framebuffer->commits % FRAMEBUFFER_DIRTY_HISTORY] = framebuffer->dirty;
+    framebuffer->buffer_commit[buffer_index(framebuffer, framebuffer->buffer)] = framebuffer->commits;
+    framebuffer->latest = framebuffer->buffer;
+    framebuffer->buffer = NULL;
 
     return FRAMEBUFFER_OK;
 }
 
+// Scan-out side of the page flip, take the newest committed buffer
+// and release the ones that were overtaken before reaching the screen.
+static uint32_t *SCAN_RAM_FUNC(take_committed)(framebuffer_t *framebuffer) {
+    uint32_t *newest = NULL;
+    uint32_t *next;
+    while (frame_queue_pop(&framebuffer->committed, &next)) {
+        if (newest != NULL) {
+            frame_queue_push(&framebuffer->released, newest);
+        }
+        newest = next;
+    }
+    return newest;
+}
+
+#if FRAMEBUFFER_SCAN_PIO
+int framebuffer_sync(framebuffer_t *framebuffer) {
+    // Refresh runs on the PIO state machines and DMA, only brightness
+    // changes are handed over from here. The row DMA may still be reading
+    // the previous stream until the cycle after the switch has started.
+    uint8_t brightness = framebuffer->scan_brightness;
+    if (brightness == framebuffer->stream_brightness || framebuffer->refresh_count - framebuffer->stream_refresh < 2) {
+        return FRAMEBUFFER_OK;
+    }
+    uint32_t *stream = framebuffer->row_streams[framebuffer->row_stream == framebuffer->row_streams[0]];
+    hub75_build_row_stream(&framebuffer->config, framebuffer->slices, framebuffer->slice_count,
+                           platform_cycles_per_us(), brightness, stream);
+    framebuffer->row_stream = stream;
+    framebuffer->stream_brightness = brightness;
+    framebuffer->stream_refresh = framebuffer->refresh_count;
+    return FRAMEBUFFER_OK;
+}
+#else
 // http://www.batsocks.co.uk/readme/art_bcm_5.htm
 int framebuffer_sync(framebuffer_t *framebuffer) {
-    if (framebuffer->pwm > 7) {
+    if (framebuffer->pwm >= framebuffer->slice_count) {
         framebuffer->pwm = 0;
+        framebuffer->refresh_count++;
+        framebuffer->cycle_brightness = framebuffer->scan_brightness;
+        framebuffer->phase = framebuffer->refresh_count & (framebuffer->phases - 1);
+
+        uint32_t *next = take_committed(framebuffer);
+        if (next != NULL) {
+            frame_queue_push(&framebuffer->released, framebuffer->front);
+            framebuffer->front = next;
+        }
     }
 
-    uint8_t *ptr = framebuffer->buffer;
     uint32_t clr_mask = 1ul << framebuffer->config.pin_r0 |
             1ul << framebuffer->config.pin_g0 |
             1ul << framebuffer->config.pin_b0 |
@@ -72,88 +512,453 @@ int framebuffer_sync(framebuffer_t *framebuffer) {
             1ul << framebuffer->config.pin_g1 |
             1ul << framebuffer->config.pin_b1;
 
-    for (int y = 0; y < framebuffer->config.h / 2 ; y++) {
-        int y_idx = y * framebuffer->config.w * 4;
-        int y_b_idx = y_idx + (framebuffer->config.w * 4 * 8);
-        for (int x = 0; x < framebuffer->config.w; x++) {
-            int x_idx = x * 4;
-
-
-            int t_r = ptr[y_idx + x_idx + 1] >> framebuffer->pwm & 0x1;
-            int t_g = ptr[y_idx + x_idx + 2] >> framebuffer->pwm & 0x1;
-            int t_b = ptr[y_idx + x_idx + 3] >> framebuffer->pwm & 0x1;
-
-            int b_r = ptr[y_b_idx + x_idx + 1] >> framebuffer->pwm & 0x1;
-            int b_g = ptr[y_b_idx + x_idx + 2] >> framebuffer->pwm & 0x1;
-            int b_b = ptr[y_b_idx + x_idx + 3] >> framebuffer->pwm & 0x1;
-
-            uint32_t set_mask = t_r << framebuffer->config.pin_r0 |
-                                t_g << framebuffer->config.pin_g0 |
-                                t_b << framebuffer->config.pin_b0 |
-                                b_r << framebuffer->config.pin_r1 |
-                                b_g << framebuffer->config.pin_g1 |
-                                b_b << framebuffer->config.pin_b1;
-
-            gpio_clr_mask(clr_mask);
-            gpio_set_mask(set_mask);
+    int rows = framebuffer->rows;
+    int columns = framebuffer->columns;
+    int data_base = framebuffer->data_base;
+    int packed = framebuffer->column_bytes == 1;
+    const framebuffer_slice_t *slice = &framebuffer->slices[framebuffer->pwm];
+    const uint8_t *ptr = (const uint8_t *) framebuffer->front + framebuffer->phase * framebuffer->phase_size +
+            (slice->plane - framebuffer->lowest_plane) * framebuffer->plane_size;
+    for (int y = 0; y < rows; y++) {
+        for (int x = 0; x < columns; x++) {
+            uint32_t bits = packed ? *ptr : *(const uint32_t *) ptr;
+            ptr += framebuffer->column_bytes;
+            platform_gpio_clr_mask(clr_mask);
+            platform_gpio_set_mask(bits << data_base);
             asm volatile("nop \n nop");
 
             // Shift the register into the shifter
-            gpio_put(framebuffer->config.pin_clk, 1);
+            platform_gpio_put(framebuffer->config.pin_clk, 1);
             asm volatile("nop \n nop \n nop");
 
-            gpio_put(framebuffer->config.pin_clk, 0);
+            platform_gpio_put(framebuffer->config.pin_clk, 0);
         }
 
         // Trigger the latch
-        latch(framebuffer, y, 1 << (framebuffer->pwm + 1));
+        latch(framebuffer, y, slice->lit_us, framebuffer->cycle_brightness);
     }
 
-    // Increase pwm cycle (colordepth steps)
+    // Next slice of the BCM cycle
     framebuffer->pwm++;
 
+#if FRAMEBUFFER_OE_PULSE
+    // The last row of a slice is still lit, the caller gets that time
+    // unless the cycle ends here and has to be complete on return
+    if (framebuffer->pwm >= framebuffer->slice_count) {
+        platform_pulse_wait(&oe_pulse);
+    }
+#endif
+
     return FRAMEBUFFER_OK;
 }
+#endif
+
+static void mark_dirty(framebuffer_t *framebuffer, int x0, int y0, int x1, int y1) {
+    framebuffer_rect_t *dirty = &framebuffer->dirty;
+    if (dirty->x1 <= dirty->x0) {
+        *dirty = (framebuffer_rect_t) { x0, y0, x1, y1 };
+    } else {
+        if (x0 < dirty->x0) dirty->x0 = x0;
+        if (y0 < dirty->y0) dirty->y0 = y0;
+        if (x1 > dirty->x1) dirty->x1 = x1;
+        if (y1 > dirty->y1) dirty->y1 = y1;
+    }
+}
+
+// Slice the pixel at map into the bit-planes starting at buffer, bit n of
+// every channel goes into plane n. Planes below the depth shown are not stored.
+static inline void draw_color(framebuffer_t *framebuffer, uint8_t *buffer, uint32_t map, uint32_t color) {
+    // The top half of the panel is driven by R0/G0/B0, the bottom half by R1/G1/B1
+    const int *shift = framebuffer->channel_shift[map & FRAMEBUFFER_MAP_LOWER ? 1 : 0];
+    int pin_r = shift[0];
+    int pin_g = shift[1];
+    int pin_b = shift[2];
+    uint32_t mask = 1ul << pin_r | 1ul << pin_g | 1ul << pin_b;
+
+    uint8_t r = color >> 16 & 0xff;
+    uint8_t g = color >> 8 & 0xff;
+    uint8_t b = color & 0xff;
+
+    size_t plane_size = framebuffer->plane_size;
+    uint8_t *ptr = buffer + (map & ~FRAMEBUFFER_MAP_LOWER);
+    for (int plane = framebuffer->lowest_plane; plane < FRAMEBUFFER_PLANES; plane++) {
+        uint32_t bits = (uint32_t)(r >> plane & 0x1) << pin_r |
+                        (uint32_t)(g >> plane & 0x1) << pin_g |
+                        (uint32_t)(b >> plane & 0x1) << pin_b;
+        if (framebuffer->column_bytes == 1) {
+            *ptr = (*ptr & ~mask) | bits;
+        } else {
+            uint32_t *word = (uint32_t *) ptr;
+            *word = (*word & ~mask) | bits;
+        }
+        ptr += plane_size;
+    }
+}
+
+// Packed columns, the bits of all planes come out of the spread tables
+// as two words, planes 0-3 and 4-7 one byte each
+static inline void draw_packed(framebuffer_t *framebuffer, uint8_t *buffer, uint32_t map, uint32_t color) {
+    int half = map & FRAMEBUFFER_MAP_LOWER ? 1 : 0;
+    const uint32_t (*spread)[16] = framebuffer->plane_spread[half];
+    uint8_t mask = spread[0][1] | spread[1][1] | spread[2][1];
+
+    uint8_t r = color >> 16 & 0xff;
+    uint8_t g = color >> 8 & 0xff;
+    uint8_t b = color & 0xff;
+    uint32_t low = spread[0][r & 0xf] | spread[1][g & 0xf] | spread[2][b & 0xf];
+    uint32_t high = spread[0][r >> 4] | spread[1][g >> 4] | spread[2][b >> 4];
+
+    size_t plane_size = framebuffer->plane_size;
+    uint8_t *ptr = buffer + (map & ~FRAMEBUFFER_MAP_LOWER);
+    int plane = framebuffer->lowest_plane;
+    for (; plane < 4; plane++) {
+        *ptr = (*ptr & ~mask) | (uint8_t) (low >> (plane * 8));
+        ptr += plane_size;
+    }
+    for (; plane < FRAMEBUFFER_PLANES; plane++) {
+        *ptr = (*ptr & ~mask) | (uint8_t) (high >> ((plane - 4) * 8));
+        ptr += plane_size;
+    }
+}
 
 int framebuffer_drawpixel(framebuffer_t *framebuffer, int x, int y, uint32_t color) {
-    if (x < 0 || x >= framebuffer->config.w) {
+    if (x < 0 || x >= framebuffer->width) {
+        return FRAMEBUFFER_ERROR;
+    }
+
+    if (y < 0 || y >= framebuffer->height) {
+        return FRAMEBUFFER_ERROR;
+    }
+
+    if (framebuffer->buffer == NULL) {
+        return FRAMEBUFFER_ERROR;
+    }
+
+    mark_dirty(framebuffer, x, y, x + 1, y + 1);
+    framebuffer->pixels_drawn++;
+    if (framebuffer->colors != NULL) {
+        framebuffer->colors[y * framebuffer->width + x] = color;
+        return FRAMEBUFFER_OK;
+    }
+    draw_color(framebuffer, (uint8_t *) framebuffer->buffer, framebuffer->map_x[x] + framebuffer->map_y[y], color);
+
+    return FRAMEBUFFER_OK;
+}
+
+int framebuffer_drawspan(framebuffer_t *framebuffer, int x, int y, const uint8_t *pixels, int count,
+                         const uint32_t *palette) {
+    if (x < 0) {
+        pixels -= x;
+        count += x;
+        x = 0;
+    }
+    if (count > framebuffer->width - x) {
+        count = framebuffer->width - x;
+    }
+    if (count <= 0 || y < 0 || y >= framebuffer->height || framebuffer->buffer == NULL) {
+        return FRAMEBUFFER_ERROR;
+    }
+
+    mark_dirty(framebuffer, x, y, x + count, y + 1);
+    framebuffer->pixels_drawn += count;
+
+    if (framebuffer->colors != NULL) {
+        uint32_t *colors = framebuffer->colors + y * framebuffer->width + x;
+        for (int i = 0; i < count; i++) {
+            colors[i] = palette[pixels[i]];
+        }
+        return FRAMEBUFFER_OK;
+    }
+
+    const uint32_t *map_x = framebuffer->map_x + x;
+    uint32_t map_y = framebuffer->map_y[y];
+    uint8_t *buffer = (uint8_t *) framebuffer->buffer;
+    if (framebuffer->column_bytes != 1) {
+        for (int i = 0; i < count; i++) {
+            draw_color(framebuffer, buffer, map_x[i] + map_y, palette[pixels[i]]);
+        }
+        return FRAMEBUFFER_OK;
+    }
+    for (int i = 0; i < count; i++) {
+        draw_packed(framebuffer, buffer, map_x[i] + map_y, palette[pixels[i]]);
+    }
+
+    return FRAMEBUFFER_OK;
+}
+
+int framebuffer_drawrow(framebuffer_t *framebuffer, int x, int y, const uint32_t *colors, int count) {
+    if (x < 0) {
+        colors -= x;
+        count += x;
+        x = 0;
+    }
+    if (count > framebuffer->width - x) {
+        count = framebuffer->width - x;
+    }
+    if (count <= 0 || y < 0 || y >= framebuffer->height || framebuffer->buffer == NULL) {
         return FRAMEBUFFER_ERROR;
     }
 
-    if (y < 0 || y >= framebuffer->config.h) {
+    mark_dirty(framebuffer, x, y, x + count, y + 1);
+    framebuffer->pixels_drawn += count;
+
+    if (framebuffer->colors != NULL) {
+        memcpy(framebuffer->colors + y * framebuffer->width + x, colors, count * sizeof(uint32_t));
+        return FRAMEBUFFER_OK;
+    }
+
+    const uint32_t *map_x = framebuffer->map_x + x;
+    uint32_t map_y = framebuffer->map_y[y];
+    uint8_t *buffer = (uint8_t *) framebuffer->buffer;
+    if (framebuffer->column_bytes != 1) {
+        for (int i = 0; i < count; i++) {
+            draw_color(framebuffer, buffer, map_x[i] + map_y, colors[i]);
+        }
+        return FRAMEBUFFER_OK;
+    }
+    for (int i = 0; i < count; i++) {
+        draw_packed(framebuffer, buffer, map_x[i] + map_y, colors[i]);
+    }
+
+    return FRAMEBUFFER_OK;
+}
+
+// Order the phases go through the fraction thresholds in, and the phase
+// every pixel of a 2x2 block starts at, so neighbours take turns
+static const uint8_t dither_order[FRAMEBUFFER_DITHER_PHASES] = { 0, 2, 1, 3 };
+static const uint8_t dither_offset[4] = { 0, 2, 3, 1 };
+
+// Color shown in the phase where the fraction has to be above threshold
+// for a channel to go up by one. Channels at 0xff stay there.
+static inline uint32_t dither_color(uint32_t color, uint32_t threshold) {
+    uint32_t fraction = color >> 24;
+    uint32_t up = (uint32_t) ((fraction >> 4 & 0x3) > threshold) << 16 |
+                  (uint32_t) ((fraction >> 2 & 0x3) > threshold) << 8 |
+                  (uint32_t) ((fraction & 0x3) > threshold);
+    uint32_t full = ((color & 0x7f7f7f) + 0x010101) & color & 0x808080;
+    return (color & 0xffffff) + (up & ~(full >> 7));
+}
+
+// Every phase of the area drawn since framebuffer_begin(), from colors
+static void dither(framebuffer_t *framebuffer) {
+    const framebuffer_rect_t *dirty = &framebuffer->dirty;
+    uint8_t *buffer = (uint8_t *) framebuffer->buffer;
+    int packed = framebuffer->column_bytes == 1;
+    for (int y = dirty->y0; y < dirty->y1; y++) {
+        const uint32_t *colors = framebuffer->colors + y * framebuffer->width;
+        uint32_t map_y = framebuffer->map_y[y];
+        for (int x = dirty->x0; x < dirty->x1; x++) {
+            uint32_t map = framebuffer->map_x[x] + map_y;
+            int offset = dither_offset[(y & 1) << 1 | (x & 1)];
+            uint8_t *phase = buffer;
+            for (int i = 0; i < FRAMEBUFFER_DITHER_PHASES; i++) {
+                uint32_t color = dither_color(colors[x], (dither_order[i] + offset) % FRAMEBUFFER_DITHER_PHASES);
+                if (packed) {
+                    draw_packed(framebuffer, phase, map, color);
+                } else {
+                    draw_color(framebuffer, phase, map, color);
+                }
+                phase += framebuffer->phase_size;
+            }
+        }
+    }
+}
+
+#if FRAMEBUFFER_SCAN_PIO
+// Set up a channel that streams words into a PIO FIFO and a control channel
+// that restarts it from *source every time it completes. With source_increment
+// the control channel moves on to the next pointer in source every time.
+static void scan_dma_init(int channel, int control, volatile void *fifo, uint dreq,
+                          uint32_t **source, bool source_increment, size_t count) {
+    dma_channel_config c = dma_channel_get_default_config(channel);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, dreq);
+    channel_config_set_chain_to(&c, control);
+    dma_channel_configure(channel, &c, fifo, NULL, count, false);
+
+    c = dma_channel_get_default_config(control);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, source_increment);
+    channel_config_set_write_increment(&c, false);
+    dma_channel_configure(control, &c, &dma_hw->ch[channel].al3_read_addr_trig, source, 1, false);
+}
+
+// Point the data channel at the planes of buffer in slice order
+static void SCAN_RAM_FUNC(scan_set_buffer)(framebuffer_t *framebuffer, uint32_t *buffer) {
+    size_t plane_words = framebuffer->plane_size / sizeof(uint32_t);
+    for (int i = 0; i < framebuffer->slice_count; i++) {
+        int plane = framebuffer->slices[i].plane - framebuffer->lowest_plane;
+        framebuffer->scan_slices[i] = buffer + plane * plane_words;
+    }
+}
+
+static int scan_init(framebuffer_t *framebuffer) {
+    framebuffer_config_t *config = &framebuffer->config;
+
+    // OE and LAT are driven as one side-set group by the row program
+    if (config->pin_lat != config->pin_oe + 1) {
         return FRAMEBUFFER_ERROR;
     }
 
-    uint8_t *ptr = framebuffer->buffer;
-    int y_idx = y * framebuffer->config.w * 4;
-    int x_idx = x * 4;
+    int data_pins[6];
+    int data_count = hub75_data_pins(config, data_pins);
+    int address_pins[5];
+    int address_count = hub75_address_pins(config, address_pins);
 
-    ptr[y_idx + x_idx]  = color >> 24;
-    ptr[y_idx + x_idx + 1] = color >> 16 & 0xff;
-    ptr[y_idx + x_idx + 2]  = color >> 8 & 0xff;
-    ptr[y_idx + x_idx + 3] = color & 0xff;
+    // Two row streams, a brightness change is built in the one not in use
+    size_t row_stream_size = hub75_row_stream_size(config, framebuffer->slice_count);
+    framebuffer->row_streams[0] = malloc(2 * row_stream_size * sizeof(uint32_t));
+    if (framebuffer->row_streams[0] == NULL) {
+        return FRAMEBUFFER_ERROR;
+    }
+    framebuffer->row_streams[1] = framebuffer->row_streams[0] + row_stream_size;
+    framebuffer->row_stream = framebuffer->row_streams[0];
+    framebuffer->stream_brightness = framebuffer->scan_brightness;
+    framebuffer->stream_refresh = 0;
+    hub75_build_row_stream(config, framebuffer->slices, framebuffer->slice_count,
+                           platform_cycles_per_us(), framebuffer->stream_brightness, framebuffer->row_stream);
+    scan_set_buffer(framebuffer, framebuffer->front);
+    framebuffer->scan_pending = NULL;
+
+    // Packed planes hold four columns per word, the data program takes
+    // them a byte at a time
+    int packed = framebuffer->column_bytes == 1;
+    const pio_program_t *data_program = packed ? &hub75_data_packed_program : &hub75_data_program;
+
+    PIO pio = pio0;
+    if (!pio_can_add_program(pio, data_program) || !pio_can_add_program(pio, &hub75_row_program)) {
+        return FRAMEBUFFER_ERROR;
+    }
+    uint data_offset = pio_add_program(pio, data_program);
+    uint row_offset = pio_add_program(pio, &hub75_row_program);
+    uint sm_data = pio_claim_unused_sm(pio, true);
+    uint sm_row = pio_claim_unused_sm(pio, true);
+
+    hub75_data_program_init(pio, sm_data, data_offset, packed,
+                            hub75_pin_mask(data_pins, data_count),
+                            framebuffer->data_base, hub75_pin_count(data_pins, data_count),
+                            config->pin_clk, framebuffer->columns, HUB75_DATA_CLKDIV);
+    hub75_row_program_init(pio, sm_row, row_offset,
+                           hub75_pin_mask(address_pins, address_count),
+                           hub75_pin_base(address_pins, address_count),
+                           hub75_pin_count(address_pins, address_count),
+                           config->pin_oe);
+    if (config->oe_inverted) {
+        gpio_set_outover(config->pin_oe, GPIO_OVERRIDE_INVERT);
+    }
+
+    framebuffer->dma_data = dma_claim_unused_channel(true);
+    framebuffer->dma_data_ctrl = dma_claim_unused_channel(true);
+    framebuffer->dma_row = dma_claim_unused_channel(true);
+    framebuffer->dma_row_ctrl = dma_claim_unused_channel(true);
+
+    // The data channel sends one plane per slice, the row channel the whole cycle
+    scan_dma_init(framebuffer->dma_data, framebuffer->dma_data_ctrl, &pio->txf[sm_data],
+                  pio_get_dreq(pio, sm_data, true), framebuffer->scan_slices, true,
+                  framebuffer->plane_size / sizeof(uint32_t));
+    scan_dma_init(framebuffer->dma_row, framebuffer->dma_row_ctrl, &pio->txf[sm_row],
+                  pio_get_dreq(pio, sm_row, true), &framebuffer->row_stream, false,
+                  row_stream_size);
+
+    // Completion of the data control channel marks the start of a slice
+    scan_framebuffer = framebuffer;
+    dma_channel_set_irq0_enabled(framebuffer->dma_data_ctrl, true);
+    irq_set_exclusive_handler(DMA_IRQ_0, scan_dma_irq_handler);
+    irq_set_enabled(DMA_IRQ_0, true);
+    platform_flash_keep_irq(DMA_IRQ_0);
+
+    pio_enable_sm_mask_in_sync(pio, 1u << sm_data | 1u << sm_row);
+    dma_start_channel_mask(1u << framebuffer->dma_data_ctrl | 1u << framebuffer->dma_row_ctrl);
 
     return FRAMEBUFFER_OK;
 }
 
-static void latch(framebuffer_t *framebuffer, int line, int delay) {
+static void SCAN_RAM_FUNC(scan_dma_irq_handler)(void) {
+    framebuffer_t *framebuffer = scan_framebuffer;
+    dma_hw->ints0 = 1u << framebuffer->dma_data_ctrl;
+
+    // The control channel just started the data channel on
+    // a slice, its read address tells which one that was
+    uint32_t **next = (uint32_t **) (uintptr_t) dma_hw->ch[framebuffer->dma_data_ctrl].read_addr;
+    int started = next - framebuffer->scan_slices;
+
+    // First slice of a BCM cycle, the previous buffer is off screen
+    if (started == 1) {
+        framebuffer->refresh_count++;
+        if (framebuffer->scan_pending != NULL) {
+            frame_queue_push(&framebuffer->released, framebuffer->front);
+            framebuffer->front = framebuffer->scan_pending;
+            framebuffer->scan_pending = NULL;
+        }
+    }
+
+    // Last slice, the data channel runs from its own copy of the address
+    // so the table can be pointed at the next buffer or dither phase and rewound
+    if (started >= framebuffer->slice_count) {
+        uint32_t *pending = take_committed(framebuffer);
+        if (pending != NULL) {
+            framebuffer->scan_pending = pending;
+        }
+        if (pending != NULL || framebuffer->phases > 1) {
+            uint32_t phase = (framebuffer->refresh_count + 1) & (framebuffer->phases - 1);
+            scan_set_buffer(framebuffer, (pending != NULL ? pending : framebuffer->front) +
+                            phase * (framebuffer->phase_size / sizeof(uint32_t)));
+        }
+        dma_channel_set_read_addr(framebuffer->dma_data_ctrl, framebuffer->scan_slices, false);
+    }
+}
+#else
+#if FRAMEBUFFER_OE_PULSE
+// The row was shifted in while the previous one was lit. The PWM turns OE
+// off when its lit part is over and the dark part only needs to pass before
+// the next latch, the CPU is free until then.
+static void latch(framebuffer_t *framebuffer, int line, int delay, int brightness) {
+    platform_pulse_wait(&oe_pulse);
+
+    platform_gpio_clr_mask(framebuffer->address_mask);
+    platform_gpio_set_mask(framebuffer->row_select[line]);
+
+    platform_gpio_put(framebuffer->config.pin_lat, 1);
+    asm volatile("nop \n nop \n nop");
+    platform_gpio_put(framebuffer->config.pin_lat, 0);
+
+    uint32_t cycles = delay * framebuffer->cycles_per_us;
+    platform_pulse_start(&oe_pulse, cycles * brightness / FRAMEBUFFER_BRIGHTNESS_MAX, cycles);
+}
+#else
+static void latch(framebuffer_t *framebuffer, int line, int delay, int brightness) {
     // Select line to latch
-    gpio_put(framebuffer->config.pin_a, line & 0x1);
-    gpio_put(framebuffer->config.pin_b, (line & 0x2) >> 1);
-    gpio_put(framebuffer->config.pin_c, (line & 0x4) >> 2);
+    platform_gpio_clr_mask(framebuffer->address_mask);
+    platform_gpio_set_mask(framebuffer->row_select[line]);
 
     // Set output enable LOW to turn off the display
-    gpio_put(framebuffer->config.pin_oe, 0);
+    platform_gpio_put(framebuffer->config.pin_oe, 0);
 
     // Trigger the latch by pulsing LAT to HIGH
-    gpio_put(framebuffer->config.pin_lat, 1);
+    platform_gpio_put(framebuffer->config.pin_lat, 1);
     asm volatile("nop \n nop \n nop");
-    gpio_put(framebuffer->config.pin_lat, 0);
-
-    // Set output enable HIGH to turn on the display
-    gpio_put(framebuffer->config.pin_oe, 1);
+    platform_gpio_put(framebuffer->config.pin_lat, 0);
+
+    // Count cycles instead of reading the timer, this stays
+    // safe when the refresh loop runs on core 1
+    uint32_t cycles = delay * framebuffer->cycles_per_us;
+    if (brightness == FRAMEBUFFER_BRIGHTNESS_MAX) {
+        // Set output enable HIGH to turn on the display
+        platform_gpio_put(framebuffer->config.pin_oe, 1);
+        platform_delay_cycles(cycles);
+        return;
+    }
 
-    // This requires access to the low lever timer registers
-    // which is not safe to do on multiple cores.
-    busy_wait_us(delay);
-}
\ No newline at end of file
+    // Dimmed rows spend the rest of their time dark
+    uint32_t lit_cycles = cycles * brightness / FRAMEBUFFER_BRIGHTNESS_MAX;
+    if (lit_cycles > 0) {
+        platform_gpio_put(framebuffer->config.pin_oe, 1);
+        platform_delay_cycles(lit_cycles);
+        platform_gpio_put(framebuffer->config.pin_oe, 0);
+    }
+    platform_delay_cycles(cycles - lit_cycles);
+}
+#endif
+#endif
@@ -5,8 +5,22 @@
 #ifndef LEDPANEL_FRAMEBUFFER_H
 #define LEDPANEL_FRAMEBUFFER_H
 
+#include <stddef.h>
 #include <stdint.h>
-#include "pico/multicore.h"
+#include "frame_queue.h"
+
+// Scan-out backend, 1 refreshes the panel from PIO state machines fed by DMA,
+// 0 bit-bangs the GPIOs from framebuffer_sync()
+#ifndef FRAMEBUFFER_SCAN_PIO
+#define FRAMEBUFFER_SCAN_PIO 1
+#endif
+
+// Bit-banged backend only, 1 times the lit part of every row with a pulse
+// on OE from the PWM so the next row is shifted in while it is lit, 0 keeps
+// OE on and counts cycles
+#ifndef FRAMEBUFFER_OE_PULSE
+#define FRAMEBUFFER_OE_PULSE 1
+#endif
 
 typedef struct {
     int pin_r0, pin_g0, pin_b0;
@@ -17,21 +31,215 @@ typedef struct {
     int pin_a, pin_b, pin_c;
     int w, h, bpp;
     int oe_inverted;
+    int depth;      // BCM planes shown, 0 for FRAMEBUFFER_DEPTH
+    int slice_us;   // Longest time a plane is lit in one go, 0 for FRAMEBUFFER_SLICE_US, 256 keeps planes whole
+    int pin_d, pin_e; // Only driven when scan needs more than three address lines
+    int chain;      // Panels of w x h daisy chained side by side, 0 for one
+    int scan;       // Row addresses, 1/scan of the rows is lit at a time, 0 for h/2
+    int orientation; // FRAMEBUFFER_ROTATE_*
+    int format;     // FRAMEBUFFER_FORMAT_*, 0 for FRAMEBUFFER_FORMAT
+    int led_ua;     // Current of one lit LED of one colour, 0 for FRAMEBUFFER_LED_UA
+    int current_limit_ma; // Budget for the LEDs, 0 for no limit
+    int dither;     // Show the fraction bits of colors, see FRAMEBUFFER_DITHER_PHASES
 } framebuffer_config_t;
 
+// Clockwise rotation of the display relative to the panel chain
+#define FRAMEBUFFER_ROTATE_0 0
+#define FRAMEBUFFER_ROTATE_90 1
+#define FRAMEBUFFER_ROTATE_180 2
+#define FRAMEBUFFER_ROTATE_270 3
+
+// Row addresses supported by five address lines A-E
+#define FRAMEBUFFER_MAX_ROWS 32
+
+// Number of BCM bit-planes, one per bit of an 8-bit colour channel
+#define FRAMEBUFFER_PLANES 8
+
+// Colour depth that is scanned out, 1 to FRAMEBUFFER_PLANES. Fewer planes
+// drop the least significant bits and shorten the BCM cycle, the lowest
+// plane shown is always lit for 2 us.
+#ifndef FRAMEBUFFER_DEPTH
+#define FRAMEBUFFER_DEPTH FRAMEBUFFER_PLANES
+#endif
+
+// Planes lit for longer than this are split into slices that are spread
+// over the BCM cycle, so the bright bits flicker at a multiple of the
+// refresh rate. Rounded down to a power of two, 0 keeps planes whole.
+#ifndef FRAMEBUFFER_SLICE_US
+#define FRAMEBUFFER_SLICE_US 32
+#endif
+
+// Storage of one column in a bit-plane. Packed keeps a byte per column and
+// needs the data pins within 8 consecutive GPIOs, word keeps a 32-bit word
+// per column for any pin layout.
+#define FRAMEBUFFER_FORMAT_WORD 1
+#define FRAMEBUFFER_FORMAT_PACKED 2
+
+#ifndef FRAMEBUFFER_FORMAT
+#define FRAMEBUFFER_FORMAT FRAMEBUFFER_FORMAT_PACKED
+#endif
+
+// Typical of the constant current drivers on HUB75 panels, set led_ua
+// in the config to what the panel's reference resistor gives
+#ifndef FRAMEBUFFER_LED_UA
+#define FRAMEBUFFER_LED_UA 20000
+#endif
+
+// Colors are 0x00RRGGBB, the top byte holds two more bits of every channel
+// as 0b00rrggbb. Framebuffers that dither show a channel at value + 1 for
+// fraction out of every FRAMEBUFFER_DITHER_PHASES cycles, the others
+// ignore the fraction.
+#define FRAMEBUFFER_COLOR_FRACTION(r, g, b) ((uint32_t) ((r) << 4 | (g) << 2 | (b)) << 24)
+
+// Every buffer of a dithering framebuffer holds one copy of its planes per
+// phase, scan-out shows the next phase every BCM cycle. Must be a power of
+// two, scan-out picks the phase with a mask.
+#define FRAMEBUFFER_DITHER_PHASES 4
+
+// Full brightness, rows are lit for their whole BCM display time
+#define FRAMEBUFFER_BRIGHTNESS_MAX 255
+
+// Upper bound on the slices in one BCM cycle, a slice length of 4 us fits
+#define FRAMEBUFFER_MAX_SLICES 128
+
+// One step of the BCM cycle, plane is lit for lit_us on every row
 typedef struct {
-    void *buffer;
+    uint8_t plane;
+    uint16_t lit_us;
+} framebuffer_slice_t;
+
+// One buffer on screen, one being drawn and one in flight between the two
+#define FRAMEBUFFER_BUFFERS 3
+
+// Number of commits whose dirty rectangles are remembered
+#define FRAMEBUFFER_DIRTY_HISTORY 8
+
+// Pixel area, x1 and y1 are exclusive
+typedef struct {
+    int x0, y0, x1, y1;
+} framebuffer_rect_t;
+
+// Every buffer holds the bit-planes that are shown, planes lowest_plane up
+// to FRAMEBUFFER_PLANES - 1, of rows (the scan row addresses) by columns
+// (the length of the chain) each, in the order they are shifted out. A
+// column of column_bytes (1 packed, 4 word) carries the R0/G0/B0/R1/G1/B1
+// bits for one column of a row pair, positioned relative to data_base (the
+// lowest of those pins), so scan-out only has to shift it onto the pins.
+// Drawing uses display coordinates, width by height after chaining and
+// rotation. map_x and map_y translate them into a byte offset in a plane,
+// FRAMEBUFFER_MAP_LOWER marks pixels driven by R1/G1/B1.
+// Scan-out walks slices[] which hub75_build_schedule() derives from the
+// depth and slice length.
+//
+// Drawing always goes to buffer, the back buffer. framebuffer_commit() queues
+// it for scan-out, which switches to the newest committed buffer at the next
+// BCM cycle boundary and releases the one it was showing back to the drawing
+// side. Both directions are single producer, single consumer queues so the
+// drawing side and scan-out can live on different cores without a lock.
+//
+// Drawing tracks the rectangle it touched. Every commit records that
+// rectangle, framebuffer_begin() uses them to only bring the parts of a
+// released buffer up to date that changed since it was last on screen.
+//
+// Every commit also counts the LEDs lit in each plane of the frame, again
+// only in the area drawn, and estimates the current it draws, see
+// hub75_estimate_current(). When that exceeds the current limit the
+// brightness shown is lowered until it fits.
+// Scan-out takes brightness changes at the start of a BCM cycle.
+//
+// With dither set drawing only stores colors, fraction included, in colors.
+// Commit works out every phase of the area drawn from them, the planes of
+// phase n follow those of phase n - 1 in the buffer.
+typedef struct {
+    uint32_t *buffer;
+    uint32_t *buffers[FRAMEBUFFER_BUFFERS];
+    uint32_t *latest;
+    uint32_t *front;
+    frame_queue_t committed;
+    frame_queue_t released;
+    volatile uint32_t refresh_count;
+    framebuffer_rect_t dirty;
+    framebuffer_rect_t dirty_history[FRAMEBUFFER_DIRTY_HISTORY];
+    uint32_t commits;
+    uint32_t buffer_commit[FRAMEBUFFER_BUFFERS];
+    uint32_t pixels_drawn;
     size_t buffer_size;
+    size_t phase_size; // Bytes of the planes of one dither phase
+    size_t plane_size; // Bytes
+    int column_bytes;
+    int lowest_plane;
     framebuffer_config_t config;
-    int pwm;
+    int width, height;
+    int rows, columns;
+    uint32_t *map_x, *map_y;
+    int data_base;
+    int channel_shift[2][3];
+    // Packed format only, bits 0-3 of a channel value spread over the bytes
+    // of a word, one plane per byte, shifted onto the pin of the channel
+    uint32_t plane_spread[2][3][16];
+    framebuffer_slice_t slices[FRAMEBUFFER_MAX_SLICES];
+    int slice_count;
+    int pwm; // Next slice framebuffer_sync() shows
+    volatile uint8_t brightness;       // Set by framebuffer_set_brightness(), applied by the next commit
+    volatile uint8_t scan_brightness;  // Shown, brightness within the current limit
+    volatile uint32_t current_limit_ma;
+    uint32_t current_ma;               // Estimate for the latest frame at scan_brightness
+    uint32_t plane_bits[FRAMEBUFFER_PLANES]; // LEDs lit per plane in the latest frame, averaged over the phases
+    uint32_t lit_bits[FRAMEBUFFER_PLANES];   // The same summed over the phases
+    int phases;                        // Dither phases per buffer, 1 without dithering, a power of two
+    uint32_t *colors;                  // Dithering only, color of every display pixel
+#if FRAMEBUFFER_SCAN_PIO
+    uint32_t *scan_pending;
+    uint32_t *scan_slices[FRAMEBUFFER_MAX_SLICES];
+    uint32_t *row_stream;     // Read by the row DMA at the start of every cycle
+    uint32_t *row_streams[2];
+    uint8_t stream_brightness;
+    uint32_t stream_refresh;  // refresh_count when row_stream last changed
+    int dma_data, dma_data_ctrl;
+    int dma_row, dma_row_ctrl;
+#else
+    uint32_t cycles_per_us;
+    uint32_t address_mask;
+    uint32_t row_select[FRAMEBUFFER_MAX_ROWS];
+    uint8_t cycle_brightness; // scan_brightness at the start of the cycle being shown
+    int phase;                // Dither phase of the cycle being shown
+#endif
 } framebuffer_t;
 
+#define FRAMEBUFFER_MAP_LOWER 0x80000000ul
+
 #define FRAMEBUFFER_OK 0
 #define FRAMEBUFFER_ERROR 1
+#define FRAMEBUFFER_BUSY 2
 
 int framebuffer_init(framebuffer_config_t config, framebuffer_t *framebuffer);
 int framebuffer_sync(framebuffer_t *framebuffer);
 int framebuffer_clear(framebuffer_t *framebuffer);
 int framebuffer_drawpixel(framebuffer_t *framebuffer, int x, int y, uint32_t color);
 
+// Draw count pixels of row y starting at x, every pixel is an index into
+// palette. The span is clipped and marked dirty once instead of per pixel.
+// Returns FRAMEBUFFER_ERROR when nothing of it is on the display.
+int framebuffer_drawspan(framebuffer_t *framebuffer, int x, int y, const uint8_t *pixels, int count,
+                         const uint32_t *palette);
+
+// The same for a row of colors, see compositor.h
+int framebuffer_drawrow(framebuffer_t *framebuffer, int x, int y, const uint32_t *colors, int count);
+
+// Drawing side of the page flip. framebuffer_begin() returns FRAMEBUFFER_BUSY
+// while scan-out hasn't released a buffer yet, otherwise the back buffer holds
+// a copy of the last committed frame and can be drawn on.
+// refresh_count counts full BCM cycles for refresh rate measurements,
+// compare it with hub75_refresh_model(). pixels_drawn counts the pixels
+// drawn by framebuffer_drawpixel(), framebuffer_drawspan() and framebuffer_drawrow().
+int framebuffer_begin(framebuffer_t *framebuffer);
+int framebuffer_commit(framebuffer_t *framebuffer);
+
+// Brightness shortens the time rows are lit, it costs nothing per pixel and
+// keeps every bit of colour depth. 0 is off, FRAMEBUFFER_BRIGHTNESS_MAX full.
+// A limit of 0 mA turns the power limit off. Both only take effect with the
+// next commit, which keeps them safe to call from an interrupt.
+void framebuffer_set_brightness(framebuffer_t *framebuffer, int brightness);
+void framebuffer_set_current_limit(framebuffer_t *framebuffer, uint32_t limit_ma);
+
 #endif //LEDPANEL_FRAMEBUFFER_H
@@ -0,0 +1,267 @@
+// Everything in here is plain C without SDK dependencies so the
+// DMA streams can be built and checked on a workstation.
+//
+
+#include "hub75_stream.h"
+
+int hub75_pin_base(const int *pins, int count) {
+    int base = pins[0];
+    for (int i = 1; i < count; i++) {
+        if (pins[i] < base) {
+            base = pins[i];
+        }
+    }
+    return base;
+}
+
+int hub75_pin_count(const int *pins, int count) {
+    int base = hub75_pin_base(pins, count);
+    int top = pins[0];
+    for (int i = 1; i < count; i++) {
+        if (pins[i] > top) {
+            top = pins[i];
+        }
+    }
+    return top - base + 1;
+}
+
+uint32_t hub75_pin_mask(const int *pins, int count) {
+    uint32_t mask = 0;
+    for (int i = 0; i < count; i++) {
+        mask |= 1ul << pins[i];
+    }
+    return mask;
+}
+
+int hub75_data_pins(const framebuffer_config_t *config, int *pins) {
+    pins[0] = config->pin_r0;
+    pins[1] = config->pin_g0;
+    pins[2] = config->pin_b0;
+    pins[3] = config->pin_r1;
+    pins[4] = config->pin_g1;
+    pins[5] = config->pin_b1;
+    return 6;
+}
+
+int hub75_address_pins(const framebuffer_config_t *config, int *pins) {
+    const int address_pins[] = { config->pin_a, config->pin_b, config->pin_c, config->pin_d, config->pin_e };
+    int rows = hub75_scan_rows(config);
+    int count = 0;
+    while (count < 5 && (1 << count) < rows) {
+        pins[count] = address_pins[count];
+        count++;
+    }
+    return count;
+}
+
+int hub75_check_geometry(const framebuffer_config_t *config) {
+    int rows = hub75_scan_rows(config);
+    if (config->w <= 0 || config->chain < 0 || config->orientation < FRAMEBUFFER_ROTATE_0 ||
+            config->orientation > FRAMEBUFFER_ROTATE_270) {
+        return -1;
+    }
+    if (rows < 2 || rows > FRAMEBUFFER_MAX_ROWS || (rows & (rows - 1)) != 0 || config->h != 2 * rows) {
+        return -1;
+    }
+    return 0;
+}
+
+int hub75_scan_rows(const framebuffer_config_t *config) {
+    return config->scan != 0 ? config->scan : config->h / 2;
+}
+
+int hub75_chain_columns(const framebuffer_config_t *config) {
+    return (config->chain != 0 ? config->chain : 1) * config->w;
+}
+
+void hub75_display_size(const framebuffer_config_t *config, int *width, int *height) {
+    int columns = hub75_chain_columns(config);
+    if (config->orientation == FRAMEBUFFER_ROTATE_90 || config->orientation == FRAMEBUFFER_ROTATE_270) {
+        *width = config->h;
+        *height = columns;
+    } else {
+        *width = columns;
+        *height = config->h;
+    }
+}
+
+void hub75_map_pixel(const framebuffer_config_t *config, int x, int y, int *column, int *row) {
+    int columns = hub75_chain_columns(config);
+    switch (config->orientation) {
+        case FRAMEBUFFER_ROTATE_90:
+            *column = y;
+            *row = config->h - 1 - x;
+            break;
+        case FRAMEBUFFER_ROTATE_180:
+            *column = columns - 1 - x;
+            *row = config->h - 1 - y;
+            break;
+        case FRAMEBUFFER_ROTATE_270:
+            *column = columns - 1 - y;
+            *row = x;
+            break;
+        default:
+            *column = x;
+            *row = y;
+            break;
+    }
+}
+
+int hub75_check_format(const framebuffer_config_t *config) {
+    int format = config->format != 0 ? config->format : FRAMEBUFFER_FORMAT;
+    if (format == FRAMEBUFFER_FORMAT_WORD) {
+        return 0;
+    }
+    if (format != FRAMEBUFFER_FORMAT_PACKED) {
+        return -1;
+    }
+
+    int data_pins[6];
+    int data_count = hub75_data_pins(config, data_pins);
+    if (hub75_pin_count(data_pins, data_count) > 8 || hub75_plane_size(config) % sizeof(uint32_t) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+int hub75_column_bytes(const framebuffer_config_t *config) {
+    int format = config->format != 0 ? config->format : FRAMEBUFFER_FORMAT;
+    return format == FRAMEBUFFER_FORMAT_PACKED ? 1 : sizeof(uint32_t);
+}
+
+int hub75_lowest_plane(const framebuffer_config_t *config) {
+    return FRAMEBUFFER_PLANES - (config->depth != 0 ? config->depth : FRAMEBUFFER_DEPTH);
+}
+
+size_t hub75_plane_size(const framebuffer_config_t *config) {
+    return hub75_scan_rows(config) * hub75_chain_columns(config) * hub75_column_bytes(config);
+}
+
+size_t hub75_buffer_size(const framebuffer_config_t *config) {
+    return (FRAMEBUFFER_PLANES - hub75_lowest_plane(config)) * hub75_plane_size(config);
+}
+
+int hub75_build_schedule(const framebuffer_config_t *config, framebuffer_slice_t *slices) {
+    int depth = config->depth != 0 ? config->depth : FRAMEBUFFER_DEPTH;
+    int slice_us = config->slice_us != 0 ? config->slice_us : FRAMEBUFFER_SLICE_US;
+    if (depth < 1 || depth > FRAMEBUFFER_PLANES || slice_us < 0) {
+        return -1;
+    }
+
+    uint32_t max_us = 0;
+    if (slice_us > 0) {
+        max_us = 1;
+        while (max_us * 2 <= (uint32_t) slice_us) {
+            max_us *= 2;
+        }
+    }
+
+    // Insertion sort on the position in the cycle, planes with the
+    // same position stay in order from least to most significant
+    uint32_t positions[FRAMEBUFFER_MAX_SLICES];
+    int count = 0;
+    int lowest = hub75_lowest_plane(config);
+    for (int plane = lowest; plane < FRAMEBUFFER_PLANES; plane++) {
+        uint32_t lit_us = 2ul << (plane - lowest);
+        uint32_t split = max_us != 0 && lit_us > max_us ? lit_us / max_us : 1;
+        for (uint32_t i = 0; i < split; i++) {
+            if (count == FRAMEBUFFER_MAX_SLICES) {
+                return -1;
+            }
+            uint32_t position = ((2 * i + 1) << 16) / (2 * split);
+            int j = count++;
+            while (j > 0 && positions[j - 1] > position) {
+                positions[j] = positions[j - 1];
+                slices[j] = slices[j - 1];
+                j--;
+            }
+            positions[j] = position;
+            slices[j] = (framebuffer_slice_t) { plane, lit_us / split };
+        }
+    }
+    return count;
+}
+
+size_t hub75_row_stream_size(const framebuffer_config_t *config, int slice_count) {
+    return slice_count * hub75_scan_rows(config) * 3;
+}
+
+void hub75_build_row_stream(const framebuffer_config_t *config, const framebuffer_slice_t *slices, int slice_count,
+                            uint32_t cycles_per_us, int brightness, uint32_t *stream) {
+    int pins[5];
+    int count = hub75_address_pins(config, pins);
+    int base = hub75_pin_base(pins, count);
+
+    for (int slice = 0; slice < slice_count; slice++) {
+        uint32_t display_cycles = slices[slice].lit_us * cycles_per_us;
+        uint32_t lit_cycles = display_cycles * brightness / FRAMEBUFFER_BRIGHTNESS_MAX;
+
+        for (int line = 0; line < hub75_scan_rows(config); line++) {
+            uint32_t address = 0;
+            for (int i = 0; i < count; i++) {
+                address |= (uint32_t)(line >> i & 0x1) << (pins[i] - base);
+            }
+
+            // The row program lights the row for x cycles, then counts x
+            // down to zero in the dark
+            *stream++ = lit_cycles;
+            *stream++ = address;
+            *stream++ = display_cycles - lit_cycles;
+        }
+    }
+}
+
+uint32_t hub75_estimate_current(const framebuffer_config_t *config, const uint32_t *plane_bits, int brightness,
+                                uint32_t led_ua) {
+    // Planes are lit in proportion to their weight, the lowest shown weighs 1
+    int lowest = hub75_lowest_plane(config);
+    uint64_t weighted = 0;
+    for (int plane = lowest; plane < FRAMEBUFFER_PLANES; plane++) {
+        weighted += (uint64_t) plane_bits[plane] << (plane - lowest);
+    }
+    uint64_t total_weight = (1ul << (FRAMEBUFFER_PLANES - lowest)) - 1;
+    uint64_t divisor = total_weight * hub75_scan_rows(config) * FRAMEBUFFER_BRIGHTNESS_MAX * 1000;
+    return weighted * led_ua * brightness / divisor;
+}
+
+hub75_timing_t hub75_pio_timing(uint32_t cycles_per_us) {
+    // hub75_data spends two instructions per column, hub75_row ten
+    // cycles on every row besides the lit and dark time from the stream
+    return (hub75_timing_t) {
+        .cycles_per_us = cycles_per_us,
+        .column_cycles = 2 * HUB75_DATA_CLKDIV,
+        .row_cycles = 10,
+        .overlapped = 1
+    };
+}
+
+hub75_timing_t hub75_bitbang_timing(uint32_t cycles_per_us) {
+    // Starting the OE pulse takes a handful of PWM register writes on top
+    // of selecting and latching the row
+    return (hub75_timing_t) {
+        .cycles_per_us = cycles_per_us,
+        .column_cycles = 14,
+        .row_cycles = FRAMEBUFFER_OE_PULSE ? 40 : 24,
+        .overlapped = FRAMEBUFFER_OE_PULSE
+    };
+}
+
+float hub75_refresh_model(const framebuffer_config_t *config, const framebuffer_slice_t *slices, int slice_count,
+                          const hub75_timing_t *timing) {
+    uint64_t shift_cycles = (uint64_t) hub75_chain_columns(config) * timing->column_cycles;
+    uint64_t cycle_cycles = 0;
+    for (int slice = 0; slice < slice_count; slice++) {
+        uint64_t lit_cycles = (uint64_t) slices[slice].lit_us * timing->cycles_per_us;
+        uint64_t row = timing->row_cycles;
+        if (timing->overlapped) {
+            row += lit_cycles > shift_cycles ? lit_cycles : shift_cycles;
+        } else {
+            row += lit_cycles + shift_cycles;
+        }
+        cycle_cycles += row * hub75_scan_rows(config);
+    }
+    if (cycle_cycles == 0) {
+        return 0;
+    }
+    return timing->cycles_per_us * 1e6f / cycle_cycles;
+}
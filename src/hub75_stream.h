@@ -0,0 +1,87 @@
+#ifndef LEDPANEL_HUB75_STREAM_H
+#define LEDPANEL_HUB75_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "framebuffer.h"
+
+// The data state machine runs at sys_clk / 4 and needs two cycles per column,
+// keeping CLK around 15 MHz which all panels we have seen can follow.
+#define HUB75_DATA_CLKDIV 4
+
+// Pin group helpers, the PIO programs drive every group as one
+// contiguous range starting at its lowest pin
+int hub75_pin_base(const int *pins, int count);
+int hub75_pin_count(const int *pins, int count);
+uint32_t hub75_pin_mask(const int *pins, int count);
+
+int hub75_data_pins(const framebuffer_config_t *config, int *pins);
+// A, B, C, D and E as far as the scan needs them
+int hub75_address_pins(const framebuffer_config_t *config, int *pins);
+
+// Geometry of the chain, panels are lined up from left to right as seen
+// from the front with the one the controller drives on the right. Word n
+// of a row ends up in column n counting from the left.
+// hub75_check_geometry() returns -1 for layouts the scan engine can't drive:
+// every address has to light one row in each half of the panel.
+int hub75_check_geometry(const framebuffer_config_t *config);
+int hub75_scan_rows(const framebuffer_config_t *config);
+int hub75_chain_columns(const framebuffer_config_t *config);
+void hub75_display_size(const framebuffer_config_t *config, int *width, int *height);
+
+// Column in the chain and panel row of display pixel (x, y)
+void hub75_map_pixel(const framebuffer_config_t *config, int x, int y, int *column, int *row);
+
+// Storage of the bit-planes, see framebuffer_t. hub75_check_format() returns
+// -1 if the data pins don't fit in a packed column, or if a packed plane
+// doesn't fill whole 32-bit words for the DMA.
+int hub75_check_format(const framebuffer_config_t *config);
+int hub75_column_bytes(const framebuffer_config_t *config);
+int hub75_lowest_plane(const framebuffer_config_t *config);
+size_t hub75_plane_size(const framebuffer_config_t *config);
+size_t hub75_buffer_size(const framebuffer_config_t *config);
+
+// Order of the BCM cycle for the depth and slice length in config. Plane n
+// of the planes shown is lit for 2^(n+1) us in total. A plane split in k
+// slices has them at (2i+1)/2k of the cycle, planes that are not split sit
+// in the middle. Returns the number of slices, -1 if the settings are out of
+// range or need more than FRAMEBUFFER_MAX_SLICES.
+int hub75_build_schedule(const framebuffer_config_t *config, framebuffer_slice_t *slices);
+
+// The row stream feeds the hub75_row program. For every slice and every
+// row pair it holds three words: the number of cycles the row stays lit,
+// the row address relative to the lowest address pin and the number of
+// cycles it stays dark after that. Brightness, out of
+// FRAMEBUFFER_BRIGHTNESS_MAX, moves cycles from lit to dark so the timing
+// of the cycle stays the same.
+// Order matches the slices, so both streams advance in lockstep.
+size_t hub75_row_stream_size(const framebuffer_config_t *config, int slice_count);
+void hub75_build_row_stream(const framebuffer_config_t *config, const framebuffer_slice_t *slices, int slice_count,
+                            uint32_t cycles_per_us, int brightness, uint32_t *stream);
+
+// Average current in mA the LEDs draw for a frame at brightness, plane_bits[n]
+// counts the LEDs lit in plane n over all row addresses. Every lit LED draws
+// led_ua while its row is lit and the row addresses take turns, a frame
+// that lights everything draws 1/scan of what all LEDs together would.
+// Shifting and latching count as lit time, so this errs on the high side.
+uint32_t hub75_estimate_current(const framebuffer_config_t *config, const uint32_t *plane_bits, int brightness,
+                                uint32_t led_ua);
+
+// Cost of driving the panel, in system clock cycles
+typedef struct {
+    uint32_t cycles_per_us;
+    uint32_t column_cycles; // Clocking one column into the shift registers
+    uint32_t row_cycles;    // Selecting and latching a row
+    int overlapped;         // The next row is shifted in while the current one is lit
+} hub75_timing_t;
+
+// The PIO figures follow from the programs in hub75.pio, the bit-banged
+// ones are estimated from the instructions in the framebuffer_sync() loop.
+hub75_timing_t hub75_pio_timing(uint32_t cycles_per_us);
+hub75_timing_t hub75_bitbang_timing(uint32_t cycles_per_us);
+
+// Predicted full BCM cycles per second for a schedule
+float hub75_refresh_model(const framebuffer_config_t *config, const framebuffer_slice_t *slices, int slice_count,
+                          const hub75_timing_t *timing);
+
+#endif //LEDPANEL_HUB75_STREAM_H
@@ -3,20 +3,65 @@
 #include <hardware/gpio.h>
 #include <pico/time.h>
 #include <math.h>
+#include <string.h>
 #include <hardware/i2c.h>
 #include <pico/stdio_uart.h>
+#include <pico/multicore.h>
+#include "asset_store.h"
 #include "framebuffer.h"
+#include "frame_stream.h"
+#include "hub75_stream.h"
 #include "animations/animations.h"
 #include "i2c_slave.h"
 #include "panel.h"
+#include "platform/platform.h"
 
-#define I2C_BAUDRATE 100000
+// Fast-mode Plus, needs external pull-ups of around 1k on SCL and SDA,
+// the internal ones only make it to standard mode
+#define I2C_BAUDRATE 1000000
 #define I2C_ADDRESS 0x50
+
+// Writes to any other register select a sequence and a play state
+#define I2C_REGISTER_STATE 0x42          // read sequence and play state
+#define I2C_REGISTER_PLAYBACK 0x43       // write mode [frame:u16], read mode, frame:u16 and frames:u16
+#define I2C_REGISTER_VIEW 0x44           // write scale shrink filter [x:i16 y:i16], read those and canvas w:u16 h:u16
+#define I2C_REGISTER_POWER 0x45          // write brightness [limit:u16 mA], read those, shown brightness, current:u16 mA
+#define I2C_REGISTER_STREAM 0x10         // frame stream commands, see frame_stream.h
+#define I2C_REGISTER_STREAM_STATUS 0x11  // read ring space, status and frames, write to reset
+#define I2C_STREAM_RESET 0x01
+#define I2C_REGISTER_STORE 0x20          // asset store commands, read busy, result and asset count
+
+// Asset store commands, the first byte written to I2C_REGISTER_STORE.
+// Every command runs from the main loop once the write has finished, poll
+// the register until it is no longer busy before sending the next one.
+// Flash is unavailable while it is written, reads are stretched meanwhile.
+// Space is erased a sector at a time by the data commands, none of them
+// keeps flash for longer than one sector erase and a page program.
+#define I2C_STORE_BEGIN 0x01   // name[8] size:u32 crc32:u32, reserves the space
+#define I2C_STORE_DATA 0x02    // up to I2C_STORE_CHUNK bytes of the asset
+#define I2C_STORE_FINISH 0x03  // check the crc and make the asset playable
+#define I2C_STORE_DELETE 0x04  // index:u8
+#define I2C_STORE_FORMAT 0x05
+#define I2C_STORE_CHUNK 256
+
+// Stream bytes parsed per pass of the main loop
+#define I2C_STREAM_BATCH 256
 #define I2C_1_SCL 15
 #define I2C_1_SDA 14
 
-// Frequency in HZ for the animation update loop
-#define ANIMATION_FREQUENCY 24
+// With the bit-banged backend core 1 owns the refresh loop while core 0
+// decodes animations and handles I2C. Set to 0 to run everything on core 0.
+// The PIO backend refreshes in hardware and leaves core 1 unused.
+#define CORE1_REFRESH 1
+#define REFRESH_ON_CORE1 (!FRAMEBUFFER_SCAN_PIO && CORE1_REFRESH)
+
+// Bytes of RAM used to cache the decoded frames of the
+// active sequence between loops, 0 disables the cache
+#define GIF_FRAME_CACHE_SIZE (32 * 1024)
+
+// Print refresh and decode rates on the uart
+#define STATS 0
+#define STATS_INTERVAL_US (5 * 1000 * 1000)
 
 framebuffer_t fb;
 framebuffer_config_t framebuffer_config = {
@@ -25,19 +70,52 @@ framebuffer_config_t framebuffer_config = {
     CLK, LAT, OE,
     A, B, C,
     DISPLAY_W, DISPLAY_H, DISPLAY_BPP,
-    .oe_inverted = false // LOW = off
+    .oe_inverted = false, // LOW = off
+    .chain = DISPLAY_CHAIN,
+    .scan = DISPLAY_SCAN,
+    .orientation = DISPLAY_ORIENTATION,
+    .led_ua = DISPLAY_LED_UA,
+    .current_limit_ma = DISPLAY_CURRENT_LIMIT_MA,
+    .dither = DISPLAY_DITHER
 };
 
+#if GIF_FRAME_CACHE_SIZE
+static uint8_t frame_cache_storage[GIF_FRAME_CACHE_SIZE] __attribute__((aligned(8)));
+#endif
+
 static void core1_entry();
 static void i2c_slave_handler(i2c_inst_t *i2c, i2c_slave_event_t event);
 
 static uint64_t last_i2c_transmission;
 static uint8_t i2c_timeout;
 
-bool timer_callback(repeating_timer_t *user_data) {
-    gif_animation_update(&fb);
-    return true;
-}
+// Raw frames from the controller take the framebuffer over from the
+// animations until a sequence is selected again
+static frame_stream_t stream;
+static volatile uint8_t stream_selected;
+
+// Uploaded animations, played as the sequences after the built-in ones
+static asset_store_t store;
+static uint8_t store_request[1 + I2C_STORE_CHUNK];
+static size_t store_request_length;
+static volatile uint8_t store_busy;
+static volatile uint8_t store_result;
+static void store_handle_request();
+
+// Sequence, playback and view requests from the I2C handler, run from the
+// main loop. The animation calls block on its mutex, which the main loop
+// may hold when the interrupt comes in. Single producer, single consumer
+// like frame_queue.h, requests that don't fit are dropped.
+#define I2C_REQUESTS 8 // Must be a power of two
+typedef struct {
+    uint8_t i2c_register;
+    uint8_t length;  // Bytes received, the register included
+    uint8_t data[8]; // As received into buffer
+} i2c_request_t;
+static i2c_request_t i2c_requests[I2C_REQUESTS];
+static uint32_t i2c_requests_head; // written by the handler only
+static uint32_t i2c_requests_tail; // written by the main loop only
+static void i2c_handle_requests();
 
 int main(void) {
     stdio_uart_init();
@@ -49,14 +127,28 @@ int main(void) {
     gpio_put(PICO_DEFAULT_LED_PIN, 1);
 
 
+    // The framebuffer has to exist before the animations start drawing into it
+    if (framebuffer_init(framebuffer_config, &fb) != FRAMEBUFFER_OK) {
+        panic("Framebuffer issue");
+    }
+
+#if REFRESH_ON_CORE1
     // Start all the framebuffer work on the second core
-    //multicore_launch_core1(core1_entry);
+    multicore_launch_core1(core1_entry);
+#endif
 
     gif_animation_init(&fb);
+    if (asset_store_init(&store) == ASSET_STORE_OK) {
+        gif_animation_set_store(&store);
+    } else {
+        printf("Asset store unavailable\n");
+    }
+#if GIF_FRAME_CACHE_SIZE
+    gif_animation_enable_cache(frame_cache_storage, sizeof(frame_cache_storage));
+#endif
 
-    repeating_timer_t timer;
-    alarm_pool_t *alarm_pool = alarm_pool_create_with_unused_hardware_alarm(1);
-    alarm_pool_add_repeating_timer_us(alarm_pool, 1000000UL / ANIMATION_FREQUENCY, timer_callback, NULL, &timer);
+    frame_stream_init(&stream);
+    uint8_t streaming = 0;
 
     i2c_init(i2c1, I2C_BAUDRATE);
     gpio_init(I2C_1_SCL);
@@ -68,78 +160,197 @@ int main(void) {
     i2c_slave_init(i2c1, I2C_ADDRESS, &i2c_slave_handler);
     last_i2c_transmission = time_us_64(); // Initialize the timeout measurement
 
-    // Core issues with timers, run on main core for now
-    if (framebuffer_init(framebuffer_config, &fb) != FRAMEBUFFER_OK) {
-        panic("Framebuffer issue");
-    }
+#if STATS
+    uint64_t last_stats = time_us_64();
+    uint32_t last_refresh_count = fb.refresh_count;
+    uint32_t last_frames_decoded = gif_animation_get_frames_decoded();
+#if FRAMEBUFFER_SCAN_PIO
+    hub75_timing_t timing = hub75_pio_timing(platform_cycles_per_us());
+#else
+    hub75_timing_t timing = hub75_bitbang_timing(platform_cycles_per_us());
+#endif
+    printf("refresh model %lu Hz for %d slices\n",
+           (unsigned long) hub75_refresh_model(&fb.config, fb.slices, fb.slice_count, &timing),
+           fb.slice_count);
+#endif
 
     while (1) {
         if (time_us_64() - last_i2c_transmission > 10 * 1000 * 1000) {
             if (!i2c_timeout) {
                 i2c_timeout = 1;
+                stream_selected = 0;
                 gif_animation_play(DEFAULT_GIF_SEQUENCE, 3);
             }
         }
         else {
             i2c_timeout = 0;
         }
+
+        if (store_busy) {
+            store_handle_request();
+        }
+        i2c_handle_requests();
+
+        if (stream_selected != streaming) {
+            streaming = stream_selected;
+            if (streaming) {
+                gif_animation_release();
+            }
+        }
+        if (streaming) {
+            frame_stream_process(&stream, &fb, I2C_STREAM_BATCH);
+        }
+
+#if STATS
+        uint64_t now = time_us_64();
+        if (now - last_stats > STATS_INTERVAL_US) {
+            uint32_t refresh_count = fb.refresh_count;
+            uint32_t frames_decoded = gif_animation_get_frames_decoded();
+            uint32_t elapsed_ms = (now - last_stats) / 1000;
+            printf("refresh %lu Hz, decode %lu fps\n",
+                   (unsigned long) ((refresh_count - last_refresh_count) * 1000UL / elapsed_ms),
+                   (unsigned long) ((frames_decoded - last_frames_decoded) * 1000UL / elapsed_ms));
+#if GIF_FRAME_CACHE_SIZE
+            uint32_t hits, misses;
+            size_t bytes_used;
+            gif_animation_get_cache_stats(&hits, &misses, &bytes_used);
+            printf("frame cache %lu hits, %lu misses, %u bytes\n",
+                   (unsigned long) hits, (unsigned long) misses, (unsigned) bytes_used);
+#endif
+            last_stats = now;
+            last_refresh_count = refresh_count;
+            last_frames_decoded = frames_decoded;
+        }
+#endif
+
+#if !REFRESH_ON_CORE1
         framebuffer_sync(&fb);
+#endif
     }
 }
 
+// Core 1 only refreshes the panel, it must not touch the
+// SDK timers or alarms which are owned by core 0.
 static void core1_entry() {
-    if (framebuffer_init(framebuffer_config, &fb) != FRAMEBUFFER_OK) {
-        return;
-    }
-
+    // Writing flash pauses this core, see platform_flash_erase()
+    multicore_lockout_victim_init();
     while (1) {
         framebuffer_sync(&fb);
     }
 }
 
-static uint8_t i2c_bytes_received = 0;
+static uint32_t i2c_bytes_received = 0;
 static uint8_t i2c_bytes_sent = 0;
 static uint8_t i2c_register;
-static uint8_t buffer[64];
+static uint8_t buffer[8];
+
+static void i2c_post_request(uint8_t length) {
+    uint32_t head = i2c_requests_head;
+    if (head - __atomic_load_n(&i2c_requests_tail, __ATOMIC_ACQUIRE) == I2C_REQUESTS) {
+        return;
+    }
+    i2c_request_t *request = &i2c_requests[head & (I2C_REQUESTS - 1)];
+    request->i2c_register = i2c_register;
+    request->length = length;
+    memcpy(request->data, buffer, sizeof(request->data));
+    __atomic_store_n(&i2c_requests_head, head + 1, __ATOMIC_RELEASE);
+}
+
 static void i2c_slave_handler(i2c_inst_t *i2c, i2c_slave_event_t event) {
     uint8_t byte;
     last_i2c_transmission = time_us_64();
 
     switch(event) {
     case I2C_SLAVE_RECEIVE:
-        buffer[i2c_bytes_received] = i2c_read_byte_raw(i2c);
+        byte = i2c_read_byte_raw(i2c);
         if (i2c_bytes_received == 0) {
             // First byte after START or RESTART is the register id
-            i2c_register = buffer[0];
-        }
-
-        if (i2c_bytes_received == 2) {
-            if (buffer[1] > 11 || buffer[2] > 3) {
-                // Safety
-                gif_animation_play(1, 3);
-                return;
-            }
-
-            if (buffer[1] != gif_animation_get_sequence()) {
-                gif_animation_play(buffer[1], buffer[2]);
+            i2c_register = byte;
+        } else if (i2c_register == I2C_REGISTER_STREAM) {
+            frame_stream_push(&stream, byte);
+            stream_selected = 1;
+        } else if (i2c_register == I2C_REGISTER_STREAM_STATUS) {
+            if (byte == I2C_STREAM_RESET) {
+                frame_stream_request_reset(&stream);
             }
-            switch (buffer[2]) {
-                case 0:
-                    gif_animation_stop();
-                    break;
-                case 1:
-                    gif_animation_pause();
-                    break;
-                case 2:
-                    gif_animation_resume();
+        } else if (i2c_register == I2C_REGISTER_STORE) {
+            // Requests that arrive while the last one is running are dropped
+            if (!store_busy && i2c_bytes_received - 1 < sizeof(store_request)) {
+                store_request[i2c_bytes_received - 1] = byte;
+                store_request_length = i2c_bytes_received;
             }
+        } else if (i2c_bytes_received < sizeof(buffer)) {
+            buffer[i2c_bytes_received] = byte;
+        }
+
+        if (i2c_bytes_received == 2 && i2c_register != I2C_REGISTER_STREAM &&
+                i2c_register != I2C_REGISTER_STREAM_STATUS && i2c_register != I2C_REGISTER_STORE &&
+                i2c_register != I2C_REGISTER_PLAYBACK && i2c_register != I2C_REGISTER_VIEW &&
+                i2c_register != I2C_REGISTER_POWER) {
+            // Leftovers of a stream must not take the panel back
+            stream_selected = 0;
+            frame_stream_request_reset(&stream);
+            i2c_post_request(3);
         }
 
         i2c_bytes_received++;
 
         break;
     case I2C_SLAVE_REQUEST:
-        if (i2c_register != 0x42) {
+        if (i2c_register == I2C_REGISTER_STREAM_STATUS) {
+            // Free ring space, so the controller knows how much it can send,
+            // followed by the status flags and the frames committed
+            size_t free_bytes = frame_stream_free(&stream);
+            uint8_t status[] = {
+                    free_bytes & 0xff, free_bytes >> 8 & 0xff,
+                    frame_stream_status(&stream), stream.frames & 0xff
+            };
+            i2c_write_byte_raw(i2c, i2c_bytes_sent < sizeof(status) ? status[i2c_bytes_sent] : 0x0);
+            i2c_bytes_sent++;
+            return;
+        }
+
+        if (i2c_register == I2C_REGISTER_STORE) {
+            uint8_t status[] = { store_busy, store_result, asset_store_count(&store) };
+            i2c_write_byte_raw(i2c, i2c_bytes_sent < sizeof(status) ? status[i2c_bytes_sent] : 0x0);
+            i2c_bytes_sent++;
+            return;
+        }
+
+        if (i2c_register == I2C_REGISTER_PLAYBACK) {
+            int frame = gif_animation_get_frame();
+            int frames = gif_animation_get_frame_count();
+            uint8_t status[] = {
+                    gif_animation_get_playback(), frame & 0xff, frame >> 8 & 0xff, frames & 0xff, frames >> 8
+            };
+            i2c_write_byte_raw(i2c, i2c_bytes_sent < sizeof(status) ? status[i2c_bytes_sent] : 0x0);
+            i2c_bytes_sent++;
+            return;
+        }
+
+        if (i2c_register == I2C_REGISTER_VIEW) {
+            const canvas_view_t *view = gif_animation_get_view();
+            uint8_t status[] = {
+                    view->scale, view->shrink, view->filter,
+                    view->x & 0xff, view->x >> 8 & 0xff, view->y & 0xff, view->y >> 8 & 0xff,
+                    view->canvas_width & 0xff, view->canvas_width >> 8, view->canvas_height & 0xff, view->canvas_height >> 8
+            };
+            i2c_write_byte_raw(i2c, i2c_bytes_sent < sizeof(status) ? status[i2c_bytes_sent] : 0x0);
+            i2c_bytes_sent++;
+            return;
+        }
+
+        if (i2c_register == I2C_REGISTER_POWER) {
+            uint8_t status[] = {
+                    fb.brightness, fb.current_limit_ma & 0xff, fb.current_limit_ma >> 8 & 0xff,
+                    fb.scan_brightness, fb.current_ma & 0xff, fb.current_ma >> 8 & 0xff
+            };
+            i2c_write_byte_raw(i2c, i2c_bytes_sent < sizeof(status) ? status[i2c_bytes_sent] : 0x0);
+            i2c_bytes_sent++;
+            return;
+        }
+
+        if (i2c_register != I2C_REGISTER_STATE) {
             i2c_write_byte_raw(i2c, 0x0);
             return;
         }
@@ -156,6 +367,20 @@ static void i2c_slave_handler(i2c_inst_t *i2c, i2c_slave_event_t event) {
         }
         break;
     case I2C_SLAVE_FINISH:
+        if (i2c_register == I2C_REGISTER_STORE && i2c_bytes_received > 1 && !store_busy) {
+            store_busy = 1;
+        }
+        if ((i2c_register == I2C_REGISTER_PLAYBACK && i2c_bytes_received >= 2) ||
+                (i2c_register == I2C_REGISTER_VIEW && i2c_bytes_received >= 4)) {
+            i2c_post_request(i2c_bytes_received);
+        }
+        if (i2c_register == I2C_REGISTER_POWER && i2c_bytes_received >= 2) {
+            // Only latched, the next frame committed applies them
+            if (i2c_bytes_received == 4) {
+                framebuffer_set_current_limit(&fb, buffer[2] | buffer[3] << 8);
+            }
+            framebuffer_set_brightness(&fb, buffer[1]);
+        }
         i2c_bytes_sent = 0;
         i2c_bytes_received = 0;
         break;
@@ -164,3 +389,96 @@ static void i2c_slave_handler(i2c_inst_t *i2c, i2c_slave_event_t event) {
     }
 }
 
+// Runs the requests the I2C handler posted, in the order they came in
+static void i2c_handle_requests() {
+    uint32_t tail = i2c_requests_tail;
+    while (tail != __atomic_load_n(&i2c_requests_head, __ATOMIC_ACQUIRE)) {
+        const i2c_request_t *request = &i2c_requests[tail & (I2C_REQUESTS - 1)];
+        const uint8_t *data = request->data;
+
+        if (request->i2c_register == I2C_REGISTER_PLAYBACK) {
+            if (data[1] <= GIF_PLAYBACK_PINGPONG) {
+                gif_animation_set_playback(data[1]);
+                if (request->length == 4) {
+                    gif_animation_seek(data[2] | data[3] << 8);
+                }
+            }
+        } else if (request->i2c_register == I2C_REGISTER_VIEW) {
+            gif_animation_set_view(data[1], data[2], data[3]);
+            if (request->length == 8) {
+                gif_animation_pan((int16_t) (data[4] | data[5] << 8), (int16_t) (data[6] | data[7] << 8));
+            }
+        } else if (data[1] >= gif_animation_get_sequence_count() || data[2] > 3) {
+            // Safety
+            gif_animation_play(1, 3);
+        } else {
+            if (data[1] != gif_animation_get_sequence()) {
+                gif_animation_play(data[1], data[2]);
+            }
+            switch (data[2]) {
+                case 0:
+                    gif_animation_stop();
+                    break;
+                case 1:
+                    gif_animation_pause();
+                    break;
+                case 2:
+                    gif_animation_resume();
+            }
+        }
+
+        tail++;
+        __atomic_store_n(&i2c_requests_tail, tail, __ATOMIC_RELEASE);
+    }
+}
+
+static uint32_t read_u32(const uint8_t *src) {
+    return src[0] | src[1] << 8 | src[2] << 16 | (uint32_t) src[3] << 24;
+}
+
+// Runs the request the I2C handler collected, flash can't be written from
+// the interrupt
+static void store_handle_request() {
+    const uint8_t *args = store_request + 1;
+    size_t length = store_request_length - 1;
+    uint8_t result = ASSET_STORE_ERROR;
+
+    switch (store_request[0]) {
+        case I2C_STORE_BEGIN:
+            if (length == ASSET_STORE_NAME_SIZE + 8) {
+                char name[ASSET_STORE_NAME_SIZE + 1] = { 0 };
+                memcpy(name, args, ASSET_STORE_NAME_SIZE);
+                result = asset_store_begin(&store, name, read_u32(args + ASSET_STORE_NAME_SIZE),
+                                           read_u32(args + ASSET_STORE_NAME_SIZE + 4));
+            }
+            break;
+        case I2C_STORE_DATA:
+            result = asset_store_write(&store, args, length);
+            break;
+        case I2C_STORE_FINISH:
+            result = asset_store_finish(&store);
+            break;
+        case I2C_STORE_DELETE:
+        case I2C_STORE_FORMAT:
+            // Uploaded sequences move or disappear, don't keep playing from under them
+            if (gif_animation_get_sequence() >= gif_animation_get_builtin_count()) {
+                gif_animation_stop();
+            }
+            if (store_request[0] == I2C_STORE_FORMAT) {
+                result = asset_store_format(&store);
+            } else if (length == 1) {
+                result = asset_store_delete(&store, args[0]);
+            }
+            break;
+        default:
+            break;
+    }
+
+    // Validates what changed, the sequence numbers may have moved as well
+    if (result == ASSET_STORE_OK && store_request[0] != I2C_STORE_BEGIN && store_request[0] != I2C_STORE_DATA) {
+        gif_animation_set_store(&store);
+    }
+
+    store_result = result;
+    store_busy = 0;
+}
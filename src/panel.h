@@ -19,8 +19,28 @@
 #define OE 21
 #define LAT 22
 
+// Size of one panel, DISPLAY_CHAIN of them are daisy chained side by side.
+// Panels with more than 8 row addresses need the D and E address lines,
+// set pin_d and pin_e in the framebuffer config for those.
 #define DISPLAY_W 32
 #define DISPLAY_H 16
 #define DISPLAY_BPP 32
+#define DISPLAY_CHAIN 1
+#define DISPLAY_SCAN 8          // 1/8 scan
+#define DISPLAY_ORIENTATION 0   // FRAMEBUFFER_ROTATE_*
+
+// Pixels on the whole display
+#define DISPLAY_PIXELS (DISPLAY_W * DISPLAY_H * DISPLAY_CHAIN)
+
+// Current of one lit LED of one colour in uA, and the most the LEDs may
+// draw in mA as estimated from every frame, 0 for no limit. Brightness is
+// lowered for frames over the limit, see framebuffer.h.
+#define DISPLAY_LED_UA 20000
+#define DISPLAY_CURRENT_LIMIT_MA 0
+
+// Show the two bits of every channel below the 8 that make it into the
+// bit-planes by temporal dithering. Takes FRAMEBUFFER_DITHER_PHASES times the
+// buffer memory and rules out assets compiled to bit-planes.
+#define DISPLAY_DITHER 0
 
 #endif //LEDPANEL_PANEL_H
@@ -0,0 +1,16 @@
+// Thin layer between the panel code and the Pico SDK. The firmware maps it
+// straight onto the SDK, the host build (see host/) onto a recording GPIO
+// backend and a virtual clock so the scan and decode paths can be profiled
+// on a workstation.
+//
+
+#ifndef LEDPANEL_PLATFORM_H
+#define LEDPANEL_PLATFORM_H
+
+#ifdef PLATFORM_HOST
+#include "platform_host.h"
+#else
+#include "platform_pico.h"
+#endif
+
+#endif //LEDPANEL_PLATFORM_H
@@ -0,0 +1,306 @@
+// Recording GPIO backend and virtual clock for the host build
+//
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "platform.h"
+
+// Same system clock as the RP2040 at its default 125 MHz
+#define HOST_CYCLES_PER_US 125
+
+static uint32_t gpio_out;
+static uint64_t gpio_writes;
+static platform_host_gpio_hook_t gpio_hook;
+
+static uint64_t now_us;
+static uint32_t pending_cycles;
+static platform_timer_t *timers;
+static platform_alarm_t *alarms;
+static int in_timer;
+static uint32_t gpio_cycles;
+
+// The pulse whose pin is still high
+static platform_pulse_t *pulse_high;
+static uint64_t idle_cycles;
+
+static FILE *flash_file;
+static uint8_t *flash_memory;
+static uint32_t flash_size;
+
+static void gpio_changed(void) {
+    gpio_writes++;
+    if (gpio_hook != NULL) {
+        gpio_hook(gpio_out, now_us);
+    }
+    if (gpio_cycles != 0) {
+        platform_delay_cycles(gpio_cycles);
+    }
+}
+
+// Drop the pin of the pulse when the clock moves past the end of its high part
+static void pulse_update(uint64_t target_us) {
+    if (pulse_high == NULL) {
+        return;
+    }
+    uint64_t edge_us = pulse_high->high_end / HOST_CYCLES_PER_US;
+    if (edge_us > target_us) {
+        return;
+    }
+    gpio_out &= ~(1ul << pulse_high->pin);
+    pulse_high = NULL;
+    gpio_writes++;
+    if (gpio_hook != NULL) {
+        gpio_hook(gpio_out, edge_us);
+    }
+}
+
+void platform_gpio_init_outputs(uint32_t mask) {
+    gpio_out &= ~mask;
+    gpio_changed();
+}
+
+void platform_gpio_pull_down(int pin) {
+    (void) pin;
+}
+
+void platform_gpio_set_mask(uint32_t mask) {
+    gpio_out |= mask;
+    gpio_changed();
+}
+
+void platform_gpio_clr_mask(uint32_t mask) {
+    gpio_out &= ~mask;
+    gpio_changed();
+}
+
+void platform_gpio_put(int pin, bool value) {
+    if (value) {
+        gpio_out |= 1ul << pin;
+    } else {
+        gpio_out &= ~(1ul << pin);
+    }
+    gpio_changed();
+}
+
+uint64_t platform_time_us(void) {
+    return now_us;
+}
+
+uint32_t platform_cycles_per_us(void) {
+    return HOST_CYCLES_PER_US;
+}
+
+void platform_delay_cycles(uint32_t cycles) {
+    // Keep the remainder so short delays still add up
+    pending_cycles += cycles;
+    platform_host_advance_us(pending_cycles / HOST_CYCLES_PER_US);
+    pending_cycles %= HOST_CYCLES_PER_US;
+}
+
+void platform_pulse_init(platform_pulse_t *pulse, int pin) {
+    pulse->pin = pin;
+    pulse->high_end = 0;
+    pulse->end = 0;
+}
+
+void platform_pulse_start(platform_pulse_t *pulse, uint32_t high_cycles, uint32_t period_cycles) {
+    uint64_t now = platform_host_cycles();
+    pulse->high_end = now + high_cycles;
+    pulse->end = now + period_cycles;
+    if (high_cycles != 0) {
+        pulse_high = pulse;
+        gpio_out |= 1ul << pulse->pin;
+        gpio_changed();
+    }
+}
+
+void platform_pulse_wait(const platform_pulse_t *pulse) {
+    uint64_t now = platform_host_cycles();
+    if (pulse->end > now) {
+        idle_cycles += pulse->end - now;
+        platform_delay_cycles(pulse->end - now);
+    }
+}
+
+void platform_mutex_init(platform_mutex_t *mutex) {
+    mutex->locked = 0;
+}
+
+void platform_mutex_enter(platform_mutex_t *mutex) {
+    // Nothing can hold it across a preemption point on the host
+    assert(!mutex->locked);
+    mutex->locked = 1;
+}
+
+bool platform_mutex_try_enter(platform_mutex_t *mutex) {
+    if (mutex->locked) {
+        return false;
+    }
+    mutex->locked = 1;
+    return true;
+}
+
+void platform_mutex_exit(platform_mutex_t *mutex) {
+    mutex->locked = 0;
+}
+
+bool platform_timer_start(platform_timer_t *timer, uint32_t interval_us, platform_timer_callback_t callback) {
+    timer->interval_us = interval_us;
+    timer->next_us = now_us + interval_us;
+    timer->callback = callback;
+    timer->next = timers;
+    timers = timer;
+    return true;
+}
+
+bool platform_alarm_at(platform_alarm_t *alarm, uint64_t time_us, platform_alarm_callback_t callback) {
+    alarm->time_us = time_us;
+    alarm->callback = callback;
+    alarm->armed = 1;
+    if (!alarm->linked) {
+        alarm->linked = 1;
+        alarm->next = alarms;
+        alarms = alarm;
+    }
+    return true;
+}
+
+void platform_alarm_cancel(platform_alarm_t *alarm) {
+    alarm->armed = 0;
+}
+
+void platform_host_set_gpio_hook(platform_host_gpio_hook_t hook) {
+    gpio_hook = hook;
+}
+
+uint64_t platform_host_gpio_writes(void) {
+    return gpio_writes;
+}
+
+void platform_host_set_gpio_cycles(uint32_t cycles) {
+    gpio_cycles = cycles;
+}
+
+uint64_t platform_host_cycles(void) {
+    return now_us * HOST_CYCLES_PER_US + pending_cycles;
+}
+
+uint64_t platform_host_idle_cycles(void) {
+    return idle_cycles;
+}
+
+void platform_host_advance_us(uint64_t us) {
+    uint64_t target = now_us + us;
+
+    // Timers don't nest, like an interrupt handler they run to completion
+    if (in_timer) {
+        pulse_update(target);
+        now_us = target;
+        return;
+    }
+
+    in_timer = 1;
+    while (1) {
+        platform_timer_t *due = NULL;
+        for (platform_timer_t *timer = timers; timer != NULL; timer = timer->next) {
+            if (timer->next_us <= target && (due == NULL || timer->next_us < due->next_us)) {
+                due = timer;
+            }
+        }
+        platform_alarm_t *due_alarm = NULL;
+        for (platform_alarm_t *alarm = alarms; alarm != NULL; alarm = alarm->next) {
+            if (alarm->armed && alarm->time_us <= target &&
+                    (due_alarm == NULL || alarm->time_us < due_alarm->time_us)) {
+                due_alarm = alarm;
+            }
+        }
+
+        if (due_alarm != NULL && (due == NULL || due_alarm->time_us < due->next_us)) {
+            // Alarms that were due in the past fire right away, like fire_if_past on the pico
+            if (due_alarm->time_us > now_us) {
+                now_us = due_alarm->time_us;
+            }
+            due_alarm->armed = 0;
+            uint64_t next_us = due_alarm->callback(due_alarm);
+            if (next_us != 0) {
+                due_alarm->time_us = next_us;
+                due_alarm->armed = 1;
+            }
+            continue;
+        }
+        if (due == NULL) {
+            break;
+        }
+
+        now_us = due->next_us;
+        due->next_us += due->interval_us;
+        if (!due->callback(due)) {
+            due->next_us = UINT64_MAX;
+        }
+    }
+    // A timer may have taken longer than the step, time doesn't go back
+    if (now_us < target) {
+        pulse_update(target);
+        now_us = target;
+    }
+    in_timer = 0;
+}
+
+bool platform_host_flash_open(const char *path, uint32_t size) {
+    flash_memory = malloc(size);
+    if (flash_memory == NULL) {
+        return false;
+    }
+    memset(flash_memory, 0xff, size);
+    flash_size = size;
+
+    flash_file = fopen(path, "r+b");
+    if (flash_file != NULL) {
+        size_t read = fread(flash_memory, 1, size, flash_file);
+        (void) read;
+        return true;
+    }
+    flash_file = fopen(path, "w+b");
+    return flash_file != NULL && fwrite(flash_memory, 1, size, flash_file) == size && fflush(flash_file) == 0;
+}
+
+static bool flash_write_through(uint32_t offset, size_t size) {
+    return fseek(flash_file, offset, SEEK_SET) == 0 &&
+           fwrite(flash_memory + offset, 1, size, flash_file) == size &&
+           fflush(flash_file) == 0;
+}
+
+void platform_flash_region(uint32_t *start, uint32_t *end) {
+    *start = 0;
+    *end = flash_size;
+}
+
+const uint8_t *platform_flash_data(uint32_t offset) {
+    return flash_memory + offset;
+}
+
+bool platform_flash_erase(uint32_t offset, size_t size) {
+    if (flash_memory == NULL || offset % PLATFORM_FLASH_SECTOR_SIZE != 0 || size % PLATFORM_FLASH_SECTOR_SIZE != 0 ||
+            offset + size > flash_size) {
+        return false;
+    }
+    memset(flash_memory + offset, 0xff, size);
+    platform_host_advance_us(size / PLATFORM_FLASH_SECTOR_SIZE * HOST_FLASH_ERASE_US);
+    return flash_write_through(offset, size);
+}
+
+// Like NOR flash programming only clears bits, ones leave a bit as it is
+bool platform_flash_program(uint32_t offset, const uint8_t *data, size_t size) {
+    if (flash_memory == NULL || offset % PLATFORM_FLASH_PAGE_SIZE != 0 || size % PLATFORM_FLASH_PAGE_SIZE != 0 ||
+            offset + size > flash_size) {
+        return false;
+    }
+    for (size_t i = 0; i < size; i++) {
+        flash_memory[offset + i] &= data[i];
+    }
+    platform_host_advance_us(size / PLATFORM_FLASH_PAGE_SIZE * HOST_FLASH_PROGRAM_US);
+    return flash_write_through(offset, size);
+}
@@ -0,0 +1,109 @@
+#ifndef LEDPANEL_PLATFORM_HOST_H
+#define LEDPANEL_PLATFORM_HOST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The host build is single threaded, timers fire from within
+// platform_delay_cycles() the way an interrupt would preempt the scan loop.
+
+typedef struct {
+    int locked;
+} platform_mutex_t;
+
+typedef struct platform_timer platform_timer_t;
+typedef bool (*platform_timer_callback_t)(platform_timer_t *timer);
+
+struct platform_timer {
+    uint64_t interval_us;
+    uint64_t next_us;
+    platform_timer_callback_t callback;
+    platform_timer_t *next;
+};
+
+// Pulses run on the virtual clock, the pin goes low when the clock passes
+// the end of the high part. Waiting moves the clock to the end of the
+// period and counts as idle time, see platform_host_idle_cycles().
+typedef struct {
+    int pin;
+    uint64_t high_end; // Virtual clock cycles
+    uint64_t end;
+} platform_pulse_t;
+
+#define PLATFORM_PULSE_MAX 0xffff
+
+typedef struct platform_alarm platform_alarm_t;
+typedef uint64_t (*platform_alarm_callback_t)(platform_alarm_t *alarm);
+
+struct platform_alarm {
+    uint64_t time_us;
+    platform_alarm_callback_t callback;
+    int armed;
+    int linked;
+    platform_alarm_t *next;
+};
+
+void platform_gpio_init_outputs(uint32_t mask);
+void platform_gpio_pull_down(int pin);
+void platform_gpio_set_mask(uint32_t mask);
+void platform_gpio_clr_mask(uint32_t mask);
+void platform_gpio_put(int pin, bool value);
+
+uint64_t platform_time_us(void);
+uint32_t platform_cycles_per_us(void);
+void platform_delay_cycles(uint32_t cycles);
+
+void platform_pulse_init(platform_pulse_t *pulse, int pin);
+void platform_pulse_start(platform_pulse_t *pulse, uint32_t high_cycles, uint32_t period_cycles);
+void platform_pulse_wait(const platform_pulse_t *pulse);
+
+void platform_mutex_init(platform_mutex_t *mutex);
+void platform_mutex_enter(platform_mutex_t *mutex);
+bool platform_mutex_try_enter(platform_mutex_t *mutex);
+void platform_mutex_exit(platform_mutex_t *mutex);
+
+bool platform_timer_start(platform_timer_t *timer, uint32_t interval_us, platform_timer_callback_t callback);
+bool platform_alarm_at(platform_alarm_t *alarm, uint64_t time_us, platform_alarm_callback_t callback);
+void platform_alarm_cancel(platform_alarm_t *alarm);
+
+// Flash that is free for data, from the end of the firmware image to the end
+// of flash. Offsets count from the start of flash, erasing works on whole
+// sectors and programming on whole pages. Programming can only clear bits.
+// Reads go through platform_flash_data(), which points straight into the
+// memory mapped flash.
+// On the host flash is a file, see platform_host_flash_open(). Erasing and
+// programming advance the virtual clock by the typical figures of the
+// W25Q16JV on the Pico.
+#define PLATFORM_FLASH_SECTOR_SIZE 4096
+#define PLATFORM_FLASH_PAGE_SIZE 256
+#define HOST_FLASH_ERASE_US 45000  // Per sector
+#define HOST_FLASH_PROGRAM_US 400  // Per page
+
+void platform_flash_region(uint32_t *start, uint32_t *end);
+const uint8_t *platform_flash_data(uint32_t offset);
+bool platform_flash_erase(uint32_t offset, size_t size);
+bool platform_flash_program(uint32_t offset, const uint8_t *data, size_t size);
+
+// Host only, called with the GPIO output state after every change
+typedef void (*platform_host_gpio_hook_t)(uint32_t gpio_out, uint64_t time_us);
+
+void platform_host_set_gpio_hook(platform_host_gpio_hook_t hook);
+uint64_t platform_host_gpio_writes(void);
+
+// Back the flash region with a file of size bytes, created erased when it
+// doesn't exist yet. Changes are written through to the file.
+bool platform_host_flash_open(const char *path, uint32_t size);
+
+// Move the virtual clock forward and run the timers that became due
+void platform_host_advance_us(uint64_t us);
+
+// CPU time every GPIO write takes on the virtual clock. 0 by default, the
+// scan then only takes the time rows are lit.
+void platform_host_set_gpio_cycles(uint32_t cycles);
+
+// Virtual clock in cycles, and the part of it spent waiting for pulses
+uint64_t platform_host_cycles(void);
+uint64_t platform_host_idle_cycles(void);
+
+#endif //LEDPANEL_PLATFORM_HOST_H
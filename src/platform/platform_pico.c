@@ -0,0 +1,131 @@
+#include <hardware/flash.h>
+#include <hardware/irq.h>
+#include <hardware/regs/addressmap.h>
+#include <hardware/regs/m0plus.h>
+#include <pico/multicore.h>
+#include "platform.h"
+
+// End of the firmware image in flash, from the linker script
+extern char __flash_binary_end;
+
+static uint32_t flash_keep_irqs;
+
+static alarm_pool_t *alarm_pool;
+
+static alarm_pool_t *get_alarm_pool() {
+    if (alarm_pool == NULL) {
+        alarm_pool = alarm_pool_create_with_unused_hardware_alarm(4);
+    }
+    return alarm_pool;
+}
+
+void platform_pulse_init(platform_pulse_t *pulse, int pin) {
+    pulse->slice = pwm_gpio_to_slice_num(pin);
+    pulse->channel = pwm_gpio_to_channel(pin);
+    pulse->period = 0;
+
+    // Counting system clock cycles
+    pwm_config config = pwm_get_default_config();
+    pwm_config_set_clkdiv_int(&config, 1);
+    pwm_config_set_wrap(&config, PLATFORM_PULSE_MAX);
+    pwm_init(pulse->slice, &config, false);
+    pwm_set_chan_level(pulse->slice, pulse->channel, 0);
+    gpio_set_function(pin, GPIO_FUNC_PWM);
+}
+
+bool platform_timer_start(platform_timer_t *timer, uint32_t interval_us, platform_timer_callback_t callback) {
+    return alarm_pool_add_repeating_timer_us(get_alarm_pool(), interval_us, callback, NULL, timer);
+}
+
+static int64_t alarm_callback(alarm_id_t id, void *user_data) {
+    (void) id;
+    platform_alarm_t *alarm = user_data;
+    uint64_t next_us = alarm->callback(alarm);
+    if (next_us == 0) {
+        alarm->id = 0;
+        return 0;
+    }
+
+    // A negative value reschedules relative to when this alarm was due,
+    // so deadlines stay absolute no matter how late the callback ran
+    int64_t delta = (int64_t) (next_us - alarm->time_us);
+    if (delta <= 0) {
+        delta = 1;
+    }
+    alarm->time_us += delta;
+    return -delta;
+}
+
+bool platform_alarm_at(platform_alarm_t *alarm, uint64_t time_us, platform_alarm_callback_t callback) {
+    platform_alarm_cancel(alarm);
+
+    alarm->time_us = time_us;
+    alarm->callback = callback;
+    alarm_id_t id = alarm_pool_add_alarm_at(get_alarm_pool(), from_us_since_boot(time_us), alarm_callback, alarm, true);
+    if (id < 0) {
+        return false;
+    }
+    alarm->id = id;
+    return true;
+}
+
+void platform_alarm_cancel(platform_alarm_t *alarm) {
+    if (alarm->id > 0) {
+        alarm_pool_cancel_alarm(get_alarm_pool(), alarm->id);
+        alarm->id = 0;
+    }
+}
+
+void platform_flash_region(uint32_t *start, uint32_t *end) {
+    uint32_t binary_end = (uintptr_t) &__flash_binary_end - XIP_BASE;
+    *start = (binary_end + PLATFORM_FLASH_SECTOR_SIZE - 1) & ~(PLATFORM_FLASH_SECTOR_SIZE - 1);
+    *end = PICO_FLASH_SIZE_BYTES;
+}
+
+const uint8_t *platform_flash_data(uint32_t offset) {
+    return (const uint8_t *) (uintptr_t) (XIP_BASE + offset);
+}
+
+void platform_flash_keep_irq(unsigned int irq) {
+    flash_keep_irqs |= 1u << irq;
+}
+
+// Nothing may run from flash while it is busy, only the interrupts
+// that were asked for stay enabled
+static uint32_t flash_begin(void) {
+    if (multicore_lockout_victim_is_initialized(1)) {
+        multicore_lockout_start_blocking();
+    }
+    uint32_t enabled = *(io_rw_32 *) (PPB_BASE + M0PLUS_NVIC_ISER_OFFSET);
+    irq_set_mask_enabled(enabled & ~flash_keep_irqs, false);
+    return enabled;
+}
+
+static void flash_end(uint32_t enabled) {
+    irq_set_mask_enabled(enabled, true);
+    if (multicore_lockout_victim_is_initialized(1)) {
+        multicore_lockout_end_blocking();
+    }
+}
+
+bool platform_flash_erase(uint32_t offset, size_t size) {
+    if (offset % PLATFORM_FLASH_SECTOR_SIZE != 0 || size % PLATFORM_FLASH_SECTOR_SIZE != 0 ||
+            offset + size > PICO_FLASH_SIZE_BYTES) {
+        return false;
+    }
+    uint32_t enabled = flash_begin();
+    flash_range_erase(offset, size);
+    flash_end(enabled);
+    return true;
+}
+
+bool platform_flash_program(uint32_t offset, const uint8_t *data, size_t size) {
+    if (offset % PLATFORM_FLASH_PAGE_SIZE != 0 || size % PLATFORM_FLASH_PAGE_SIZE != 0 ||
+            offset + size > PICO_FLASH_SIZE_BYTES) {
+        return false;
+    }
+    uint32_t enabled = flash_begin();
+    flash_range_program(offset, data, size);
+    flash_end(enabled);
+    return true;
+}
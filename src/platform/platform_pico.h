@@ -0,0 +1,144 @@
+#ifndef LEDPANEL_PLATFORM_PICO_H
+#define LEDPANEL_PLATFORM_PICO_H
+
+#include <stddef.h>
+#include <hardware/clocks.h>
+#include <hardware/gpio.h>
+#include <hardware/pwm.h>
+#include <pico/sync.h>
+#include <pico/time.h>
+
+// Everything used on the scan path is inline so the firmware
+// pays nothing for going through this layer.
+
+typedef mutex_t platform_mutex_t;
+typedef repeating_timer_t platform_timer_t;
+typedef bool (*platform_timer_callback_t)(platform_timer_t *timer);
+
+// PWM slice driving the pin of a pulse
+typedef struct {
+    uint slice;
+    uint channel;
+    uint32_t period;
+} platform_pulse_t;
+
+typedef struct platform_alarm platform_alarm_t;
+typedef uint64_t (*platform_alarm_callback_t)(platform_alarm_t *alarm);
+
+struct platform_alarm {
+    alarm_id_t id;
+    uint64_t time_us;
+    platform_alarm_callback_t callback;
+};
+
+static inline void platform_gpio_init_outputs(uint32_t mask) {
+    gpio_init_mask(mask);
+    gpio_set_dir_out_masked(mask);
+    gpio_clr_mask(mask);
+}
+
+static inline void platform_gpio_pull_down(int pin) {
+    gpio_set_pulls(pin, false, true);
+}
+
+static inline void platform_gpio_set_mask(uint32_t mask) {
+    gpio_set_mask(mask);
+}
+
+static inline void platform_gpio_clr_mask(uint32_t mask) {
+    gpio_clr_mask(mask);
+}
+
+static inline void platform_gpio_put(int pin, bool value) {
+    gpio_put(pin, value);
+}
+
+static inline uint64_t platform_time_us(void) {
+    return time_us_64();
+}
+
+static inline uint32_t platform_cycles_per_us(void) {
+    return clock_get_hz(clk_sys) / 1000000;
+}
+
+// Busy wait without touching the timer, safe to use on either core
+static inline void platform_delay_cycles(uint32_t cycles) {
+    busy_wait_at_least_cycles(cycles);
+}
+
+// Pulses drive a pin high for a number of system clock cycles in hardware,
+// the CPU only has to come back by the end of the period to start the next.
+// The longest period is PLATFORM_PULSE_MAX cycles. A pulse is one shot of
+// the PWM slice of the pin: starting the counter at the top wraps it right
+// away and loads the level, the level written after that only loads at the
+// next wrap and keeps the pin low from there on.
+#define PLATFORM_PULSE_MAX 0xffff
+
+void platform_pulse_init(platform_pulse_t *pulse, int pin);
+
+static inline void platform_pulse_start(platform_pulse_t *pulse, uint32_t high_cycles, uint32_t period_cycles) {
+    pwm_set_enabled(pulse->slice, false);
+    pwm_set_counter(pulse->slice, PLATFORM_PULSE_MAX);
+    pwm_set_chan_level(pulse->slice, pulse->channel, high_cycles);
+    pwm_set_enabled(pulse->slice, true);
+    while (pwm_get_counter(pulse->slice) == PLATFORM_PULSE_MAX) {
+    }
+    pwm_clear_irq(pulse->slice);
+    pwm_set_chan_level(pulse->slice, pulse->channel, 0);
+    pulse->period = period_cycles;
+}
+
+// A wrap means the CPU came back after the slice ran through its whole range
+static inline bool platform_pulse_done(const platform_pulse_t *pulse) {
+    return pwm_get_counter(pulse->slice) >= pulse->period || (pwm_hw->intr & 1u << pulse->slice) != 0;
+}
+
+static inline void platform_pulse_wait(const platform_pulse_t *pulse) {
+    while (!platform_pulse_done(pulse)) {
+    }
+}
+
+static inline void platform_mutex_init(platform_mutex_t *mutex) {
+    mutex_init(mutex);
+}
+
+static inline void platform_mutex_enter(platform_mutex_t *mutex) {
+    mutex_enter_blocking(mutex);
+}
+
+static inline bool platform_mutex_try_enter(platform_mutex_t *mutex) {
+    return mutex_try_enter(mutex, NULL);
+}
+
+static inline void platform_mutex_exit(platform_mutex_t *mutex) {
+    mutex_exit(mutex);
+}
+
+// Repeating timer on a dedicated alarm pool, callbacks run in interrupt context
+bool platform_timer_start(platform_timer_t *timer, uint32_t interval_us, platform_timer_callback_t callback);
+
+// One-shot alarm at an absolute platform_time_us() on the same pool. The
+// callback returns the absolute time to run again, or 0 to stay idle. Arming
+// an alarm that is already armed moves it. Alarms must be zero initialised.
+bool platform_alarm_at(platform_alarm_t *alarm, uint64_t time_us, platform_alarm_callback_t callback);
+void platform_alarm_cancel(platform_alarm_t *alarm);
+
+// Flash that is free for data, from the end of the firmware image to the end
+// of flash. Offsets count from the start of flash, erasing works on whole
+// sectors and programming on whole pages. Programming can only clear bits.
+// Reads go through platform_flash_data(), which points straight into the
+// memory mapped flash.
+// Flash can't be read while it is written, so the other core is paused and
+// every interrupt is masked except the ones marked with
+// platform_flash_keep_irq(). Their handlers and everything they call have
+// to be in RAM. Erasing a sector takes around 45 ms.
+#define PLATFORM_FLASH_SECTOR_SIZE 4096
+#define PLATFORM_FLASH_PAGE_SIZE 256
+
+void platform_flash_region(uint32_t *start, uint32_t *end);
+const uint8_t *platform_flash_data(uint32_t offset);
+bool platform_flash_erase(uint32_t offset, size_t size);
+bool platform_flash_program(uint32_t offset, const uint8_t *data, size_t size);
+void platform_flash_keep_irq(unsigned int irq);
+
+#endif //LEDPANEL_PLATFORM_PICO_H
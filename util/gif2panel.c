@@ -0,0 +1,435 @@
+// Build time asset compiler, used by add_resource() in embedded.cmake.
+// Decodes a GIF on the build machine and emits it in the same assembler
+// format as bin2asm, either as the original GIF or as a panel asset (see
+// src/animations/panel_asset.h) with the frames composited onto the panel
+// canvas, the palette converted by palette.c and missing delays filled
+// in. A report comparing flash size and host decode time of
+// the three formats goes to stderr.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "gif_decoder.h"
+#include "gif_canvas.h"
+#include "panel.h"
+#include "hub75_stream.h"
+#include "animations/panel_asset.h"
+#include "animations/palette.h"
+
+#define MAX_INPUT_SIZE (4 * 1024 * 1024)
+#define MAX_FRAMES 4096
+// Largest buffer, every plane stored as words
+#define PLANE_BYTES (FRAMEBUFFER_PLANES * DISPLAY_PIXELS / 2 * sizeof(uint32_t))
+
+// Embedding the original file, next to the panel asset formats
+#define PANEL_ASSET_GIF 0
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+} output_t;
+
+static framebuffer_config_t config = {
+    R0, G0, B0,
+    R1, G1, B1,
+    CLK, LAT, OE,
+    A, B, C,
+    DISPLAY_W, DISPLAY_H, DISPLAY_BPP,
+    .chain = DISPLAY_CHAIN,
+    .scan = DISPLAY_SCAN,
+    .orientation = DISPLAY_ORIENTATION
+};
+
+// Display size after chaining and rotation
+static int display_w, display_h;
+
+static uint32_t canvases[MAX_FRAMES][DISPLAY_PIXELS];
+static uint16_t delays[MAX_FRAMES];
+static int frame_count;
+static long dirty_pixels;
+
+static uint32_t asset_palette[256];
+static int asset_palette_size;
+
+static void output_append(output_t *output, const void *data, size_t size) {
+    if (size == 0) {
+        return;
+    }
+    if (output->size + size > output->capacity) {
+        output->capacity = (output->size + size) * 2;
+        output->data = realloc(output->data, output->capacity);
+        if (output->data == NULL) {
+            fprintf(stderr, "gif2panel: out of memory\n");
+            exit(1);
+        }
+    }
+    memcpy(output->data + output->size, data, size);
+    output->size += size;
+}
+
+static void output_align(output_t *output) {
+    static const uint8_t padding[4];
+    output_append(output, padding, (4 - output->size % 4) % 4);
+}
+
+static void write_u16(uint8_t *dst, uint16_t value) {
+    dst[0] = value & 0xff;
+    dst[1] = value >> 8;
+}
+
+static void write_u32(uint8_t *dst, uint32_t value) {
+    write_u16(dst, value & 0xffff);
+    write_u16(dst + 2, value >> 16);
+}
+
+// Panel view of the logical screen, clipped like framebuffer_drawpixel() does.
+// Assets hold 8-bit colors, the fraction for dithering is dropped.
+static void render(const gif_canvas_t *gif_canvas, const uint32_t *colors, uint32_t *canvas) {
+    for (int y = 0; y < display_h; y++) {
+        for (int x = 0; x < display_w; x++) {
+            uint32_t color = 0;
+            if (x < gif_canvas->width && y < gif_canvas->height) {
+                color = colors[gif_canvas->pixels[y * gif_canvas->width + x]] & 0xffffff;
+            }
+            canvas[y * display_w + x] = color;
+        }
+    }
+}
+
+// Frames without a delay get the default that gif_animation.c uses as well
+static uint16_t normalise_delay(uint16_t delay) {
+    return delay != 0 ? delay : GIF_DEFAULT_DELAY;
+}
+
+static int decode(uint8_t *gif_data, size_t size, uint32_t (*frames)[DISPLAY_PIXELS]) {
+    static uint8_t frame_pixels[65536];
+    static uint8_t canvas_pixels[65536];
+    static uint8_t canvas_previous[65536];
+    static uint32_t colors[PALETTE_SIZE];
+    static gif_lzw_context_t lzw;
+    gif_t gif = { .lzw = &lzw };
+    gif_canvas_t gif_canvas;
+    frame_t frame = { .frame = frame_pixels };
+
+    if (gif_decoder_init(gif_data, size, &gif) != GIF_OK || gif.width * gif.height > sizeof(canvas_pixels)) {
+        return -1;
+    }
+    palette_convert(gif.global_ct, gif.ct_size, colors);
+    gif_canvas_init(&gif_canvas, &gif, canvas_pixels, canvas_previous);
+    dirty_pixels = 0;
+
+    int count = 0;
+    gif_error_t res;
+    while ((res = gif_decoder_read_next_frame(&gif, &frame)) == GIF_OK) {
+        if (count == MAX_FRAMES) {
+            return -1;
+        }
+        gif_canvas_draw(&gif_canvas, &frame);
+        dirty_pixels += gif_canvas.dirty.width * gif_canvas.dirty.height;
+        if (frames != NULL) {
+            render(&gif_canvas, colors, frames[count]);
+            delays[count] = normalise_delay(frame.delay);
+        }
+        count++;
+    }
+    return res == GIF_EOF ? count : -1;
+}
+
+static int asset_palette_index(uint32_t color) {
+    for (int i = 0; i < asset_palette_size; i++) {
+        if (asset_palette[i] == color) {
+            return i;
+        }
+    }
+    if (asset_palette_size == 256) {
+        return -1;
+    }
+    asset_palette[asset_palette_size] = color;
+    return asset_palette_size++;
+}
+
+// Run-length encode a canvas as (length, palette index) pairs,
+// returns 0 when the colors don't fit in the palette
+static size_t encode_runs(const uint32_t *canvas, uint8_t *runs) {
+    size_t length = 0;
+    int pixel = 0;
+    while (pixel < DISPLAY_PIXELS) {
+        int run = 1;
+        while (run < 255 && pixel + run < DISPLAY_PIXELS && canvas[pixel + run] == canvas[pixel]) {
+            run++;
+        }
+        int index = asset_palette_index(canvas[pixel]);
+        if (index < 0) {
+            return 0;
+        }
+        runs[length++] = run;
+        runs[length++] = index;
+        pixel += run;
+    }
+    return length;
+}
+
+static void decode_runs(const uint8_t *runs, size_t length, uint32_t *canvas) {
+    for (size_t i = 0; i < length; i += 2) {
+        for (int n = 0; n < runs[i]; n++) {
+            *canvas++ = asset_palette[runs[i + 1]];
+        }
+    }
+}
+
+// Same layout as framebuffer_drawpixel() produces, words are little endian
+static void slice_planes(const uint32_t *canvas, uint8_t *planes) {
+    int data_pins[6];
+    int data_count = hub75_data_pins(&config, data_pins);
+    int data_base = hub75_pin_base(data_pins, data_count);
+    int rows = hub75_scan_rows(&config);
+    int columns = hub75_chain_columns(&config);
+    int column_bytes = hub75_column_bytes(&config);
+    int lowest = hub75_lowest_plane(&config);
+    size_t plane_size = hub75_plane_size(&config);
+
+    memset(planes, 0, hub75_buffer_size(&config));
+    for (int y = 0; y < display_h; y++) {
+        for (int x = 0; x < display_w; x++) {
+            int column, row;
+            hub75_map_pixel(&config, x, y, &column, &row);
+            int pin_r = (row < rows ? R0 : R1) - data_base;
+            int pin_g = (row < rows ? G0 : G1) - data_base;
+            int pin_b = (row < rows ? B0 : B1) - data_base;
+            uint32_t color = canvas[y * display_w + x];
+            uint8_t *ptr = planes + ((row % rows) * columns + column) * column_bytes;
+            for (int plane = lowest; plane < FRAMEBUFFER_PLANES; plane++) {
+                uint32_t bits = (color >> (16 + plane) & 0x1) << pin_r |
+                                (color >> (8 + plane) & 0x1) << pin_g |
+                                (color >> plane & 0x1) << pin_b;
+                for (int i = 0; i < column_bytes; i++) {
+                    ptr[i] |= bits >> (8 * i);
+                }
+                ptr += plane_size;
+            }
+        }
+    }
+}
+
+// Frames that are identical to an earlier one share its data
+static int find_duplicate(int frame) {
+    for (int i = 0; i < frame; i++) {
+        if (memcmp(canvases[i], canvases[frame], sizeof(canvases[frame])) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int build_asset(int format, output_t *output) {
+    panel_asset_header_t header = {
+            .magic = PANEL_ASSET_MAGIC,
+            .format = format,
+            .frame_count = frame_count,
+            .width = display_w,
+            .height = display_h,
+            .planes = FRAMEBUFFER_PLANES - hub75_lowest_plane(&config),
+            .column_bytes = hub75_column_bytes(&config),
+    };
+
+    int data_pins[6];
+    int data_count = hub75_data_pins(&config, data_pins);
+    int data_base = hub75_pin_base(data_pins, data_count);
+    int pins[6] = { R0, G0, B0, R1, G1, B1 };
+    for (int i = 0; i < 6; i++) {
+        header.pins[i] = pins[i] - data_base;
+    }
+
+    // Frame data goes to a separate buffer first, the palette is only complete afterwards
+    static uint8_t runs[2 * DISPLAY_PIXELS];
+    static uint8_t planes[PLANE_BYTES];
+    output_t data = { 0 };
+    uint32_t offsets[MAX_FRAMES], lengths[MAX_FRAMES];
+    for (int i = 0; i < frame_count; i++) {
+        int duplicate = find_duplicate(i);
+        if (duplicate >= 0) {
+            offsets[i] = offsets[duplicate];
+            lengths[i] = lengths[duplicate];
+            continue;
+        }
+
+        output_align(&data);
+        offsets[i] = data.size;
+        if (format == PANEL_ASSET_RGB) {
+            lengths[i] = encode_runs(canvases[i], runs);
+            if (lengths[i] == 0) {
+                free(data.data);
+                return -1;
+            }
+            output_append(&data, runs, lengths[i]);
+        } else {
+            slice_planes(canvases[i], planes);
+            lengths[i] = hub75_buffer_size(&config);
+            output_append(&data, planes, lengths[i]);
+        }
+    }
+    header.palette_size = format == PANEL_ASSET_RGB ? asset_palette_size : 0;
+
+    uint8_t bytes[sizeof(panel_asset_header_t)];
+    write_u32(bytes, header.magic);
+    write_u16(bytes + 4, header.format);
+    write_u16(bytes + 6, header.frame_count);
+    write_u16(bytes + 8, header.width);
+    write_u16(bytes + 10, header.height);
+    write_u16(bytes + 12, header.planes);
+    write_u16(bytes + 14, header.palette_size);
+    memcpy(bytes + 16, header.pins, sizeof(header.pins));
+    bytes[22] = header.column_bytes;
+    bytes[23] = 0;
+    output_append(output, bytes, sizeof(bytes));
+
+    size_t data_start = sizeof(panel_asset_header_t) + frame_count * sizeof(panel_asset_frame_t)
+            + header.palette_size * sizeof(uint32_t);
+    for (int i = 0; i < frame_count; i++) {
+        uint8_t entry[sizeof(panel_asset_frame_t)] = { 0 };
+        write_u32(entry, data_start + offsets[i]);
+        write_u32(entry + 4, lengths[i]);
+        write_u16(entry + 8, delays[i]);
+        output_append(output, entry, sizeof(entry));
+    }
+    for (int i = 0; i < header.palette_size; i++) {
+        uint8_t color[4];
+        write_u32(color, asset_palette[i]);
+        output_append(output, color, sizeof(color));
+    }
+    output_append(output, data.data, data.size);
+    free(data.data);
+    return 0;
+}
+
+// Host time per frame to get from the embedded data to the bit-planes
+static double measure(uint8_t *gif_data, size_t size, int format) {
+    static uint8_t planes[PLANE_BYTES];
+    static uint8_t sliced[PLANE_BYTES];
+    static uint32_t canvas[DISPLAY_PIXELS];
+    static uint8_t runs[MAX_FRAMES][2 * DISPLAY_PIXELS];
+    static size_t lengths[MAX_FRAMES];
+
+    // Palette indices are already assigned by build_asset()
+    for (int i = 0; i < frame_count && format == PANEL_ASSET_RGB; i++) {
+        lengths[i] = encode_runs(canvases[i], runs[i]);
+    }
+    slice_planes(canvases[0], sliced);
+
+    int loops = 0;
+    clock_t start = clock();
+    do {
+        if (format == PANEL_ASSET_GIF) {
+            decode(gif_data, size, NULL);
+        }
+        for (int i = 0; i < frame_count; i++) {
+            if (format == PANEL_ASSET_GIF) {
+                slice_planes(canvases[i], planes);
+            } else if (format == PANEL_ASSET_RGB) {
+                decode_runs(runs[i], lengths[i], canvas);
+                slice_planes(canvas, planes);
+            } else {
+                memcpy(planes, sliced, hub75_buffer_size(&config));
+            }
+        }
+        loops++;
+    } while (clock() - start < CLOCKS_PER_SEC / 20);
+    return (double) (clock() - start) * 1e6 / CLOCKS_PER_SEC / loops / frame_count;
+}
+
+static void emit(const char *name, const uint8_t *data, size_t size) {
+    printf("\
+.globl %s_start\n\
+	.section .rodata\n\
+	.align 8\n\
+%s_start:\n\
+", name, name);
+
+    for (size_t i = 0; i < size; i++) {
+        printf(i % 16 == 0 ? ".byte 0x%02x" : ",0x%02x", data[i]);
+        if (i % 16 == 15 || i == size - 1) {
+            printf("\n");
+        }
+    }
+
+    printf("\
+.globl %s_end\n\
+	.section .rodata\n\
+	.align 8\n\
+%s_end:\n\
+", name, name);
+}
+
+int main(int argc, char *argv[]) {
+    static const char *formats[] = { "gif", "rgb", "planes" };
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s NAME gif|rgb|planes < GIF_FILE > ASM_FILE\n", argv[0]);
+        return 1;
+    }
+
+    const char *name = argv[1];
+    if (hub75_check_geometry(&config) != 0 || hub75_check_format(&config) != 0) {
+        fprintf(stderr, "gif2panel: unsupported panel geometry in panel.h\n");
+        return 1;
+    }
+    hub75_display_size(&config, &display_w, &display_h);
+
+    int format = -1;
+    for (int i = PANEL_ASSET_GIF; i <= PANEL_ASSET_PLANES; i++) {
+        if (strcmp(argv[2], formats[i]) == 0) {
+            format = i;
+        }
+    }
+    if (format < 0) {
+        fprintf(stderr, "gif2panel: unknown format '%s'\n", argv[2]);
+        return 1;
+    }
+
+    uint8_t *gif_data = malloc(MAX_INPUT_SIZE);
+    size_t size = fread(gif_data, 1, MAX_INPUT_SIZE, stdin);
+    if (size == MAX_INPUT_SIZE) {
+        fprintf(stderr, "gif2panel: %s is too large\n", name);
+        return 1;
+    }
+
+    // Whatever the runtime decoder can't play is embedded as is, like bin2asm does
+    frame_count = decode(gif_data, size, canvases);
+    if (frame_count <= 0) {
+        fprintf(stderr, "%s: doesn't decode, embedding the gif\n", name);
+        emit(name, gif_data, size);
+        free(gif_data);
+        return 0;
+    }
+
+    // Build every format for the report, embed the requested one
+    output_t outputs[3] = { 0 };
+    output_append(&outputs[PANEL_ASSET_GIF], gif_data, size);
+    // One write per report, builds run in parallel
+    char report[512];
+    int length = snprintf(report, sizeof(report), "%s: %d frames, %ld dirty pixels per frame",
+                          name, frame_count, dirty_pixels / frame_count);
+    for (int i = PANEL_ASSET_GIF; i <= PANEL_ASSET_PLANES; i++) {
+        if (i != PANEL_ASSET_GIF && build_asset(i, &outputs[i]) != 0) {
+            length += snprintf(report + length, sizeof(report) - length, ", %s n/a", formats[i]);
+            continue;
+        }
+        length += snprintf(report + length, sizeof(report) - length, ", %s %zu bytes %.1f us",
+                           formats[i], outputs[i].size, measure(gif_data, size, i));
+    }
+    fprintf(stderr, "%s per frame on the host, embedding %s\n", report, formats[format]);
+
+    if (outputs[format].size == 0) {
+        fprintf(stderr, "gif2panel: %s can't be stored as %s, use KEEP_GIF\n", name, formats[format]);
+        return 1;
+    }
+    emit(name, outputs[format].data, outputs[format].size);
+
+    for (int i = PANEL_ASSET_GIF; i <= PANEL_ASSET_PLANES; i++) {
+        free(outputs[i].data);
+    }
+    free(gif_data);
+    return 0;
+}